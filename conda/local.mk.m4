@@ -9,7 +9,7 @@ CPPFLAGS		=	--sysroot CONDA_PREFIX/x86_64-conda-linux-gnu/sysroot \
 
 LDFLAGS			=	--sysroot CONDA_PREFIX/x86_64-conda-linux-gnu/sysroot \
 					-L CONDA_PREFIX/lib \
-					-pthread -ldl
+					-pthread -lz -ldl
 
 BOOST_INCLUDE	=
 BOOST_LIBS		= -lboost_iostreams
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef VCF2MULTIALIGN_A2M_LAYOUT_HH
+#define VCF2MULTIALIGN_A2M_LAYOUT_HH
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace vcf2multialign {
+
+	// Byte offsets of the records of an A2M file in which every sequence has the same length.
+	// Each record consists of “>”, the FASTA identifier, a newline, the sequence and a newline.
+	class a2m_layout
+	{
+	public:
+		typedef std::uint64_t	offset_type;
+
+	private:
+		std::vector <std::string>	m_fasta_identifiers;
+		std::vector <offset_type>	m_sequence_offsets;		// Offset of the first character of each sequence.
+		offset_type					m_sequence_length{};
+		offset_type					m_size{};
+
+	public:
+		a2m_layout() = default;
+
+		explicit a2m_layout(offset_type const sequence_length):
+			m_sequence_length(sequence_length)
+		{
+		}
+
+		void add_record(std::string fasta_identifier);
+
+		std::size_t record_count() const { return m_sequence_offsets.size(); }
+		offset_type sequence_length() const { return m_sequence_length; }
+		offset_type sequence_offset(std::size_t const idx) const { return m_sequence_offsets[idx]; }
+		offset_type size() const { return m_size; }
+
+		// Write everything except the sequences to dst, which needs to have size() bytes.
+		void write_headers(char *dst) const;
+	};
+}
+
+#endif
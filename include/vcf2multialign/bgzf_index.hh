@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef VCF2MULTIALIGN_BGZF_INDEX_HH
+#define VCF2MULTIALIGN_BGZF_INDEX_HH
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vcf2multialign/bgzf_reader.hh>
+
+
+namespace vcf2multialign {
+
+	// Find a tabix (.tbi) or CSI (.csi) index next to the given variant file. Returns an empty string if there is none.
+	std::string find_bgzf_index(char const *variants_path);
+
+	// Return the virtual offset of the first record of the given contig in a tabix or CSI index,
+	// or std::nullopt if the index does not have records for the contig.
+	// Throws std::runtime_error if the index cannot be read.
+	std::optional <bgzf_reader::virtual_offset_type> contig_offset_in_bgzf_index(char const *index_path, std::string_view const contig);
+
+	// Return the number of records of the given contig from the statistics in a tabix or CSI index,
+	// or std::nullopt if the index does not have them. Throws std::runtime_error if the index cannot be read.
+	std::optional <std::uint64_t> contig_record_count_in_bgzf_index(char const *index_path, std::string_view const contig);
+}
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef VCF2MULTIALIGN_BGZF_READER_HH
+#define VCF2MULTIALIGN_BGZF_READER_HH
+
+#include <boost/iostreams/categories.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <ios>										// std::streamsize
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace vcf2multialign {
+
+	// Reads a BGZF file, i.e. a series of gzip members of at most 64 KiB, and decompresses
+	// the blocks in worker threads. The blocks are returned in the original order.
+	class bgzf_reader
+	{
+	public:
+		typedef std::uint64_t	virtual_offset_type;	// Compressed offset in the upper 48 bits, uncompressed offset within the block in the lower 16.
+
+		constexpr static inline std::size_t const MAX_BLOCK_SIZE{65536};
+
+	private:
+		enum class block_status : std::uint8_t
+		{
+			EMPTY,
+			IN_PROGRESS,
+			READY
+		};
+
+		struct block
+		{
+			std::vector <char>	data;
+			std::uint64_t		sequence_number{};
+			block_status		status{block_status::EMPTY};
+		};
+
+		std::vector <block>			m_blocks;	// Ring buffer indexed by the sequence number.
+		std::vector <std::jthread>	m_workers;
+		std::mutex					m_mutex;
+		std::condition_variable		m_worker_cv;
+		std::condition_variable		m_reader_cv;
+		std::exception_ptr			m_exception;
+		char const					*m_compressed_data{};
+		std::size_t					m_compressed_size{};
+		std::size_t					m_next_compressed_offset{};	// Offset of the next block to be decompressed.
+		std::uint64_t				m_next_sequence_number{};	// Sequence number of the next block to be decompressed.
+		std::uint64_t				m_read_sequence_number{};	// Sequence number of the block being read.
+		std::size_t					m_in_progress_count{};
+		std::size_t					m_read_offset{};			// Offset in the block being read.
+		bool						m_should_stop{};
+
+	public:
+		// Map the file and start the workers.
+		bgzf_reader(char const *path, std::uint16_t const thread_count);
+		~bgzf_reader();
+
+		bgzf_reader(bgzf_reader const &) = delete;
+		bgzf_reader &operator=(bgzf_reader const &) = delete;
+
+		// Continue reading from the given position. Not thread-safe w.r.t. read().
+		void seek(virtual_offset_type const offset);
+
+		// Seek to the end of the file.
+		void seek_to_end();
+
+		// Read at most size bytes; returns the number of bytes read, or -1 at the end of the file if size is positive.
+		std::streamsize read(char *dst, std::streamsize const size);
+
+	private:
+		void run();
+		void stop_workers_and_reset(std::size_t const compressed_offset);
+	};
+
+
+	// Boost.Iostreams source that refers to a bgzf_reader.
+	class bgzf_source
+	{
+	public:
+		typedef char								char_type;
+		typedef boost::iostreams::source_tag		category;
+
+	private:
+		bgzf_reader	*m_reader{};
+
+	public:
+		explicit bgzf_source(bgzf_reader &reader):
+			m_reader(&reader)
+		{
+		}
+
+		std::streamsize read(char *dst, std::streamsize const size) { return m_reader->read(dst, size); }
+	};
+
+
+	// Boost.Iostreams source that returns the header lines of a VCF file and then
+	// continues from the given offset, e.g. the first record of a contig.
+	class bgzf_vcf_region_source
+	{
+	public:
+		typedef char								char_type;
+		typedef boost::iostreams::source_tag		category;
+		typedef bgzf_reader::virtual_offset_type	virtual_offset_type;
+
+	private:
+		bgzf_reader			*m_reader{};
+		virtual_offset_type	m_region_offset{};
+		bool				m_has_region{};
+		bool				m_is_reading_header{true};
+		bool				m_is_at_line_start{true};
+
+	public:
+		// If has_region is false, nothing is returned after the header.
+		bgzf_vcf_region_source(bgzf_reader &reader, virtual_offset_type const region_offset, bool const has_region):
+			m_reader(&reader),
+			m_region_offset(region_offset),
+			m_has_region(has_region)
+		{
+		}
+
+		std::streamsize read(char *dst, std::streamsize const size);
+	};
+
+
+	// Check whether the given file starts with a BGZF block header.
+	bool is_bgzf_file(char const *path);
+}
+
+#endif
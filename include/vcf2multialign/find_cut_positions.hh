@@ -7,6 +7,7 @@
 #define VCF2MULTIALIGN_FIND_CUT_POSITIONS_HH
 
 #include <limits>
+#include <vcf2multialign/pbwt.hh>
 #include <vcf2multialign/variant_graph.hh>
 #include <vector>
 
@@ -23,7 +24,8 @@ namespace vcf2multialign {
 		variant_graph const &graph,
 		variant_graph::edge_type const min_length,
 		cut_position_vector &out_cut_positions,
-		process_graph_delegate &delegate
+		process_graph_delegate &delegate,
+		pbwt_implementation const pbwt_impl = pbwt_implementation::dense
 	);
 }
 
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef VCF2MULTIALIGN_GENOTYPE_FIELD_FILTER_HH
+#define VCF2MULTIALIGN_GENOTYPE_FIELD_FILTER_HH
+
+#include <algorithm>
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/read.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <ios>										// std::streamsize
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+namespace vcf2multialign {
+
+	// Sample columns of the records that have passed through genotype_field_filter, in the order of the records.
+	// Lets the genotypes be decoded outside the VCF parser. The buffers are swapped in and out instead of copied.
+	class genotype_record_queue
+	{
+	public:
+		struct record
+		{
+			std::string	sample_columns;		// Tab-separated GT values.
+			bool		has_genotypes{};
+		};
+
+	private:
+		std::deque <record>			m_records;
+		std::vector <std::string>	m_buffers;	// For reuse.
+
+	public:
+		bool empty() const { return m_records.empty(); }
+
+		// Append a record and leave an empty buffer in sample_columns.
+		void push(std::string &sample_columns, bool const has_genotypes);
+
+		// Move the first record to dst and keep the previous buffer of dst for reuse.
+		void pop(record &dst);
+	};
+
+
+	// Boost.Iostreams input filter that removes the parts of VCF records that are not needed for building
+	// the variant graph. The INFO column is replaced with “.”, and the FORMAT column and the sample columns
+	// are reduced to GT. Header lines are passed through unchanged, and so are records without GT.
+	// CRLF line endings are converted to LF. If a genotype_record_queue is given, the sample columns of each
+	// record are also appended to it, and a line feed is added to the last record if it does not have one.
+	class genotype_field_filter
+	{
+	public:
+		typedef char								char_type;
+		typedef boost::iostreams::multichar_input_filter_tag	category;
+
+		constexpr static inline std::size_t const BUFFER_SIZE{65536};
+
+	private:
+		enum class state : std::uint8_t
+		{
+			LINE_START,
+			COPY_LINE,		// Header or a record without GT.
+			COPY_FIELD,		// CHROM to FILTER.
+			SKIP_INFO,
+			FORMAT,
+			SAMPLE,
+			GT_ONLY_SAMPLES	// FORMAT is “GT”, so the sample columns can be copied as they are.
+		};
+
+		std::vector <char>		m_input;
+		std::string				m_output;
+		std::string				m_format;			// Contents of the current FORMAT column.
+		std::string				m_lf_input;			// Input without carriage returns that precede line feeds.
+		std::string				m_sample_columns;	// Output sample columns of the current record.
+		genotype_record_queue	*m_records{};
+		std::size_t				m_output_pos{};
+		std::size_t				m_sample_columns_start{};	// Position in m_output from which the sample columns have not been copied.
+		std::size_t				m_field_idx{};
+		std::size_t				m_gt_idx{};			// Index of GT in the FORMAT column.
+		std::size_t				m_subfield_idx{};	// Index of the current subfield in the sample column.
+		state					m_state{state::LINE_START};
+		bool					m_did_output_gt{};	// Whether anything was output for the current sample.
+		bool					m_has_pending_cr{};	// The previous input ended with a carriage return.
+		bool					m_is_record{};		// The current line is a record.
+		bool					m_has_genotypes{};	// The current record has GT.
+		bool					m_is_in_samples{};	// The sample columns of the current record are being output.
+
+	public:
+		explicit genotype_field_filter(genotype_record_queue *records = nullptr):
+			m_input(BUFFER_SIZE),
+			m_records(records)
+		{
+			m_output.reserve(BUFFER_SIZE);
+		}
+
+		template <typename t_source>
+		std::streamsize read(t_source &src, char *dst, std::streamsize const size);
+
+		// Filter the given characters and append the result to m_output. Exposed for testing.
+		void filter(std::string_view const input);
+		std::string const &output() const { return m_output; }
+		void clear_output() { m_output.clear(); m_output_pos = 0; }
+
+	private:
+		void filter_lines(std::string_view const input);
+		void handle_format_end();
+		void finish_record();
+	};
+
+
+	// Check whether the header of the given plain text VCF file declares INFO fields or FORMAT fields other than GT.
+	bool vcf_header_has_non_genotype_fields(char const *path);
+
+
+	template <typename t_source>
+	std::streamsize genotype_field_filter::read(t_source &src, char *dst, std::streamsize const size)
+	{
+		while (m_output_pos == m_output.size())
+		{
+			clear_output();
+			auto const res(boost::iostreams::read(src, m_input.data(), m_input.size()));
+			if (res < 0)
+			{
+				// Terminate the last record so that its sample columns are queued.
+				if (m_records && state::LINE_START != m_state)
+				{
+					filter_lines("\n");
+					continue;
+				}
+
+				return -1;
+			}
+
+			filter(std::string_view(m_input.data(), res));
+		}
+
+		auto const count(std::min(std::size_t(size), m_output.size() - m_output_pos));
+		std::copy_n(m_output.data() + m_output_pos, count, dst);
+		m_output_pos += count;
+		return count;
+	}
+}
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef VCF2MULTIALIGN_GRAPH_FILE_HH
+#define VCF2MULTIALIGN_GRAPH_FILE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vcf2multialign/mapped_file.hh>
+#include <vcf2multialign/variant_graph.hh>
+#include <vector>
+
+
+namespace vcf2multialign {
+
+	// Native variant graph file format. The file consists of a versioned header followed by the arrays
+	// of the graph, each aligned to GRAPH_FILE_ALIGNMENT bytes, so that a memory-mapped file may be used
+	// as the graph’s storage without deserialisation. The values are stored in the byte order of the
+	// machine that wrote the file.
+	//
+	// In the compressed variant, the contents of a native file are split into blocks of
+	// GRAPH_FILE_COMPRESSION_BLOCK_SIZE bytes, which are compressed independently with zlib, so that
+	// both compression and decompression may be done in parallel.
+	//
+	// The chunked variant stores the chunks of a graph built with build_variant_graph_chunks(). It consists
+	// of a header, a native image of each chunk with offsets relative to the beginning of the chunk,
+	// a table of the chunk offsets and a footer. The chunks are appended to the file as they are completed.
+	constexpr inline std::uint32_t const GRAPH_FILE_VERSION{1};
+	constexpr inline std::size_t const GRAPH_FILE_ALIGNMENT{64};
+	constexpr inline std::size_t const GRAPH_FILE_COMPRESSION_BLOCK_SIZE{4 * 1024 * 1024};
+
+	enum class graph_file_format : std::uint8_t
+	{
+		native,
+		compressed
+	};
+
+	// True for both the native and the compressed format.
+	bool is_graph_file(char const *path);
+	void write_graph_file(variant_graph const &graph, char const *path, graph_file_format const format = graph_file_format::native, std::uint16_t const thread_count = 1);
+	bool is_chunked_graph_file(char const *path);
+
+
+	// Outputs that need the whole graph and hence cannot be produced from a chunked graph file.
+	// Only the statistics and the haplotype sequences in A2M format are output one chunk at a time.
+	struct chunked_graph_outputs
+	{
+		bool	founder_sequences{};
+		bool	separate_sequences{};
+		bool	graphviz{};
+		bool	memory_breakdown{};
+	};
+
+	// Throws std::runtime_error if any of the given outputs was requested.
+	void check_chunked_graph_outputs(chunked_graph_outputs const &outputs);
+
+
+	class mapped_graph_file
+	{
+	private:
+		mapped_input_file				m_file;
+		std::vector <std::uint64_t>		m_buffer;	// Decompressed contents if the file was compressed.
+		char const						*m_data{};
+		std::size_t						m_size{};
+
+	public:
+		mapped_graph_file() = default;
+		explicit mapped_graph_file(char const *path, std::uint16_t const thread_count = 1) { open(path, thread_count); }
+
+		// Checks the header and the array bounds. Compressed files are decompressed to memory
+		// using the given number of threads.
+		void open(char const *path, std::uint16_t const thread_count = 1);
+		void close();
+
+		bool is_compressed() const { return !m_buffer.empty(); }
+
+		// Replace the contents of the graph with arrays that refer to the mapped file (or the decompressed
+		// contents), except for the sample names and the ploidies, which are copied. The graph must not be
+		// used after *this has been destroyed.
+		void get_graph(variant_graph &graph) const;
+	};
+
+
+	// Writes the chunks of a graph one at a time, so that only the current chunk needs to be kept in memory.
+	// The file is not valid until close() has been called.
+	class graph_chunk_writer final : public build_graph_chunk_delegate
+	{
+	private:
+		std::string						m_path;
+		std::vector <char>				m_buffer;
+		std::vector <std::uint64_t>		m_chunk_offsets;
+		packed_label_vector				m_sample_names;
+		std::uint64_t					m_position{};
+		int								m_fd{-1};
+
+	public:
+		graph_chunk_writer() = default;
+		explicit graph_chunk_writer(char const *path) { open(path); }
+		~graph_chunk_writer();
+
+		graph_chunk_writer(graph_chunk_writer const &) = delete;
+		graph_chunk_writer &operator=(graph_chunk_writer const &) = delete;
+
+		void open(char const *path);
+		void write_chunk(variant_graph const &chunk);
+		void close();
+
+		std::size_t chunk_count() const { return m_chunk_offsets.size(); }
+
+		void handle_chunk(variant_graph const &chunk) override { write_chunk(chunk); }
+
+	private:
+		void write(char const *data, std::size_t size);
+	};
+
+
+	class mapped_chunked_graph_file
+	{
+	private:
+		mapped_input_file				m_file;
+		std::vector <std::uint64_t>		m_chunk_offsets;	// Including the end of the last chunk.
+
+	public:
+		mapped_chunked_graph_file() = default;
+		explicit mapped_chunked_graph_file(char const *path) { open(path); }
+
+		// Checks the header, the chunk table and each chunk.
+		void open(char const *path);
+		void close();
+
+		std::size_t chunk_count() const { return m_chunk_offsets.empty() ? 0 : m_chunk_offsets.size() - 1; }
+
+		// Replace the contents of the graph with arrays that refer to the given chunk in the mapped file.
+		// The sample names and the ploidies are the same in every chunk and are not modified; get_samples()
+		// copies them. The graph must not be used after *this has been destroyed.
+		void get_chunk(std::size_t const idx, variant_graph &graph) const;
+		void get_samples(variant_graph &graph) const;
+	};
+}
+
+#endif
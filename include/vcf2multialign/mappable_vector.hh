@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef VCF2MULTIALIGN_MAPPABLE_VECTOR_HH
+#define VCF2MULTIALIGN_MAPPABLE_VECTOR_HH
+
+#include <algorithm>
+#include <cereal/cereal.hpp>
+#include <cstddef>
+#include <initializer_list>
+#include <libbio/assert.hh>
+#include <libbio/size_calculator.hh>
+#include <span>
+#include <type_traits>
+#include <utility>				// std::swap
+#include <vector>
+
+
+namespace vcf2multialign {
+
+	// Contiguous storage that either owns its values or refers to memory owned by someone else,
+	// e.g. a memory-mapped graph file. Borrowed values are copied before they are modified.
+	template <typename t_value>
+	class mappable_vector
+	{
+		static_assert(std::is_trivially_copyable_v <t_value>);
+
+	public:
+		typedef t_value					value_type;
+		typedef std::vector <t_value>	vector_type;
+		typedef t_value const			*const_iterator;
+
+	private:
+		vector_type						m_owned;
+		t_value const					*m_data{};
+		std::size_t						m_size{};
+		bool							m_is_borrowed{};
+
+	public:
+		mappable_vector() = default;
+
+		explicit mappable_vector(vector_type values):
+			m_owned(std::move(values)),
+			m_data(m_owned.data()),
+			m_size(m_owned.size())
+		{
+		}
+
+		mappable_vector(std::initializer_list <t_value> const values):
+			mappable_vector(vector_type(values))
+		{
+		}
+
+		explicit mappable_vector(std::span <t_value const> const borrowed):
+			m_data(borrowed.data()),
+			m_size(borrowed.size()),
+			m_is_borrowed(true)
+		{
+		}
+
+		// Copies of borrowed storage refer to the same memory.
+		mappable_vector(mappable_vector const &other):
+			m_owned(other.m_owned),
+			m_data(other.m_is_borrowed ? other.m_data : m_owned.data()),
+			m_size(other.m_size),
+			m_is_borrowed(other.m_is_borrowed)
+		{
+		}
+
+		mappable_vector(mappable_vector &&other):
+			m_owned(std::move(other.m_owned)),
+			m_data(std::exchange(other.m_data, nullptr)),
+			m_size(std::exchange(other.m_size, 0)),
+			m_is_borrowed(std::exchange(other.m_is_borrowed, false))
+		{
+		}
+
+		mappable_vector &operator=(mappable_vector other) { swap(other); return *this; }
+
+		inline void swap(mappable_vector &other);
+
+		std::size_t size() const { return m_size; }
+		bool empty() const { return 0 == m_size; }
+		bool is_borrowed() const { return m_is_borrowed; }
+		t_value const *data() const { return m_data; }
+		const_iterator begin() const { return m_data; }
+		const_iterator end() const { return m_data + m_size; }
+		t_value const &operator[](std::size_t const idx) const { libbio_assert_lt(idx, m_size); return m_data[idx]; }
+		t_value const &back() const { libbio_assert(m_size); return m_data[m_size - 1]; }
+		std::span <t_value const> values() const { return {m_data, m_size}; }
+		vector_type const &owned_values() const { return m_owned; }
+
+		// Modification.
+		t_value *mutable_data() { make_owned(); return m_owned.data(); }
+		void push_back(t_value const val) { make_owned(); m_owned.push_back(val); update(); }
+		void resize(std::size_t const size, t_value const val = t_value{}) { make_owned(); m_owned.resize(size, val); update(); }
+		void reserve(std::size_t const size) { make_owned(); m_owned.reserve(size); update(); }
+		void clear() { m_owned.clear(); m_is_borrowed = false; update(); }
+		void shrink_to_fit() { if (!m_is_borrowed) { m_owned.shrink_to_fit(); update(); } }
+
+		template <typename t_iterator>
+		void append(t_iterator first, t_iterator last) { make_owned(); m_owned.insert(m_owned.end(), first, last); update(); }
+
+		bool operator==(mappable_vector const &other) const { return std::equal(begin(), end(), other.begin(), other.end()); }
+
+		// For Cereal; the format is the same as that of std::vector of arithmetic values.
+		template <typename t_archive> void save(t_archive &ar) const;
+		template <typename t_archive> void load(t_archive &ar);
+
+	private:
+		void update() { m_data = m_owned.data(); m_size = m_owned.size(); }
+		inline void make_owned();
+	};
+
+
+	template <typename t_value>
+	void mappable_vector <t_value>::swap(mappable_vector &other)
+	{
+		using std::swap;
+		swap(m_owned, other.m_owned);
+		swap(m_data, other.m_data);
+		swap(m_size, other.m_size);
+		swap(m_is_borrowed, other.m_is_borrowed);
+	}
+
+
+	template <typename t_value>
+	void mappable_vector <t_value>::make_owned()
+	{
+		if (!m_is_borrowed)
+			return;
+
+		m_owned.assign(m_data, m_data + m_size);
+		m_is_borrowed = false;
+		update();
+	}
+
+
+	template <typename t_value>
+	template <typename t_archive>
+	void mappable_vector <t_value>::save(t_archive &ar) const
+	{
+		ar(cereal::make_size_tag(static_cast <cereal::size_type>(m_size)));
+		ar(cereal::binary_data(m_data, m_size * sizeof(t_value)));
+	}
+
+
+	template <typename t_value>
+	template <typename t_archive>
+	void mappable_vector <t_value>::load(t_archive &ar)
+	{
+		cereal::size_type size{};
+		ar(cereal::make_size_tag(size));
+		m_owned.resize(size);
+		ar(cereal::binary_data(m_owned.data(), size * sizeof(t_value)));
+		m_is_borrowed = false;
+		update();
+	}
+}
+
+
+namespace libbio::size_calculation {
+
+	template <typename t_value>
+	struct value_size_calculator <vcf2multialign::mappable_vector <t_value>>
+	{
+		// Borrowed memory is not counted.
+		void operator()(size_calculator &sc, entry_index_type const entry_idx, vcf2multialign::mappable_vector <t_value> const &vec) const
+		{
+			sc.add_entry_for(entry_idx, "owned_values", vec.owned_values());
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef VCF2MULTIALIGN_MAPPED_FILE_HH
+#define VCF2MULTIALIGN_MAPPED_FILE_HH
+
+#include <cstddef>
+#include <utility>				// std::exchange
+
+
+namespace vcf2multialign {
+
+	// Output file the size of which is known in advance. The file is truncated to the given size
+	// and written through a shared memory mapping.
+	class mapped_output_file
+	{
+	private:
+		char		*m_data{};
+		std::size_t	m_size{};
+		int			m_fd{-1};
+
+	public:
+		mapped_output_file() = default;
+		mapped_output_file(char const *path, std::size_t const size) { open(path, size); }
+		~mapped_output_file() { close(); }
+
+		mapped_output_file(mapped_output_file const &) = delete;
+		mapped_output_file &operator=(mapped_output_file const &) = delete;
+
+		mapped_output_file(mapped_output_file &&other):
+			m_data(std::exchange(other.m_data, nullptr)),
+			m_size(std::exchange(other.m_size, 0)),
+			m_fd(std::exchange(other.m_fd, -1))
+		{
+		}
+
+		mapped_output_file &operator=(mapped_output_file &&other)
+		{
+			if (this != &other)
+			{
+				close();
+				m_data = std::exchange(other.m_data, nullptr);
+				m_size = std::exchange(other.m_size, 0);
+				m_fd = std::exchange(other.m_fd, -1);
+			}
+			return *this;
+		}
+
+		void open(char const *path, std::size_t const size);
+		void close();
+
+		char *data() { return m_data; }
+		char const *data() const { return m_data; }
+		std::size_t size() const { return m_size; }
+		bool is_open() const { return -1 != m_fd; }
+	};
+
+
+	// Read-only mapping of a whole file. The file is closed after mapping; the contents remain
+	// accessible until the object is destroyed.
+	class mapped_input_file
+	{
+	private:
+		char const	*m_data{};
+		std::size_t	m_size{};
+
+	public:
+		mapped_input_file() = default;
+		explicit mapped_input_file(char const *path) { open(path); }
+		~mapped_input_file() { close(); }
+
+		mapped_input_file(mapped_input_file const &) = delete;
+		mapped_input_file &operator=(mapped_input_file const &) = delete;
+
+		mapped_input_file(mapped_input_file &&other):
+			m_data(std::exchange(other.m_data, nullptr)),
+			m_size(std::exchange(other.m_size, 0))
+		{
+		}
+
+		mapped_input_file &operator=(mapped_input_file &&other)
+		{
+			if (this != &other)
+			{
+				close();
+				m_data = std::exchange(other.m_data, nullptr);
+				m_size = std::exchange(other.m_size, 0);
+			}
+			return *this;
+		}
+
+		void open(char const *path);
+		void close();
+
+		char const *data() const { return m_data; }
+		std::size_t size() const { return m_size; }
+	};
+}
+
+#endif
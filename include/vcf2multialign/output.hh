@@ -7,11 +7,13 @@
 #define VCF2MULTIALIGN_OUTPUT_HH
 
 #include <cstdint>
+#include <functional>
 #include <libbio/matrix.hh>
 #include <libbio/subprocess.hh>
 #include <ostream>
 #include <string>
 #include <vcf2multialign/find_cut_positions.hh>
+#include <vcf2multialign/pbwt.hh>
 #include <vcf2multialign/variant_graph.hh>
 
 
@@ -21,6 +23,7 @@ namespace vcf2multialign {
 
 
 	struct sequence_writing_delegate; // Fwd.
+	class mapped_chunked_graph_file; // Fwd.
 
 
 	struct output_delegate : public process_graph_delegate
@@ -44,6 +47,7 @@ namespace vcf2multialign {
 		char const		*m_pipe_cmd{};
 		char const		*m_chromosome_id{};
 		output_delegate	*m_delegate{};
+		std::uint16_t	m_thread_count{1};
 		bool			m_should_output_reference{};
 		bool			m_should_output_unaligned{};
 
@@ -58,13 +62,19 @@ namespace vcf2multialign {
 		}
 
 		virtual ~output() {}
+
+		void set_thread_count(std::uint16_t const thread_count) { m_thread_count = thread_count; }
+
 		virtual void output_separate(sequence_type const &ref_seq, variant_graph const &graph, bool const should_include_fasta_header) = 0;
 
 		void output_a2m(sequence_type const &ref_seq, variant_graph const &graph, char const * const dst_name);
 		virtual void output_a2m(sequence_type const &ref_seq, variant_graph const &graph, std::ostream &stream) = 0;
 
 	protected:
+		// Call fn with a stream that writes to the pipe command (if any) or to the destination file.
+		void output_to_stream(char const * const dst_name, std::function <void(std::ostream &)> const &fn);
 		void output_sequence_file(sequence_type const &ref_seq, variant_graph const &graph, char const * const dst_name, bool const should_include_fasta_header, sequence_writing_delegate &delegate);
+		virtual void output_a2m_to_file(sequence_type const &ref_seq, variant_graph const &graph, char const * const dst_name);
 	};
 
 
@@ -75,6 +85,15 @@ namespace vcf2multialign {
 
 		void output_separate(sequence_type const &ref_seq, variant_graph const &graph, bool const should_include_fasta_header) override;
 		void output_a2m(sequence_type const &ref_seq, variant_graph const &graph, std::ostream &stream) override;
+
+		// Output the sequences of a graph built in chunks, reading one chunk at a time.
+		void output_a2m_chunked(sequence_type const &ref_seq, mapped_chunked_graph_file const &graph_file, char const * const dst_name);
+
+	protected:
+		void output_a2m_to_file(sequence_type const &ref_seq, variant_graph const &graph, char const * const dst_name) override;
+
+	private:
+		void output_a2m_parallel(sequence_type const &ref_seq, variant_graph const &graph, std::ostream &stream);
 	};
 
 
@@ -97,9 +116,10 @@ namespace vcf2multialign {
 		};
 
 	private:
-		cut_positions	m_cut_positions;
-		ploidy_matrix	m_assigned_samples;
-		bool			m_should_keep_ref_edges{};
+		cut_positions			m_cut_positions;
+		ploidy_matrix			m_assigned_samples;
+		pbwt_implementation		m_pbwt_implementation{pbwt_implementation::dense};
+		bool					m_should_keep_ref_edges{};
 
 	public:
 		founder_sequence_greedy_output(
@@ -124,9 +144,17 @@ namespace vcf2multialign {
 		[[nodiscard]] cut_position_score_type max_segmentation_height() const { return m_cut_positions.score; }
 
 		[[nodiscard]] bool find_matchings(variant_graph const &graph, ploidy_type const founder_count);
+		void set_pbwt_implementation(pbwt_implementation const pbwt_impl) { m_pbwt_implementation = pbwt_impl; }
 
 		void output_separate(sequence_type const &ref_seq, variant_graph const &graph, bool const should_include_fasta_header) override;
 		void output_a2m(sequence_type const &ref_seq, variant_graph const &graph, std::ostream &stream) override;
+
+	protected:
+		void output_a2m_to_file(sequence_type const &ref_seq, variant_graph const &graph, char const * const dst_name) override;
+
+	private:
+		template <typename t_pbwt_context>
+		[[nodiscard]] bool find_matchings_(variant_graph const &graph, ploidy_type const founder_count);
 	};
 
 
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef VCF2MULTIALIGN_PACKED_VECTOR_HH
+#define VCF2MULTIALIGN_PACKED_VECTOR_HH
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <libbio/assert.hh>
+#include <utility>				// std::move
+#include <vcf2multialign/mappable_vector.hh>
+#include <vector>
+
+
+namespace vcf2multialign {
+
+	// Vector of unsigned integers that stores each value in the number of bits needed for the largest value.
+	// Storing a value that does not fit causes the vector to be repacked with a greater width, so values
+	// may be added in any order, but building the vector is cheapest when the values are mostly increasing.
+	class packed_vector
+	{
+	public:
+		typedef std::uint64_t				value_type;
+		typedef std::uint64_t				word_type;
+		typedef std::vector <word_type>		word_vector;
+		typedef mappable_vector <word_type>	word_array;
+		class const_iterator;
+
+		constexpr static inline std::uint8_t const WORD_BITS{64};
+
+	private:
+		word_array							m_words;
+		std::size_t							m_size{};
+		std::uint8_t						m_width{1};
+
+	public:
+		packed_vector() = default;
+
+		packed_vector(std::initializer_list <value_type> const values)
+		{
+			assign(values);
+		}
+
+		// The words may refer to memory owned by someone else, e.g. a mapped graph file.
+		packed_vector(word_array words, std::size_t const size, std::uint8_t const width):
+			m_words(std::move(words)),
+			m_size(size),
+			m_width(width)
+		{
+			libbio_assert_lte(1, width);
+			libbio_assert_lte(width, WORD_BITS);
+			libbio_assert_eq(words_needed(size, width), m_words.size());
+		}
+
+		static std::size_t words_needed(std::size_t const size, std::uint8_t const width) { return (size * width + WORD_BITS - 1) / WORD_BITS; }
+
+		std::size_t size() const { return m_size; }
+		bool empty() const { return 0 == m_size; }
+		std::uint8_t width() const { return m_width; }
+		word_array const &words() const { return m_words; }
+
+		value_type operator[](std::size_t const idx) const { libbio_assert_lt(idx, m_size); return load(m_words.data(), idx, m_width); }
+		value_type back() const { return (*this)[m_size - 1]; }
+		inline void set(std::size_t const idx, value_type const val);
+		inline void push_back(value_type const val);
+		void clear() { m_words.clear(); m_size = 0; m_width = 1; }
+		void shrink_to_fit() { m_words.shrink_to_fit(); }
+
+		// Reserve space for the given number of values, the greatest of which is expected to be max_value.
+		// Setting the width in advance avoids repacking the vector while it is being filled.
+		inline void reserve(std::size_t const size, value_type const max_value = 0);
+
+		template <typename t_range>
+		void assign(t_range const &values);
+
+		inline const_iterator begin() const;
+		inline const_iterator end() const;
+
+		// Compares the values regardless of the widths.
+		inline bool operator==(packed_vector const &other) const;
+
+		// For Cereal
+		template <typename t_archive> void serialize(t_archive &ar) { ar(m_width); ar(m_size); ar(m_words); }
+
+	private:
+		static std::uint8_t bits_needed(value_type const val) { return std::max <std::uint8_t>(1, std::bit_width(val)); }
+		static inline value_type load(word_type const *words, std::size_t const idx, std::uint8_t const width);
+		static inline void store(word_type *words, std::size_t const idx, std::uint8_t const width, value_type const val);
+		void widen(std::uint8_t const width);
+	};
+
+
+	class packed_vector::const_iterator
+	{
+	public:
+		typedef std::random_access_iterator_tag	iterator_category;
+		typedef packed_vector::value_type		value_type;
+		typedef std::ptrdiff_t					difference_type;
+		typedef value_type						reference;
+		typedef void							pointer;
+
+	private:
+		packed_vector const						*m_vector{};
+		std::size_t								m_idx{};
+
+	public:
+		const_iterator() = default;
+
+		const_iterator(packed_vector const &vec, std::size_t const idx):
+			m_vector(&vec),
+			m_idx(idx)
+		{
+		}
+
+		value_type operator*() const { return (*m_vector)[m_idx]; }
+		value_type operator[](difference_type const diff) const { return (*m_vector)[m_idx + diff]; }
+
+		const_iterator &operator++() { ++m_idx; return *this; }
+		const_iterator &operator--() { --m_idx; return *this; }
+		const_iterator operator++(int) { auto retval(*this); ++m_idx; return retval; }
+		const_iterator operator--(int) { auto retval(*this); --m_idx; return retval; }
+		const_iterator &operator+=(difference_type const diff) { m_idx += diff; return *this; }
+		const_iterator &operator-=(difference_type const diff) { m_idx -= diff; return *this; }
+		const_iterator operator+(difference_type const diff) const { return {*m_vector, m_idx + diff}; }
+		const_iterator operator-(difference_type const diff) const { return {*m_vector, m_idx - diff}; }
+		friend const_iterator operator+(difference_type const diff, const_iterator const &it) { return it + diff; }
+		difference_type operator-(const_iterator const &other) const { return difference_type(m_idx) - difference_type(other.m_idx); }
+
+		bool operator==(const_iterator const &other) const { return m_idx == other.m_idx; }
+		auto operator<=>(const_iterator const &other) const { return m_idx <=> other.m_idx; }
+	};
+
+
+	auto packed_vector::begin() const -> const_iterator { return {*this, 0}; }
+	auto packed_vector::end() const -> const_iterator { return {*this, m_size}; }
+
+
+	auto packed_vector::load(word_type const *words, std::size_t const idx, std::uint8_t const width) -> value_type
+	{
+		auto const bit_idx(idx * width);
+		auto const word_idx(bit_idx / WORD_BITS);
+		auto const shift(bit_idx % WORD_BITS);
+		auto const mask(WORD_BITS == width ? ~word_type{} : (word_type{1} << width) - 1);
+
+		auto retval(words[word_idx] >> shift);
+		if (WORD_BITS < shift + width)
+			retval |= words[1 + word_idx] << (WORD_BITS - shift);
+		return retval & mask;
+	}
+
+
+	void packed_vector::store(word_type *words, std::size_t const idx, std::uint8_t const width, value_type const val)
+	{
+		auto const bit_idx(idx * width);
+		auto const word_idx(bit_idx / WORD_BITS);
+		auto const shift(bit_idx % WORD_BITS);
+		auto const mask(WORD_BITS == width ? ~word_type{} : (word_type{1} << width) - 1);
+
+		words[word_idx] &= ~(mask << shift);
+		words[word_idx] |= val << shift;
+		if (WORD_BITS < shift + width)
+		{
+			auto const rshift(WORD_BITS - shift);
+			words[1 + word_idx] &= ~(mask >> rshift);
+			words[1 + word_idx] |= val >> rshift;
+		}
+	}
+
+
+	void packed_vector::set(std::size_t const idx, value_type const val)
+	{
+		libbio_assert_lt(idx, m_size);
+		if (auto const width(bits_needed(val)); m_width < width)
+			widen(width);
+		store(m_words.mutable_data(), idx, m_width, val);
+	}
+
+
+	void packed_vector::reserve(std::size_t const size, value_type const max_value)
+	{
+		if (auto const width(bits_needed(max_value)); m_width < width)
+			widen(width);
+		m_words.reserve(words_needed(size, m_width));
+	}
+
+
+	void packed_vector::push_back(value_type const val)
+	{
+		if (auto const width(bits_needed(val)); m_width < width)
+			widen(width);
+
+		++m_size;
+		m_words.resize(words_needed(m_size, m_width), 0);
+		store(m_words.mutable_data(), m_size - 1, m_width, val);
+	}
+
+
+	template <typename t_range>
+	void packed_vector::assign(t_range const &values)
+	{
+		clear();
+		for (auto const val : values)
+			push_back(val);
+	}
+
+
+	bool packed_vector::operator==(packed_vector const &other) const
+	{
+		if (m_width == other.m_width)
+			return m_size == other.m_size && m_words == other.m_words;
+
+		return std::equal(begin(), end(), other.begin(), other.end());
+	}
+}
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef VCF2MULTIALIGN_PARALLEL_FOR_HH
+#define VCF2MULTIALIGN_PARALLEL_FOR_HH
+
+#include <algorithm>			// std::min
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace vcf2multialign {
+
+	// Call fn(idx) for each idx in [0, count) using at most thread_count threads.
+	// The indices are handed out in increasing order. The first exception thrown by fn is rethrown
+	// after the threads have finished, and no new indices are handed out after it has been thrown.
+	template <typename t_fn>
+	void parallel_for(std::size_t const count, std::uint16_t const thread_count, t_fn &&fn)
+	{
+		if (thread_count <= 1 || count <= 1)
+		{
+			for (std::size_t idx{}; idx < count; ++idx)
+				fn(idx);
+			return;
+		}
+
+		std::atomic <std::size_t> next_idx{};
+		std::exception_ptr exc;
+		std::mutex exc_mutex;
+
+		{
+			auto const worker_count(std::min(std::size_t(thread_count), count));
+			std::vector <std::jthread> workers;
+			workers.reserve(worker_count);
+			for (std::size_t i{}; i < worker_count; ++i)
+			{
+				workers.emplace_back([count, &fn, &next_idx, &exc, &exc_mutex](){
+					while (true)
+					{
+						auto const idx(next_idx.fetch_add(1, std::memory_order_relaxed));
+						if (count <= idx)
+							break;
+
+						try
+						{
+							fn(idx);
+						}
+						catch (...)
+						{
+							std::lock_guard const lock(exc_mutex);
+							if (!exc)
+								exc = std::current_exception();
+							next_idx.store(count, std::memory_order_relaxed);
+							break;
+						}
+					}
+				});
+			}
+		}
+
+		if (exc)
+			std::rethrow_exception(exc);
+	}
+}
+
+#endif
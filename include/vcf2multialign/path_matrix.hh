@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef VCF2MULTIALIGN_PATH_MATRIX_HH
+#define VCF2MULTIALIGN_PATH_MATRIX_HH
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <libbio/assert.hh>
+#include <libbio/int_matrix.hh>
+#include <span>
+#include <utility>				// std::move
+#include <vcf2multialign/mappable_vector.hh>
+#include <vector>
+
+
+namespace vcf2multialign {
+
+	// Paths of the chromosome copies (rows) through the ALT edges (columns). Most ALT edges are carried by
+	// a handful of chromosome copies, so a column with few ones is stored as a sorted list of its rows, and
+	// only the other columns are stored as bit vectors. The matrix is filled one column at a time.
+	class path_matrix
+	{
+	public:
+		typedef std::uint32_t					row_type;
+		typedef std::uint64_t					column_index_type;
+		typedef std::uint64_t					word_type;
+		typedef std::uint64_t					offset_type;
+		typedef std::vector <word_type>			word_vector;
+		typedef mappable_vector <word_type>		word_array;
+		typedef mappable_vector <row_type>		row_array;
+		typedef mappable_vector <offset_type>	offset_array;
+		class column_type;
+
+		constexpr static inline std::size_t const WORD_BITS{64};
+
+	private:
+		word_array								m_dense_words;		// Dense columns one after another.
+		row_array								m_sparse_rows;		// Rows of the sparse columns one after another.
+		offset_array							m_column_offsets;	// Offsets to m_dense_words or m_sparse_rows by column.
+		row_array								m_one_counts;		// By column.
+		row_type								m_row_count{};
+
+	public:
+		path_matrix() = default;
+
+		explicit path_matrix(row_type const row_count):
+			m_row_count(row_count)
+		{
+		}
+
+		// Convert a dense matrix; its dimensions may be greater than the given ones.
+		path_matrix(libbio::bit_matrix const &mat, row_type const row_count, column_index_type const column_count);
+
+		// The arrays may refer to memory owned by someone else, e.g. a mapped graph file.
+		path_matrix(row_type const row_count, word_array dense_words, row_array sparse_rows, offset_array column_offsets, row_array one_counts):
+			m_dense_words(std::move(dense_words)),
+			m_sparse_rows(std::move(sparse_rows)),
+			m_column_offsets(std::move(column_offsets)),
+			m_one_counts(std::move(one_counts)),
+			m_row_count(row_count)
+		{
+			libbio_assert_eq(m_column_offsets.size(), m_one_counts.size());
+		}
+
+		row_type number_of_rows() const { return m_row_count; }
+		column_index_type number_of_columns() const { return m_column_offsets.size(); }
+		std::size_t words_per_column() const { return (m_row_count + WORD_BITS - 1) / WORD_BITS; }
+
+		// Columns with at most this many ones are stored as lists of rows, since those take less space than the bit vectors.
+		row_type sparse_column_limit() const { return WORD_BITS / (8 * sizeof(row_type)) * words_per_column(); }
+		bool is_dense(column_index_type const col) const { return sparse_column_limit() < m_one_counts[col]; }
+		row_type one_count(column_index_type const col) const { return m_one_counts[col]; }
+		column_index_type dense_column_count() const { auto const wpc(words_per_column()); return wpc ? m_dense_words.size() / wpc : 0; }
+
+		inline column_type column(column_index_type const col) const;
+		inline bool operator()(row_type const row, column_index_type const col) const;
+
+		// Add a column with ones in the given rows, which need to be sorted.
+		void push_back_column(std::span <row_type const> const rows);
+		void reserve_columns(column_index_type const column_count) { m_column_offsets.reserve(column_count); m_one_counts.reserve(column_count); }
+		void clear_columns() { m_dense_words.clear(); m_sparse_rows.clear(); m_column_offsets.clear(); m_one_counts.clear(); }
+		void shrink_to_fit();
+
+		word_array const &dense_words() const { return m_dense_words; }
+		row_array const &sparse_rows() const { return m_sparse_rows; }
+		offset_array const &column_offsets() const { return m_column_offsets; }
+		row_array const &one_counts() const { return m_one_counts; }
+
+		bool operator==(path_matrix const &) const = default;
+
+		// For Cereal
+		template <typename t_archive> void serialize(t_archive &ar) { ar(m_row_count); ar(m_column_offsets); ar(m_one_counts); ar(m_dense_words); ar(m_sparse_rows); }
+	};
+
+
+	// A column of path_matrix. Either words() or rows() is non-empty, depending on the representation.
+	class path_matrix::column_type
+	{
+	private:
+		std::span <word_type const>	m_words;
+		std::span <row_type const>	m_rows;
+		row_type					m_row_count{};
+		row_type					m_one_count{};
+
+	public:
+		column_type() = default;
+
+		column_type(std::span <word_type const> const words, std::span <row_type const> const rows, row_type const row_count, row_type const one_count):
+			m_words(words),
+			m_rows(rows),
+			m_row_count(row_count),
+			m_one_count(one_count)
+		{
+		}
+
+		row_type size() const { return m_row_count; }
+		row_type one_count() const { return m_one_count; }
+		bool is_dense() const { return !m_words.empty(); }
+		std::span <word_type const> words() const { return m_words; }
+		std::span <row_type const> rows() const { return m_rows; }
+
+		inline bool operator[](row_type const row) const;
+
+		// Get the column as a bit vector; dst is used as the buffer if the column is sparse.
+		inline std::span <word_type const> to_words(word_vector &dst) const;
+
+		// Get the rows of the ones; dst is used as the buffer if the column is dense.
+		inline std::span <row_type const> to_rows(std::vector <row_type> &dst) const;
+	};
+
+
+	auto path_matrix::column(column_index_type const col) const -> column_type
+	{
+		libbio_assert_lt(col, m_column_offsets.size());
+		auto const offset(m_column_offsets[col]);
+		auto const one_count(m_one_counts[col]);
+		if (is_dense(col))
+			return {std::span(m_dense_words.data() + offset, words_per_column()), {}, m_row_count, one_count};
+		return {{}, std::span(m_sparse_rows.data() + offset, one_count), m_row_count, one_count};
+	}
+
+
+	bool path_matrix::operator()(row_type const row, column_index_type const col) const
+	{
+		libbio_assert_lt(row, m_row_count);
+		return column(col)[row];
+	}
+
+
+	bool path_matrix::column_type::operator[](row_type const row) const
+	{
+		libbio_assert_lt(row, m_row_count);
+		if (is_dense())
+			return (m_words[row / WORD_BITS] >> (row % WORD_BITS)) & 0x1;
+		return std::binary_search(m_rows.begin(), m_rows.end(), row);
+	}
+
+
+	auto path_matrix::column_type::to_words(word_vector &dst) const -> std::span <word_type const>
+	{
+		if (is_dense())
+			return m_words;
+
+		dst.clear();
+		dst.resize((m_row_count + WORD_BITS - 1) / WORD_BITS, 0);
+		for (auto const row : m_rows)
+			dst[row / WORD_BITS] |= word_type(1) << (row % WORD_BITS);
+		return dst;
+	}
+
+
+	auto path_matrix::column_type::to_rows(std::vector <row_type> &dst) const -> std::span <row_type const>
+	{
+		if (!is_dense())
+			return m_rows;
+
+		dst.clear();
+		dst.reserve(m_one_count);
+		for (std::size_t word_idx{}; word_idx < m_words.size(); ++word_idx)
+		{
+			auto word(m_words[word_idx]);
+			while (word)
+			{
+				dst.push_back(word_idx * WORD_BITS + std::countr_zero(word));
+				word &= word - 1;
+			}
+		}
+		return dst;
+	}
+}
+
+#endif
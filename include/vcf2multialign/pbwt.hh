@@ -6,20 +6,69 @@
 #ifndef VCF2MULTIALIGN_PBWT_HH
 #define VCF2MULTIALIGN_PBWT_HH
 
-#include <algorithm>			// std::iota
-#include <libbio/bits.hh>
-#include <libbio/int_matrix.hh>
+#include <algorithm>			// std::copy, std::find_if, std::max, std::min
+#include <bit>					// std::countr_zero, std::popcount
+#include <cstddef>
+#include <cstdint>
 #include <limits>
-#include <map>
-#include <numeric>
-#include <type_traits>			// std::is_unsigned_v
-#include <utility>				// std::swap
+#include <numeric>				// std::iota
+#include <span>
+#include <type_traits>			// std::is_same_v, std::is_unsigned_v
+#include <utility>				// std::pair, std::swap
+#include <vcf2multialign/path_matrix.hh>
 #include <vector>
 
 
 namespace vcf2multialign {
 
-	template <typename t_index, typename t_divergence, typename t_count>
+	// Set bit i of dst to bit indices[i] of words. dst needs to have space for ⌈indices.size() / 64⌉ words.
+	// The AVX2 variant is used if the CPU supports it.
+	void gather_bits(
+		std::span <path_matrix::word_type const> const words,
+		std::span <std::uint32_t const> const indices,
+		path_matrix::word_type *dst
+	);
+
+
+	template <typename t_index>
+	void gather_bits_portable(
+		std::span <path_matrix::word_type const> const words,
+		std::span <t_index const> const indices,
+		path_matrix::word_type *dst
+	)
+	{
+		constexpr auto const WORD_BITS(path_matrix::WORD_BITS);
+		for (std::size_t ii{}; ii < indices.size(); ii += WORD_BITS)
+		{
+			auto const limit(std::min(ii + WORD_BITS, indices.size()));
+			path_matrix::word_type word{};
+			for (auto jj(ii); jj < limit; ++jj)
+			{
+				auto const idx(indices[jj]);
+				word |= ((words[idx / WORD_BITS] >> (idx % WORD_BITS)) & 0x1) << (jj - ii);
+			}
+			*dst++ = word;
+		}
+	}
+
+
+	enum class pbwt_implementation : std::uint8_t
+	{
+		dense,
+		sparse		// sparse_pbwt_context
+	};
+
+
+	struct pbwt_statistics
+	{
+		std::uint64_t	handled_columns{};
+		std::uint64_t	skipped_columns{};	// Columns with no or only ones, handled in constant time.
+		std::uint64_t	sparse_columns{};	// Columns with few ones, handled by the positions of the ones.
+	};
+
+
+	// If t_should_count_divergence_values is false, divergence_value_counts is not maintained.
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values = true>
 	struct pbwt_context
 	{
 		typedef t_index			index_type;
@@ -27,6 +76,9 @@ namespace vcf2multialign {
 		typedef t_count			count_type;
 		constexpr static inline auto const DIVERGENCE_MAX{std::numeric_limits <divergence_type>::max()};
 		constexpr static inline auto const COUNT_MAX{std::numeric_limits <count_type>::max()};
+		constexpr static inline count_type const MIN_BLOCK_RUN_LENGTH{8};	// Shorter runs of equal bits are handled value by value.
+		constexpr static inline int const MAX_BLOCK_RUN_COUNT{4};			// Words with more runs are handled value by value.
+		constexpr static inline count_type const SPARSE_COLUMN_DIVISOR{64};	// Columns with at most count / divisor ones are sparse.
 
 		struct divergence_value
 		{
@@ -44,104 +96,644 @@ namespace vcf2multialign {
 			// Place DIVERGENCE_MAX first; needed to get the equivalence class count in find_cut_positions_lambda_min().
 			bool operator<(divergence_value const other) const { return 1 + value < 1 + other.value; }
 			/* implicit */ operator divergence_type() const { return value; }
+
+			// Values in the order of operator<.
+			divergence_type encoded() const { return static_cast <divergence_type>(value + 1); }
 		};
 
-		std::vector <index_type>				permutation;
-		std::vector <index_type>				prev_permutation;
-		std::vector <divergence_value>			divergence;
-		std::vector <divergence_value>			prev_divergence;
-		std::map <divergence_value, count_type>	divergence_value_counts;
+		typedef std::pair <divergence_value, count_type>	divergence_value_count;
+		typedef std::vector <divergence_value_count>		divergence_value_count_vector;
+
+		std::vector <index_type>		permutation;
+		std::vector <index_type>		prev_permutation;
+		std::vector <divergence_value>	divergence;
+		std::vector <divergence_value>	prev_divergence;
+		divergence_value_count_vector	divergence_value_counts;	// Sorted by the value, only non-zero counts.
+		path_matrix::word_vector		column_buffer;	// For sparse columns.
+		pbwt_statistics					statistics;
 
 		explicit pbwt_context(count_type const count);
-		void update_divergence(libbio::bit_matrix::const_slice_type const slice, divergence_value const kk);
+		void update_divergence(path_matrix::column_type const &column, divergence_value const kk);
+
+		// Handle columns [lb, rb) of paths as if update_divergence() were called for each of them with the
+		// column index as kk, but sort the indices by their columns with one pass.
+		void update_divergence(path_matrix const &paths, path_matrix::column_index_type const lb, path_matrix::column_index_type const rb);
+
 		void swap_vectors();
+		void fill_vectors() {}	// For compatibility with sparse_pbwt_context.
+		index_type first_index() const { return permutation.front(); }
+
+		// Indices of the divergence values in divergence_value_counts, parallel to divergence; for sparse_pbwt_context.
+		std::vector <count_type> &count_indices() { return m_count_indices; }
+		std::vector <count_type> const &count_indices() const { return m_count_indices; }
+
+	private:
+		// Indices of the divergence values in divergence_value_counts, parallel to divergence.
+		std::vector <count_type>		m_count_indices;
+		std::vector <count_type>		m_prev_count_indices;
+		divergence_value_count_vector	m_count_buffer;
+		std::vector <count_type>		m_count_index_map;
+		path_matrix::word_vector		m_permuted_bits;	// The column in the order of prev_permutation.
+		path_matrix::word_vector		m_carrier_words;	// Union of the columns in update_divergence(paths, lb, rb).
+		std::vector <path_matrix::row_type>	m_rows;
+		std::vector <path_matrix::row_type>	m_carrier_rows;
+		std::vector <std::uint32_t>		m_alleles;			// By index, 1 + column - lb for the carriers, zero otherwise.
+		std::vector <index_type>		m_carrier_permutation;
+		std::vector <divergence_value>	m_carrier_divergence;
+		std::vector <count_type>		m_carrier_count_indices;
+		std::vector <count_type>		m_group_offsets;
+		std::vector <count_type>		m_group_begins;
+		std::vector <divergence_type>	m_group_max;		// Encoded maximum divergence value since the previous index in each group.
+		std::vector <count_type>		m_group_max_idx;	// Position of said value in the carriers.
+		std::vector <count_type>		m_group_count_indices;
+		bool							m_has_max_divergence{};	// True until the first column has been handled.
+
+		void update_divergence_uniform(divergence_value const kk);
+		void sort_carriers(path_matrix::column_index_type const lb, path_matrix::column_index_type const rb);
+		void push_divergence_value_count(std::size_t const idx);
+		void compact_divergence_value_counts();
+
+		template <typename t_value>
+		constexpr static t_value select_value(bool const cond, t_value const lhs, t_value const rhs);
 	};
 
 
-	template <typename t_index, typename t_divergence, typename t_count>
-	pbwt_context <t_index, t_divergence, t_count>::pbwt_context(count_type const count):
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::pbwt_context(count_type const count):
 		permutation(count),
 		divergence(count, DIVERGENCE_MAX)
 	{
 		if (count)
 		{
 			divergence[0] = 0;
-			divergence_value_counts[0] = 1;
-			if (1 < count)
-				divergence_value_counts[DIVERGENCE_MAX] = count - 1;
+			m_has_max_divergence = (1 < count);
+			if constexpr (t_should_count_divergence_values)
+			{
+				m_count_indices.resize(count, 0);
+				if (1 < count)
+				{
+					divergence_value_counts.emplace_back(DIVERGENCE_MAX, count - 1);
+					m_count_indices[0] = 1;
+				}
+				divergence_value_counts.emplace_back(0, 1);
+			}
 		}
 		std::iota(permutation.begin(), permutation.end(), 0);
 	}
 
 
-	template <typename t_index, typename t_divergence, typename t_count>
-	void pbwt_context <t_index, t_divergence, t_count>::update_divergence(libbio::bit_matrix::const_slice_type const slice, divergence_value const kk)
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	template <typename t_value>
+	constexpr auto pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::select_value(
+		bool const cond,
+		t_value const lhs,
+		t_value const rhs
+	) -> t_value
+	{
+		// Select with a mask since the compiler might otherwise generate a branch.
+		t_value const mask(-static_cast <t_value>(cond));
+		return (lhs & mask) | (rhs & ~mask);
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::update_divergence_uniform(
+		divergence_value const kk
+	)
+	{
+		// All the values are zeros or all of them are ones. Since there are no DIVERGENCE_MAX values left,
+		// the order does not change, and only the first divergence value becomes kk + 1. Hence we restore
+		// the vectors swapped by swap_vectors().
+		using std::swap;
+		swap(permutation, prev_permutation);
+		swap(divergence, prev_divergence);
+		swap(m_count_indices, m_prev_count_indices);
+
+		divergence.front() = kk + 1;
+
+		if constexpr (t_should_count_divergence_values)
+		{
+			// The previous value is kk_prev + 1, i.e. the last one, unless the indices were not consecutive.
+			auto &dvc(divergence_value_counts);
+			auto const prev_idx(m_count_indices.front());
+			--dvc[prev_idx].second;
+			if (0 == dvc[prev_idx].second && prev_idx + 1 == dvc.size())
+				dvc.back() = divergence_value_count(kk + 1, 1);
+			else
+			{
+				dvc.emplace_back(kk + 1, 1);
+				count_type new_idx(dvc.size() - 1);
+				if (0 == dvc[prev_idx].second)
+				{
+					dvc.erase(dvc.begin() + prev_idx);
+					for (auto &count_idx : m_count_indices)
+						count_idx -= (prev_idx < count_idx);
+					--new_idx;
+				}
+				m_count_indices.front() = new_idx;
+			}
+		}
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::push_divergence_value_count(
+		std::size_t const idx
+	)
+	{
+		// Move the value to m_count_buffer if its count is non-zero.
+		auto const &dvc(divergence_value_counts);
+		if (dvc[idx].second)
+		{
+			m_count_index_map[idx] = m_count_buffer.size();
+			m_count_buffer.push_back(dvc[idx]);
+		}
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::compact_divergence_value_counts()
+	{
+		// The last two values are kk + 1 and zero. Move zero to its place and remove the values
+		// with zero counts.
+		auto &dvc(divergence_value_counts);
+		auto &dst(m_count_buffer);
+		auto const zero_value_idx(dvc.size() - 1);
+		auto const next_value_idx(dvc.size() - 2);
+
+		dst.clear();
+		m_count_index_map.resize(dvc.size());
+		auto const push([this](std::size_t const idx){ push_divergence_value_count(idx); });
+
+		std::size_t idx{};
+		if (idx < next_value_idx && DIVERGENCE_MAX == dvc[idx].first.value)
+			push(idx++);
+
+		if (idx < next_value_idx && 0 == dvc[idx].first.value)
+		{
+			dvc[idx].second += dvc[zero_value_idx].second;
+			push(idx);
+			m_count_index_map[zero_value_idx] = m_count_index_map[idx];
+			++idx;
+		}
+		else
+		{
+			push(zero_value_idx);
+		}
+
+		for (; idx <= next_value_idx; ++idx)
+			push(idx);
+
+		using std::swap;
+		swap(dvc, dst);
+
+		for (auto &count_idx : m_count_indices)
+			count_idx = m_count_index_map[count_idx];
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::update_divergence(
+		path_matrix::column_type const &column,
+		divergence_value const kk
+	)
 	{
 		// Mostly following Algorithm 2 in Efficient haplotype matching and storage using the positional
-		// Burrows–Wheeler transform (PBWT).
+		// Burrows–Wheeler transform (PBWT). Instead of testing the bits one by one, we gather them in the order
+		// of prev_permutation and handle the runs of equal bits as blocks. Within a run of zeros, the first
+		// divergence value is max(p, d[lb]) and the remaining ones are max(0, d[i]), and q is updated with
+		// the maximum of the run (and vice versa for a run of ones).
 
-		// Note that the size of the matrix slice may be greater than that of the permutation b.c. the former must be word-aligned.
+		constexpr auto const WORD_BITS(path_matrix::WORD_BITS);
+		count_type const count(prev_permutation.size());
+		auto const one_count(column.one_count());
 
-		// First count the ones.
-		t_count zero_idx{};
-		auto one_idx([&] -> t_count {
-			t_count one_count{};
-			for (auto const word : slice.to_span())
-				one_count += libbio::bits::count_bits_set(word);
-			return prev_permutation.size() - one_count;
-		}());
+		++statistics.handled_columns;
+		if (count && !m_has_max_divergence && (0 == one_count || count == one_count))
+		{
+			++statistics.skipped_columns;
+			update_divergence_uniform(kk);
+			return;
+		}
+
+		// Sparse columns are expanded to bit vectors.
+		{
+			auto const words(column.to_words(column_buffer));
+			std::span <index_type const> const indices(prev_permutation);
+			m_permuted_bits.resize((count + WORD_BITS - 1) / WORD_BITS);
+			if constexpr (std::is_same_v <index_type, std::uint32_t>)
+				gather_bits(words, indices, m_permuted_bits.data());
+			else
+				gather_bits_portable(words, indices, m_permuted_bits.data());
+		}
+
+		count_type zero_idx{};
+		count_type one_idx(count - one_count);
 
 		// Update the sorted order.
-		permutation.resize(prev_permutation.size());
-		divergence.resize(prev_divergence.size());
+		permutation.resize(count);
+		divergence.resize(count);
 		divergence_value pp{kk + 1};
 		divergence_value qq{kk + 1};
-		for (t_count ii{}; ii < prev_permutation.size(); ++ii)
+
+		// The counts are kept in a flat vector. The new values, i.e. kk + 1 (which is greater than the
+		// existing ones) and zero, are appended and moved to their places after the column has been handled.
+		// Each divergence value is associated with its index in the vector, so no searching is needed.
+		auto &dvc(divergence_value_counts);
+		count_type zero_value_idx{};
+		count_type pp_idx{};
+		count_type qq_idx{};
+		if constexpr (t_should_count_divergence_values)
+		{
+			m_count_indices.resize(count);
+			pp_idx = dvc.size();
+			qq_idx = pp_idx;
+			zero_value_idx = pp_idx + 1;
+			dvc.emplace_back(kk + 1, 0);
+			dvc.emplace_back(0, 0);
+		}
+
+		auto const handle_run([&](
+			count_type const lb,
+			count_type const rb,
+			count_type &dst_idx,
+			divergence_value &own,
+			count_type &own_idx,
+			divergence_value &other,
+			count_type &other_idx
+		){
+			auto const prev_divergence_begin(prev_divergence.begin());
+			auto const run_length(rb - lb);
+
+			// Update the other maximum.
+			{
+				divergence_type max_value{};
+				for (auto ii(lb); ii < rb; ++ii)
+					max_value = std::max(max_value, prev_divergence[ii].encoded());
+
+				if (other.encoded() < max_value)
+				{
+					other = max_value - 1;
+					if constexpr (t_should_count_divergence_values)
+					{
+						auto const it(std::find_if(prev_divergence_begin + lb, prev_divergence_begin + rb, [max_value](auto const dd){
+							return dd.encoded() == max_value;
+						}));
+						other_idx = m_prev_count_indices[it - prev_divergence_begin];
+					}
+				}
+			}
+
+			std::copy(prev_permutation.begin() + lb, prev_permutation.begin() + rb, permutation.begin() + dst_idx);
+
+			// Handle the first value.
+			{
+				auto const pd(prev_divergence[lb]);
+				if (own < pd)
+				{
+					own = pd;
+					if constexpr (t_should_count_divergence_values)
+						own_idx = m_prev_count_indices[lb];
+				}
+
+				divergence[dst_idx] = own;
+
+				if constexpr (t_should_count_divergence_values)
+				{
+					--dvc[m_prev_count_indices[lb]].second;
+					++dvc[own_idx].second;
+					m_count_indices[dst_idx] = own_idx;
+				}
+			}
+
+			// Handle the remaining values; only DIVERGENCE_MAX changes.
+			for (count_type ii{1}; ii < run_length; ++ii)
+			{
+				auto const pd(prev_divergence[lb + ii]);
+				divergence[dst_idx + ii] = (DIVERGENCE_MAX == pd.value ? 0 : pd.value);
+			}
+
+			if constexpr (t_should_count_divergence_values)
+			{
+				for (count_type ii{1}; ii < run_length; ++ii)
+				{
+					auto const pd_idx(m_prev_count_indices[lb + ii]);
+					if (DIVERGENCE_MAX == prev_divergence[lb + ii].value)
+					{
+						--dvc[pd_idx].second;
+						++dvc[zero_value_idx].second;
+						m_count_indices[dst_idx + ii] = zero_value_idx;
+					}
+					else
+					{
+						m_count_indices[dst_idx + ii] = pd_idx;
+					}
+				}
+			}
+
+			dst_idx += run_length;
+			own = 0;
+			own_idx = zero_value_idx;
+		});
+
+		// Handle one value as in Algorithm 2 but without branching on the bit.
+		auto const handle_value([&](count_type const ii, bool const bit){
+			auto const pd(prev_divergence[ii].encoded());
+			auto pe(pp.encoded());
+			auto qe(qq.encoded());
+			if constexpr (t_should_count_divergence_values)
+			{
+				auto const pd_idx(m_prev_count_indices[ii]);
+				--dvc[pd_idx].second;
+				pp_idx = select_value(pe < pd, pd_idx, pp_idx);
+				qq_idx = select_value(qe < pd, pd_idx, qq_idx);
+			}
+
+			pe = std::max(pe, pd);
+			qe = std::max(qe, pd);
+
+			auto const dst_idx(select_value(bit, one_idx, zero_idx));
+			permutation[dst_idx] = prev_permutation[ii];
+			divergence[dst_idx] = select_value(bit, qe, pe) - 1;
+			if constexpr (t_should_count_divergence_values)
+			{
+				auto const dd_idx(select_value(bit, qq_idx, pp_idx));
+				++dvc[dd_idx].second;
+				m_count_indices[dst_idx] = dd_idx;
+				pp_idx = select_value(bit, pp_idx, zero_value_idx);
+				qq_idx = select_value(bit, zero_value_idx, qq_idx);
+			}
+
+			one_idx += bit;
+			zero_idx += !bit;
+			pp = select_value(bit, pe, divergence_type(1)) - 1;
+			qq = select_value(bit, divergence_type(1), qe) - 1;
+		});
+
+		if (one_count <= count / SPARSE_COLUMN_DIVISOR)
+		{
+			// Handle the values between the ones as runs of zeros.
+			++statistics.sparse_columns;
+			count_type lb{};
+			for (std::size_t word_idx{}; word_idx < m_permuted_bits.size(); ++word_idx)
+			{
+				auto word(m_permuted_bits[word_idx]);
+				while (word)
+				{
+					count_type const ii(word_idx * WORD_BITS + std::countr_zero(word));
+					word &= word - 1;
+					if (lb < ii)
+						handle_run(lb, ii, zero_idx, pp, pp_idx, qq, qq_idx);
+					handle_value(ii, true);
+					lb = ii + 1;
+				}
+			}
+
+			if (lb < count)
+				handle_run(lb, count, zero_idx, pp, pp_idx, qq, qq_idx);
+		}
+		else
 		{
-			auto const val_idx(prev_permutation[ii]);
-			auto const pd(prev_divergence[ii]);
+			for (std::size_t word_idx{}; word_idx < m_permuted_bits.size(); ++word_idx)
+			{
+				auto word(m_permuted_bits[word_idx]);
+				count_type lb(word_idx * WORD_BITS);
+				count_type const limit(std::min <std::size_t>(lb + WORD_BITS, count));
+
+				// Handle the values one by one if the word has many short runs, since branching on the run lengths
+				// would not be predictable.
+				if (MAX_BLOCK_RUN_COUNT < std::popcount(word ^ (word >> 1)))
+				{
+					for (auto ii(lb); ii < limit; ++ii)
+					{
+						handle_value(ii, word & 0x1);
+						word >>= 1;
+					}
+					continue;
+				}
+
+				while (lb < limit)
+				{
+					bool const bit(word & 0x1);
+					count_type const rb(std::min <std::size_t>(lb + std::countr_zero(bit ? ~word : word), limit));
+					if (rb - lb < MIN_BLOCK_RUN_LENGTH)
+					{
+						for (auto ii(lb); ii < rb; ++ii)
+							handle_value(ii, bit);
+					}
+					else if (bit)
+					{
+						handle_run(lb, rb, one_idx, qq, qq_idx, pp, pp_idx);
+					}
+					else
+					{
+						handle_run(lb, rb, zero_idx, pp, pp_idx, qq, qq_idx);
+					}
+
+					word = (WORD_BITS == rb - lb ? 0 : word >> (rb - lb));
+					lb = rb;
+				}
+			}
+		}
 
-			if (pp < pd)
-				pp = pd;
+		m_has_max_divergence = false;
+		if constexpr (t_should_count_divergence_values)
+			compact_divergence_value_counts();
+	}
 
-			if (qq < pd)
-				qq = pd;
 
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::update_divergence(
+		path_matrix const &paths,
+		path_matrix::column_index_type const lb,
+		path_matrix::column_index_type const rb
+	)
+	{
+		// Handling the columns one by one sorts the indices stably by the last column in which they have a one.
+		// If none of the rows have a one in more than one column (which should hold for the ALT edges of a node),
+		// the columns can be handled with one pass: the union of the columns is handled as a binary column with
+		// kk = rb - 1, after which the zeros are in their final places, and the ones are sorted by their
+		// columns in sort_carriers().
+		if (rb - lb <= 1)
+		{
+			if (lb < rb)
+				update_divergence(paths.column(lb), lb);
+			return;
+		}
+
+		count_type const count(prev_permutation.size());
+		m_alleles.resize(count, 0);
+		m_carrier_rows.clear();
+		bool has_overlaps{};
+		for (auto col(lb); col < rb; ++col)
+		{
+			for (auto const row : paths.column(col).to_rows(m_rows))
 			{
-				auto const it(divergence_value_counts.find(pd));
-				--it->second;
-				if (0 == it->second)
-					divergence_value_counts.erase(it);
+				has_overlaps |= (0 != m_alleles[row]);
+				m_alleles[row] = 1 + col - lb;
+				m_carrier_rows.push_back(row);
 			}
+		}
+
+		if (has_overlaps)
+		{
+			for (auto const row : m_carrier_rows)
+				m_alleles[row] = 0;
 
-			if (0 == slice[val_idx])
+			for (auto col(lb); col < rb; ++col)
 			{
-				++divergence_value_counts[pp];
-				permutation[zero_idx] = val_idx;
-				divergence[zero_idx] = pp;
-				++zero_idx;
-				pp = 0;
+				if (lb != col)
+					swap_vectors();
+				update_divergence(paths.column(col), col);
+			}
+			return;
+		}
+
+		{
+			constexpr auto const WORD_BITS(path_matrix::WORD_BITS);
+			m_carrier_words.clear();
+			m_carrier_words.resize(paths.words_per_column(), 0);
+			for (auto const row : m_carrier_rows)
+				m_carrier_words[row / WORD_BITS] |= path_matrix::word_type(1) << (row % WORD_BITS);
+		}
+
+		path_matrix::column_type const carriers(m_carrier_words, {}, paths.number_of_rows(), m_carrier_rows.size());
+		update_divergence(carriers, rb - 1);
+		statistics.handled_columns += rb - lb - 1;
+
+		if (!m_carrier_rows.empty())
+			sort_carriers(lb, rb);
+
+		for (auto const row : m_carrier_rows)
+			m_alleles[row] = 0;
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::sort_carriers(
+		path_matrix::column_index_type const lb,
+		path_matrix::column_index_type const rb
+	)
+	{
+		// The carriers are at the end in the order of prev_permutation. Sort them by their columns with
+		// counting sort. The first index in a group differs from the previous one (in the previous group)
+		// in the group’s column, so its divergence value is 1 + column, or rb if it is the first index overall.
+		// The remaining values are maxima of the values from the binary step since the previous index in
+		// the same group, so we maintain a maximum for each group as in Algorithm 2.
+		count_type const count(permutation.size());
+		count_type const carrier_count(m_carrier_rows.size());
+		count_type const carrier_begin(count - carrier_count);
+		std::size_t const group_count(1 + rb - lb);	// Group zero is not used.
+
+		m_carrier_permutation.assign(permutation.begin() + carrier_begin, permutation.end());
+		m_carrier_divergence.assign(divergence.begin() + carrier_begin, divergence.end());
+		if constexpr (t_should_count_divergence_values)
+			m_carrier_count_indices.assign(m_count_indices.begin() + carrier_begin, m_count_indices.end());
+
+		m_group_offsets.assign(group_count, 0);
+		for (auto const idx : m_carrier_permutation)
+			++m_group_offsets[m_alleles[idx]];
+
+		{
+			count_type offset(carrier_begin);
+			for (auto &group_offset : m_group_offsets)
+			{
+				auto const group_size(group_offset);
+				group_offset = offset;
+				offset += group_size;
+			}
+		}
+
+		// The last value is rb, i.e. kk + 1 of the binary step.
+		auto &dvc(divergence_value_counts);
+		count_type const last_value_idx(dvc.size() - 1);
+		m_group_begins = m_group_offsets;
+		m_group_max.assign(group_count, 0);
+		m_group_max_idx.assign(group_count, 0);
+		m_group_count_indices.assign(group_count, COUNT_MAX);
+		for (count_type ii{}; ii < carrier_count; ++ii)
+		{
+			auto const group(m_alleles[m_carrier_permutation[ii]]);
+			auto const de(m_carrier_divergence[ii].encoded());
+			// Without branching, since the groups are typically few.
+			for (std::size_t gg{1}; gg < group_count; ++gg)
+			{
+				bool const should_update(m_group_max[gg] <= de);
+				m_group_max[gg] = select_value(should_update, de, m_group_max[gg]);
+				m_group_max_idx[gg] = select_value(should_update, ii, m_group_max_idx[gg]);
+			}
+
+			auto const dst_idx(m_group_offsets[group]++);
+			permutation[dst_idx] = m_carrier_permutation[ii];
+
+			if (m_group_begins[group] == dst_idx)
+			{
+				divergence_value const dd(0 == dst_idx ? rb : lb + group);
+				divergence[dst_idx] = dd;
+				if constexpr (t_should_count_divergence_values)
+				{
+					--dvc[m_carrier_count_indices[ii]].second;
+					count_type dd_idx(last_value_idx);
+					if (rb != dd.value)
+					{
+						dd_idx = dvc.size();
+						m_group_count_indices[group] = dd_idx;
+						dvc.emplace_back(dd, 0);
+					}
+					++dvc[dd_idx].second;
+					m_count_indices[dst_idx] = dd_idx;
+				}
 			}
 			else
 			{
-				++divergence_value_counts[qq];
-				permutation[one_idx] = val_idx;
-				divergence[one_idx] = qq;
-				++one_idx;
-				qq = 0;
+				auto const src_idx(m_group_max_idx[group]);
+				divergence[dst_idx] = m_carrier_divergence[src_idx];
+				if constexpr (t_should_count_divergence_values)
+				{
+					auto const dd_idx(m_carrier_count_indices[src_idx]);
+					--dvc[m_carrier_count_indices[ii]].second;
+					++dvc[dd_idx].second;
+					m_count_indices[dst_idx] = dd_idx;
+				}
 			}
+
+			m_group_max[group] = 0;
+		}
+
+		if constexpr (t_should_count_divergence_values)
+		{
+			// The new values are between the previous ones and rb. Move them to their places and remove
+			// the values with zero counts.
+			m_count_buffer.clear();
+			m_count_index_map.resize(dvc.size());
+			for (count_type idx{}; idx < last_value_idx; ++idx)
+				push_divergence_value_count(idx);
+			for (auto const idx : m_group_count_indices)
+			{
+				if (COUNT_MAX != idx)
+					push_divergence_value_count(idx);
+			}
+			push_divergence_value_count(last_value_idx);
+
+			using std::swap;
+			swap(dvc, m_count_buffer);
+
+			for (auto &count_idx : m_count_indices)
+				count_idx = m_count_index_map[count_idx];
 		}
 	}
 
 
-	template <typename t_index, typename t_divergence, typename t_count>
-	void pbwt_context <t_index, t_divergence, t_count>::swap_vectors()
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::swap_vectors()
 	{
 		using std::swap;
 		swap(permutation, prev_permutation);
 		swap(divergence, prev_divergence);
+		swap(m_count_indices, m_prev_count_indices);
 		permutation.clear();
 		divergence.clear();
+		m_count_indices.clear();
 	}
 }
 
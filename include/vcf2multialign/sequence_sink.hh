@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef VCF2MULTIALIGN_SEQUENCE_SINK_HH
+#define VCF2MULTIALIGN_SEQUENCE_SINK_HH
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <sys/uio.h>	// iovec
+#include <vector>
+
+
+namespace vcf2multialign {
+
+	// Collects sequence fragments and writes them in bulk either to a file descriptor with writev(2)
+	// or to a std::ostream with write(). Short fragments and gaps are copied to a staging buffer.
+	// Long fragments are not copied, so they need to stay valid until flush() has been called.
+	// Long gaps refer to a pre-allocated block of gap characters.
+	class buffered_sequence_sink
+	{
+	public:
+		constexpr static inline std::size_t const BUFFER_SIZE{65536};
+		constexpr static inline std::size_t const COPY_LIMIT{256};
+		constexpr static inline std::size_t const GAP_BLOCK_SIZE{16384};
+		constexpr static inline std::size_t const IOVEC_LIMIT{512};
+
+	private:
+		std::unique_ptr <char[]>	m_buffer;
+		std::vector <iovec>			m_iovecs;
+		std::ostream				*m_stream{};
+		std::size_t					m_buffer_size{};
+		int							m_fd{-1};
+
+	public:
+		explicit buffered_sequence_sink(std::ostream &stream):
+			m_buffer(new char[BUFFER_SIZE]),
+			m_stream(&stream)
+		{
+			m_iovecs.reserve(IOVEC_LIMIT);
+		}
+
+		explicit buffered_sequence_sink(int const fd):
+			m_buffer(new char[BUFFER_SIZE]),
+			m_fd(fd)
+		{
+			m_iovecs.reserve(IOVEC_LIMIT);
+		}
+
+		// Does not flush, since flush() may throw.
+		~buffered_sequence_sink() = default;
+
+		inline void append(std::string_view const sv);
+		inline void append_gap(std::size_t count);
+		void flush();
+
+	private:
+		inline char *reserve_buffer(std::size_t const size);
+		inline void add_iovec(char const *src, std::size_t const size);
+		static char const *gap_block();
+	};
+
+
+	void buffered_sequence_sink::add_iovec(char const *src, std::size_t const size)
+	{
+		if (IOVEC_LIMIT == m_iovecs.size())
+			flush();
+
+		// writev() does not modify the source buffers.
+		m_iovecs.push_back(iovec{const_cast <char *>(src), size});
+	}
+
+
+	char *buffered_sequence_sink::reserve_buffer(std::size_t const size)
+	{
+		if (BUFFER_SIZE - m_buffer_size < size || IOVEC_LIMIT == m_iovecs.size())
+			flush();
+
+		auto * const dst(m_buffer.get() + m_buffer_size);
+		m_buffer_size += size;
+
+		// Extend the previous iovec if it ends where the reserved space begins.
+		if (!m_iovecs.empty())
+		{
+			auto &last(m_iovecs.back());
+			if (static_cast <char *>(last.iov_base) + last.iov_len == dst)
+			{
+				last.iov_len += size;
+				return dst;
+			}
+		}
+
+		m_iovecs.push_back(iovec{dst, size});
+		return dst;
+	}
+
+
+	void buffered_sequence_sink::append(std::string_view const sv)
+	{
+		if (sv.empty())
+			return;
+
+		if (sv.size() <= COPY_LIMIT)
+			std::copy(sv.begin(), sv.end(), reserve_buffer(sv.size()));
+		else
+			add_iovec(sv.data(), sv.size());
+	}
+
+
+	void buffered_sequence_sink::append_gap(std::size_t count)
+	{
+		if (!count)
+			return;
+
+		if (count <= COPY_LIMIT)
+		{
+			std::fill_n(reserve_buffer(count), count, '-');
+			return;
+		}
+
+		auto const * const block(gap_block());
+		while (count)
+		{
+			auto const size(std::min(count, GAP_BLOCK_SIZE));
+			add_iovec(block, size);
+			count -= size;
+		}
+	}
+}
+
+#endif
@@ -54,6 +54,15 @@ namespace vcf2multialign {
 		bool const should_output_unaligned,
 		sequence_writing_delegate &delegate
 	);
+
+
+	// Output the aligned sequence to dst, which needs to have space for graph.aligned_positions.back() - graph.aligned_positions[0] characters.
+	void output_sequence(
+		sequence_type const &ref_seq,
+		variant_graph const &graph,
+		char *dst,
+		sequence_writing_delegate &delegate
+	);
 }
 
 #endif
@@ -0,0 +1,670 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#ifndef VCF2MULTIALIGN_SPARSE_PBWT_HH
+#define VCF2MULTIALIGN_SPARSE_PBWT_HH
+
+#include <algorithm>			// std::lower_bound, std::max, std::min, std::sort
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>				// std::pair
+#include <vcf2multialign/path_matrix.hh>
+#include <vcf2multialign/pbwt.hh>
+#include <vector>
+
+
+namespace vcf2multialign {
+
+	// pBWT that handles a column with few ones in time proportional to the number of ones (times log m).
+	// The sorted order is stored in an implicit treap. After a column, the zeros stay in the same order and
+	// only the zeros that follow ones get new divergence values, while the ones are moved to the end; the new
+	// values are determined with range maximum queries. Other columns are handled with pbwt_context; the
+	// representation is only converted when the kind of the column changes.
+	//
+	// permutation and divergence are only filled by fill_vectors(), and divergence_value_counts may contain
+	// zero counts.
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values = true>
+	class sparse_pbwt_context
+	{
+	public:
+		typedef pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>	dense_context_type;
+		typedef t_index															index_type;
+		typedef t_divergence													divergence_type;
+		typedef t_count															count_type;
+		typedef typename dense_context_type::divergence_value					divergence_value;
+		typedef typename dense_context_type::divergence_value_count			divergence_value_count;
+		typedef typename dense_context_type::divergence_value_count_vector		divergence_value_count_vector;
+		constexpr static inline auto const DIVERGENCE_MAX{dense_context_type::DIVERGENCE_MAX};
+		constexpr static inline count_type const SPARSE_COLUMN_DIVISOR{1024};	// Default; columns with at most count / divisor ones are handled with the treap.
+		constexpr static inline count_type const TREE_COLUMN_LIMIT_MULTIPLIER{16};	// Once the treap is in use, it is used for columns with more ones, too.
+		constexpr static inline std::size_t const MIN_COMPACTED_ZERO_COUNTS{64};
+
+	private:
+		constexpr static inline index_type const NIL{std::numeric_limits <index_type>::max()};
+
+		// The nodes are stored in the sorted order when the treap is built, which makes traversing it faster.
+		struct node
+		{
+			index_type			left{NIL};
+			index_type			right{NIL};
+			index_type			parent{NIL};
+			index_type			path{};
+			std::uint32_t		priority{};
+			count_type			size{1};
+			count_type			count_idx{};	// Index of value in divergence_value_counts.
+			divergence_value	value{};
+			divergence_type		max_encoded{};	// Maximum in the subtree in the order of divergence_value.
+		};
+
+		typedef std::pair <count_type, index_type>			position_pair;
+		typedef std::pair <index_type, divergence_value>	value_update;
+
+	public:
+		std::vector <index_type>		permutation;
+		std::vector <divergence_value>	divergence;
+		divergence_value_count_vector	divergence_value_counts;	// Sorted by the value, may contain zero counts.
+		pbwt_statistics					statistics;
+
+	private:
+		std::vector <node>						m_nodes;
+		std::vector <index_type>				m_node_indices;	// By path.
+		dense_context_type						m_dense_ctx;
+		std::vector <path_matrix::row_type>		m_rows;
+		std::vector <position_pair>				m_ones;			// Positions and node indices.
+		std::vector <value_update>				m_updates;
+		std::vector <index_type>				m_stack;
+		std::vector <count_type>				m_count_index_map;
+		index_type								m_root{NIL};
+		count_type								m_zero_count_entries{};
+		count_type								m_sparse_column_limit{};
+		count_type								m_tree_column_limit{};
+		bool									m_has_max_divergence{};	// True until the first column has been handled.
+		bool									m_tree_is_current{};	// If false, m_dense_ctx has the current state.
+
+	public:
+		explicit sparse_pbwt_context(count_type const count, count_type const sparse_column_divisor = SPARSE_COLUMN_DIVISOR);
+
+		void update_divergence(path_matrix::column_type const &column, divergence_value const kk);
+		void update_divergence(path_matrix const &paths, path_matrix::column_index_type const lb, path_matrix::column_index_type const rb);
+		void swap_vectors() {}
+		void fill_vectors();
+		index_type first_index() const;
+
+	private:
+		count_type size(index_type const nn) const { return NIL == nn ? 0 : m_nodes[nn].size; }
+		divergence_type max_encoded(index_type const nn) const { return NIL == nn ? 0 : m_nodes[nn].max_encoded; }
+		inline void update_node(index_type const nn);
+		index_type merge(index_type const lhs, index_type const rhs);
+		std::pair <index_type, index_type> split(index_type const nn, count_type const count);
+		count_type position(index_type nn) const;
+		index_type node_at(count_type pos) const;
+		divergence_type range_max_encoded(index_type const nn, count_type const lb, count_type const rb) const;
+		void set_value(index_type nn, divergence_value const dd);
+
+		void build_tree(dense_context_type const &ctx);
+		template <bool t_should_fill_count_indices>
+		void fill_vectors(std::vector <index_type> &permutation_, std::vector <divergence_value> &divergence_, std::vector <count_type> &count_indices);
+		template <typename t_update>
+		void update_divergence_dense(t_update &&update);
+		void update_divergence_sparse(path_matrix::column_type const &column, divergence_value const kk);
+
+		count_type count_index(divergence_value const dd);
+		void compact_divergence_value_counts();
+		void compact_divergence_value_counts_if_needed();
+	};
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::sparse_pbwt_context(
+		count_type const count,
+		count_type const sparse_column_divisor
+	):
+		m_nodes(count),
+		m_node_indices(count),
+		m_dense_ctx(count),
+		m_sparse_column_limit(std::max(count_type(1), count_type(count / sparse_column_divisor))),	// Singletons are common.
+		m_tree_column_limit(std::min(count, TREE_COLUMN_LIMIT_MULTIPLIER * m_sparse_column_limit)),
+		m_has_max_divergence(1 < count)
+	{
+		divergence_value_counts = m_dense_ctx.divergence_value_counts;
+
+		// Deterministic priorities by the node index, mixed with the finaliser of SplitMix64.
+		for (index_type ii{}; ii < count; ++ii)
+		{
+			std::uint64_t hh(ii);
+			hh = (hh ^ (hh >> 30)) * 0xBF58'476D'1CE4'E5B9ULL;
+			hh = (hh ^ (hh >> 27)) * 0x94D0'49BB'1331'11EBULL;
+			m_nodes[ii].priority = (hh ^ (hh >> 31)) >> 32;
+		}
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::update_node(index_type const nn)
+	{
+		auto &node_(m_nodes[nn]);
+		node_.size = 1 + size(node_.left) + size(node_.right);
+		node_.max_encoded = std::max({node_.value.encoded(), max_encoded(node_.left), max_encoded(node_.right)});
+		if (NIL != node_.left)
+			m_nodes[node_.left].parent = nn;
+		if (NIL != node_.right)
+			m_nodes[node_.right].parent = nn;
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	auto sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::merge(
+		index_type const lhs,
+		index_type const rhs
+	) -> index_type
+	{
+		if (NIL == lhs)
+			return rhs;
+		if (NIL == rhs)
+			return lhs;
+
+		if (m_nodes[rhs].priority < m_nodes[lhs].priority)
+		{
+			m_nodes[lhs].right = merge(m_nodes[lhs].right, rhs);
+			update_node(lhs);
+			return lhs;
+		}
+		else
+		{
+			m_nodes[rhs].left = merge(lhs, m_nodes[rhs].left);
+			update_node(rhs);
+			return rhs;
+		}
+	}
+
+
+	// Split the subtree to the first count nodes and the rest. The parents of the returned roots are not updated.
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	auto sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::split(
+		index_type const nn,
+		count_type const count
+	) -> std::pair <index_type, index_type>
+	{
+		if (NIL == nn)
+			return {NIL, NIL};
+
+		auto &node_(m_nodes[nn]);
+		auto const left_size(size(node_.left));
+		if (count <= left_size)
+		{
+			auto const [lhs, rhs](split(node_.left, count));
+			node_.left = rhs;
+			update_node(nn);
+			return {lhs, nn};
+		}
+		else
+		{
+			auto const [lhs, rhs](split(node_.right, count - left_size - 1));
+			node_.right = lhs;
+			update_node(nn);
+			return {nn, rhs};
+		}
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	auto sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::position(
+		index_type nn
+	) const -> count_type
+	{
+		count_type retval(size(m_nodes[nn].left));
+		while (NIL != m_nodes[nn].parent)
+		{
+			auto const parent(m_nodes[nn].parent);
+			if (m_nodes[parent].right == nn)
+				retval += 1 + size(m_nodes[parent].left);
+			nn = parent;
+		}
+		return retval;
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	auto sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::node_at(
+		count_type pos
+	) const -> index_type
+	{
+		auto nn(m_root);
+		while (true)
+		{
+			auto const &node_(m_nodes[nn]);
+			auto const left_size(size(node_.left));
+			if (pos < left_size)
+				nn = node_.left;
+			else if (pos == left_size)
+				return nn;
+			else
+			{
+				pos -= left_size + 1;
+				nn = node_.right;
+			}
+		}
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	auto sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::first_index() const -> index_type
+	{
+		if (!m_tree_is_current)
+			return m_dense_ctx.first_index();
+
+		return m_nodes[node_at(0)].path;
+	}
+
+
+	// Maximum of the encoded values in positions [lb, rb) of the subtree.
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	auto sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::range_max_encoded(
+		index_type const nn,
+		count_type const lb,
+		count_type const rb
+	) const -> divergence_type
+	{
+		if (NIL == nn || rb <= lb)
+			return 0;
+
+		auto const &node_(m_nodes[nn]);
+		if (0 == lb && node_.size <= rb)
+			return node_.max_encoded;
+
+		divergence_type retval{};
+		auto const left_size(size(node_.left));
+		if (lb < left_size)
+			retval = range_max_encoded(node_.left, lb, std::min(rb, left_size));
+		if (lb <= left_size && left_size < rb)
+			retval = std::max(retval, node_.value.encoded());
+		if (left_size + 1 < rb)
+			retval = std::max(retval, range_max_encoded(node_.right, (left_size + 1 < lb ? lb - left_size - 1 : 0), rb - left_size - 1));
+		return retval;
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::set_value(
+		index_type nn,
+		divergence_value const dd
+	)
+	{
+		if constexpr (t_should_count_divergence_values)
+		{
+			auto &dvc(divergence_value_counts);
+			auto &node_(m_nodes[nn]);
+			if (0 == --dvc[node_.count_idx].second)
+				++m_zero_count_entries;
+
+			node_.count_idx = count_index(dd);
+			if (0 == dvc[node_.count_idx].second++)
+				--m_zero_count_entries;
+		}
+
+		m_nodes[nn].value = dd;
+		while (NIL != nn)
+		{
+			auto &node_(m_nodes[nn]);
+			node_.max_encoded = std::max({node_.value.encoded(), max_encoded(node_.left), max_encoded(node_.right)});
+			nn = node_.parent;
+		}
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::build_tree(
+		dense_context_type const &ctx
+	)
+	{
+		// Build the Cartesian tree of the priorities in linear time. The right spine is kept in m_stack.
+		m_stack.clear();
+		for (index_type nn{}; nn < ctx.permutation.size(); ++nn)
+		{
+			auto &node_(m_nodes[nn]);
+			node_.left = NIL;
+			node_.right = NIL;
+			node_.parent = NIL;
+			node_.path = ctx.permutation[nn];
+			node_.value = ctx.divergence[nn];
+			if constexpr (t_should_count_divergence_values)
+				node_.count_idx = ctx.count_indices()[nn];
+			m_node_indices[node_.path] = nn;
+
+			index_type last{NIL};
+			while (!m_stack.empty() && m_nodes[m_stack.back()].priority < node_.priority)
+			{
+				last = m_stack.back();
+				m_stack.pop_back();
+				update_node(last);
+			}
+
+			node_.left = last;
+			if (!m_stack.empty())
+				m_nodes[m_stack.back()].right = nn;
+			m_stack.push_back(nn);
+		}
+
+		for (auto it(m_stack.rbegin()), end(m_stack.rend()); it != end; ++it)
+			update_node(*it);
+
+		m_root = (m_stack.empty() ? NIL : m_stack.front());
+		if (NIL != m_root)
+			m_nodes[m_root].parent = NIL;
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	template <bool t_should_fill_count_indices>
+	void sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::fill_vectors(
+		std::vector <index_type> &permutation_,
+		std::vector <divergence_value> &divergence_,
+		std::vector <count_type> &count_indices
+	)
+	{
+		permutation_.clear();
+		divergence_.clear();
+		if constexpr (t_should_fill_count_indices)
+			count_indices.clear();
+		m_stack.clear();
+		auto nn(m_root);
+		while (NIL != nn || !m_stack.empty())
+		{
+			while (NIL != nn)
+			{
+				m_stack.push_back(nn);
+				nn = m_nodes[nn].left;
+			}
+
+			nn = m_stack.back();
+			m_stack.pop_back();
+			auto const &node_(m_nodes[nn]);
+			permutation_.push_back(node_.path);
+			divergence_.push_back(node_.value);
+			if constexpr (t_should_fill_count_indices)
+				count_indices.push_back(node_.count_idx);
+			nn = node_.right;
+		}
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::fill_vectors()
+	{
+		if (m_tree_is_current)
+			fill_vectors <false>(permutation, divergence, m_count_index_map);
+		else
+		{
+			permutation = m_dense_ctx.permutation;
+			divergence = m_dense_ctx.divergence;
+		}
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::update_divergence(
+		path_matrix::column_type const &column,
+		divergence_value const kk
+	)
+	{
+		count_type const count(m_nodes.size());
+		auto const one_count(column.one_count());
+		bool const is_uniform(0 == one_count || count == one_count);
+
+		if (m_has_max_divergence)
+		{
+			update_divergence_dense([&](auto &ctx){ ctx.update_divergence(column, kk); });
+			m_has_max_divergence = false;
+		}
+		else if (is_uniform)
+		{
+			if (m_tree_is_current)
+			{
+				// See pbwt_context::update_divergence_uniform().
+				++statistics.handled_columns;
+				++statistics.skipped_columns;
+
+				auto const nn(node_at(0));
+				divergence_value const dd(kk + 1);
+				if constexpr (t_should_count_divergence_values)
+				{
+					// In a run of uniform columns, the first node has the only copy of the greatest value,
+					// so its count entry may be reused.
+					auto &dvc(divergence_value_counts);
+					auto const count_idx(m_nodes[nn].count_idx);
+					if (count_idx + 1 == dvc.size() && 1 == dvc[count_idx].second && dvc[count_idx].first < dd)
+						dvc[count_idx].first = dd;
+				}
+
+				set_value(nn, dd);
+
+				if constexpr (t_should_count_divergence_values)
+					compact_divergence_value_counts_if_needed();
+			}
+			else
+			{
+				// Handled in constant time, too.
+				update_divergence_dense([&](auto &ctx){ ctx.update_divergence(column, kk); });
+			}
+		}
+		else if (one_count <= (m_tree_is_current ? m_tree_column_limit : m_sparse_column_limit))
+		{
+			++statistics.handled_columns;
+			++statistics.sparse_columns;
+			update_divergence_sparse(column, kk);
+		}
+		else
+		{
+			update_divergence_dense([&](auto &ctx){ ctx.update_divergence(column, kk); });
+		}
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::update_divergence(
+		path_matrix const &paths,
+		path_matrix::column_index_type const lb,
+		path_matrix::column_index_type const rb
+	)
+	{
+		// The treap handles the columns in time proportional to the number of ones, so the columns are
+		// only handled together if they go to pbwt_context.
+		path_matrix::row_type one_count{};
+		for (auto col(lb); col < rb; ++col)
+			one_count += paths.one_count(col);
+
+		if (m_has_max_divergence || (m_tree_is_current ? m_tree_column_limit : m_sparse_column_limit) < one_count)
+		{
+			update_divergence_dense([&](auto &ctx){ ctx.update_divergence(paths, lb, rb); });
+			m_has_max_divergence = false;
+		}
+		else
+		{
+			for (auto col(lb); col < rb; ++col)
+				update_divergence(paths.column(col), col);
+		}
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	template <typename t_update>
+	void sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::update_divergence_dense(
+		t_update &&update
+	)
+	{
+		if (m_tree_is_current)
+		{
+			if constexpr (t_should_count_divergence_values)
+			{
+				compact_divergence_value_counts();
+				m_dense_ctx.divergence_value_counts = divergence_value_counts;
+			}
+
+			fill_vectors <t_should_count_divergence_values>(m_dense_ctx.permutation, m_dense_ctx.divergence, m_dense_ctx.count_indices());
+			m_tree_is_current = false;
+		}
+
+		auto const prev_statistics(m_dense_ctx.statistics);
+		m_dense_ctx.swap_vectors();
+		update(m_dense_ctx);
+
+		statistics.handled_columns += m_dense_ctx.statistics.handled_columns - prev_statistics.handled_columns;
+		statistics.skipped_columns += m_dense_ctx.statistics.skipped_columns - prev_statistics.skipped_columns;
+		statistics.sparse_columns += m_dense_ctx.statistics.sparse_columns - prev_statistics.sparse_columns;
+
+		if constexpr (t_should_count_divergence_values)
+		{
+			divergence_value_counts = m_dense_ctx.divergence_value_counts;
+			m_zero_count_entries = 0;
+		}
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::update_divergence_sparse(
+		path_matrix::column_type const &column,
+		divergence_value const kk
+	)
+	{
+		// There are no DIVERGENCE_MAX values left, so max(0, d) = d for the zeros that do not follow ones.
+		count_type const count(m_nodes.size());
+		divergence_type const zero_encoded(divergence_value(0).encoded());
+
+		if (!m_tree_is_current)
+		{
+			build_tree(m_dense_ctx);
+			m_tree_is_current = true;
+		}
+
+		// Find the positions of the ones.
+		m_ones.clear();
+		for (auto const row : column.to_rows(m_rows))
+		{
+			auto const nn(m_node_indices[row]);
+			m_ones.emplace_back(position(nn), nn);
+		}
+		std::sort(m_ones.begin(), m_ones.end());
+
+		// Determine the new values before modifying the tree.
+		m_updates.clear();
+
+		// The value of a one is the maximum since the previous one (or kk + 1 for the first one).
+		{
+			count_type lb{};
+			divergence_type floor(divergence_value(kk + 1).encoded());
+			for (auto const [pos, nn] : m_ones)
+			{
+				auto const max_encoded_(std::max(floor, range_max_encoded(m_root, lb, pos + 1)));
+				m_updates.emplace_back(nn, max_encoded_ - 1);
+				floor = zero_encoded;
+				lb = pos + 1;
+			}
+		}
+
+		// The first zero gets kk + 1 and the zero that follows a run of ones the maximum of the run and its own value.
+		{
+			std::size_t leading_ones{};
+			while (leading_ones < m_ones.size() && m_ones[leading_ones].first == leading_ones)
+				++leading_ones;
+
+			if (leading_ones < count)
+				m_updates.emplace_back(node_at(leading_ones), kk + 1);
+
+			auto ii(leading_ones);
+			while (ii < m_ones.size())
+			{
+				auto const run_lb(m_ones[ii].first);
+				auto jj(ii + 1);
+				while (jj < m_ones.size() && m_ones[jj].first == m_ones[jj - 1].first + 1)
+					++jj;
+
+				count_type const zero_pos(m_ones[jj - 1].first + 1);
+				if (zero_pos < count)
+				{
+					auto const max_encoded_(std::max(zero_encoded, range_max_encoded(m_root, run_lb, zero_pos + 1)));
+					m_updates.emplace_back(node_at(zero_pos), max_encoded_ - 1);
+				}
+
+				ii = jj;
+			}
+		}
+
+		for (auto const [nn, dd] : m_updates)
+			set_value(nn, dd);
+
+		// Move the ones to the end.
+		for (auto it(m_ones.rbegin()), end(m_ones.rend()); it != end; ++it)
+		{
+			auto const [lhs, rhs](split(m_root, it->first));
+			auto const [mid, rhs_](split(rhs, 1));
+			m_root = merge(lhs, rhs_);
+		}
+
+		for (auto const [pos, nn] : m_ones)
+		{
+			m_nodes[nn].parent = NIL;
+			m_root = merge(m_root, nn);
+		}
+
+		m_nodes[m_root].parent = NIL;
+
+		if constexpr (t_should_count_divergence_values)
+			compact_divergence_value_counts_if_needed();
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	auto sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::count_index(
+		divergence_value const dd
+	) -> count_type
+	{
+		// The new values are either kk + 1, i.e. greater than the existing ones, or maxima of existing values,
+		// so the indices of the existing values do not change.
+		auto &dvc(divergence_value_counts);
+		if (dvc.empty() || dvc.back().first < dd)
+		{
+			dvc.emplace_back(dd, 0);
+			++m_zero_count_entries;
+			return dvc.size() - 1;
+		}
+
+		auto const it(std::lower_bound(dvc.begin(), dvc.end(), dd, [](auto const &kv, auto const dd_){ return kv.first < dd_; }));
+		return it - dvc.begin();
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::compact_divergence_value_counts()
+	{
+		auto &dvc(divergence_value_counts);
+		m_count_index_map.resize(dvc.size());
+		count_type dst_idx{};
+		for (count_type src_idx{}; src_idx < dvc.size(); ++src_idx)
+		{
+			m_count_index_map[src_idx] = dst_idx;
+			if (dvc[src_idx].second)
+				dvc[dst_idx++] = dvc[src_idx];
+		}
+
+		dvc.resize(dst_idx);
+		m_zero_count_entries = 0;
+
+		for (auto &node_ : m_nodes)
+			node_.count_idx = m_count_index_map[node_.count_idx];
+	}
+
+
+	template <typename t_index, typename t_divergence, typename t_count, bool t_should_count_divergence_values>
+	void sparse_pbwt_context <t_index, t_divergence, t_count, t_should_count_divergence_values>::compact_divergence_value_counts_if_needed()
+	{
+		// Remove the zero counts if there are more of them than other values.
+		auto const nonzero_counts(divergence_value_counts.size() - m_zero_count_entries);
+		if (std::max(MIN_COMPACTED_ZERO_COUNTS, nonzero_counts) < m_zero_count_entries)
+			compact_divergence_value_counts();
+	}
+}
+
+#endif
@@ -1,17 +1,35 @@
 /*
- * Copyright (c) 2023 Tuukka Norri
+ * Copyright (c) 2023-2024 Tuukka Norri
  * This code is licensed under MIT license (see LICENSE for details).
  */
 
 #ifndef VCF2MULTIALIGN_TRANSPOSE_MATRIX_HH
 #define VCF2MULTIALIGN_TRANSPOSE_MATRIX_HH
 
+#include <cstddef>
+#include <cstdint>
 #include <libbio/int_matrix.hh>
+#include <vcf2multialign/path_matrix.hh>
 
 
 namespace vcf2multialign {
-	
-	[[nodiscard]] libbio::bit_matrix transpose_matrix(libbio::bit_matrix const &mat);
+
+	// Since the path matrix is only stored by ALT edge, the program itself no longer transposes matrices;
+	// the functions below are library utilities for tools that need the rows as bit vectors.
+
+	// The numbers of rows and columns need to be multiples of 64. The matrix is processed in 64×64 blocks
+	// with a kernel selected by the CPU features, and groups of columns are divided among the threads.
+	[[nodiscard]] libbio::bit_matrix transpose_matrix(libbio::bit_matrix const &mat, std::uint16_t const thread_count = 1);
+
+	// Write the transpose to a file as the words of a libbio::bit_matrix, i.e. column by column, without
+	// holding the whole destination in memory. The destination columns are produced in stripes of at most
+	// buffer_size bytes (but at least 64 columns). The source may refer to a memory-mapped file.
+	// For a path_matrix, the destination has one column for each chromosome copy, and the numbers of its
+	// rows and columns are rounded up to multiples of 64; the padding is filled with zeros.
+	// These are not used when building or serialising graphs, since the path matrix is filled and written
+	// one ALT edge at a time, and --memory-budget only limits the number of contigs processed concurrently.
+	void transpose_matrix(libbio::bit_matrix const &mat, char const *path, std::size_t const buffer_size, std::uint16_t const thread_count = 1);
+	void transpose_matrix(path_matrix const &mat, char const *path, std::size_t const buffer_size, std::uint16_t const thread_count = 1);
 }
 
 #endif
@@ -6,6 +6,9 @@
 #ifndef VCF2MULTIALIGN_VARIANT_GRAPH_HH
 #define VCF2MULTIALIGN_VARIANT_GRAPH_HH
 
+#include <cereal/cereal.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
 #include <cstddef>
 #include <cstdint>
 #include <filesystem>
@@ -18,12 +21,17 @@
 #include <libbio/size_calculator.hh>
 #include <libbio/vcf/variant.hh>
 #include <limits>										// std::numeric_limits
+#include <range/v3/view/iota.hpp>
+#include <range/v3/view/transform.hpp>
 #include <range/v3/view/zip.hpp>
 #include <span>
 #include <string>
 #include <string_view>
 #include <type_traits>
-#include <utility>										// std::pair
+#include <utility>										// std::move, std::pair
+#include <vcf2multialign/mappable_vector.hh>
+#include <vcf2multialign/packed_vector.hh>
+#include <vcf2multialign/path_matrix.hh>
 #include <vector>
 
 
@@ -33,20 +41,66 @@ namespace vcf2multialign {
 	typedef std::vector <char>				sequence_type;
 
 
+	// Stores strings in one contiguous buffer, which avoids allocating memory for each of them.
+	class packed_label_vector
+	{
+	public:
+		typedef std::uint64_t				offset_type;
+		typedef mappable_vector <char>			character_vector;
+		typedef mappable_vector <offset_type>	offset_vector;
+
+	private:
+		character_vector					m_characters;
+		offset_vector						m_offsets{0};	// Cumulative sum of the label lengths.
+
+	public:
+		packed_label_vector() = default;
+
+		// The vectors may refer to memory owned by someone else, e.g. a mapped graph file.
+		packed_label_vector(character_vector characters, offset_vector offsets):
+			m_characters(std::move(characters)),
+			m_offsets(std::move(offsets))
+		{
+			libbio_assert(!m_offsets.empty());
+			libbio_assert_eq(m_offsets.back(), m_characters.size());
+		}
+
+		std::size_t size() const { return m_offsets.size() - 1; }
+		bool empty() const { return 1 == m_offsets.size(); }
+		character_vector const &characters() const { return m_characters; }
+		offset_vector const &offsets() const { return m_offsets; }
+
+		std::string_view operator[](std::size_t const idx) const { libbio_assert_lt(idx, size()); return {m_characters.data() + m_offsets[idx], m_characters.data() + m_offsets[1 + idx]}; }
+		inline void push_back(std::string_view const label);
+		void clear() { m_characters.clear(); m_offsets.clear(); m_offsets.push_back(0); }
+		void reserve(std::size_t const count, std::size_t const characters) { m_characters.reserve(characters); m_offsets.reserve(1 + count); }
+		void shrink_to_fit() { m_characters.shrink_to_fit(); m_offsets.shrink_to_fit(); }
+
+		template <typename t_range>
+		void assign(t_range const &labels);
+
+		bool operator==(packed_label_vector const &) const = default;
+
+		// For Cereal
+		template <typename t_archive> void serialize(t_archive &ar) { ar(m_characters); ar(m_offsets); }
+	};
+
+
 	struct variant_graph
 	{
-		typedef std::uint64_t				position_type;	// FIXME: is std::uint32_t enough?
+		typedef std::uint64_t				position_type;
 		typedef std::uint64_t				node_type;
 		typedef std::uint64_t				edge_type;
 		typedef std::uint32_t				sample_type;
 		typedef std::uint32_t				ploidy_type;
-		typedef std::string					label_type;
-		typedef std::vector <position_type>	position_vector;
-		typedef std::vector <node_type>		node_vector;
-		typedef std::vector <edge_type>		edge_vector;
-		typedef std::vector <label_type>	label_vector;
+		typedef std::string_view			label_type;
+		typedef packed_vector				position_vector;	// Only as many bits per value as needed for the greatest one.
+		typedef packed_vector				node_vector;
+		typedef packed_vector				edge_vector;
+		typedef packed_label_vector			label_vector;
+		typedef std::vector <std::string>	string_vector;
 		typedef std::vector <ploidy_type>	ploidy_csum_vector;
-		typedef libbio::bit_matrix			path_matrix;
+		typedef vcf2multialign::path_matrix	path_matrix;
 
 		constexpr static inline position_type const POSITION_MAX{std::numeric_limits <position_type>::max()};
 		constexpr static inline node_type const NODE_MAX{std::numeric_limits <node_type>::max()};
@@ -59,10 +113,9 @@ namespace vcf2multialign {
 		node_vector							alt_edge_targets;				// ALT edge targets by edge number.
 		edge_vector							alt_edge_count_csum;			// Cumulative sum of ALT edge counts by 1-based node number.
 		label_vector						alt_edge_labels;				// ALT edge labels by edge number.
-		path_matrix							paths_by_chrom_copy_and_edge;	// Edges on rows, chromosome copies (samples multiplied by ploidy) in columns.
-		path_matrix							paths_by_edge_and_chrom_copy;	// Chromosome copies on rows, edges in columns.
+		path_matrix							paths_by_edge_and_chrom_copy;	// Chromosome copies (samples multiplied by ploidy) on rows, edges in columns.
 
-		label_vector						sample_names;					// Sample names by sample index. FIXME: In case we have variant_graph ->> chromosome at some point, this should be in the graph.
+		string_vector						sample_names;					// Sample names by sample index. FIXME: In case we have variant_graph ->> chromosome at some point, this should be in the graph.
 		ploidy_csum_vector					ploidy_csum;					// Cumulative sum of ploidies by 1-based sample number (for this chromosome).
 
 		node_type node_count() const { return reference_positions.size(); }
@@ -77,6 +130,10 @@ namespace vcf2multialign {
 		node_type add_or_update_node(position_type const ref_pos, position_type const aln_pos);
 		edge_type add_edge(std::string_view const label = std::string_view{});
 
+		// Reserve space for building the graph. The estimates need not be exact; shrink_to_fit() releases the excess.
+		void reserve(node_type const node_count, edge_type const edge_count, position_type const max_position);
+		void shrink_to_fit();
+
 		position_type aligned_length(node_type const lhs, node_type const rhs) const { return aligned_positions[rhs] - aligned_positions[lhs]; }
 
 		// For Cereal
@@ -140,7 +197,7 @@ namespace vcf2multialign {
 		typedef variant_graph::position_type	position_type;
 
 		virtual ~build_graph_delegate() {}
-		virtual bool should_include(std::string_view const sample_name, variant_graph::ploidy_type const chrom_copy_idx) const = 0;
+		virtual bool should_include(std::string_view const chr_id, std::string_view const sample_name, variant_graph::ploidy_type const chrom_copy_idx) const = 0;
 
 		// FIXME: add typedef for line number.
 		virtual void report_overlapping_alternative(
@@ -157,10 +214,22 @@ namespace vcf2multialign {
 	};
 
 
+	struct build_graph_chunk_delegate
+	{
+		virtual ~build_graph_chunk_delegate() {}
+
+		// Called with each completed chunk, which is cleared afterwards.
+		virtual void handle_chunk(variant_graph const &chunk) = 0;
+	};
+
+
+	struct pbwt_statistics; // Fwd.
+
+
 	struct process_graph_delegate
 	{
 		virtual ~process_graph_delegate() {}
-		virtual void handled_node(variant_graph::node_type const node) = 0;
+		virtual void handled_node(variant_graph::node_type const node, pbwt_statistics const &stats) = 0;
 	};
 
 
@@ -171,13 +240,69 @@ namespace vcf2multialign {
 	};
 
 
+	struct variant_graph_contig
+	{
+		sequence_type const	*reference{};
+		char const			*chromosome_id{};
+		variant_graph		*graph{};
+	};
+
+
+	struct build_graph_contig_delegate
+	{
+		virtual ~build_graph_contig_delegate() {}
+
+		// Called with each completed graph as soon as the records of its contig have been handled.
+		// The parser waits until the function returns.
+		virtual void handle_contig_graph(variant_graph_contig const &contig) = 0;
+	};
+
+
+	// Build one graph per contig in a single pass over the variant file; records of other chromosomes are skipped.
+	// If thread_count is greater than one, the paths are filled in worker threads while the parser
+	// thread handles the graph structure. The delegate is only called from the calling thread.
+	void build_variant_graphs(
+		char const *variants_path,
+		std::span <variant_graph_contig const> const contigs,
+		build_graph_statistics &stats,
+		build_graph_delegate &delegate,
+		std::uint16_t const thread_count = 1
+	);
+
+
+	inline void build_variant_graphs(
+		std::filesystem::path const &variants_path,
+		std::span <variant_graph_contig const> const contigs,
+		build_graph_statistics &stats,
+		build_graph_delegate &delegate,
+		std::uint16_t const thread_count = 1
+	)
+	{
+		build_variant_graphs(variants_path.c_str(), contigs, stats, delegate, thread_count);
+	}
+
+
+	// As above but each graph is passed to contig_delegate as soon as it is complete. The records of each contig
+	// need to be contiguous in the variant file, i.e. it needs to be sorted by contig. The graphs of the contigs
+	// without records are passed to the delegate last.
+	void build_variant_graphs(
+		char const *variants_path,
+		std::span <variant_graph_contig const> const contigs,
+		build_graph_statistics &stats,
+		build_graph_delegate &delegate,
+		build_graph_contig_delegate &contig_delegate,
+		std::uint16_t const thread_count = 1
+	);
+
+
 	void build_variant_graph(
 		sequence_type const &ref_seq,
 		char const *variants_path,
 		char const *chr_id,
 		variant_graph &graph,
 		build_graph_statistics &stats,
-		build_graph_delegate &delegate
+		build_graph_delegate &delegate,
+		std::uint16_t const thread_count = 1
 	);
 
 
@@ -187,39 +312,164 @@ namespace vcf2multialign {
 		char const *chr_id,
 		variant_graph &graph,
 		build_graph_statistics &stats,
-		build_graph_delegate &delegate
+		build_graph_delegate &delegate,
+		std::uint16_t const thread_count = 1
 	)
 	{
-		build_variant_graph(ref_seq, variants_path.c_str(), chr_id, graph, stats, delegate);
+		build_variant_graph(ref_seq, variants_path.c_str(), chr_id, graph, stats, delegate, thread_count);
+	}
+
+
+	// Build the graph of one contig in chunks, so that only the current chunk needs to be kept in memory.
+	// A chunk is completed at the first bridge node, i.e. a node that no ALT edge spans, after it has
+	// at least min_edge_count ALT edges. The last node of a chunk is also the first node of the next one,
+	// and the node indices are relative to the chunk. Every chunk has all the samples and paths, so
+	// the sequences may be output by concatenating their parts in the chunks. The first chunk begins
+	// with the source node and the last one ends with the sink node.
+	void build_variant_graph_chunks(
+		sequence_type const &ref_seq,
+		char const *variants_path,
+		char const *chr_id,
+		build_graph_statistics &stats,
+		build_graph_delegate &delegate,
+		build_graph_chunk_delegate &chunk_delegate,
+		variant_graph::edge_type const min_edge_count,
+		std::uint16_t const thread_count = 1
+	);
+
+
+	inline void build_variant_graph_chunks(
+		sequence_type const &ref_seq,
+		std::filesystem::path const &variants_path,
+		char const *chr_id,
+		build_graph_statistics &stats,
+		build_graph_delegate &delegate,
+		build_graph_chunk_delegate &chunk_delegate,
+		variant_graph::edge_type const min_edge_count,
+		std::uint16_t const thread_count = 1
+	)
+	{
+		build_variant_graph_chunks(ref_seq, variants_path.c_str(), chr_id, stats, delegate, chunk_delegate, min_edge_count, thread_count);
+	}
+
+
+	// Add the samples of the given variant file to an existing graph of the given contig without
+	// re-reading the samples already in the graph. The records of the contig need to be the same
+	// as those from which the graph was built, apart from the samples; otherwise std::runtime_error
+	// is thrown. The thread count is only used for decompressing the file.
+	void append_samples(
+		char const *variants_path,
+		char const *chr_id,
+		variant_graph &graph,
+		build_graph_statistics &stats,
+		build_graph_delegate &delegate,
+		std::uint16_t const thread_count = 1
+	);
+
+
+	inline void append_samples(
+		std::filesystem::path const &variants_path,
+		char const *chr_id,
+		variant_graph &graph,
+		build_graph_statistics &stats,
+		build_graph_delegate &delegate,
+		std::uint16_t const thread_count = 1
+	)
+	{
+		append_samples(variants_path.c_str(), chr_id, graph, stats, delegate, thread_count);
 	}
 
 
 	template <typename t_archive>
 	void variant_graph::serialize(t_archive &ar, cereal_version_type const version)
 	{
-		ar(reference_positions);
-		ar(aligned_positions);
-		ar(alt_edge_targets);
-		ar(alt_edge_count_csum);
-		ar(alt_edge_labels);
-		ar(paths_by_chrom_copy_and_edge);
-		ar(paths_by_edge_and_chrom_copy);
-		ar(sample_names);
-		ar(ploidy_csum);
+		if (version < 2)
+		{
+			// The positions and the edges were stored as 64-bit integers before version 2.
+			auto const load_vector([&ar](packed_vector &dst){
+				std::vector <std::uint64_t> values;
+				ar(values);
+				dst.assign(values);
+			});
+
+			load_vector(reference_positions);
+			load_vector(aligned_positions);
+			load_vector(alt_edge_targets);
+			load_vector(alt_edge_count_csum);
+		}
+		else
+		{
+			ar(reference_positions);
+			ar(aligned_positions);
+			ar(alt_edge_targets);
+			ar(alt_edge_count_csum);
+		}
+
+		if (version < 1)
+		{
+			// The labels were stored one by one in version 0.
+			std::vector <std::string> labels;
+			ar(labels);
+			alt_edge_labels.assign(labels);
+		}
+		else
+		{
+			ar(alt_edge_labels);
+		}
+
+		if (version < 4)
+		{
+			// The path matrices were dense before version 4, and the transpose was also stored before version 3.
+			if (version < 3)
+			{
+				libbio::bit_matrix paths_by_chrom_copy_and_edge;
+				ar(paths_by_chrom_copy_and_edge);
+			}
+
+			libbio::bit_matrix paths;
+			ar(paths);
+			ar(sample_names);
+			ar(ploidy_csum);
+			paths_by_edge_and_chrom_copy = path_matrix(paths, total_chromosome_copies(), edge_count());
+		}
+		else
+		{
+			ar(paths_by_edge_and_chrom_copy);
+			ar(sample_names);
+			ar(ploidy_csum);
+		}
+	}
+
+
+	void packed_label_vector::push_back(std::string_view const label)
+	{
+		m_characters.append(label.begin(), label.end());
+		m_offsets.push_back(m_characters.size());
+	}
+
+
+	template <typename t_range>
+	void packed_label_vector::assign(t_range const &labels)
+	{
+		clear();
+		for (auto const &label : labels)
+			push_back(label);
 	}
 
 
 	auto variant_graph_walker::alt_edge_labels() const
 	{
-		auto const *data(m_graph->alt_edge_labels.data());
-		return std::span(data + m_graph->alt_edge_count_csum[m_node], data + m_graph->alt_edge_count_csum[1 + m_node]);
+		auto const *labels(&m_graph->alt_edge_labels);
+		return ranges::views::iota(m_graph->alt_edge_count_csum[m_node], m_graph->alt_edge_count_csum[1 + m_node])
+			| ranges::views::transform([labels](edge_type const edge_idx){ return (*labels)[edge_idx]; });
 	}
 
 
 	auto variant_graph_walker::alt_edge_targets() const
 	{
-		auto const *data(m_graph->alt_edge_targets.data());
-		return std::span(data + m_graph->alt_edge_count_csum[m_node], data + m_graph->alt_edge_count_csum[1 + m_node]);
+		auto const *targets(&m_graph->alt_edge_targets);
+		return ranges::views::iota(m_graph->alt_edge_count_csum[m_node], m_graph->alt_edge_count_csum[1 + m_node])
+			| ranges::views::transform([targets](edge_type const edge_idx){ return (*targets)[edge_idx]; });
 	}
 
 
@@ -232,6 +482,27 @@ namespace vcf2multialign {
 
 namespace libbio::size_calculation {
 
+	template <>
+	struct value_size_calculator <vcf2multialign::packed_vector>
+	{
+		void operator()(size_calculator &sc, entry_index_type const entry_idx, vcf2multialign::packed_vector const &vec) const;
+	};
+
+
+	template <>
+	struct value_size_calculator <vcf2multialign::path_matrix>
+	{
+		void operator()(size_calculator &sc, entry_index_type const entry_idx, vcf2multialign::path_matrix const &mat) const;
+	};
+
+
+	template <>
+	struct value_size_calculator <vcf2multialign::packed_label_vector>
+	{
+		void operator()(size_calculator &sc, entry_index_type const entry_idx, vcf2multialign::packed_label_vector const &vec) const;
+	};
+
+
 	template <>
 	struct value_size_calculator <vcf2multialign::variant_graph>
 	{
@@ -239,4 +510,6 @@ namespace libbio::size_calculation {
 	};
 }
 
+CEREAL_CLASS_VERSION(vcf2multialign::variant_graph, 4);
+
 #endif
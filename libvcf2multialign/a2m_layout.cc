@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <libbio/assert.hh>
+#include <range/v3/view/zip.hpp>
+#include <utility>
+#include <vcf2multialign/a2m_layout.hh>
+
+namespace rsv	= ranges::views;
+
+
+namespace vcf2multialign {
+
+	void a2m_layout::add_record(std::string fasta_identifier)
+	{
+		auto const header_size(2 + fasta_identifier.size()); // “>” and newline.
+		m_sequence_offsets.push_back(m_size + header_size);
+		m_size += header_size + m_sequence_length + 1;
+		m_fasta_identifiers.emplace_back(std::move(fasta_identifier));
+	}
+
+
+	void a2m_layout::write_headers(char *dst) const
+	{
+		for (auto const &[fasta_id, seq_offset] : rsv::zip(m_fasta_identifiers, m_sequence_offsets))
+		{
+			auto *header(dst + seq_offset - fasta_id.size() - 2);
+			*header++ = '>';
+			header = std::copy(fasta_id.begin(), fasta_id.end(), header);
+			*header = '\n';
+			libbio_assert_eq(header + 1, dst + seq_offset);
+			dst[seq_offset + m_sequence_length] = '\n';
+		}
+	}
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vcf2multialign/bgzf_index.hh>
+#include <vector>
+#include <zlib.h>
+
+namespace fs	= std::filesystem;
+namespace v2m	= vcf2multialign;
+
+
+namespace {
+
+	static_assert(std::endian::little == std::endian::native, "Index parsing assumes a little-endian architecture.");
+
+	typedef v2m::bgzf_reader::virtual_offset_type	virtual_offset_type;
+
+
+	std::vector <char> read_gzip_file(char const *path)
+	{
+		auto * const fp(gzopen(path, "rb"));
+		if (!fp)
+			throw std::runtime_error(std::string("Unable to open ") + path);
+
+		std::vector <char> retval;
+		std::size_t size{};
+		while (true)
+		{
+			retval.resize(size + 65536);
+			auto const res(gzread(fp, retval.data() + size, 65536));
+			if (res < 0)
+			{
+				gzclose(fp);
+				throw std::runtime_error(std::string("Unable to read ") + path);
+			}
+
+			if (0 == res)
+				break;
+
+			size += res;
+		}
+
+		gzclose(fp);
+		retval.resize(size);
+		return retval;
+	}
+
+
+	class index_cursor
+	{
+	private:
+		char const	*m_it{};
+		char const	*m_end{};
+
+	public:
+		explicit index_cursor(std::vector <char> const &data):
+			m_it(data.data()),
+			m_end(data.data() + data.size())
+		{
+		}
+
+		index_cursor(char const *begin, char const *end):
+			m_it(begin),
+			m_end(end)
+		{
+		}
+
+		template <typename t_type>
+		t_type read()
+		{
+			t_type retval{};
+			std::memcpy(&retval, advance(sizeof(t_type)), sizeof(t_type));
+			return retval;
+		}
+
+		std::size_t read_count()
+		{
+			auto const retval(read <std::int32_t>());
+			if (retval < 0)
+				throw std::runtime_error("Invalid count in index");
+			return retval;
+		}
+
+		char const *advance(std::size_t const size)
+		{
+			if (std::size_t(m_end - m_it) < size)
+				throw std::runtime_error("Truncated index");
+
+			auto const *retval(m_it);
+			m_it += size;
+			return retval;
+		}
+
+		// Return a cursor for the next size bytes and skip them.
+		index_cursor sub_cursor(std::size_t const size)
+		{
+			auto const * const begin(advance(size));
+			return index_cursor(begin, begin + size);
+		}
+	};
+
+
+	// Return the index of the contig in the tabix-style sequence name list that follows the column specification.
+	std::optional <std::size_t> read_contig_index(index_cursor &cursor, std::string_view const contig)
+	{
+		cursor.advance(6 * sizeof(std::int32_t)); // format, col_seq, col_beg, col_end, meta, skip
+		auto const names_size(cursor.read_count());
+		auto const * const names_begin(cursor.advance(names_size));
+		std::string_view const names(names_begin, names_size);
+
+		std::size_t idx{};
+		std::size_t pos{};
+		while (pos < names.size())
+		{
+			auto const end(std::min(names.find('\0', pos), names.size()));
+			if (names.substr(pos, end - pos) == contig)
+				return idx;
+
+			pos = 1 + end;
+			++idx;
+		}
+
+		return std::nullopt;
+	}
+
+
+	struct contig_summary
+	{
+		std::optional <virtual_offset_type>	offset;			// Smallest chunk start.
+		std::optional <std::uint64_t>		record_count;	// From the pseudo-bin, if present.
+	};
+
+
+	// Read the bins of one reference.
+	contig_summary read_bins(index_cursor &cursor, std::uint32_t const pseudo_bin, bool const has_loffset)
+	{
+		contig_summary retval;
+		auto const bin_count(cursor.read_count());
+		for (std::size_t i{}; i < bin_count; ++i)
+		{
+			auto const bin(cursor.read <std::uint32_t>());
+			if (has_loffset)
+				cursor.read <std::uint64_t>();
+
+			auto const chunk_count(cursor.read_count());
+			for (std::size_t j{}; j < chunk_count; ++j)
+			{
+				auto const chunk_begin(cursor.read <std::uint64_t>());
+				cursor.read <std::uint64_t>(); // chunk_end
+
+				// The pseudo-bin contains metadata; the second pair has the numbers of mapped and unmapped records.
+				if (pseudo_bin != bin)
+					retval.offset = std::min(retval.offset.value_or(chunk_begin), chunk_begin);
+				else if (1 == j)
+					retval.record_count = chunk_begin;
+			}
+		}
+
+		return retval;
+	}
+
+
+	std::optional <contig_summary> contig_summary_in_tbi(index_cursor &cursor, std::string_view const contig)
+	{
+		auto const ref_count(cursor.read_count());
+		auto const contig_idx(read_contig_index(cursor, contig));
+		if (!contig_idx)
+			return std::nullopt;
+
+		for (std::size_t i{}; i < ref_count; ++i)
+		{
+			auto const summary(read_bins(cursor, 37450, false));
+			if (i == *contig_idx)
+				return summary;
+
+			// Linear index.
+			auto const interval_count(cursor.read_count());
+			cursor.advance(interval_count * sizeof(std::uint64_t));
+		}
+
+		throw std::runtime_error("Contig index out of bounds");
+	}
+
+
+	std::optional <contig_summary> contig_summary_in_csi(index_cursor &cursor, std::string_view const contig)
+	{
+		cursor.read <std::int32_t>(); // min_shift
+		auto const depth(cursor.read_count());
+		auto const aux_size(cursor.read_count());
+		if (aux_size < 7 * sizeof(std::int32_t))
+			throw std::runtime_error("CSI index does not contain sequence names");
+
+		// The auxiliary data is expected to be in the tabix format; parse it separately in case it has padding.
+		auto aux_cursor(cursor.sub_cursor(aux_size));
+		auto const contig_idx(read_contig_index(aux_cursor, contig));
+		if (!contig_idx)
+			return std::nullopt;
+
+		std::uint32_t const pseudo_bin(((1U << (3 * (depth + 1))) - 1) / 7 + 1);
+		auto const ref_count(cursor.read_count());
+		for (std::size_t i{}; i < ref_count; ++i)
+		{
+			auto const summary(read_bins(cursor, pseudo_bin, true));
+			if (i == *contig_idx)
+				return summary;
+		}
+
+		throw std::runtime_error("Contig index out of bounds");
+	}
+
+
+	std::optional <contig_summary> contig_summary_in_bgzf_index(char const *index_path, std::string_view const contig)
+	{
+		auto const data(read_gzip_file(index_path));
+		index_cursor cursor(data);
+		std::string_view const magic(cursor.advance(4), 4);
+
+		if ("TBI\1" == magic)
+			return contig_summary_in_tbi(cursor, contig);
+
+		if ("CSI\1" == magic)
+			return contig_summary_in_csi(cursor, contig);
+
+		throw std::runtime_error(std::string("Unrecognised index format in ") + index_path);
+	}
+}
+
+
+namespace vcf2multialign {
+
+	std::string find_bgzf_index(char const *variants_path)
+	{
+		for (auto const *suffix : {".tbi", ".csi"})
+		{
+			std::string path(variants_path);
+			path += suffix;
+			if (fs::exists(path))
+				return path;
+		}
+
+		return {};
+	}
+
+
+	std::optional <bgzf_reader::virtual_offset_type> contig_offset_in_bgzf_index(char const *index_path, std::string_view const contig)
+	{
+		auto const summary(contig_summary_in_bgzf_index(index_path, contig));
+		return summary ? summary->offset : std::nullopt;
+	}
+
+
+	std::optional <std::uint64_t> contig_record_count_in_bgzf_index(char const *index_path, std::string_view const contig)
+	{
+		auto const summary(contig_summary_in_bgzf_index(index_path, contig));
+		return summary ? summary->record_count : std::nullopt;
+	}
+}
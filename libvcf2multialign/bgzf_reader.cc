@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <vcf2multialign/bgzf_reader.hh>
+#include <zlib.h>
+
+
+namespace {
+
+	static_assert(std::endian::little == std::endian::native, "BGZF parsing assumes a little-endian architecture.");
+
+	constexpr static inline std::size_t const BGZF_HEADER_SIZE{18};
+	constexpr static inline std::size_t const BGZF_FOOTER_SIZE{8};
+
+
+	template <typename t_type>
+	t_type read_le(char const *src)
+	{
+		t_type retval{};
+		std::memcpy(&retval, src, sizeof(t_type));
+		return retval;
+	}
+
+
+	bool is_bgzf_header(char const *data, std::size_t const size)
+	{
+		return (
+			BGZF_HEADER_SIZE <= size &&
+			'\x1f' == data[0] && '\x8b' == data[1] && '\x08' == data[2] && '\x04' == data[3] &&	// gzip, deflate, FEXTRA
+			6 <= read_le <std::uint16_t>(data + 10) &&												// XLEN
+			'B' == data[12] && 'C' == data[13] && 2 == read_le <std::uint16_t>(data + 14)			// BC subfield
+		);
+	}
+
+
+	// Return the size of the block that starts at data.
+	std::size_t bgzf_block_size(char const *data, std::size_t const size)
+	{
+		if (!is_bgzf_header(data, size))
+			throw std::runtime_error("Invalid BGZF block header");
+
+		std::size_t const block_size(1 + read_le <std::uint16_t>(data + 16));
+		std::size_t const xlen(read_le <std::uint16_t>(data + 10));
+		if (size < block_size || block_size < 12 + xlen + BGZF_FOOTER_SIZE)
+			throw std::runtime_error("Truncated BGZF block");
+
+		return block_size;
+	}
+
+
+	class inflate_stream
+	{
+	private:
+		z_stream	m_stream{};
+
+	public:
+		inflate_stream()
+		{
+			// Raw deflate data.
+			if (Z_OK != inflateInit2(&m_stream, -15))
+				throw std::runtime_error("Unable to initialise zlib");
+		}
+
+		~inflate_stream() { inflateEnd(&m_stream); }
+
+		inflate_stream(inflate_stream const &) = delete;
+		inflate_stream &operator=(inflate_stream const &) = delete;
+
+		void inflate_block(char const *block, std::size_t const block_size, std::vector <char> &dst);
+	};
+
+
+	void inflate_stream::inflate_block(char const *block, std::size_t const block_size, std::vector <char> &dst)
+	{
+		std::size_t const xlen(read_le <std::uint16_t>(block + 10));
+		auto const * const compressed(block + 12 + xlen);
+		auto const * const footer(block + block_size - BGZF_FOOTER_SIZE);
+		auto const crc(read_le <std::uint32_t>(footer));
+		auto const uncompressed_size(read_le <std::uint32_t>(footer + 4));
+
+		if (vcf2multialign::bgzf_reader::MAX_BLOCK_SIZE < uncompressed_size)
+			throw std::runtime_error("Invalid BGZF block size");
+
+		dst.resize(uncompressed_size);
+		if (!uncompressed_size)
+			return;
+
+		if (Z_OK != inflateReset(&m_stream))
+			throw std::runtime_error("Unable to reset the zlib stream");
+
+		m_stream.next_in = reinterpret_cast <Bytef *>(const_cast <char *>(compressed));
+		m_stream.avail_in = footer - compressed;
+		m_stream.next_out = reinterpret_cast <Bytef *>(dst.data());
+		m_stream.avail_out = uncompressed_size;
+
+		if (Z_STREAM_END != ::inflate(&m_stream, Z_FINISH) || m_stream.avail_out)
+			throw std::runtime_error("Unable to decompress a BGZF block");
+
+		if (crc != crc32(0, reinterpret_cast <Bytef const *>(dst.data()), uncompressed_size))
+			throw std::runtime_error("CRC mismatch in a BGZF block");
+	}
+}
+
+
+namespace vcf2multialign {
+
+	bgzf_reader::bgzf_reader(char const *path, std::uint16_t const thread_count):
+		m_blocks(4 * std::max(std::uint16_t(1), thread_count))
+	{
+		auto const fd(::open(path, O_RDONLY));
+		if (-1 == fd)
+			throw std::system_error(errno, std::generic_category(), std::string("Unable to open ") + path);
+
+		struct stat sb{};
+		if (-1 == ::fstat(fd, &sb))
+		{
+			auto const err(errno);
+			::close(fd);
+			throw std::system_error(err, std::generic_category(), std::string("Unable to stat ") + path);
+		}
+
+		m_compressed_size = sb.st_size;
+		if (m_compressed_size)
+		{
+			auto * const data(::mmap(nullptr, m_compressed_size, PROT_READ, MAP_PRIVATE, fd, 0));
+			if (MAP_FAILED == data)
+			{
+				auto const err(errno);
+				::close(fd);
+				throw std::system_error(err, std::generic_category(), std::string("Unable to map ") + path);
+			}
+
+			::madvise(data, m_compressed_size, MADV_SEQUENTIAL);
+			m_compressed_data = static_cast <char const *>(data);
+		}
+
+		// The mapping remains valid after closing the file.
+		::close(fd);
+
+		for (auto &blk : m_blocks)
+			blk.data.reserve(MAX_BLOCK_SIZE);
+
+		auto const worker_count(std::max(std::uint16_t(1), thread_count));
+		m_workers.reserve(worker_count);
+		for (std::uint16_t i{}; i < worker_count; ++i)
+			m_workers.emplace_back([this](){ run(); });
+	}
+
+
+	bgzf_reader::~bgzf_reader()
+	{
+		{
+			std::lock_guard const lock(m_mutex);
+			m_should_stop = true;
+		}
+
+		m_worker_cv.notify_all();
+		m_workers.clear();
+
+		if (m_compressed_data)
+			::munmap(const_cast <char *>(m_compressed_data), m_compressed_size);
+	}
+
+
+	void bgzf_reader::run()
+	{
+		inflate_stream stream;
+		while (true)
+		{
+			std::size_t offset{};
+			std::size_t block_size{};
+			block *blk{};
+
+			{
+				std::unique_lock lock(m_mutex);
+				m_worker_cv.wait(lock, [this](){
+					return m_should_stop || (
+						m_next_compressed_offset < m_compressed_size &&
+						block_status::EMPTY == m_blocks[m_next_sequence_number % m_blocks.size()].status
+					);
+				});
+
+				if (m_should_stop)
+					return;
+
+				// Determine the block size while holding the lock since we need it to find the next block.
+				offset = m_next_compressed_offset;
+				try
+				{
+					block_size = bgzf_block_size(m_compressed_data + offset, m_compressed_size - offset);
+				}
+				catch (...)
+				{
+					if (!m_exception)
+						m_exception = std::current_exception();
+					m_next_compressed_offset = m_compressed_size;
+					m_reader_cv.notify_all();
+					continue;
+				}
+
+				m_next_compressed_offset += block_size;
+				blk = &m_blocks[m_next_sequence_number % m_blocks.size()];
+				blk->sequence_number = m_next_sequence_number++;
+				blk->status = block_status::IN_PROGRESS;
+				++m_in_progress_count;
+			}
+
+			std::exception_ptr exc;
+			try
+			{
+				stream.inflate_block(m_compressed_data + offset, block_size, blk->data);
+			}
+			catch (...)
+			{
+				exc = std::current_exception();
+			}
+
+			{
+				std::lock_guard const lock(m_mutex);
+				blk->status = block_status::READY;
+				--m_in_progress_count;
+				if (exc && !m_exception)
+					m_exception = exc;
+			}
+
+			m_reader_cv.notify_all();
+		}
+	}
+
+
+	void bgzf_reader::stop_workers_and_reset(std::size_t const compressed_offset)
+	{
+		{
+			std::unique_lock lock(m_mutex);
+
+			// Prevent the workers from starting new blocks and wait for the current ones.
+			m_next_compressed_offset = m_compressed_size;
+			m_reader_cv.wait(lock, [this](){ return 0 == m_in_progress_count; });
+
+			for (auto &blk : m_blocks)
+				blk.status = block_status::EMPTY;
+
+			m_next_compressed_offset = std::min(compressed_offset, m_compressed_size);
+			m_next_sequence_number = 0;
+			m_read_sequence_number = 0;
+			m_read_offset = 0;
+		}
+
+		m_worker_cv.notify_all();
+	}
+
+
+	void bgzf_reader::seek(virtual_offset_type const offset)
+	{
+		stop_workers_and_reset(offset >> 16);
+		m_read_offset = offset & 0xFFFF;
+	}
+
+
+	void bgzf_reader::seek_to_end()
+	{
+		stop_workers_and_reset(m_compressed_size);
+	}
+
+
+	std::streamsize bgzf_reader::read(char *dst, std::streamsize const size)
+	{
+		if (size <= 0)
+			return 0;
+
+		std::streamsize retval{};
+		while (retval < size)
+		{
+			block *blk{};
+
+			{
+				std::unique_lock lock(m_mutex);
+				m_reader_cv.wait(lock, [this](){
+					auto const &blk(m_blocks[m_read_sequence_number % m_blocks.size()]);
+					return (
+						m_exception ||
+						(block_status::READY == blk.status && m_read_sequence_number == blk.sequence_number) ||
+						(m_compressed_size <= m_next_compressed_offset && m_read_sequence_number == m_next_sequence_number)
+					);
+				});
+
+				if (m_exception)
+					std::rethrow_exception(m_exception);
+
+				blk = &m_blocks[m_read_sequence_number % m_blocks.size()];
+				if (! (block_status::READY == blk->status && m_read_sequence_number == blk->sequence_number))
+					break; // End of file.
+			}
+
+			// The workers do not modify ready blocks, so the contents may be copied without holding the lock.
+			auto const &data(blk->data);
+			if (m_read_offset < data.size())
+			{
+				auto const count(std::min(std::size_t(size - retval), data.size() - m_read_offset));
+				std::copy_n(data.data() + m_read_offset, count, dst + retval);
+				m_read_offset += count;
+				retval += count;
+			}
+
+			if (data.size() <= m_read_offset)
+			{
+				{
+					std::lock_guard const lock(m_mutex);
+					blk->status = block_status::EMPTY;
+					++m_read_sequence_number;
+					m_read_offset = 0;
+				}
+
+				m_worker_cv.notify_one();
+			}
+		}
+
+		return (retval ? retval : -1);
+	}
+
+
+	std::streamsize bgzf_vcf_region_source::read(char *dst, std::streamsize const size)
+	{
+		if (!m_is_reading_header)
+			return m_reader->read(dst, size);
+
+		auto const res(m_reader->read(dst, size));
+		for (std::streamsize i{}; i < res; ++i)
+		{
+			if (m_is_at_line_start && '#' != dst[i])
+			{
+				// Found the first record; continue from the region.
+				m_is_reading_header = false;
+				if (m_has_region)
+					m_reader->seek(m_region_offset);
+				else
+					m_reader->seek_to_end();
+
+				if (i)
+					return i;
+
+				return m_reader->read(dst, size);
+			}
+
+			m_is_at_line_start = ('\n' == dst[i]);
+		}
+
+		return res;
+	}
+
+
+	bool is_bgzf_file(char const *path)
+	{
+		auto const fd(::open(path, O_RDONLY));
+		if (-1 == fd)
+			throw std::system_error(errno, std::generic_category(), std::string("Unable to open ") + path);
+
+		std::array <char, BGZF_HEADER_SIZE> buffer{};
+		auto const res(::read(fd, buffer.data(), buffer.size()));
+		::close(fd);
+
+		return (0 < res && is_bgzf_header(buffer.data(), res));
+	}
+}
@@ -9,6 +9,7 @@
 #include <range/v3/view/subrange.hpp>
 #include <vcf2multialign/find_cut_positions.hh>
 #include <vcf2multialign/pbwt.hh>
+#include <vcf2multialign/sparse_pbwt.hh>
 #include <vcf2multialign/variant_graph.hh>
 #include <vector>
 
@@ -24,6 +25,12 @@ namespace {
 		v2m::variant_graph::ploidy_type
 	>										pbwt_context_type;
 
+	typedef v2m::sparse_pbwt_context <
+		v2m::variant_graph::sample_type,
+		v2m::variant_graph::edge_type,
+		v2m::variant_graph::ploidy_type
+	>										sparse_pbwt_context_type;
+
 
 	// We calculate positions by edge numbers due to the fact that a path using a given edge is a binary property
 	// and hence we would like to maintain the pBWT divergence values for them.
@@ -68,13 +75,13 @@ namespace vcf2multialign {
 
 	// Find cut positions in the graph minimising the block height.
 	// The algorithm uses pBWT to determine the number of equivalence classes
-	// of the sequence segments between candidate cut positions. To use the
-	// binary alphabet version of pBWT, we consider each ALT edge separately
-	// instead of each node. A node is a candidate cut position if it is an
-	// endpoint of a bridge.
+	// of the sequence segments between candidate cut positions. The divergence
+	// values are ALT edge indices, i.e. the paths are compared as if each ALT edge
+	// were a binary column, but the edges of a node are handled with one pass.
+	// A node is a candidate cut position if it is an endpoint of a bridge.
 	//
 	// The algorithm works as follows. In addition to the a and d arrays of the
-	// pBWT, we maintain a map of divergence value counts.
+	// pBWT, we maintain the counts of the divergence values.
 	//	– When we arrive at a node, we check if it is a candidate cut position.
 	//		– If this is the case, we calculate the scores of the subgraphs ending at
 	//		  said position and pick the best one.
@@ -89,8 +96,9 @@ namespace vcf2multialign {
 	//		– Finally, we consider the case where the current subgraph extends beyond the
 	//		  leftmost divergence value. (This is particularly helpful when the aligned length
 	//		  of the current subgraph is less than min_length.)
-	//	– Before leaving the node, we update the pBWT values for each ALT edge separately.
-	cut_position_score_type find_initial_cut_positions_lambda_min(
+	//	– Before leaving the node, we update the pBWT values with its ALT edges.
+	template <typename t_pbwt_context>
+	cut_position_score_type find_initial_cut_positions_lambda_min_(
 		variant_graph const &graph,
 		variant_graph::edge_type const min_distance,
 		std::vector <variant_graph::position_type> &out_cut_positions,
@@ -106,7 +114,7 @@ namespace vcf2multialign {
 		variant_graph::edge_type edge_idx{};
 		variant_graph::edge_type prev_cut_pos_id{variant_graph::EDGE_MAX};
 
-		pbwt_context_type pbwt_ctx(path_count);
+		t_pbwt_context pbwt_ctx(path_count);
 
 		cut_position_vector_ cut_positions;
 		cut_positions.emplace_back(0, variant_graph::EDGE_MAX, 0, 0);
@@ -137,6 +145,10 @@ namespace vcf2multialign {
 					auto eq_class_count(pbwt_ctx.divergence_value_counts.rbegin()->second);
 					for (auto const &[div_edge_idx, div_count] : divergence_value_counts_reversed())
 					{
+						// sparse_pbwt_context may retain values that no longer occur.
+						if (!div_count)
+							continue;
+
 						// Find the leftmost cut position not less than div_edge_idx.
 						// We only need to check said position once b.c. the number of equivalence classes,
 						// as determined from the divergence values, incereases as we iterate over said values.
@@ -167,15 +179,17 @@ namespace vcf2multialign {
 			}
 
 			// Handle the edges.
-			for (auto const dst_node : walker.alt_edge_targets())
+			if (auto const alt_edge_count(walker.alt_edge_count()); alt_edge_count)
 			{
 				pbwt_ctx.swap_vectors();
-				pbwt_ctx.update_divergence(graph.paths_by_edge_and_chrom_copy.column(edge_idx), edge_idx);
-				++edge_idx;
-				rightmost_seen_alt_edge_target = std::max(rightmost_seen_alt_edge_target, dst_node);
+				pbwt_ctx.update_divergence(graph.paths_by_edge_and_chrom_copy, edge_idx, edge_idx + alt_edge_count);
+				edge_idx += alt_edge_count;
+
+				for (auto const dst_node : walker.alt_edge_targets())
+					rightmost_seen_alt_edge_target = std::max(rightmost_seen_alt_edge_target, dst_node);
 			}
 
-			delegate.handled_node(walker.node());
+			delegate.handled_node(walker.node(), pbwt_ctx.statistics);
 		}
 
 		// Copy the solution if possible.
@@ -209,4 +223,24 @@ namespace vcf2multialign {
 			return retval;
 		}
 	}
+
+
+	cut_position_score_type find_initial_cut_positions_lambda_min(
+		variant_graph const &graph,
+		variant_graph::edge_type const min_distance,
+		std::vector <variant_graph::position_type> &out_cut_positions,
+		process_graph_delegate &delegate,
+		pbwt_implementation const pbwt_impl
+	)
+	{
+		switch (pbwt_impl)
+		{
+			case pbwt_implementation::dense:
+				return find_initial_cut_positions_lambda_min_ <pbwt_context_type>(graph, min_distance, out_cut_positions, delegate);
+			case pbwt_implementation::sparse:
+				return find_initial_cut_positions_lambda_min_ <sparse_pbwt_context_type>(graph, min_distance, out_cut_positions, delegate);
+		}
+
+		return CUT_POSITION_SCORE_MAX;
+	}
 }
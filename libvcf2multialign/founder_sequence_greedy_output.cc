@@ -19,10 +19,14 @@
 #include <range/v3/view/take.hpp>
 #include <range/v3/view/zip.hpp>
 #include <sstream>
+#include <vcf2multialign/a2m_layout.hh>
 #include <vcf2multialign/find_cut_positions.hh>
+#include <vcf2multialign/mapped_file.hh>
 #include <vcf2multialign/pbwt.hh>
 #include <vcf2multialign/output.hh>
+#include <vcf2multialign/parallel_for.hh>
 #include <vcf2multialign/sequence_writer.hh>
+#include <vcf2multialign/sparse_pbwt.hh>
 #include <vcf2multialign/variant_graph.hh>
 #include <utility>								// std::swap
 #include <vector>
@@ -41,9 +45,17 @@ namespace {
 	typedef v2m::pbwt_context <
 		v2m::variant_graph::sample_type,
 		v2m::variant_graph::edge_type,
-		ploidy_type
+		ploidy_type,
+		false
 	>															pbwt_context_type;
 
+	typedef v2m::sparse_pbwt_context <
+		v2m::variant_graph::sample_type,
+		v2m::variant_graph::edge_type,
+		ploidy_type,
+		false
+	>															sparse_pbwt_context_type;
+
 
 	struct joined_path_eq_class
 	{
@@ -141,7 +153,7 @@ namespace vcf2multialign {
 		variant_graph::position_type const min_dist
 	)
 	{
-		auto const score(find_initial_cut_positions_lambda_min(graph, min_dist, m_cut_positions.cut_positions, *m_delegate));
+		auto const score(find_initial_cut_positions_lambda_min(graph, min_dist, m_cut_positions.cut_positions, *m_delegate, m_pbwt_implementation));
 		if (CUT_POSITION_SCORE_MAX == score)
 			return false;
 
@@ -152,6 +164,21 @@ namespace vcf2multialign {
 
 
 	bool founder_sequence_greedy_output::find_matchings(variant_graph const &graph, ploidy_type const founder_count)
+	{
+		switch (m_pbwt_implementation)
+		{
+			case pbwt_implementation::dense:
+				return find_matchings_ <pbwt_context_type>(graph, founder_count);
+			case pbwt_implementation::sparse:
+				return find_matchings_ <sparse_pbwt_context_type>(graph, founder_count);
+		}
+
+		return false;
+	}
+
+
+	template <typename t_pbwt_context>
+	bool founder_sequence_greedy_output::find_matchings_(variant_graph const &graph, ploidy_type const founder_count)
 	{
 		// We re-calculate the pBWT in order to determine the equivalence class representatives
 		// of paths between adjacent cut positions. When we have a pair of such blocks (and lists
@@ -194,7 +221,7 @@ namespace vcf2multialign {
 		auto cut_pos_it(m_cut_positions.cut_positions.begin());
 		++cut_pos_it; // Node zero.
 
-		pbwt_context_type pbwt_ctx(graph.total_chromosome_copies());
+		t_pbwt_context pbwt_ctx(graph.total_chromosome_copies());
 
 		// Handle the rest.
 		variant_graph::position_type cut_pos_idx{};
@@ -209,6 +236,7 @@ namespace vcf2multialign {
 			if (node == *cut_pos_it)
 			{
 				bool const is_final_node(graph.node_count() == 1 + node);
+				pbwt_ctx.fill_vectors();
 
 				{
 					using std::swap;
@@ -219,7 +247,7 @@ namespace vcf2multialign {
 					lhs_first_path_eq_class = rhs_first_path_eq_class;
 
 					rhs_distinct_eq_classes = 0;
-					rhs_first_path_eq_class = pbwt_ctx.permutation.front();
+					rhs_first_path_eq_class = pbwt_ctx.first_index();
 				}
 
 				{
@@ -458,22 +486,26 @@ namespace vcf2multialign {
 			}
 
 			// Handle the edges.
-			for (auto const dst_node : walker.alt_edge_targets())
+			if (auto const alt_edge_count(walker.alt_edge_count()); alt_edge_count)
 			{
+				auto const &paths(graph.paths_by_edge_and_chrom_copy);
 				pbwt_ctx.swap_vectors();
-				pbwt_ctx.update_divergence(graph.paths_by_edge_and_chrom_copy.column(edge_idx), edge_idx);
+				pbwt_ctx.update_divergence(paths, edge_idx, edge_idx + alt_edge_count);
 
-				rhs_first_path_is_ref &= (0 == graph.paths_by_edge_and_chrom_copy(pbwt_ctx.permutation.front(), edge_idx));
+				// Handling an edge as a binary column would move a path that does not use it first, if there is one.
+				for (auto const alt_edge_idx : rsv::iota(edge_idx, edge_idx + alt_edge_count))
+					rhs_first_path_is_ref &= (paths.one_count(alt_edge_idx) < paths.number_of_rows());
 
-				++edge_idx;
+				edge_idx += alt_edge_count;
 			}
 
-			m_delegate->handled_node(node);
+			m_delegate->handled_node(node, pbwt_ctx.statistics);
 		}
 
 		// Handle the trivial case.
 		if (1 == cut_pos_idx)
 		{
+			pbwt_ctx.fill_vectors();
 			ploidy_type rep{PLOIDY_MAX};
 			joined_path_eq_classes.clear();
 			for (auto const [aa, dd] : rsv::zip(pbwt_ctx.permutation, pbwt_ctx.divergence))
@@ -550,6 +582,68 @@ namespace vcf2multialign {
 	}
 
 
+	void founder_sequence_greedy_output::output_a2m_to_file(sequence_type const &ref_seq, variant_graph const &graph, char const * const dst_name)
+	{
+		// Unaligned sequences have different lengths.
+		if (m_should_output_unaligned)
+		{
+			output::output_a2m_to_file(ref_seq, graph, dst_name);
+			return;
+		}
+
+		typedef variant_graph::ploidy_type	ploidy_type;
+
+		// Since the length of every aligned sequence is known, we can determine the position of each
+		// sequence in advance and write the sequences to a memory-mapped file in parallel.
+		ploidy_type const col_count(m_assigned_samples.number_of_columns());
+		a2m_layout layout(graph.aligned_positions.back());
+
+		if (m_should_output_reference)
+		{
+			// FIXME: Use std::format.
+			std::stringstream fasta_identifier;
+			if (m_chromosome_id)
+				fasta_identifier << m_chromosome_id << '\t';
+			fasta_identifier << "REF";
+			layout.add_record(fasta_identifier.str());
+		}
+
+		for (auto const col_idx : rsv::iota(ploidy_type(0), col_count))
+		{
+			// FIXME: Use std::format.
+			std::stringstream fasta_identifier;
+			if (m_chromosome_id)
+				fasta_identifier << m_chromosome_id << '\t';
+			fasta_identifier << (1 + col_idx);
+			layout.add_record(fasta_identifier.str());
+		}
+
+		mapped_output_file dst(dst_name, layout.size());
+		auto * const data(dst.data());
+		layout.write_headers(data);
+
+		parallel_for(layout.record_count(), m_thread_count, [this, &ref_seq, &graph, &layout, data](std::size_t const record_idx){
+			auto * const seq_dst(data + layout.sequence_offset(record_idx));
+			if (m_should_output_reference)
+			{
+				if (0 == record_idx)
+				{
+					reference_sequence_writing_delegate delegate;
+					output_sequence(ref_seq, graph, seq_dst, delegate);
+					return;
+				}
+			}
+
+			ploidy_type const col_idx(record_idx - m_should_output_reference);
+			founder_sequence_writing_delegate delegate(m_assigned_samples.const_column(col_idx), m_cut_positions.cut_positions);
+			output_sequence(ref_seq, graph, seq_dst, delegate);
+		});
+
+		// Count the reference even if it was omitted, as in output_a2m().
+		m_delegate->handled_sequences(1 + col_count);
+	}
+
+
 	void founder_sequence_greedy_output::output_separate(sequence_type const &ref_seq, variant_graph const &graph, bool const should_include_fasta_header)
 	{
 		typedef variant_graph::ploidy_type	ploidy_type;
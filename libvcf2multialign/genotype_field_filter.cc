@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <fstream>
+#include <libbio/assert.hh>
+#include <stdexcept>
+#include <vcf2multialign/genotype_field_filter.hh>
+
+
+namespace {
+
+	constexpr static inline std::size_t const INFO_FIELD_INDEX{7};
+
+
+	inline bool is_field_separator(char const cc) { return '\t' == cc || '\n' == cc; }
+	inline bool is_subfield_separator(char const cc) { return '\t' == cc || '\n' == cc || ':' == cc; }
+}
+
+
+namespace vcf2multialign {
+
+	void genotype_record_queue::push(std::string &sample_columns, bool const has_genotypes)
+	{
+		auto &rec(m_records.emplace_back());
+		using std::swap;
+		swap(rec.sample_columns, sample_columns);
+		rec.has_genotypes = has_genotypes;
+
+		if (!m_buffers.empty())
+		{
+			swap(sample_columns, m_buffers.back());
+			m_buffers.pop_back();
+		}
+	}
+
+
+	void genotype_record_queue::pop(record &dst)
+	{
+		libbio_assert(!m_records.empty());
+		auto &rec(m_records.front());
+		using std::swap;
+		swap(dst.sample_columns, rec.sample_columns);
+		dst.has_genotypes = rec.has_genotypes;
+
+		rec.sample_columns.clear();
+		m_buffers.emplace_back(std::move(rec.sample_columns));
+		m_records.pop_front();
+	}
+
+
+	void genotype_field_filter::handle_format_end()
+	{
+		std::string_view format(m_format);
+		std::size_t idx{};
+		while (true)
+		{
+			auto const pos(format.find(':'));
+			if (format.substr(0, pos) == "GT")
+			{
+				m_gt_idx = idx;
+				m_subfield_idx = 0;
+				m_did_output_gt = false;
+				m_has_genotypes = true;
+				m_output += "GT";
+				m_state = (format.size() == 2 && 0 == idx ? state::GT_ONLY_SAMPLES : state::SAMPLE);
+				return;
+			}
+
+			if (std::string_view::npos == pos)
+				break;
+
+			format.remove_prefix(1 + pos);
+			++idx;
+		}
+
+		// No GT, pass the rest of the record through.
+		m_output += m_format;
+		m_state = state::COPY_LINE;
+	}
+
+
+	void genotype_field_filter::finish_record()
+	{
+		if (m_records && m_is_record)
+		{
+			if (m_is_in_samples)
+				m_sample_columns.append(m_output, m_sample_columns_start);
+			m_records->push(m_sample_columns, m_has_genotypes);
+		}
+
+		m_sample_columns.clear();
+		m_is_record = false;
+		m_has_genotypes = false;
+		m_is_in_samples = false;
+	}
+
+
+	void genotype_field_filter::filter(std::string_view const input)
+	{
+		if (input.empty())
+			return;
+
+		// Remove the carriage returns of CRLF line endings. If the input ends with one, we need the next
+		// character to determine whether it should be kept. (A carriage return at the end of the file is removed.)
+		if (m_has_pending_cr)
+		{
+			m_has_pending_cr = false;
+			if ('\n' != input.front())
+				filter_lines("\r");
+		}
+
+		if (std::string_view::npos == input.find('\r'))
+		{
+			filter_lines(input);
+			return;
+		}
+
+		m_lf_input.clear();
+		for (std::size_t ii{}; ii < input.size(); ++ii)
+		{
+			auto const cc(input[ii]);
+			if ('\r' == cc)
+			{
+				if (ii + 1 == input.size())
+				{
+					m_has_pending_cr = true;
+					break;
+				}
+
+				if ('\n' == input[ii + 1])
+					continue;
+			}
+
+			m_lf_input.push_back(cc);
+		}
+
+		filter_lines(m_lf_input);
+	}
+
+
+	void genotype_field_filter::filter_lines(std::string_view const input)
+	{
+		auto it(input.begin());
+		auto const end(input.end());
+		m_sample_columns_start = m_output.size();
+		while (it != end)
+		{
+			switch (m_state)
+			{
+				case state::LINE_START:
+				{
+					m_field_idx = 0;
+					m_is_record = ('#' != *it && '\n' != *it);
+					m_state = ('#' == *it ? state::COPY_LINE : state::COPY_FIELD);
+					break;
+				}
+
+				case state::COPY_LINE:
+				{
+					auto const nl(std::find(it, end, '\n'));
+					if (end == nl)
+					{
+						m_output.append(it, end);
+						it = end;
+						break;
+					}
+
+					finish_record();
+					m_output.append(it, nl + 1);
+					it = nl + 1;
+					m_state = state::LINE_START;
+					break;
+				}
+
+				case state::COPY_FIELD:
+				{
+					auto const sep(std::find_if(it, end, is_field_separator));
+					m_output.append(it, sep);
+					it = sep;
+					if (end == it)
+						break;
+
+					if ('\n' == *it)
+						finish_record();
+
+					m_output.push_back(*it);
+					if ('\n' == *it)
+						m_state = state::LINE_START;
+					else if (INFO_FIELD_INDEX == ++m_field_idx)
+					{
+						m_output.push_back('.');
+						m_state = state::SKIP_INFO;
+					}
+					++it;
+					break;
+				}
+
+				case state::SKIP_INFO:
+				{
+					it = std::find_if(it, end, is_field_separator);
+					if (end == it)
+						break;
+
+					if ('\n' == *it)
+						finish_record();
+
+					m_output.push_back(*it);
+					if ('\n' == *it)
+						m_state = state::LINE_START; // No genotypes.
+					else
+					{
+						m_format.clear();
+						m_state = state::FORMAT;
+					}
+					++it;
+					break;
+				}
+
+				case state::FORMAT:
+				{
+					auto const sep(std::find_if(it, end, is_field_separator));
+					m_format.append(it, sep);
+					it = sep;
+					if (end == it)
+						break;
+
+					handle_format_end();
+					if ('\n' == *it)
+						finish_record();
+
+					m_output.push_back(*it);
+					if ('\n' == *it)
+						m_state = state::LINE_START;
+					else if (state::SAMPLE == m_state || state::GT_ONLY_SAMPLES == m_state)
+					{
+						m_is_in_samples = true;
+						m_sample_columns_start = m_output.size();
+					}
+					++it;
+					break;
+				}
+
+				case state::GT_ONLY_SAMPLES:
+				{
+					auto const nl_pos(input.find('\n', it - input.begin()));
+					if (std::string_view::npos == nl_pos)
+					{
+						m_output.append(it, end);
+						it = end;
+						break;
+					}
+
+					auto const nl(input.begin() + nl_pos);
+					m_output.append(it, nl);
+					finish_record();
+					m_output.push_back('\n');
+					it = nl + 1;
+					m_state = state::LINE_START;
+					break;
+				}
+
+				case state::SAMPLE:
+				{
+					// Copy the GT subfield.
+					auto const sep(std::find_if(it, end, is_subfield_separator));
+					if (m_subfield_idx == m_gt_idx && it != sep)
+					{
+						m_output.append(it, sep);
+						m_did_output_gt = true;
+					}
+					it = sep;
+					if (end == it)
+						break;
+
+					if (':' == *it)
+						++m_subfield_idx;
+					else
+					{
+						if (!m_did_output_gt)
+							m_output.push_back('.');
+
+						if ('\n' == *it)
+							finish_record();
+
+						m_output.push_back(*it);
+						m_subfield_idx = 0;
+						m_did_output_gt = false;
+						if ('\n' == *it)
+							m_state = state::LINE_START;
+					}
+					++it;
+					break;
+				}
+			}
+		}
+
+		// The output may be cleared before the next call.
+		if (m_is_in_samples)
+			m_sample_columns.append(m_output, m_sample_columns_start);
+	}
+
+
+	bool vcf_header_has_non_genotype_fields(char const *path)
+	{
+		std::ifstream stream(path);
+		if (!stream)
+			throw std::runtime_error(std::string("Unable to open ") + path);
+
+		std::string line;
+		while (std::getline(stream, line) && line.starts_with("##"))
+		{
+			if (line.starts_with("##INFO="))
+				return true;
+
+			if (line.starts_with("##FORMAT=") && !line.starts_with("##FORMAT=<ID=GT,"))
+				return true;
+		}
+
+		return false;
+	}
+}
@@ -0,0 +1,730 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <libbio/assert.hh>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vcf2multialign/graph_file.hh>
+#include <vcf2multialign/parallel_for.hh>
+#include <vector>
+#include <zlib.h>
+
+
+namespace vcf2multialign {
+	namespace {
+
+		enum array_index : std::uint8_t
+		{
+			REFERENCE_POSITION_WORDS = 0,
+			ALIGNED_POSITION_WORDS,
+			ALT_EDGE_TARGET_WORDS,
+			ALT_EDGE_COUNT_CSUM_WORDS,
+			ALT_EDGE_LABEL_CHARACTERS,
+			ALT_EDGE_LABEL_OFFSETS,
+			PATH_DENSE_WORDS,
+			PATH_SPARSE_ROWS,
+			PATH_COLUMN_OFFSETS,
+			PATH_ONE_COUNTS,
+			PLOIDY_CSUM,
+			SAMPLE_NAME_CHARACTERS,
+			SAMPLE_NAME_OFFSETS,
+			ARRAY_COUNT
+		};
+
+		// The packed vectors are stored in the order of their word arrays.
+		constexpr inline std::size_t const PACKED_VECTOR_COUNT{4};
+
+		constexpr inline std::array <std::size_t, ARRAY_COUNT> const ELEMENT_SIZES{
+			sizeof(packed_vector::word_type),
+			sizeof(packed_vector::word_type),
+			sizeof(packed_vector::word_type),
+			sizeof(packed_vector::word_type),
+			sizeof(char),
+			sizeof(packed_label_vector::offset_type),
+			sizeof(path_matrix::word_type),
+			sizeof(path_matrix::row_type),
+			sizeof(path_matrix::offset_type),
+			sizeof(path_matrix::row_type),
+			sizeof(variant_graph::ploidy_type),
+			sizeof(char),
+			sizeof(packed_label_vector::offset_type)
+		};
+
+		constexpr inline std::array <char, 8> const MAGIC{'V', '2', 'M', 'G', 'R', 'A', 'P', 'H'};
+		constexpr inline std::array <char, 8> const COMPRESSED_MAGIC{'V', '2', 'M', 'G', 'R', 'A', 'P', 'Z'};
+		constexpr inline std::array <char, 8> const CHUNKED_MAGIC{'V', '2', 'M', 'G', 'R', 'A', 'P', 'C'};
+		constexpr inline std::uint32_t const BYTE_ORDER_MARK{0x01020304};
+
+
+		struct array_entry
+		{
+			std::uint64_t	offset{};	// From the beginning of the file.
+			std::uint64_t	count{};	// Number of elements.
+		};
+
+
+		struct file_header
+		{
+			std::array <char, 8>								magic{};
+			std::uint32_t										version{};
+			std::uint32_t										byte_order_mark{};
+			std::array <std::uint64_t, PACKED_VECTOR_COUNT>		packed_vector_sizes{};
+			std::array <std::uint8_t, PACKED_VECTOR_COUNT>		packed_vector_widths{};
+			std::uint32_t										path_row_count{};
+			std::array <array_entry, ARRAY_COUNT>				arrays{};
+		};
+
+		static_assert(std::is_trivially_copyable_v <file_header>);
+		static_assert(std::has_unique_object_representations_v <file_header>); // No padding.
+
+
+		// Followed by the file offsets of the compressed blocks and the end of the last block,
+		// and then the blocks.
+		struct compressed_file_header
+		{
+			std::array <char, 8>	magic{};
+			std::uint32_t			version{};
+			std::uint32_t			byte_order_mark{};
+			std::uint64_t			contents_size{};	// Uncompressed.
+			std::uint64_t			block_size{};		// Uncompressed.
+			std::uint64_t			block_count{};
+		};
+
+		static_assert(std::is_trivially_copyable_v <compressed_file_header>);
+		static_assert(std::has_unique_object_representations_v <compressed_file_header>);
+
+
+		// Padded to GRAPH_FILE_ALIGNMENT bytes and followed by the chunks.
+		struct chunked_file_header
+		{
+			std::array <char, 8>	magic{};
+			std::uint32_t			version{};
+			std::uint32_t			byte_order_mark{};
+		};
+
+		static_assert(std::is_trivially_copyable_v <chunked_file_header>);
+		static_assert(std::has_unique_object_representations_v <chunked_file_header>);
+
+
+		// At the end of the file, preceded by the offsets of the chunks and the end of the last chunk.
+		// The magic is repeated so that a file that was not closed properly may be detected.
+		struct chunked_file_footer
+		{
+			std::uint64_t			chunk_count{};
+			std::uint64_t			table_offset{};
+			std::array <char, 8>	magic{};
+		};
+
+		static_assert(std::is_trivially_copyable_v <chunked_file_footer>);
+		static_assert(std::has_unique_object_representations_v <chunked_file_footer>);
+
+
+		constexpr std::size_t aligned(std::size_t const pos)
+		{
+			return (pos + GRAPH_FILE_ALIGNMENT - 1) / GRAPH_FILE_ALIGNMENT * GRAPH_FILE_ALIGNMENT;
+		}
+
+
+		template <typename t_header = file_header>
+		t_header read_header(char const *data)
+		{
+			// The mapping is page-aligned but memcpy avoids relying on it here.
+			t_header retval;
+			std::memcpy(&retval, data, sizeof(t_header));
+			return retval;
+		}
+
+
+		template <typename t_value>
+		std::span <t_value const> get_array(char const *data, file_header const &header, array_index const idx)
+		{
+			auto const &entry(header.arrays[idx]);
+			return {reinterpret_cast <t_value const *>(data + entry.offset), entry.count};
+		}
+
+
+		template <typename t_header, typename t_fail>
+		void check_version(t_header const &header, t_fail &&fail)
+		{
+			if (BYTE_ORDER_MARK != header.byte_order_mark)
+				fail("Variant graph written on a machine with a different byte order (the portable Cereal format may be used instead)");
+			if (GRAPH_FILE_VERSION != header.version)
+				fail("Unsupported variant graph format version");
+		}
+
+
+		// Check the header and the array bounds of a native image.
+		template <typename t_fail>
+		void check_contents(char const *data, std::size_t const size, t_fail &&fail)
+		{
+			if (size < sizeof(file_header))
+				fail("Truncated variant graph header");
+
+			auto const header(read_header(data));
+			if (MAGIC != header.magic)
+				fail("Unrecognised variant graph format");
+			check_version(header, fail);
+
+			for (std::size_t i{}; i < ARRAY_COUNT; ++i)
+			{
+				auto const &entry(header.arrays[i]);
+				if (entry.offset % GRAPH_FILE_ALIGNMENT)
+					fail("Misaligned array");
+				if (size < entry.offset || (size - entry.offset) / ELEMENT_SIZES[i] < entry.count)
+					fail("Truncated array");
+			}
+
+			for (std::size_t i{}; i < PACKED_VECTOR_COUNT; ++i)
+			{
+				auto const width(header.packed_vector_widths[i]);
+				if (! (1 <= width && width <= packed_vector::WORD_BITS))
+					fail("Invalid packed vector width");
+				if (packed_vector::words_needed(header.packed_vector_sizes[i], width) != header.arrays[REFERENCE_POSITION_WORDS + i].count)
+					fail("Invalid packed vector size");
+			}
+
+			auto const check_offsets([&](array_index const offsets_idx, array_index const characters_idx){
+				auto const offsets(get_array <packed_label_vector::offset_type>(data, header, offsets_idx));
+				if (offsets.empty() || offsets.back() != header.arrays[characters_idx].count || !std::is_sorted(offsets.begin(), offsets.end()))
+					fail("Invalid string offsets");
+			});
+
+			check_offsets(ALT_EDGE_LABEL_OFFSETS, ALT_EDGE_LABEL_CHARACTERS);
+			check_offsets(SAMPLE_NAME_OFFSETS, SAMPLE_NAME_CHARACTERS);
+
+			if (header.arrays[PATH_COLUMN_OFFSETS].count != header.arrays[PATH_ONE_COUNTS].count)
+				fail("Invalid path matrix");
+
+			// The dense and the sparse columns are stored one after another in separate arrays,
+			// so the column offsets of each kind need to be non-decreasing and within the array.
+			{
+				auto const row_count(header.path_row_count);
+				auto const column_offsets(get_array <path_matrix::offset_type>(data, header, PATH_COLUMN_OFFSETS));
+				auto const one_counts(get_array <path_matrix::row_type>(data, header, PATH_ONE_COUNTS));
+				path_matrix const paths(row_count); // For the dense column limit.
+				auto const words_per_column(paths.words_per_column());
+				auto const sparse_column_limit(paths.sparse_column_limit());
+				std::uint64_t dense_end{};
+				std::uint64_t sparse_end{};
+				for (std::size_t i{}; i < column_offsets.size(); ++i)
+				{
+					auto const offset(column_offsets[i]);
+					auto const one_count(one_counts[i]);
+					if (row_count < one_count)
+						fail("Invalid path matrix");
+
+					auto const is_dense(sparse_column_limit < one_count);
+					auto &end(is_dense ? dense_end : sparse_end);
+					auto const array_size(header.arrays[is_dense ? PATH_DENSE_WORDS : PATH_SPARSE_ROWS].count);
+					auto const column_size(is_dense ? words_per_column : one_count);
+					if (offset < end || array_size < offset || array_size - offset < column_size)
+						fail("Invalid path matrix column offsets");
+					end = offset + column_size;
+				}
+			}
+		}
+
+
+		// Replace the arrays of the graph with ones that refer to a native image.
+		void get_graph_arrays(char const *data, variant_graph &graph)
+		{
+			libbio_assert(data);
+			auto const header(read_header(data));
+
+			std::array <packed_vector *, PACKED_VECTOR_COUNT> const packed_vectors{
+				&graph.reference_positions,
+				&graph.aligned_positions,
+				&graph.alt_edge_targets,
+				&graph.alt_edge_count_csum
+			};
+
+			for (std::size_t i{}; i < PACKED_VECTOR_COUNT; ++i)
+			{
+				*packed_vectors[i] = packed_vector(
+					packed_vector::word_array(get_array <packed_vector::word_type>(data, header, array_index(REFERENCE_POSITION_WORDS + i))),
+					header.packed_vector_sizes[i],
+					header.packed_vector_widths[i]
+				);
+			}
+
+			graph.alt_edge_labels = packed_label_vector(
+				packed_label_vector::character_vector(get_array <char>(data, header, ALT_EDGE_LABEL_CHARACTERS)),
+				packed_label_vector::offset_vector(get_array <packed_label_vector::offset_type>(data, header, ALT_EDGE_LABEL_OFFSETS))
+			);
+
+			graph.paths_by_edge_and_chrom_copy = path_matrix(
+				header.path_row_count,
+				path_matrix::word_array(get_array <path_matrix::word_type>(data, header, PATH_DENSE_WORDS)),
+				path_matrix::row_array(get_array <path_matrix::row_type>(data, header, PATH_SPARSE_ROWS)),
+				path_matrix::offset_array(get_array <path_matrix::offset_type>(data, header, PATH_COLUMN_OFFSETS)),
+				path_matrix::row_array(get_array <path_matrix::row_type>(data, header, PATH_ONE_COUNTS))
+			);
+		}
+
+
+		// Copy the sample names and the ploidies from a native image.
+		void get_graph_samples(char const *data, variant_graph &graph)
+		{
+			libbio_assert(data);
+			auto const header(read_header(data));
+
+			{
+				auto const ploidy_csum(get_array <variant_graph::ploidy_type>(data, header, PLOIDY_CSUM));
+				graph.ploidy_csum.assign(ploidy_csum.begin(), ploidy_csum.end());
+			}
+
+			{
+				packed_label_vector const sample_names(
+					packed_label_vector::character_vector(get_array <char>(data, header, SAMPLE_NAME_CHARACTERS)),
+					packed_label_vector::offset_vector(get_array <packed_label_vector::offset_type>(data, header, SAMPLE_NAME_OFFSETS))
+				);
+
+				graph.sample_names.clear();
+				graph.sample_names.reserve(sample_names.size());
+				for (std::size_t i{}; i < sample_names.size(); ++i)
+					graph.sample_names.emplace_back(sample_names[i]);
+			}
+		}
+
+
+		std::array <char, 8> read_magic(char const *path)
+		{
+			auto const fd(::open(path, O_RDONLY));
+			if (-1 == fd)
+				throw std::system_error(errno, std::generic_category(), std::string("Unable to open ") + path);
+
+			std::array <char, 8> buffer{};
+			auto const res(::read(fd, buffer.data(), buffer.size()));
+			::close(fd);
+
+			if (! (0 < res && std::size_t(res) == buffer.size()))
+				return {};
+			return buffer;
+		}
+
+
+		// Determine the offsets of the arrays. Returns the file size.
+		std::size_t make_layout(
+			variant_graph const &graph,
+			packed_label_vector const &sample_names,
+			file_header &header,
+			std::array <std::span <std::byte const>, ARRAY_COUNT> &contents
+		)
+		{
+			header.magic = MAGIC;
+			header.version = GRAPH_FILE_VERSION;
+			header.byte_order_mark = BYTE_ORDER_MARK;
+
+			std::array <packed_vector const *, PACKED_VECTOR_COUNT> const packed_vectors{
+				&graph.reference_positions,
+				&graph.aligned_positions,
+				&graph.alt_edge_targets,
+				&graph.alt_edge_count_csum
+			};
+
+			for (std::size_t i{}; i < PACKED_VECTOR_COUNT; ++i)
+			{
+				header.packed_vector_sizes[i] = packed_vectors[i]->size();
+				header.packed_vector_widths[i] = packed_vectors[i]->width();
+			}
+
+			auto const &paths(graph.paths_by_edge_and_chrom_copy);
+			header.path_row_count = paths.number_of_rows();
+
+			std::size_t pos(aligned(sizeof(file_header)));
+			auto const add([&](array_index const idx, auto const values){
+				libbio_assert_eq(ELEMENT_SIZES[idx], sizeof(typename decltype(values)::value_type));
+				header.arrays[idx] = {pos, values.size()};
+				contents[idx] = std::as_bytes(values);
+				pos = aligned(pos + contents[idx].size());
+			});
+
+			for (std::size_t i{}; i < PACKED_VECTOR_COUNT; ++i)
+				add(array_index(REFERENCE_POSITION_WORDS + i), packed_vectors[i]->words().values());
+
+			add(ALT_EDGE_LABEL_CHARACTERS, graph.alt_edge_labels.characters().values());
+			add(ALT_EDGE_LABEL_OFFSETS, graph.alt_edge_labels.offsets().values());
+			add(PATH_DENSE_WORDS, paths.dense_words().values());
+			add(PATH_SPARSE_ROWS, paths.sparse_rows().values());
+			add(PATH_COLUMN_OFFSETS, paths.column_offsets().values());
+			add(PATH_ONE_COUNTS, paths.one_counts().values());
+			add(PLOIDY_CSUM, std::span(graph.ploidy_csum));
+			add(SAMPLE_NAME_CHARACTERS, sample_names.characters().values());
+			add(SAMPLE_NAME_OFFSETS, sample_names.offsets().values());
+
+			return pos;
+		}
+
+
+		// dst needs to have been zero-filled.
+		void write_contents(file_header const &header, std::array <std::span <std::byte const>, ARRAY_COUNT> const &contents, char *dst)
+		{
+			std::memcpy(dst, &header, sizeof(file_header));
+			for (std::size_t i{}; i < ARRAY_COUNT; ++i)
+			{
+				if (!contents[i].empty())
+					std::memcpy(dst + header.arrays[i].offset, contents[i].data(), contents[i].size());
+			}
+		}
+	}
+
+
+	bool is_graph_file(char const *path)
+	{
+		auto const magic(read_magic(path));
+		return (MAGIC == magic || COMPRESSED_MAGIC == magic);
+	}
+
+
+	bool is_chunked_graph_file(char const *path)
+	{
+		return CHUNKED_MAGIC == read_magic(path);
+	}
+
+
+	void write_graph_file(variant_graph const &graph, char const *path, graph_file_format const format, std::uint16_t const thread_count)
+	{
+		// Store the sample names in one buffer, too.
+		packed_label_vector sample_names;
+		sample_names.assign(graph.sample_names);
+
+		file_header header;
+		std::array <std::span <std::byte const>, ARRAY_COUNT> contents;
+		auto const size(make_layout(graph, sample_names, header, contents));
+
+		if (graph_file_format::native == format)
+		{
+			mapped_output_file file(path, size);
+			write_contents(header, contents, file.data());
+			return;
+		}
+
+		std::vector <char> buffer(size);
+		write_contents(header, contents, buffer.data());
+
+		// Compress the blocks.
+		auto const block_size(GRAPH_FILE_COMPRESSION_BLOCK_SIZE);
+		auto const block_count((size + block_size - 1) / block_size);
+		std::vector <std::vector <char>> blocks(block_count);
+		parallel_for(block_count, thread_count, [&buffer, &blocks, size, block_size](std::size_t const block_idx){
+			auto const begin(block_idx * block_size);
+			auto const uncompressed_size(std::min(block_size, size - begin));
+			auto &block(blocks[block_idx]);
+			uLongf compressed_size(compressBound(uncompressed_size));
+			block.resize(compressed_size);
+			if (Z_OK != compress2(
+				reinterpret_cast <Bytef *>(block.data()),
+				&compressed_size,
+				reinterpret_cast <Bytef const *>(buffer.data() + begin),
+				uncompressed_size,
+				Z_DEFAULT_COMPRESSION
+			))
+				throw std::runtime_error("Unable to compress the variant graph");
+			block.resize(compressed_size);
+		});
+
+		compressed_file_header compressed_header;
+		compressed_header.magic = COMPRESSED_MAGIC;
+		compressed_header.version = GRAPH_FILE_VERSION;
+		compressed_header.byte_order_mark = BYTE_ORDER_MARK;
+		compressed_header.contents_size = size;
+		compressed_header.block_size = block_size;
+		compressed_header.block_count = block_count;
+
+		std::vector <std::uint64_t> block_offsets;
+		block_offsets.reserve(1 + block_count);
+		std::size_t pos(sizeof(compressed_file_header) + (1 + block_count) * sizeof(std::uint64_t));
+		for (auto const &block : blocks)
+		{
+			block_offsets.push_back(pos);
+			pos += block.size();
+		}
+		block_offsets.push_back(pos);
+
+		mapped_output_file file(path, pos);
+		auto *dst(file.data());
+		std::memcpy(dst, &compressed_header, sizeof(compressed_file_header));
+		std::memcpy(dst + sizeof(compressed_file_header), block_offsets.data(), block_offsets.size() * sizeof(std::uint64_t));
+		for (std::size_t i{}; i < block_count; ++i)
+			std::memcpy(dst + block_offsets[i], blocks[i].data(), blocks[i].size());
+	}
+
+
+	void mapped_graph_file::open(char const *path, std::uint16_t const thread_count)
+	{
+		close();
+		m_file.open(path);
+
+		auto const fail([this, path](char const *reason){
+			close();
+			throw std::runtime_error(std::string(reason) + " in " + path);
+		});
+
+		if (m_file.size() < sizeof(compressed_file_header))
+			fail("Truncated variant graph header");
+
+		if (auto const compressed_header(read_header <compressed_file_header>(m_file.data())); COMPRESSED_MAGIC == compressed_header.magic)
+		{
+			check_version(compressed_header, fail);
+
+			auto const size(compressed_header.contents_size);
+			auto const block_size(compressed_header.block_size);
+			auto const block_count(compressed_header.block_count);
+			if (!block_size || block_count != (size + block_size - 1) / block_size || m_file.size() / sizeof(std::uint64_t) < block_count)
+				fail("Invalid block count");
+
+			auto const table_end(sizeof(compressed_file_header) + (1 + block_count) * sizeof(std::uint64_t));
+			if (m_file.size() < table_end)
+				fail("Truncated block table");
+
+			std::vector <std::uint64_t> block_offsets(1 + block_count);
+			std::memcpy(block_offsets.data(), m_file.data() + sizeof(compressed_file_header), block_offsets.size() * sizeof(std::uint64_t));
+			if (block_offsets.front() < table_end || !std::is_sorted(block_offsets.begin(), block_offsets.end()) || m_file.size() < block_offsets.back())
+				fail("Invalid block table");
+
+			m_buffer.resize((size + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+			auto * const dst(reinterpret_cast <char *>(m_buffer.data()));
+			auto const * const src(m_file.data());
+			parallel_for(block_count, thread_count, [dst, src, size, block_size, &block_offsets, path](std::size_t const block_idx){
+				auto const begin(block_idx * block_size);
+				auto const expected_size(std::min <std::uint64_t>(block_size, size - begin));
+				uLongf uncompressed_size(expected_size);
+				if (Z_OK != uncompress(
+					reinterpret_cast <Bytef *>(dst + begin),
+					&uncompressed_size,
+					reinterpret_cast <Bytef const *>(src + block_offsets[block_idx]),
+					block_offsets[1 + block_idx] - block_offsets[block_idx]
+				) || expected_size != uncompressed_size)
+					throw std::runtime_error(std::string("Unable to decompress a variant graph block in ") + path);
+			});
+
+			m_file.close();
+			m_data = dst;
+			m_size = size;
+		}
+		else
+		{
+			m_data = m_file.data();
+			m_size = m_file.size();
+		}
+
+		check_contents(m_data, m_size, fail);
+	}
+
+
+	void mapped_graph_file::close()
+	{
+		m_file.close();
+		m_buffer.clear();
+		m_buffer.shrink_to_fit();
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+
+	void mapped_graph_file::get_graph(variant_graph &graph) const
+	{
+		get_graph_arrays(m_data, graph);
+		get_graph_samples(m_data, graph);
+	}
+
+
+	graph_chunk_writer::~graph_chunk_writer()
+	{
+		// The file is left without the footer unless close() was called.
+		if (-1 != m_fd)
+			::close(m_fd);
+	}
+
+
+	void graph_chunk_writer::open(char const *path)
+	{
+		if (-1 != m_fd)
+		{
+			::close(m_fd);
+			m_fd = -1;
+		}
+
+		m_path = path;
+		m_chunk_offsets.clear();
+		m_sample_names.clear();
+		m_position = 0;
+
+		m_fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (-1 == m_fd)
+			throw std::system_error(errno, std::generic_category(), std::string("Unable to open ") + path);
+
+		chunked_file_header header;
+		header.magic = CHUNKED_MAGIC;
+		header.version = GRAPH_FILE_VERSION;
+		header.byte_order_mark = BYTE_ORDER_MARK;
+
+		m_buffer.assign(aligned(sizeof(chunked_file_header)), 0);
+		std::memcpy(m_buffer.data(), &header, sizeof(chunked_file_header));
+		write(m_buffer.data(), m_buffer.size());
+	}
+
+
+	void graph_chunk_writer::write_chunk(variant_graph const &chunk)
+	{
+		libbio_assert_neq(-1, m_fd);
+
+		// The samples are the same in every chunk.
+		if (m_chunk_offsets.empty())
+			m_sample_names.assign(chunk.sample_names);
+
+		file_header header;
+		std::array <std::span <std::byte const>, ARRAY_COUNT> contents;
+		auto const size(make_layout(chunk, m_sample_names, header, contents));
+
+		// The buffer is reused for the following chunks.
+		m_buffer.assign(size, 0);
+		write_contents(header, contents, m_buffer.data());
+
+		m_chunk_offsets.push_back(m_position);
+		write(m_buffer.data(), size);
+	}
+
+
+	void graph_chunk_writer::close()
+	{
+		libbio_assert_neq(-1, m_fd);
+
+		chunked_file_footer footer;
+		footer.chunk_count = m_chunk_offsets.size();
+		footer.table_offset = m_position;
+		footer.magic = CHUNKED_MAGIC;
+
+		// The table ends with the end of the last chunk, which is not added to m_chunk_offsets
+		// so that chunk_count() remains valid.
+		write(reinterpret_cast <char const *>(m_chunk_offsets.data()), m_chunk_offsets.size() * sizeof(std::uint64_t));
+		write(reinterpret_cast <char const *>(&footer.table_offset), sizeof(std::uint64_t));
+		write(reinterpret_cast <char const *>(&footer), sizeof(chunked_file_footer));
+
+		auto const fd(std::exchange(m_fd, -1));
+		if (-1 == ::close(fd))
+			throw std::system_error(errno, std::generic_category(), std::string("Unable to close ") + m_path);
+
+		m_buffer.clear();
+		m_buffer.shrink_to_fit();
+	}
+
+
+	void graph_chunk_writer::write(char const *data, std::size_t size)
+	{
+		m_position += size;
+		while (size)
+		{
+			auto const res(::write(m_fd, data, size));
+			if (-1 == res)
+			{
+				if (EINTR == errno)
+					continue;
+				throw std::system_error(errno, std::generic_category(), std::string("Unable to write to ") + m_path);
+			}
+
+			data += res;
+			size -= res;
+		}
+	}
+
+
+	void check_chunked_graph_outputs(chunked_graph_outputs const &outputs)
+	{
+		// The pBWT used for both the cut positions and the matchings is not carried over from one chunk to the next.
+		if (outputs.founder_sequences)
+			throw std::runtime_error("Founder sequences cannot be output from a chunked variant graph, since the cut positions and the matchings are determined from the whole graph");
+
+		if (outputs.separate_sequences)
+			throw std::runtime_error("Sequences cannot be output one by one from a chunked variant graph");
+
+		if (outputs.graphviz)
+			throw std::runtime_error("A chunked variant graph cannot be output in Graphviz format");
+
+		if (outputs.memory_breakdown)
+			throw std::runtime_error("The memory breakdown cannot be output for a chunked variant graph");
+	}
+
+
+	void mapped_chunked_graph_file::open(char const *path)
+	{
+		close();
+		m_file.open(path);
+
+		auto const fail([this, path](char const *reason){
+			close();
+			throw std::runtime_error(std::string(reason) + " in " + path);
+		});
+
+		auto const * const data(m_file.data());
+		auto const size(m_file.size());
+		if (size < aligned(sizeof(chunked_file_header)) + sizeof(chunked_file_footer))
+			fail("Truncated chunked variant graph");
+
+		auto const header(read_header <chunked_file_header>(data));
+		if (CHUNKED_MAGIC != header.magic)
+			fail("Unrecognised variant graph format");
+		check_version(header, fail);
+
+		auto const footer(read_header <chunked_file_footer>(data + size - sizeof(chunked_file_footer)));
+		if (CHUNKED_MAGIC != footer.magic)
+			fail("Incomplete chunked variant graph");
+
+		auto const table_end(size - sizeof(chunked_file_footer));
+		if (table_end < footer.table_offset || (table_end - footer.table_offset) / sizeof(std::uint64_t) != 1 + footer.chunk_count)
+			fail("Invalid chunk table");
+
+		m_chunk_offsets.resize(1 + footer.chunk_count);
+		std::memcpy(m_chunk_offsets.data(), data + footer.table_offset, m_chunk_offsets.size() * sizeof(std::uint64_t));
+		if (
+			!footer.chunk_count ||
+			m_chunk_offsets.front() != aligned(sizeof(chunked_file_header)) ||
+			m_chunk_offsets.back() != footer.table_offset ||
+			!std::is_sorted(m_chunk_offsets.begin(), m_chunk_offsets.end())
+		)
+			fail("Invalid chunk table");
+
+		for (std::size_t i{}; i < footer.chunk_count; ++i)
+		{
+			auto const begin(m_chunk_offsets[i]);
+			if (begin % GRAPH_FILE_ALIGNMENT)
+				fail("Misaligned chunk");
+			check_contents(data + begin, m_chunk_offsets[1 + i] - begin, fail);
+		}
+	}
+
+
+	void mapped_chunked_graph_file::close()
+	{
+		m_file.close();
+		m_chunk_offsets.clear();
+	}
+
+
+	void mapped_chunked_graph_file::get_chunk(std::size_t const idx, variant_graph &graph) const
+	{
+		libbio_assert_lt(idx, chunk_count());
+		get_graph_arrays(m_file.data() + m_chunk_offsets[idx], graph);
+	}
+
+
+	void mapped_chunked_graph_file::get_samples(variant_graph &graph) const
+	{
+		libbio_assert_lt(0, chunk_count());
+		get_graph_samples(m_file.data() + m_chunk_offsets.front(), graph);
+	}
+}
@@ -3,15 +3,30 @@
  * This code is licensed under MIT license (see LICENSE for details).
  */
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <exception>
+#include <libbio/assert.hh>
 #include <libbio/file_handling.hh>
+#include <mutex>
 #include <ostream>
 #include <range/v3/view/enumerate.hpp>
 #include <range/v3/view/iota.hpp>
 #include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vcf2multialign/a2m_layout.hh>
+#include <vcf2multialign/graph_file.hh>
+#include <vcf2multialign/mapped_file.hh>
 #include <vcf2multialign/output.hh>
+#include <vcf2multialign/parallel_for.hh>
 #include <vcf2multialign/sequence_writer.hh>
 #include <vcf2multialign/variant_graph.hh>
+#include <vector>
 
 namespace rsv	= ranges::views;
 namespace v2m	= vcf2multialign;
@@ -30,6 +45,369 @@ namespace {
 		{
 		}
 	};
+
+
+	struct sequence_description
+	{
+		typedef v2m::variant_graph::sample_type	sample_type;
+		typedef v2m::variant_graph::ploidy_type	ploidy_type;
+
+		sample_type	sample_idx{v2m::variant_graph::SAMPLE_MAX};	// SAMPLE_MAX for the reference.
+		ploidy_type	chr_copy_idx{};
+
+		sequence_description() = default;
+
+		sequence_description(sample_type const sample_idx_, ploidy_type const chr_copy_idx_):
+			sample_idx(sample_idx_),
+			chr_copy_idx(chr_copy_idx_)
+		{
+		}
+
+		bool is_reference() const { return v2m::variant_graph::SAMPLE_MAX == sample_idx; }
+	};
+
+
+	// Passes the sequences rendered by the worker threads to the writer in the original order.
+	// At most capacity sequences (in progress or waiting to be written) are kept in memory at a time.
+	class rendered_sequence_queue
+	{
+	private:
+		std::mutex					m_mutex;
+		std::condition_variable		m_cv;
+		std::vector <std::string>	m_buffers;			// Ring buffer indexed by the sequence number.
+		std::vector <char>			m_is_ready;			// Not std::vector <bool> b.c. the items are accessed from different threads.
+		std::exception_ptr			m_exception;
+		std::size_t					m_task_count{};
+		std::size_t					m_next_task{};		// Next sequence to be rendered.
+		std::size_t					m_next_output{};	// Next sequence to be written.
+		bool						m_should_stop{};
+
+	public:
+		rendered_sequence_queue(std::size_t const task_count, std::size_t const capacity):
+			m_buffers(capacity),
+			m_is_ready(capacity, 0),
+			m_task_count(task_count)
+		{
+			libbio_assert_lt(0, capacity);
+		}
+
+		std::size_t capacity() const { return m_buffers.size(); }
+
+		// For the worker threads.
+		[[nodiscard]] bool next_task(std::size_t &task_idx);
+		void finish_task(std::size_t const task_idx, std::string &&buffer);
+		void set_exception(std::exception_ptr exc);
+
+		// For the writer.
+		[[nodiscard]] std::string next_output();
+		void stop();
+	};
+
+
+	bool rendered_sequence_queue::next_task(std::size_t &task_idx)
+	{
+		std::unique_lock lock(m_mutex);
+		m_cv.wait(lock, [this]{ return m_should_stop || m_task_count <= m_next_task || m_next_task < m_next_output + capacity(); });
+		if (m_should_stop || m_task_count <= m_next_task)
+			return false;
+
+		task_idx = m_next_task;
+		++m_next_task;
+		return true;
+	}
+
+
+	void rendered_sequence_queue::finish_task(std::size_t const task_idx, std::string &&buffer)
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			auto const slot(task_idx % capacity());
+			libbio_assert(!m_is_ready[slot]);
+			m_buffers[slot] = std::move(buffer);
+			m_is_ready[slot] = 1;
+		}
+		m_cv.notify_all();
+	}
+
+
+	void rendered_sequence_queue::set_exception(std::exception_ptr exc)
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			if (!m_exception)
+				m_exception = exc;
+			m_should_stop = true;
+		}
+		m_cv.notify_all();
+	}
+
+
+	std::string rendered_sequence_queue::next_output()
+	{
+		std::string retval;
+
+		{
+			std::unique_lock lock(m_mutex);
+			auto const slot(m_next_output % capacity());
+			m_cv.wait(lock, [this, slot]{ return m_exception || m_is_ready[slot]; });
+			if (m_exception)
+				std::rethrow_exception(m_exception);
+
+			using std::swap;
+			swap(retval, m_buffers[slot]);
+			m_is_ready[slot] = 0;
+			++m_next_output;
+		}
+
+		m_cv.notify_all();
+		return retval;
+	}
+
+
+	void rendered_sequence_queue::stop()
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_should_stop = true;
+		}
+		m_cv.notify_all();
+	}
+
+
+	// Stops the workers e.g. in case writing fails.
+	struct rendered_sequence_queue_stopper
+	{
+		rendered_sequence_queue &queue;
+
+		~rendered_sequence_queue_stopper() { queue.stop(); }
+	};
+
+
+	void output_fasta_identifier(std::ostream &os, char const *chromosome_id, v2m::variant_graph const &graph, sequence_description const &desc)
+	{
+		if (chromosome_id)
+			os << chromosome_id << '\t';
+
+		if (desc.is_reference())
+			os << "REF";
+		else
+			os << graph.sample_names[desc.sample_idx] << '-' << (1 + desc.chr_copy_idx);
+	}
+
+
+	// Renders the aligned sequences of the chromosome copies to pre-sized buffers one window of nodes
+	// at a time instead of traversing the whole graph once per sequence. This way the part of the graph
+	// being processed (including the columns of the path matrix) stays in the cache while it is used for
+	// all of the chromosome copies.
+	class column_blocked_haplotype_writer
+	{
+	public:
+		typedef v2m::variant_graph				variant_graph;
+		typedef variant_graph::node_type		node_type;
+		typedef variant_graph::edge_type		edge_type;
+		typedef variant_graph::ploidy_type		ploidy_type;
+
+		constexpr static inline node_type const NODE_WINDOW_SIZE{4096};
+
+	private:
+		v2m::sequence_type const	*m_ref_seq{};
+		variant_graph const			*m_graph{};
+
+	public:
+		column_blocked_haplotype_writer(v2m::sequence_type const &ref_seq, variant_graph const &graph):
+			m_ref_seq(&ref_seq),
+			m_graph(&graph)
+		{
+		}
+
+		// Render the aligned reference to dst.
+		void render_reference(char * const dst) const { render_until <false>(dst, 0, 0, m_graph->node_count() - 1); }
+
+		// Render the chromosome copies in [copy_lb, copy_rb), the sequence of copy i to dst_by_chrom_copy[i].
+		void render_chromosome_copies(char * const * const dst_by_chrom_copy, ploidy_type const copy_lb, ploidy_type const copy_rb) const;
+
+	private:
+		template <bool t_should_follow_alt_edges>
+		node_type render_until(char * const dst, ploidy_type const chrom_copy_idx, node_type node, node_type const limit) const;
+	};
+
+
+	void column_blocked_haplotype_writer::render_chromosome_copies(
+		char * const * const dst_by_chrom_copy,
+		ploidy_type const copy_lb,
+		ploidy_type const copy_rb
+	) const
+	{
+		libbio_assert_lte(copy_lb, copy_rb);
+		std::vector <node_type> next_nodes(copy_rb - copy_lb, 0); // Current node by chromosome copy.
+		auto const limit(m_graph->node_count() - 1);
+		for (node_type window_lb{}; window_lb < limit; window_lb += NODE_WINDOW_SIZE)
+		{
+			auto const window_rb(std::min(limit, window_lb + NODE_WINDOW_SIZE));
+			for (ploidy_type copy_idx(copy_lb); copy_idx < copy_rb; ++copy_idx)
+			{
+				auto &next_node(next_nodes[copy_idx - copy_lb]);
+				next_node = render_until <true>(dst_by_chrom_copy[copy_idx], copy_idx, next_node, window_rb);
+			}
+		}
+	}
+
+
+	template <bool t_should_follow_alt_edges>
+	auto column_blocked_haplotype_writer::render_until(
+		char * const dst,
+		ploidy_type const chrom_copy_idx,
+		node_type node,
+		node_type const limit
+	) const -> node_type
+	{
+		// Since every sequence is padded to the aligned positions of the nodes, the sequence starting from
+		// a node may be written to its aligned position.
+		auto const &graph(*m_graph);
+		auto const * const ref_data(m_ref_seq->data());
+		while (node < limit)
+		{
+			auto const ref_pos(graph.reference_positions[node]);
+			auto const aln_pos(graph.aligned_positions[node]);
+			node_type next_node{node + 1};
+			std::string_view label;
+			bool did_follow_alt_edge{};
+
+			if constexpr (t_should_follow_alt_edges)
+			{
+				auto const &[edge_lb, edge_rb] = graph.edge_range_for_node(node);
+				for (edge_type edge_idx(edge_lb); edge_idx < edge_rb; ++edge_idx)
+				{
+					if (graph.paths_by_edge_and_chrom_copy(chrom_copy_idx, edge_idx))
+					{
+						// Found an ALT edge to follow.
+						next_node = graph.alt_edge_targets[edge_idx];
+						label = graph.alt_edge_labels[edge_idx];
+						did_follow_alt_edge = true;
+						break;
+					}
+				}
+			}
+
+			if (!did_follow_alt_edge)
+				label = std::string_view(ref_data + ref_pos, graph.reference_positions[next_node] - ref_pos);
+
+			auto const next_aln_pos(graph.aligned_positions[next_node]);
+			libbio_assert_lte(label.size(), next_aln_pos - aln_pos);
+			std::memcpy(dst + aln_pos, label.data(), label.size());
+			std::memset(dst + aln_pos + label.size(), '-', next_aln_pos - aln_pos - label.size());
+			node = next_node;
+		}
+
+		return node;
+	}
+
+
+	v2m::a2m_layout make_layout(
+		v2m::variant_graph const &graph,
+		v2m::a2m_layout::offset_type const sequence_length,
+		char const *chromosome_id,
+		bool const should_output_reference
+	)
+	{
+		typedef v2m::variant_graph::ploidy_type	ploidy_type;
+
+		v2m::a2m_layout retval(sequence_length);
+		auto const add_record([&](sequence_description const &desc){
+			std::stringstream fasta_id;
+			output_fasta_identifier(fasta_id, chromosome_id, graph, desc);
+			retval.add_record(fasta_id.str());
+		});
+
+		if (should_output_reference)
+			add_record(sequence_description{});
+
+		for (auto const &[sample_idx, sample] : rsv::enumerate(graph.sample_names))
+		{
+			auto const ploidy(graph.sample_ploidy(sample_idx));
+			for (auto const chr_copy_idx : rsv::iota(ploidy_type(0), ploidy))
+				add_record(sequence_description(sample_idx, chr_copy_idx));
+		}
+
+		return retval;
+	}
+
+
+	// Render the aligned sequences to their records in data. The graph may also be a chunk of a larger one,
+	// in which case only the corresponding part of each sequence is rendered. If delegate is not null,
+	// progress is reported to it from the calling thread.
+	void render_sequences(
+		v2m::sequence_type const &ref_seq,
+		v2m::variant_graph const &graph,
+		v2m::a2m_layout const &layout,
+		char * const data,
+		bool const should_output_reference,
+		std::uint16_t const thread_count,
+		v2m::output_delegate * const delegate
+	)
+	{
+		typedef v2m::variant_graph::ploidy_type	ploidy_type;
+		typedef v2m::variant_graph::sample_type	sample_type;
+
+		// The chromosome copies are in the same order as the records.
+		auto const copy_count(graph.total_chromosome_copies());
+		std::vector <char *> dst_by_chrom_copy(copy_count);
+		for (ploidy_type copy_idx{}; copy_idx < copy_count; ++copy_idx)
+			dst_by_chrom_copy[copy_idx] = data + layout.sequence_offset(should_output_reference + copy_idx);
+
+		// The copies are rendered in groups so that progress can be reported between them. Each group is
+		// read from the graph once, and a larger group makes this less frequent.
+		constexpr ploidy_type const COPIES_PER_THREAD_IN_GROUP{1024};
+		ploidy_type const group_size(COPIES_PER_THREAD_IN_GROUP * std::max(thread_count, std::uint16_t(1)));
+
+		column_blocked_haplotype_writer const writer(ref_seq, graph);
+		sample_type sample_idx{};
+		ploidy_type group_lb{};
+		bool should_render_reference{should_output_reference};
+		do
+		{
+			auto const group_rb(std::min(copy_count, ploidy_type(group_lb + group_size)));
+
+			if (delegate)
+			{
+				for (auto copy_idx(group_lb); copy_idx < group_rb; ++copy_idx)
+				{
+					while (graph.ploidy_csum[1 + sample_idx] <= copy_idx)
+						++sample_idx;
+					delegate->will_handle_sample(graph.sample_names[sample_idx], sample_idx, copy_idx - graph.ploidy_csum[sample_idx]);
+				}
+			}
+
+			// Assign the chromosome copies to the threads in blocks of 64 s.t. each thread reads different words of the path matrix columns.
+			ploidy_type const block_count((group_rb - group_lb + 63) / 64);
+			ploidy_type const copies_per_task(64 * ((block_count + thread_count - 1) / thread_count));
+			std::size_t const task_count(copies_per_task ? (group_rb - group_lb + copies_per_task - 1) / copies_per_task : 0);
+			v2m::parallel_for(should_render_reference + task_count, thread_count, [&](std::size_t task_idx){
+				if (should_render_reference)
+				{
+					if (0 == task_idx)
+					{
+						writer.render_reference(data + layout.sequence_offset(0));
+						return;
+					}
+
+					--task_idx;
+				}
+
+				ploidy_type const copy_lb(group_lb + task_idx * copies_per_task);
+				auto const copy_rb(std::min(group_rb, ploidy_type(copy_lb + copies_per_task)));
+				writer.render_chromosome_copies(dst_by_chrom_copy.data(), copy_lb, copy_rb);
+			});
+
+			// Count the reference even if it was not output, as in the other output methods.
+			if (delegate)
+				delegate->handled_sequences(1 + group_rb);
+
+			should_render_reference = false;
+			group_lb = group_rb;
+		}
+		while (group_lb < copy_count);
+	}
 }
 
 
@@ -43,6 +421,12 @@ namespace vcf2multialign {
 	{
 		typedef variant_graph::ploidy_type	ploidy_type;
 
+		if (1 < m_thread_count)
+		{
+			output_a2m_parallel(ref_seq, graph, stream);
+			return;
+		}
+
 		std::uint32_t seq_count{1};
 
 		if (m_should_output_reference)
@@ -82,6 +466,171 @@ namespace vcf2multialign {
 	}
 
 
+	void haplotype_output::output_a2m_parallel(
+		sequence_type const &ref_seq,
+		variant_graph const &graph,
+		std::ostream &stream
+	)
+	{
+		// Each worker renders complete sequences to private buffers, and the calling thread
+		// writes them to the stream in the same order as output_a2m() does.
+		typedef variant_graph::ploidy_type	ploidy_type;
+
+		std::vector <sequence_description> descriptions;
+		descriptions.reserve(m_should_output_reference + graph.total_chromosome_copies());
+		if (m_should_output_reference)
+			descriptions.emplace_back();
+
+		for (auto const &[sample_idx, sample] : rsv::enumerate(graph.sample_names))
+		{
+			auto const ploidy(graph.sample_ploidy(sample_idx));
+			for (auto const chr_copy_idx : rsv::iota(ploidy_type(0), ploidy))
+				descriptions.emplace_back(sample_idx, chr_copy_idx);
+		}
+
+		rendered_sequence_queue queue(descriptions.size(), m_thread_count);
+
+		auto const render([this, &ref_seq, &graph, &descriptions, &queue](){
+			try
+			{
+				std::size_t task_idx{};
+				while (queue.next_task(task_idx))
+				{
+					auto const &desc(descriptions[task_idx]);
+
+					std::stringstream fasta_id;
+					output_fasta_identifier(fasta_id, m_chromosome_id, graph, desc);
+
+					std::ostringstream os;
+					if (desc.is_reference())
+					{
+						::sequence_writing_delegate delegate;
+						output_sequence(ref_seq, graph, os, fasta_id.str().data(), m_should_output_unaligned, delegate);
+					}
+					else
+					{
+						::sequence_writing_delegate delegate(graph, desc.sample_idx, desc.chr_copy_idx);
+						output_sequence(ref_seq, graph, os, fasta_id.str().data(), m_should_output_unaligned, delegate);
+					}
+
+					queue.finish_task(task_idx, std::move(os).str());
+				}
+			}
+			catch (...)
+			{
+				queue.set_exception(std::current_exception());
+			}
+		});
+
+		{
+			std::vector <std::jthread> workers;
+			rendered_sequence_queue_stopper const stopper{queue}; // Destroyed before the workers are joined.
+			workers.reserve(m_thread_count);
+			for (std::uint16_t i{}; i < m_thread_count; ++i)
+				workers.emplace_back(render);
+
+			std::uint32_t seq_count{1};
+			for (auto const &desc : descriptions)
+			{
+				if (!desc.is_reference())
+					m_delegate->will_handle_sample(graph.sample_names[desc.sample_idx], desc.sample_idx, desc.chr_copy_idx);
+
+				auto const buffer(queue.next_output());
+				stream << buffer << '\n';
+
+				if (!desc.is_reference())
+					++seq_count;
+				m_delegate->handled_sequences(seq_count);
+			}
+		}
+	}
+
+
+	void haplotype_output::output_a2m_to_file(sequence_type const &ref_seq, variant_graph const &graph, char const * const dst_name)
+	{
+		// Unaligned sequences have different lengths.
+		if (m_should_output_unaligned)
+		{
+			output::output_a2m_to_file(ref_seq, graph, dst_name);
+			return;
+		}
+
+		// Since the length of every aligned sequence is known, we can determine the size of the output and
+		// the position of each sequence in advance and write the sequences one graph segment at a time.
+		auto const layout(make_layout(graph, graph.aligned_positions.back(), m_chromosome_id, m_should_output_reference));
+		mapped_output_file dst(dst_name, layout.size());
+		auto * const data(dst.data());
+		layout.write_headers(data);
+		render_sequences(ref_seq, graph, layout, data, m_should_output_reference, m_thread_count, m_delegate);
+	}
+
+
+	void haplotype_output::output_a2m_chunked(sequence_type const &ref_seq, mapped_chunked_graph_file const &graph_file, char const * const dst_name)
+	{
+		typedef variant_graph::ploidy_type	ploidy_type;
+
+		variant_graph chunk;
+		graph_file.get_samples(chunk);
+		auto const chunk_count(graph_file.chunk_count());
+
+		if (m_pipe_cmd || m_should_output_unaligned)
+		{
+			// Output each sequence by concatenating its parts in the chunks.
+			output_to_stream(dst_name, [&](std::ostream &stream){
+				std::uint32_t seq_count{};
+				auto const output_record([&](sequence_description const &desc){
+					stream << '>';
+					output_fasta_identifier(stream, m_chromosome_id, chunk, desc);
+					stream << '\n';
+
+					::sequence_writing_delegate delegate;
+					if (!desc.is_reference())
+						delegate.chromosome_copy_index = chunk.ploidy_csum[desc.sample_idx] + desc.chr_copy_idx;
+
+					for (std::size_t chunk_idx{}; chunk_idx < chunk_count; ++chunk_idx)
+					{
+						graph_file.get_chunk(chunk_idx, chunk);
+						output_sequence(ref_seq, chunk, stream, nullptr, m_should_output_unaligned, delegate);
+					}
+
+					stream << '\n';
+					++seq_count;
+					m_delegate->handled_sequences(seq_count);
+				});
+
+				if (m_should_output_reference)
+					output_record(sequence_description{});
+
+				for (auto const &[sample_idx, sample] : rsv::enumerate(chunk.sample_names))
+				{
+					auto const ploidy(chunk.sample_ploidy(sample_idx));
+					for (auto const chr_copy_idx : rsv::iota(ploidy_type(0), ploidy))
+					{
+						m_delegate->will_handle_sample(sample, sample_idx, chr_copy_idx);
+						output_record(sequence_description(sample_idx, chr_copy_idx));
+					}
+				}
+			});
+			return;
+		}
+
+		// The sequences are rendered to their aligned positions one chunk at a time.
+		graph_file.get_chunk(chunk_count - 1, chunk);
+		auto const layout(make_layout(chunk, chunk.aligned_positions.back(), m_chromosome_id, m_should_output_reference));
+		mapped_output_file dst(dst_name, layout.size());
+		auto * const data(dst.data());
+		layout.write_headers(data);
+
+		for (std::size_t chunk_idx{}; chunk_idx < chunk_count; ++chunk_idx)
+		{
+			graph_file.get_chunk(chunk_idx, chunk);
+			render_sequences(ref_seq, chunk, layout, data, m_should_output_reference, m_thread_count, nullptr);
+		}
+
+		m_delegate->handled_sequences(1 + chunk.total_chromosome_copies());
+	}
+
+
 	void haplotype_output::output_separate(sequence_type const &ref_seq, variant_graph const &graph, bool const should_include_fasta_header)
 	{
 		typedef variant_graph::ploidy_type ploidy_type;
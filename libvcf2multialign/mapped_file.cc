@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <cerrno>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <vcf2multialign/mapped_file.hh>
+
+
+namespace vcf2multialign {
+
+	void mapped_output_file::open(char const *path, std::size_t const size)
+	{
+		close();
+
+		// The file needs to be opened for reading, too, in order to be mapped.
+		m_fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (-1 == m_fd)
+			throw std::system_error(errno, std::generic_category(), std::string("Unable to open ") + path);
+
+		if (-1 == ::ftruncate(m_fd, size))
+		{
+			auto const err(errno);
+			close();
+			throw std::system_error(err, std::generic_category(), std::string("Unable to set the size of ") + path);
+		}
+
+		m_size = size;
+		if (!size)
+			return;
+
+		auto * const data(::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0));
+		if (MAP_FAILED == data)
+		{
+			auto const err(errno);
+			close();
+			throw std::system_error(err, std::generic_category(), std::string("Unable to map ") + path);
+		}
+
+		m_data = static_cast <char *>(data);
+	}
+
+
+	void mapped_output_file::close()
+	{
+		if (m_data)
+		{
+			// Not much to be done in case of an error.
+			::munmap(m_data, m_size);
+			m_data = nullptr;
+		}
+
+		if (-1 != m_fd)
+		{
+			::close(m_fd);
+			m_fd = -1;
+		}
+
+		m_size = 0;
+	}
+
+
+	void mapped_input_file::open(char const *path)
+	{
+		close();
+
+		auto const fd(::open(path, O_RDONLY));
+		if (-1 == fd)
+			throw std::system_error(errno, std::generic_category(), std::string("Unable to open ") + path);
+
+		struct stat sb{};
+		if (-1 == ::fstat(fd, &sb))
+		{
+			auto const err(errno);
+			::close(fd);
+			throw std::system_error(err, std::generic_category(), std::string("Unable to stat ") + path);
+		}
+
+		if (sb.st_size)
+		{
+			auto * const data(::mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0));
+			if (MAP_FAILED == data)
+			{
+				auto const err(errno);
+				::close(fd);
+				throw std::system_error(err, std::generic_category(), std::string("Unable to map ") + path);
+			}
+
+			m_data = static_cast <char const *>(data);
+			m_size = sb.st_size;
+		}
+
+		// The mapping remains valid after closing the file.
+		::close(fd);
+	}
+
+
+	void mapped_input_file::close()
+	{
+		if (m_data)
+		{
+			::munmap(const_cast <char *>(m_data), m_size);
+			m_data = nullptr;
+		}
+
+		m_size = 0;
+	}
+}
@@ -3,9 +3,11 @@
  * This code is licensed under MIT license (see LICENSE for details).
  */
 
+#include <functional>
 #include <libbio/file_handle.hh>
 #include <libbio/file_handling.hh>
 #include <libbio/subprocess.hh>
+#include <ostream>
 #include <vcf2multialign/output.hh>
 #include <vcf2multialign/sequence_writer.hh>
 #include <vcf2multialign/variant_graph.hh>
@@ -44,7 +46,7 @@ namespace vcf2multialign {
 	}
 
 
-	void output::output_a2m(sequence_type const &ref_seq, variant_graph const &graph, char const * const dst_name)
+	void output::output_to_stream(char const * const dst_name, std::function <void(std::ostream &)> const &fn)
 	{
 		if (m_pipe_cmd)
 		{
@@ -61,7 +63,7 @@ namespace vcf2multialign {
 			{
 				lb::file_ostream stream;
 				lb::open_stream_with_file_handle(stream, fh);
-				output_a2m(ref_seq, graph, stream);
+				fn(stream);
 			}
 
 			m_delegate->exit_subprocess(proc);
@@ -71,7 +73,22 @@ namespace vcf2multialign {
 			lb::file_handle fh(lb::open_file_for_writing(dst_name, lb::writing_open_mode::CREATE));
 			lb::file_ostream stream;
 			lb::open_stream_with_file_handle(stream, fh);
-			output_a2m(ref_seq, graph, stream);
+			fn(stream);
 		}
 	}
+
+
+	void output::output_a2m(sequence_type const &ref_seq, variant_graph const &graph, char const * const dst_name)
+	{
+		if (m_pipe_cmd)
+			output_to_stream(dst_name, [this, &ref_seq, &graph](std::ostream &stream){ output_a2m(ref_seq, graph, stream); });
+		else
+			output_a2m_to_file(ref_seq, graph, dst_name);
+	}
+
+
+	void output::output_a2m_to_file(sequence_type const &ref_seq, variant_graph const &graph, char const * const dst_name)
+	{
+		output_to_stream(dst_name, [this, &ref_seq, &graph](std::ostream &stream){ output_a2m(ref_seq, graph, stream); });
+	}
 }
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <utility>
+#include <vcf2multialign/packed_vector.hh>
+
+
+namespace vcf2multialign {
+
+	void packed_vector::widen(std::uint8_t const width)
+	{
+		libbio_assert_lt(m_width, width);
+		word_vector words(words_needed(m_size, width), 0);
+		for (std::size_t i{}; i < m_size; ++i)
+			store(words.data(), i, width, load(m_words.data(), i, m_width));
+
+		m_words = word_array(std::move(words));
+		m_width = width;
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <vcf2multialign/path_matrix.hh>
+#include <vector>
+
+
+namespace vcf2multialign {
+
+	path_matrix::path_matrix(libbio::bit_matrix const &mat, row_type const row_count, column_index_type const column_count):
+		m_row_count(row_count)
+	{
+		libbio_assert_lte(row_count, mat.number_of_rows());
+		libbio_assert_lte(column_count, mat.number_of_columns());
+		std::vector <row_type> rows;
+		for (column_index_type col{}; col < column_count; ++col)
+		{
+			rows.clear();
+			for (row_type row{}; row < row_count; ++row)
+			{
+				if (mat(row, col))
+					rows.push_back(row);
+			}
+
+			push_back_column(rows);
+		}
+	}
+
+
+	void path_matrix::push_back_column(std::span <row_type const> const rows)
+	{
+		libbio_assert(std::is_sorted(rows.begin(), rows.end()));
+		libbio_assert(rows.empty() || rows.back() < m_row_count);
+
+		m_one_counts.push_back(rows.size());
+		if (rows.size() <= sparse_column_limit())
+		{
+			m_column_offsets.push_back(m_sparse_rows.size());
+			m_sparse_rows.append(rows.begin(), rows.end());
+		}
+		else
+		{
+			auto const offset(m_dense_words.size());
+			m_column_offsets.push_back(offset);
+			m_dense_words.resize(offset + words_per_column(), 0);
+			auto * const words(m_dense_words.mutable_data() + offset);
+			for (auto const row : rows)
+				words[row / WORD_BITS] |= word_type(1) << (row % WORD_BITS);
+		}
+	}
+
+
+	void path_matrix::shrink_to_fit()
+	{
+		m_dense_words.shrink_to_fit();
+		m_sparse_rows.shrink_to_fit();
+		m_column_offsets.shrink_to_fit();
+		m_one_counts.shrink_to_fit();
+	}
+}
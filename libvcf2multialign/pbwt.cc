@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vcf2multialign/pbwt.hh>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#	define VCF2MULTIALIGN_HAVE_X86_GATHER_KERNELS
+#	include <immintrin.h>
+#endif
+
+namespace v2m	= vcf2multialign;
+
+
+namespace {
+
+	typedef v2m::path_matrix::word_type	word_type;
+
+	typedef void (*gather_kernel_type)(std::span <word_type const>, std::span <std::uint32_t const>, word_type *);
+
+
+	void gather_bits_portable(std::span <word_type const> const words, std::span <std::uint32_t const> const indices, word_type *dst)
+	{
+		v2m::gather_bits_portable(words, indices, dst);
+	}
+
+
+#if defined(VCF2MULTIALIGN_HAVE_X86_GATHER_KERNELS)
+	// Gathers four words at a time, shifts the bits to the sign positions and collects them with movemask.
+	// The word indices need to fit in 31 bits.
+	__attribute__((target("avx2")))
+	void gather_bits_avx2(std::span <word_type const> const words, std::span <std::uint32_t const> const indices, word_type *dst)
+	{
+		auto const * const src(reinterpret_cast <long long const *>(words.data()));
+		auto const low_bits(_mm_set1_epi32(0x3f));
+		std::size_t ii{};
+		for (; ii + 64 <= indices.size(); ii += 64)
+		{
+			word_type word{};
+			for (unsigned jj{}; jj < 64; jj += 4)
+			{
+				auto const idx(_mm_loadu_si128(reinterpret_cast <__m128i const *>(indices.data() + ii + jj)));
+				auto const word_idx(_mm_srli_epi32(idx, 6));
+				auto const shift(_mm256_cvtepu32_epi64(_mm_and_si128(idx, low_bits)));
+				auto const gathered(_mm256_i32gather_epi64(src, word_idx, 8));
+				auto const bits(_mm256_slli_epi64(_mm256_srlv_epi64(gathered, shift), 63));
+				word |= word_type(_mm256_movemask_pd(_mm256_castsi256_pd(bits))) << jj;
+			}
+			*dst++ = word;
+		}
+
+		if (ii < indices.size())
+			v2m::gather_bits_portable(words, indices.subspan(ii), dst);
+	}
+#endif
+
+
+	gather_kernel_type select_gather_kernel()
+	{
+#if defined(VCF2MULTIALIGN_HAVE_X86_GATHER_KERNELS)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return &gather_bits_avx2;
+#endif
+		return &gather_bits_portable;
+	}
+
+
+	gather_kernel_type gather_kernel()
+	{
+		static gather_kernel_type const retval(select_gather_kernel());
+		return retval;
+	}
+}
+
+
+namespace vcf2multialign {
+
+	void gather_bits(std::span <word_type const> const words, std::span <std::uint32_t const> const indices, word_type *dst)
+	{
+		(*gather_kernel())(words, indices, dst);
+	}
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <array>
+#include <cerrno>
+#include <system_error>
+#include <vcf2multialign/sequence_sink.hh>
+
+
+namespace vcf2multialign {
+
+	char const *buffered_sequence_sink::gap_block()
+	{
+		static auto const block([](){
+			std::array <char, GAP_BLOCK_SIZE> retval;
+			retval.fill('-');
+			return retval;
+		}());
+
+		return block.data();
+	}
+
+
+	void buffered_sequence_sink::flush()
+	{
+		if (m_stream)
+		{
+			for (auto const &vec : m_iovecs)
+				m_stream->write(static_cast <char const *>(vec.iov_base), vec.iov_len);
+		}
+		else
+		{
+			auto *begin(m_iovecs.data());
+			auto * const end(begin + m_iovecs.size());
+			while (begin != end)
+			{
+				auto res(::writev(m_fd, begin, end - begin));
+				if (-1 == res)
+				{
+					if (EINTR == errno)
+						continue;
+					throw std::system_error(errno, std::generic_category(), "Unable to write the sequence");
+				}
+
+				// Handle a partial write.
+				while (begin != end && begin->iov_len <= std::size_t(res))
+				{
+					res -= begin->iov_len;
+					++begin;
+				}
+
+				if (begin != end)
+				{
+					begin->iov_base = static_cast <char *>(begin->iov_base) + res;
+					begin->iov_len -= res;
+				}
+			}
+		}
+
+		m_iovecs.clear();
+		m_buffer_size = 0;
+	}
+}
@@ -3,40 +3,64 @@
  * This code is licensed under MIT license (see LICENSE for details).
  */
 
-#include <algorithm>
 #include <cstddef>
-#include <iterator>
+#include <cstring>
 #include <libbio/assert.hh>
 #include <libbio/file_handle.hh>
-#include <libbio/file_handling.hh>
 #include <ostream>
 #include <string_view>
+#include <vcf2multialign/sequence_sink.hh>
 #include <vcf2multialign/sequence_writer.hh>
 #include <vcf2multialign/variant_graph.hh>
 
 namespace lb	= libbio;
+namespace v2m	= vcf2multialign;
 
 
-namespace vcf2multialign {
+namespace {
 
-	void output_sequence(
-		sequence_type const &ref_seq,
-		variant_graph const &graph,
-		std::ostream &stream,
+	// Writes to a pre-allocated buffer.
+	class memory_sequence_sink
+	{
+	private:
+		char	*m_dst{};
+
+	public:
+		explicit memory_sequence_sink(char *dst):
+			m_dst(dst)
+		{
+		}
+
+		void append(std::string_view const sv) { std::memcpy(m_dst, sv.data(), sv.size()); m_dst += sv.size(); }
+		void append_gap(std::size_t const count) { std::memset(m_dst, '-', count); m_dst += count; }
+	};
+
+
+	template <typename t_sink>
+	void output_sequence_(
+		v2m::sequence_type const &ref_seq,
+		v2m::variant_graph const &graph,
+		t_sink &sink,
 		char const *fasta_identifier,
 		bool const should_output_unaligned,
-		sequence_writing_delegate &delegate
+		v2m::sequence_writing_delegate &delegate
 	)
 	{
+		typedef v2m::variant_graph				variant_graph;
 		typedef variant_graph::position_type	position_type;
 		typedef variant_graph::node_type		node_type;
 		typedef variant_graph::edge_type		edge_type;
 
 		if (fasta_identifier)
-			stream << '>' << fasta_identifier << '\n';
+		{
+			sink.append(">");
+			sink.append(fasta_identifier);
+			sink.append("\n");
+		}
 
-		position_type ref_pos{};
-		position_type aln_pos{};
+		// The graph may be a chunk of a larger one, in which case the first node is not at the beginning of the reference.
+		position_type ref_pos(graph.reference_positions[0]);
+		position_type aln_pos(graph.aligned_positions[0]);
 		position_type next_ref_pos{};
 		position_type next_aln_pos{};
 		node_type current_node{};
@@ -46,20 +70,20 @@ namespace vcf2multialign {
 			delegate.handle_node(graph, current_node);
 
 			std::size_t label_size{};
-			if (sequence_writing_delegate::PLOIDY_MAX != delegate.chromosome_copy_index) // Always follow REF edges if outputting the aligned reference.
+			if (v2m::sequence_writing_delegate::PLOIDY_MAX != delegate.chromosome_copy_index) // Always follow REF edges if outputting the aligned reference.
 			{
 				auto const &[edge_lb, edge_rb] = graph.edge_range_for_node(current_node);
 				for (edge_type edge_idx(edge_lb); edge_idx < edge_rb; ++edge_idx)
 				{
-					if (graph.paths_by_chrom_copy_and_edge(edge_idx, delegate.chromosome_copy_index))
+					if (graph.paths_by_edge_and_chrom_copy(delegate.chromosome_copy_index, edge_idx))
 					{
 						// Found an ALT edge to follow.
 						auto const target_node(graph.alt_edge_targets[edge_idx]);
-						auto const &label(graph.alt_edge_labels[edge_idx]);
+						auto const label(graph.alt_edge_labels[edge_idx]);
 						next_ref_pos = graph.reference_positions[target_node];
 						next_aln_pos = graph.aligned_positions[target_node];
 						libbio_assert_lte(label.size(), next_aln_pos - aln_pos);
-						stream << label;
+						sink.append(label);
 						current_node = target_node;
 						label_size = label.size();
 						goto continue_loop;
@@ -71,18 +95,36 @@ namespace vcf2multialign {
 				next_ref_pos = graph.reference_positions[current_node + 1];
 				next_aln_pos = graph.aligned_positions[current_node + 1];
 				std::string_view const ref_part(ref_seq.data() + ref_pos, next_ref_pos - ref_pos);
-				stream << ref_part;
+				sink.append(ref_part);
 				label_size = ref_part.size();
 				++current_node;
 			}
 
 		continue_loop:
 			if (!should_output_unaligned)
-				std::fill_n(std::ostreambuf_iterator <char>(stream), next_aln_pos - aln_pos - label_size, '-');
+				sink.append_gap(next_aln_pos - aln_pos - label_size);
 			ref_pos = next_ref_pos;
 			aln_pos = next_aln_pos;
 		}
 	}
+}
+
+
+namespace vcf2multialign {
+
+	void output_sequence(
+		sequence_type const &ref_seq,
+		variant_graph const &graph,
+		std::ostream &stream,
+		char const *fasta_identifier,
+		bool const should_output_unaligned,
+		sequence_writing_delegate &delegate
+	)
+	{
+		buffered_sequence_sink sink(stream);
+		output_sequence_(ref_seq, graph, sink, fasta_identifier, should_output_unaligned, delegate);
+		sink.flush();
+	}
 
 
 	void output_sequence(
@@ -94,8 +136,20 @@ namespace vcf2multialign {
 		sequence_writing_delegate &delegate
 	)
 	{
-		lb::file_ostream stream;
-		lb::open_stream_with_file_handle(stream, fh);
-		output_sequence(ref_seq, graph, stream, fasta_identifier, should_output_unaligned, delegate);
+		buffered_sequence_sink sink(fh.get());
+		output_sequence_(ref_seq, graph, sink, fasta_identifier, should_output_unaligned, delegate);
+		sink.flush();
+	}
+
+
+	void output_sequence(
+		sequence_type const &ref_seq,
+		variant_graph const &graph,
+		char *dst,
+		sequence_writing_delegate &delegate
+	)
+	{
+		memory_sequence_sink sink(dst);
+		output_sequence_(ref_seq, graph, sink, nullptr, false, delegate);
 	}
 }
@@ -3,42 +3,275 @@
  * This code is licensed under MIT license (see LICENSE for details).
  */
 
+#include <algorithm>
+#include <cerrno>
 #include <cstddef>
 #include <cstdint>
+#include <fcntl.h>
 #include <libbio/assert.hh>
 #include <libbio/int_matrix/int_matrix.hh>
+#include <string>
+#include <sys/stat.h>
+#include <system_error>
 #include <type_traits>
+#include <unistd.h>
+#include <vcf2multialign/parallel_for.hh>
 #include <vcf2multialign/transpose_matrix.hh>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#	define VCF2MULTIALIGN_HAVE_X86_TRANSPOSE_KERNELS
+#	include <immintrin.h>
+#endif
 
 namespace lb	= libbio;
+namespace v2m	= vcf2multialign;
 
 
-namespace vcf2multialign {
+namespace {
+
+	// Masks for the rounds of the recursive 64×64 transpose, the first one swaps 32×32 blocks.
+	constexpr std::uint64_t const TRANSPOSE_MASKS[6]{
+		0x0000'0000'FFFF'FFFF,
+		0x0000'FFFF'0000'FFFF,
+		0x00FF'00FF'00FF'00FF,
+		0x0F0F'0F0F'0F0F'0F0F,
+		0x3333'3333'3333'3333,
+		0x5555'5555'5555'5555
+	};
+
+	// Number of 64-column groups handled together. The destination words of the groups are adjacent,
+	// so the inner loop fills whole cache lines of each destination column.
+	constexpr std::size_t const COLUMN_GROUP_BLOCK_SIZE{8};
 
-	constexpr std::uint64_t transpose8x8(std::uint64_t const word)
+	typedef void (*transpose_kernel_type)(std::uint64_t *);
+
+
+	inline void swap_blocks(std::uint64_t * const block, unsigned const shift, std::uint64_t const mask)
 	{
-		// Partially from https://stackoverflow.com/a/41046873/856976
-		return (
-			  (word & 0x0100'0000'0000'0000) >> 49
-			| (word & 0x0201'0000'0000'0000) >> 42
-			| (word & 0x0402'0100'0000'0000) >> 35
-			| (word & 0x0804'0201'0000'0000) >> 28
-			| (word & 0x1008'0402'0100'0000) >> 21
-			| (word & 0x2010'0804'0201'0000) >> 14
-			| (word & 0x4020'1008'0402'0100) >> 7
-			| (word & 0x8040'2010'0804'0201)
-			| (word & 0x0080'4020'1008'0402) << 7
-			| (word & 0x0000'8040'2010'0804) << 14
-			| (word & 0x0000'0080'4020'1008) << 21
-			| (word & 0x0000'0000'8040'2010) << 28
-			| (word & 0x0000'0000'0080'4020) << 35
-			| (word & 0x0000'0000'0000'8040) << 42
-			| (word & 0x0000'0000'0000'0080) << 49
-		);
+		// Swap the upper right shift × shift sub-blocks with the lower left ones.
+		for (unsigned kk{}; kk < 64; kk = ((kk | shift) + 1) & ~shift)
+		{
+			auto const tt(((block[kk] >> shift) ^ block[kk | shift]) & mask);
+			block[kk | shift] ^= tt;
+			block[kk] ^= tt << shift;
+		}
+	}
+
+
+	// Transpose a 64×64 bit block in place, so that bit c of word r becomes bit r of word c.
+	void transpose64x64_portable(std::uint64_t * const block)
+	{
+		unsigned shift{32};
+		for (auto const mask : TRANSPOSE_MASKS)
+		{
+			swap_blocks(block, shift, mask);
+			shift /= 2;
+		}
+	}
+
+
+#if defined(VCF2MULTIALIGN_HAVE_X86_TRANSPOSE_KERNELS)
+	// The vector variants handle the rounds in which the words to be swapped are at least one vector apart,
+	// i.e. consecutive words may be loaded, and the rest with the scalar code.
+	__attribute__((target("avx2")))
+	void transpose64x64_avx2(std::uint64_t * const block)
+	{
+		unsigned shift{32};
+		for (auto const mask : TRANSPOSE_MASKS)
+		{
+			if (shift < 4)
+			{
+				swap_blocks(block, shift, mask);
+			}
+			else
+			{
+				auto const mask_(_mm256_set1_epi64x(mask));
+				auto const shift_(_mm_cvtsi32_si128(shift));
+				for (unsigned kk{}; kk < 64; kk += 2 * shift)
+				{
+					for (unsigned ii{}; ii < shift; ii += 4)
+					{
+						auto * const lo_ptr(reinterpret_cast <__m256i *>(block + kk + ii));
+						auto * const hi_ptr(reinterpret_cast <__m256i *>(block + kk + ii + shift));
+						auto lo(_mm256_loadu_si256(lo_ptr));
+						auto hi(_mm256_loadu_si256(hi_ptr));
+						auto const tt(_mm256_and_si256(_mm256_xor_si256(_mm256_srl_epi64(lo, shift_), hi), mask_));
+						hi = _mm256_xor_si256(hi, tt);
+						lo = _mm256_xor_si256(lo, _mm256_sll_epi64(tt, shift_));
+						_mm256_storeu_si256(lo_ptr, lo);
+						_mm256_storeu_si256(hi_ptr, hi);
+					}
+				}
+			}
+
+			shift /= 2;
+		}
+	}
+
+
+	__attribute__((target("avx512f")))
+	void transpose64x64_avx512(std::uint64_t * const block)
+	{
+		unsigned shift{32};
+		for (auto const mask : TRANSPOSE_MASKS)
+		{
+			if (shift < 8)
+			{
+				swap_blocks(block, shift, mask);
+			}
+			else
+			{
+				// The unmasked shifts trigger -Wmaybe-uninitialized in GCC’s headers.
+				constexpr __mmask8 const ALL_LANES(0xff);
+				auto const mask_(_mm512_set1_epi64(mask));
+				auto const shift_(_mm_cvtsi32_si128(shift));
+				for (unsigned kk{}; kk < 64; kk += 2 * shift)
+				{
+					for (unsigned ii{}; ii < shift; ii += 8)
+					{
+						auto * const lo_ptr(block + kk + ii);
+						auto * const hi_ptr(block + kk + ii + shift);
+						auto lo(_mm512_loadu_si512(lo_ptr));
+						auto hi(_mm512_loadu_si512(hi_ptr));
+						auto const tt(_mm512_and_si512(_mm512_xor_si512(_mm512_maskz_srl_epi64(ALL_LANES, lo, shift_), hi), mask_));
+						hi = _mm512_xor_si512(hi, tt);
+						lo = _mm512_xor_si512(lo, _mm512_maskz_sll_epi64(ALL_LANES, tt, shift_));
+						_mm512_storeu_si512(lo_ptr, lo);
+						_mm512_storeu_si512(hi_ptr, hi);
+					}
+				}
+			}
+
+			shift /= 2;
+		}
+	}
+#endif
+
+
+	transpose_kernel_type select_transpose_kernel()
+	{
+#if defined(VCF2MULTIALIGN_HAVE_X86_TRANSPOSE_KERNELS)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f"))
+			return &transpose64x64_avx512;
+		if (__builtin_cpu_supports("avx2"))
+			return &transpose64x64_avx2;
+#endif
+		return &transpose64x64_portable;
+	}
+
+
+	transpose_kernel_type transpose_kernel()
+	{
+		static transpose_kernel_type const retval(select_transpose_kernel());
+		return retval;
+	}
+
+
+	// Transpose the words [row_word_lb, row_word_rb) of each source column. load(col, word_idx) returns a source word,
+	// and store(dst_col, col_group, word) stores the word of the given column group to destination column
+	// 64 row_word_lb + dst_col.
+	template <typename t_load, typename t_store>
+	void transpose_words(
+		std::size_t const src_col_groups,
+		std::size_t const row_word_lb,
+		std::size_t const row_word_rb,
+		std::uint16_t const thread_count,
+		t_load &&load,
+		t_store &&store
+	)
+	{
+		auto const transpose64x64(transpose_kernel());
+		auto const col_group_blocks((src_col_groups + COLUMN_GROUP_BLOCK_SIZE - 1) / COLUMN_GROUP_BLOCK_SIZE);
+
+		// Each task handles COLUMN_GROUP_BLOCK_SIZE groups of 64 source columns, so the tasks write to
+		// distinct destination words. The source columns of the block are read sequentially.
+		v2m::parallel_for(col_group_blocks, thread_count, [&](std::size_t const block_idx){
+			auto const col_group_lb(block_idx * COLUMN_GROUP_BLOCK_SIZE);
+			auto const col_group_rb(std::min(src_col_groups, col_group_lb + COLUMN_GROUP_BLOCK_SIZE));
+			alignas(64) std::uint64_t block[64];
+
+			for (auto src_row_word_idx(row_word_lb); src_row_word_idx < row_word_rb; ++src_row_word_idx)
+			{
+				for (auto src_col_group(col_group_lb); src_col_group < col_group_rb; ++src_col_group)
+				{
+					// Word ii of the block contains rows [64 src_row_word_idx, 64 src_row_word_idx + 64) of the column.
+					for (std::size_t ii(0); ii < 64; ++ii)
+						block[ii] = load(64 * src_col_group + ii, src_row_word_idx);
+
+					(*transpose64x64)(block);
+
+					for (std::size_t ii(0); ii < 64; ++ii)
+						store(64 * (src_row_word_idx - row_word_lb) + ii, src_col_group, block[ii]);
+				}
+			}
+		});
+	}
+
+
+	// Write the transpose to path one stripe of destination columns at a time.
+	template <typename t_load>
+	void transpose_to_file(
+		std::size_t const src_col_groups,
+		std::size_t const src_col_words,
+		char const *path,
+		std::size_t const buffer_size,
+		std::uint16_t const thread_count,
+		t_load &&load
+	)
+	{
+		auto const fd(::open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH));
+		if (-1 == fd)
+			throw std::system_error(errno, std::generic_category(), std::string("Unable to open ") + path);
+
+		try
+		{
+			// Each source row word corresponds to 64 destination columns of src_col_groups words.
+			auto const dst_col_words(src_col_groups);
+			auto const stripe_words(std::max(std::size_t(1), buffer_size / (64 * dst_col_words * sizeof(std::uint64_t))));
+			std::vector <std::uint64_t> buffer(64 * std::min(stripe_words, src_col_words) * dst_col_words);
+
+			for (std::size_t row_word_lb(0); row_word_lb < src_col_words; row_word_lb += stripe_words)
+			{
+				auto const row_word_rb(std::min(src_col_words, row_word_lb + stripe_words));
+				transpose_words(src_col_groups, row_word_lb, row_word_rb, thread_count, load, [&](std::size_t const dst_col, std::size_t const col_group, std::uint64_t const word){
+					buffer[dst_col * dst_col_words + col_group] = word;
+				});
+
+				// The stripe is contiguous in the destination.
+				auto const *data(reinterpret_cast <char const *>(buffer.data()));
+				std::size_t remaining(64 * (row_word_rb - row_word_lb) * dst_col_words * sizeof(std::uint64_t));
+				while (remaining)
+				{
+					auto const res(::write(fd, data, remaining));
+					if (-1 == res)
+					{
+						if (EINTR == errno)
+							continue;
+						throw std::system_error(errno, std::generic_category(), std::string("Unable to write to ") + path);
+					}
+
+					data += res;
+					remaining -= res;
+				}
+			}
+		}
+		catch (...)
+		{
+			::close(fd);
+			throw;
+		}
+
+		if (-1 == ::close(fd))
+			throw std::system_error(errno, std::generic_category(), std::string("Unable to close ") + path);
 	}
+}
 
 
-	lb::bit_matrix transpose_matrix(lb::bit_matrix const &mat)
+namespace vcf2multialign {
+
+	lb::bit_matrix transpose_matrix(lb::bit_matrix const &mat, std::uint16_t const thread_count)
 	{
 		static_assert(std::is_same_v <std::uint64_t, lb::bit_matrix::value_type>);
 
@@ -60,51 +293,59 @@ namespace vcf2multialign {
 		auto &dst_values(dst.values());
 		libbio_assert_eq(src_values.size(), dst_values.size());
 
-		for (std::size_t src_row_word_idx(0); src_row_word_idx < src_col_words; ++src_row_word_idx)
-		{
-			for (std::uint8_t src_row_byte_idx(0); src_row_byte_idx < 8; ++src_row_byte_idx)
-			{
-				// Process 64 columns at a time so that we can fill the destination columns one 64-bit word at a time.
-				for (std::size_t src_col_group(0); src_col_group < src_col_groups; ++src_col_group)
-				{
-					std::uint64_t src_blocks[8]{};
-					std::uint64_t dst_blocks[8]{};
-
-					// Pack the src_row_byte_idx-th byte from each column in the group to the 8×8 matrix below.
-					for (std::uint8_t block_idx(0); block_idx < 8; ++block_idx)
-					{
-						for (std::uint8_t src_col_idx_add(0); src_col_idx_add < 8; ++src_col_idx_add)
-						{
-							auto const src_col_idx(64 * src_col_group + 8 * block_idx + src_col_idx_add);
-							auto const src_word_idx(src_col_idx * src_col_words + src_row_word_idx);
-							std::uint64_t src_word(src_values.word_at(src_word_idx));
-							src_word >>= 8 * src_row_byte_idx;
-							src_word &= 0xff;
-							src_word <<= 8 * src_col_idx_add;
-							src_blocks[block_idx] |= src_word;
-						}
-
-						dst_blocks[block_idx] = transpose8x8(src_blocks[block_idx]);
-					}
-
-					for (std::uint8_t block_col_idx(0); block_col_idx < 8; ++block_col_idx)
-					{
-						// Add src_col_group to get the correct word in the current column.
-						auto const dst_idx((64 * src_row_word_idx + 8 * src_row_byte_idx + block_col_idx) * dst_col_words + src_col_group);
-						auto &dst_word(dst_values.word_at(dst_idx));
-						for (std::uint8_t block_idx(0); block_idx < 8; ++block_idx)
-						{
-							std::uint64_t word(dst_blocks[block_idx]);
-							word >>= 8 * block_col_idx;
-							word &= 0xff;
-							word <<= 8 * block_idx;
-							dst_word |= word;
-						}
-					}
-				}
+		transpose_words(
+			src_col_groups,
+			0,
+			src_col_words,
+			thread_count,
+			[&](std::size_t const src_col, std::size_t const word_idx){
+				return src_values.word_at(src_col * src_col_words + word_idx);
+			},
+			[&](std::size_t const dst_col, std::size_t const col_group, std::uint64_t const word){
+				dst_values.word_at(dst_col * dst_col_words + col_group) = word;
 			}
-		}
+		);
 
 		return dst;
 	}
+
+
+	void transpose_matrix(lb::bit_matrix const &mat, char const *path, std::size_t const buffer_size, std::uint16_t const thread_count)
+	{
+		auto const src_nrow(mat.number_of_rows());
+		auto const src_ncol(mat.number_of_columns());
+		libbio_assert_eq(0, src_nrow % 64);
+		libbio_assert_eq(0, src_ncol % 64);
+		auto const src_col_words(src_nrow / 64);
+		auto const &src_values(mat.values());
+
+		transpose_to_file(src_ncol / 64, src_col_words, path, buffer_size, thread_count, [&](std::size_t const src_col, std::size_t const word_idx){
+			return src_values.word_at(src_col * src_col_words + word_idx);
+		});
+	}
+
+
+	void transpose_matrix(path_matrix const &mat, char const *path, std::size_t const buffer_size, std::uint16_t const thread_count)
+	{
+		auto const src_ncol(mat.number_of_columns());
+		auto const src_col_groups((src_ncol + 63) / 64);
+
+		transpose_to_file(src_col_groups, mat.words_per_column(), path, buffer_size, thread_count, [&](std::size_t const src_col, std::size_t const word_idx) -> std::uint64_t {
+			// Columns past the end of the matrix are padding.
+			if (src_ncol <= src_col)
+				return 0;
+
+			auto const column(mat.column(src_col));
+			if (column.is_dense())
+				return column.words()[word_idx];
+
+			// Sparse columns have few rows, so a binary search for each word is not expensive.
+			auto const rows(column.rows());
+			auto const row_lb(64 * word_idx);
+			std::uint64_t retval{};
+			for (auto it(std::lower_bound(rows.begin(), rows.end(), row_lb)); it != rows.end() && *it < row_lb + 64; ++it)
+				retval |= std::uint64_t(1) << (*it - row_lb);
+			return retval;
+		});
+	}
 }
@@ -4,459 +4,1712 @@
  */
 
 #include <algorithm>
-#include <cmath>
+#include <array>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <charconv>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <iostream>
 #include <libbio/assert.hh>
+#include <libbio/log_memory_usage.hh>
 #include <libbio/size_calculator.hh>
 #include <libbio/utility.hh>
 #include <libbio/vcf/constants.hh>
 #include <libbio/vcf/vcf_input.hh>
 #include <libbio/vcf/vcf_reader.hh>
 #include <map>
+#include <mutex>
+#include <optional>
+#include <range/v3/view/drop.hpp>
 #include <range/v3/view/enumerate.hpp>
 #include <range/v3/view/iota.hpp>
+#include <span>
+#include <stdexcept>
+#include <string>
 #include <string_view>
+#include <thread>
 #include <tuple>
 #include <utility>
-#include <vcf2multialign/transpose_matrix.hh>
+#include <vcf2multialign/bgzf_index.hh>
+#include <vcf2multialign/bgzf_reader.hh>
+#include <vcf2multialign/genotype_field_filter.hh>
+#include <vcf2multialign/state.hh>
 #include <vcf2multialign/variant_graph.hh>
 #include <vector>
 
 namespace lb	= libbio;
+namespace ml	= libbio::memory_logger;
 namespace rsv	= ranges::views;
+namespace v2m	= vcf2multialign;
 namespace vcf	= libbio::vcf;
 
 
 namespace {
 
-	// Boilerplate.
-	// FIXME: come up with a way not to duplicate the code needed for storing field pointers.
-	struct variant_format final : public vcf::variant_format
+	struct sample_chromosome_index
+	{
+		std::uint32_t	sample_vcf_index{};
+		std::uint32_t	sample_output_index{};
+		std::uint32_t	chromosome_copy_vcf_index{};
+		std::uint32_t	chromosome_copy_output_index{};
+
+		auto to_tuple() const { return std::make_tuple(sample_vcf_index, sample_output_index, chromosome_copy_vcf_index, chromosome_copy_output_index); }
+		bool operator<(sample_chromosome_index const &other) const { return to_tuple() < other.to_tuple(); }
+	};
+
+
+	// Plain text variant files are memory-mapped. BGZF-compressed files are decompressed in worker threads,
+	// and if the file has been indexed, only the records of the requested contig are read.
+	// The records are passed through genotype_field_filter, which removes the fields that are not needed
+	// and queues the sample columns, so that the genotypes can be decoded outside the parser.
+	class variant_file_input
+	{
+	private:
+		typedef boost::iostreams::filtering_istream	filtering_istream;
+
+		v2m::genotype_record_queue					m_genotype_records;	// Needs to be destroyed after the filter.
+		std::optional <v2m::bgzf_reader>			m_bgzf_reader;
+		vcf::stream_input <filtering_istream>		m_stream_input;
+		bool										m_is_indexed{};
+
+	public:
+		variant_file_input(char const *path, char const *chr_id, std::uint16_t const thread_count);
+
+		vcf::input_base &input() { return m_stream_input; }
+		v2m::genotype_record_queue &genotype_records() { return m_genotype_records; }
+		bool is_indexed() const { return m_is_indexed; }
+	};
+
+
+	variant_file_input::variant_file_input(char const *path, char const *chr_id, std::uint16_t const thread_count)
+	{
+		auto &stream(m_stream_input.stream());
+
+		if (!v2m::is_bgzf_file(path))
+		{
+			stream.push(v2m::genotype_field_filter(&m_genotype_records));
+			stream.push(boost::iostreams::mapped_file_source(path));
+			return;
+		}
+
+		m_bgzf_reader.emplace(path, thread_count);
+
+		{
+			// Check for BCF, which we cannot parse yet.
+			std::array <char, 3> magic{};
+			auto const res(m_bgzf_reader->read(magic.data(), magic.size()));
+			if (3 == res && std::string_view(magic.data(), magic.size()) == "BCF")
+			{
+				std::cerr << "ERROR: BCF input is not supported; please convert the file to bgzipped VCF.\n";
+				std::exit(EXIT_FAILURE);
+			}
+
+			m_bgzf_reader->seek(0);
+		}
+
+		stream.push(v2m::genotype_field_filter(&m_genotype_records));
+		if (auto const index_path(v2m::find_bgzf_index(path)); chr_id && !index_path.empty())
+		{
+			auto const offset(v2m::contig_offset_in_bgzf_index(index_path.c_str(), chr_id));
+			stream.push(v2m::bgzf_vcf_region_source(*m_bgzf_reader, offset.value_or(0), offset.has_value()));
+			m_is_indexed = true;
+		}
+		else
+		{
+			stream.push(v2m::bgzf_source(*m_bgzf_reader));
+		}
+	}
+
+
+	void prepare_reader(vcf::reader &reader)
+	{
+		vcf::add_reserved_info_keys(reader.info_fields());
+		vcf::add_reserved_genotype_keys(reader.genotype_fields());
+
+		// Read the headers.
+		reader.read_header();
+		reader.set_parsed_fields(vcf::field::ALT); // Parsed fields are specified as a prefix. The genotypes are taken from the genotype_record_queue of variant_file_input.
+	}
+
+
+	// Estimate the numbers of records of the given contigs for reserving memory. The counts are taken from
+	// the index statistics of BGZF-compressed files. In plain text files, records are sampled at evenly spaced
+	// offsets, and the count of a contig is estimated from the share of the samples that it has and their
+	// average length. Only the sampled records are read. Counts that cannot be determined are left unchanged;
+	// contigs that are too small to be sampled are then handled by growing the buffers as needed.
+	template <typename t_map>
+	void estimate_record_counts(char const *path, t_map &record_counts)
+	{
+		if (v2m::is_bgzf_file(path))
+		{
+			auto const index_path(v2m::find_bgzf_index(path));
+			if (index_path.empty())
+				return;
+
+			for (auto &[chr_id, count] : record_counts)
+			{
+				try
+				{
+					if (auto const count_(v2m::contig_record_count_in_bgzf_index(index_path.c_str(), chr_id)); count_)
+						count = *count_;
+				}
+				catch (std::runtime_error const &)
+				{
+					// The counts are only estimates, and the index is checked again if it is used for seeking.
+					return;
+				}
+			}
+
+			return;
+		}
+
+		boost::iostreams::mapped_file_source file(path);
+		std::string_view const contents(file.data(), file.size());
+
+		// Skip the header.
+		std::size_t data_start{};
+		while (data_start < contents.size() && '#' == contents[data_start])
+		{
+			auto const line_end(contents.find('\n', data_start));
+			if (std::string_view::npos == line_end)
+				return;
+			data_start = 1 + line_end;
+		}
+
+		if (contents.size() <= data_start)
+			return;
+
+		struct sampled_records
+		{
+			std::uint64_t	count{};
+			std::uint64_t	length{};	// Total length.
+		};
+
+		constexpr static std::size_t const SAMPLE_COUNT{1024};
+		auto const step(std::max(std::size_t(1), (contents.size() - data_start) / SAMPLE_COUNT));
+		std::map <std::string_view, sampled_records> samples_by_chr_id;
+		for (auto pos(data_start); pos < contents.size(); pos += step)
+		{
+			// Take the record that starts at or after pos.
+			auto line_start(pos);
+			if (data_start < pos)
+			{
+				line_start = contents.find('\n', pos - 1);
+				if (std::string_view::npos == line_start)
+					break;
+				++line_start;
+			}
+
+			auto line_end(contents.find('\n', line_start));
+			if (std::string_view::npos == line_end)
+				line_end = contents.size();
+
+			auto const line(contents.substr(line_start, line_end - line_start));
+			auto const chr_id(line.substr(0, line.find('\t')));
+			if (auto const it(record_counts.find(chr_id)); record_counts.end() != it)
+			{
+				auto &samples(samples_by_chr_id[it->first]);
+				++samples.count;
+				samples.length += 1 + line.size();
+			}
+		}
+
+		// Each sample stands for step bytes.
+		for (auto const &[chr_id, samples] : samples_by_chr_id)
+			record_counts.find(chr_id)->second = samples.count * samples.count * step / samples.length;
+	}
+
+
+	typedef v2m::variant_graph::position_type			position_type;
+	typedef v2m::variant_graph::edge_type				edge_type;
+	typedef v2m::variant_graph::ploidy_type				ploidy_type;
+	typedef decltype(vcf::sample_genotype::alt)			alt_type;
+
+
+	// The information about the current record that is needed for filling the path matrix.
+	struct path_record
+	{
+		std::vector <edge_type>		edges_by_alt;
+		std::vector <position_type>	edge_targets;	// Target reference positions by edge index minus min_edge.
+		position_type				ref_pos{};
+		edge_type					min_edge{};
+		edge_type					edge_limit{};	// Edge count after adding the edges of the record.
+	};
+
+
+	// A record with its undecoded genotypes, used for filling the path matrix in a worker thread.
+	struct buffered_path_record : public path_record
+	{
+		std::string					sample_columns;	// From genotype_record_queue.
+		std::vector <std::string>	var_id;
+		std::uint64_t				lineno{};
+	};
+
+
+	struct path_record_batch
+	{
+		constexpr static inline std::size_t const GENOTYPE_LIMIT{1 << 24};
+		constexpr static inline std::size_t const RECORD_LIMIT{256};
+
+		std::vector <buffered_path_record>	records;
+		std::size_t							size{};
+		std::size_t							max_size{};
+		edge_type							edge_lb{};	// Edge count before the edges of the first record.
+
+		explicit path_record_batch(ploidy_type const chrom_copy_count):
+			max_size(std::clamp(GENOTYPE_LIMIT / chrom_copy_count, std::size_t(1), RECORD_LIMIT))
+		{
+		}
+
+		buffered_path_record &next_record() { if (size == records.size()) records.emplace_back(); return records[size++]; }
+		bool is_full() const { return max_size <= size; }
+		bool empty() const { return 0 == size; }
+		void clear() { size = 0; }
+	};
+
+
+	struct overlapping_alternative
+	{
+		std::size_t	record_idx{};
+		ploidy_type	row_idx{};
+		alt_type	alt{};
+
+		auto to_tuple() const { return std::make_tuple(record_idx, row_idx); }
+		bool operator<(overlapping_alternative const &other) const { return to_tuple() < other.to_tuple(); }
+	};
+
+
+	// A one in the path matrix.
+	struct path_entry
+	{
+		edge_type	edge_idx{};
+		ploidy_type	row_idx{};
+	};
+
+
+	// Rows of the ones in the path matrix by column for a range of edges, added one record at a time.
+	// The rows of each column are in increasing order if the rows of each record are added in increasing order.
+	class column_rows_builder
+	{
+	private:
+		std::vector <path_entry>	m_record_entries;	// Not yet distributed to the columns.
+		std::vector <ploidy_type>	m_rows;
+		std::vector <std::size_t>	m_column_limits;	// End of each column in m_rows.
+		std::vector <std::size_t>	m_column_positions;	// For distributing the rows.
+		edge_type					m_edge_lb{};
+
+	public:
+		void clear(edge_type const edge_lb) { m_record_entries.clear(); m_rows.clear(); m_column_limits.clear(); m_edge_lb = edge_lb; }
+		void add(edge_type const edge_idx, ploidy_type const row_idx) { m_record_entries.emplace_back(edge_idx, row_idx); }
+
+		// Add the columns of the current record.
+		void finish_record(edge_type const edge_limit);
+
+		edge_type edge_lb() const { return m_edge_lb; }
+		edge_type edge_limit() const { return m_edge_lb + m_column_limits.size(); }
+		inline std::span <ploidy_type const> column(edge_type const edge_idx) const;
+	};
+
+
+	void column_rows_builder::finish_record(edge_type const edge_limit)
+	{
+		libbio_assert_lte(this->edge_limit(), edge_limit);
+		auto const column_lb(m_column_limits.size());
+		auto const column_count(edge_limit - this->edge_limit());
+
+		// Count the rows of each column and place them in the order in which they were added.
+		m_column_positions.assign(column_count, 0);
+		for (auto const &entry : m_record_entries)
+		{
+			libbio_assert_lte(m_edge_lb + column_lb, entry.edge_idx);
+			libbio_assert_lt(entry.edge_idx, edge_limit);
+			++m_column_positions[entry.edge_idx - m_edge_lb - column_lb];
+		}
+
+		auto pos(m_rows.size());
+		for (auto &column_pos : m_column_positions)
+		{
+			auto const count(column_pos);
+			column_pos = pos;
+			pos += count;
+			m_column_limits.push_back(pos);
+		}
+
+		m_rows.resize(pos);
+		for (auto const &entry : m_record_entries)
+			m_rows[m_column_positions[entry.edge_idx - m_edge_lb - column_lb]++] = entry.row_idx;
+
+		m_record_entries.clear();
+	}
+
+
+	std::span <ploidy_type const> column_rows_builder::column(edge_type const edge_idx) const
+	{
+		libbio_assert_lte(m_edge_lb, edge_idx);
+		libbio_assert_lt(edge_idx, edge_limit());
+		auto const column_idx(edge_idx - m_edge_lb);
+		auto const begin(column_idx ? m_column_limits[column_idx - 1] : 0);
+		return std::span(m_rows.data() + begin, m_column_limits[column_idx] - begin);
+	}
+
+
+	// Determine the included chromosome copies from the sample columns of the first record of a contig.
+	// The samples with at least one included chromosome copy are listed in sample_names and ploidy_csum.
+	void determine_included_samples(
+		std::string_view const sample_columns,
+		vcf::reader const &reader,
+		std::string_view const chr_id,
+		v2m::build_graph_delegate const &delegate,
+		std::vector <sample_chromosome_index> &included_samples,
+		v2m::variant_graph::string_vector &sample_names,
+		v2m::variant_graph::ploidy_csum_vector &ploidy_csum
+	)
+	{
+		auto const &all_sample_names(reader.sample_names_by_index());
+		included_samples.clear();
+		sample_names.clear();
+		ploidy_csum.clear();
+		ploidy_csum.push_back(0);
+
+		std::uint32_t sample_idx_output{};
+		std::size_t pos{};
+		for (std::uint32_t sample_idx_input{}; sample_idx_input < all_sample_names.size(); ++sample_idx_input)
+		{
+			// The ploidy is the number of alleles in GT.
+			std::string_view gt;
+			if (pos <= sample_columns.size())
+			{
+				auto const column_end(std::min(sample_columns.find('\t', pos), sample_columns.size()));
+				gt = sample_columns.substr(pos, column_end - pos);
+				pos = 1 + column_end;
+			}
+
+			std::uint32_t const ploidy(gt.empty() ? 0 : 1 + std::count_if(gt.begin(), gt.end(), [](char const cc){ return '|' == cc || '/' == cc; }));
+			ploidy_type included_count{};
+			for (auto const chrom_copy_idx : rsv::iota(0U, ploidy))
+			{
+				if (delegate.should_include(chr_id, all_sample_names[sample_idx_input], chrom_copy_idx))
+				{
+					included_samples.emplace_back(sample_idx_input, sample_idx_output, chrom_copy_idx, included_count);
+					++included_count;
+				}
+			}
+
+			if (included_count)
+			{
+				sample_names.emplace_back(all_sample_names[sample_idx_input]);
+				ploidy_csum.push_back(ploidy_csum.back() + included_count);
+				++sample_idx_output;
+			}
+		}
+
+		libbio_assert_eq(ploidy_csum.size(), 1 + sample_names.size());
+		libbio_assert_lte(sample_names.size(), ploidy_csum.back());
+	}
+
+
+	// Decode the alleles of the given chromosome copies from the sample columns of a record to dst.
+	// The copies need to be in the order of the samples and the chromosome copies, as in the included samples.
+	// Copies that the record does not have are assigned the null allele.
+	void decode_genotypes(
+		std::string_view const sample_columns,
+		std::span <sample_chromosome_index const> const chrom_copies,
+		std::uint64_t const lineno,
+		std::vector <alt_type> &dst
+	)
+	{
+		auto const fail([lineno](){
+			throw std::runtime_error("Unable to parse the genotypes on line " + std::to_string(lineno));
+		});
+
+		dst.clear();
+		std::uint32_t sample_idx{};
+		std::size_t pos{};	// Start of the column of sample_idx.
+		auto it(chrom_copies.begin());
+		auto const end(chrom_copies.end());
+		while (it != end)
+		{
+			// Find the column.
+			for (; sample_idx < it->sample_vcf_index; ++sample_idx)
+			{
+				pos = sample_columns.find('\t', pos);
+				if (std::string_view::npos == pos)
+					fail();
+				++pos;
+			}
+
+			// Decode the alleles and pick the ones of the included copies.
+			auto const *cc(sample_columns.data() + pos);
+			auto const * const columns_end(sample_columns.data() + sample_columns.size());
+			std::uint32_t chrom_copy_idx{};
+			while (true)
+			{
+				alt_type alt{vcf::sample_genotype::NULL_ALLELE};
+				if (cc != columns_end && '.' == *cc)
+					++cc;
+				else
+				{
+					auto const res(std::from_chars(cc, columns_end, alt));
+					if (std::errc{} != res.ec || vcf::sample_genotype::NULL_ALLELE == alt)
+						fail();
+					cc = res.ptr;
+				}
+
+				if (it != end && it->sample_vcf_index == sample_idx && it->chromosome_copy_vcf_index == chrom_copy_idx)
+				{
+					dst.push_back(alt);
+					++it;
+				}
+
+				++chrom_copy_idx;
+				if (cc == columns_end || '\t' == *cc)
+					break;
+
+				if (! ('|' == *cc || '/' == *cc))
+					fail();
+				++cc;
+			}
+
+			for (; it != end && it->sample_vcf_index == sample_idx; ++it)
+				dst.push_back(vcf::sample_genotype::NULL_ALLELE);
+		}
+	}
+
+
+	// Update the paths of the chromosome copies in [row_lb, row_rb).
+	template <typename t_alt_fn, typename t_overlap_fn>
+	void fill_paths(
+		path_record const &rec,
+		ploidy_type const row_lb,
+		ploidy_type const row_rb,
+		t_alt_fn &&alt_for_row,
+		std::vector <position_type> &target_ref_positions_by_chrom_copy,
+		column_rows_builder &columns,
+		t_overlap_fn &&report_overlap
+	)
+	{
+		for (auto const row_idx : rsv::iota(row_lb, row_rb))
+		{
+			alt_type const alt(alt_for_row(row_idx));
+
+			if (0 == alt)
+				continue;
+
+			if (vcf::sample_genotype::NULL_ALLELE == alt)
+				continue;
+
+			// Check that the alternative allele was handled.
+			libbio_assert_lt(alt - 1, rec.edges_by_alt.size());
+			auto const edge_idx(rec.edges_by_alt[alt - 1]);
+			if (v2m::variant_graph::EDGE_MAX == edge_idx)
+				continue;
+
+			// Check for overlapping edges for the current chromosome copy.
+			libbio_assert_lt(row_idx, target_ref_positions_by_chrom_copy.size());
+			if (rec.ref_pos < target_ref_positions_by_chrom_copy[row_idx])
+				report_overlap(row_idx, alt);
+
+			// Update the target position for this chromosome copy and the path information.
+			libbio_assert_lt(edge_idx - rec.min_edge, rec.edge_targets.size());
+			target_ref_positions_by_chrom_copy[row_idx] = rec.edge_targets[edge_idx - rec.min_edge];
+			columns.add(edge_idx, row_idx);
+		}
+
+		columns.finish_record(rec.edge_limit);
+	}
+
+
+	// Determines the paths in worker threads one batch of records at a time.
+	// Each worker handles a fixed range of chromosome copies, i.e. rows of the path matrix.
+	class path_matrix_filler
+	{
+	private:
+		struct worker_state
+		{
+			std::vector <overlapping_alternative>	overlaps;
+			column_rows_builder						columns;
+			std::vector <alt_type>					alts;	// By row minus row_lb.
+			ploidy_type								row_lb{};
+			ploidy_type								row_rb{};
+		};
+
+		std::vector <worker_state>			m_worker_states;
+		std::vector <sample_chromosome_index> const	*m_included_samples{};	// By row.
+		std::vector <position_type>			*m_target_ref_positions_by_chrom_copy{};
+		path_record_batch const				*m_batch{};
+		std::exception_ptr					m_exception;
+		std::mutex							m_mutex;
+		std::condition_variable				m_start_cv;
+		std::condition_variable				m_done_cv;
+		std::uint64_t						m_generation{};
+		std::size_t							m_running_count{};
+		bool								m_should_stop{};
+		std::vector <std::jthread>			m_workers;	// Needs to be destroyed first.
+
+	public:
+		path_matrix_filler(
+			std::uint16_t const thread_count,
+			std::vector <sample_chromosome_index> const &included_samples,
+			std::vector <position_type> &target_ref_positions_by_chrom_copy
+		);
+
+		~path_matrix_filler();
+
+		bool is_running() const { return m_batch; }
+		void start(path_record_batch const &batch);
+		void wait();
+
+		template <typename t_fn>
+		void report_overlaps(t_fn &&fn);
+
+		// Append the columns of the batch to paths. The rows of each column are concatenated in the order of the workers.
+		void append_path_columns(v2m::variant_graph::path_matrix &paths, std::vector <ploidy_type> &column_rows) const;
+
+	private:
+		void run(std::size_t const worker_idx);
+	};
+
+
+	path_matrix_filler::path_matrix_filler(
+		std::uint16_t const thread_count,
+		std::vector <sample_chromosome_index> const &included_samples,
+		std::vector <position_type> &target_ref_positions_by_chrom_copy
+	):
+		m_included_samples(&included_samples),
+		m_target_ref_positions_by_chrom_copy(&target_ref_positions_by_chrom_copy)
+	{
+		ploidy_type const row_count(included_samples.size());
+		ploidy_type const rows_per_worker((row_count + thread_count - 1) / thread_count);
+		for (ploidy_type row_lb{}; row_lb < row_count; row_lb += rows_per_worker)
+			m_worker_states.emplace_back(std::vector <overlapping_alternative>{}, column_rows_builder{}, std::vector <alt_type>{}, row_lb, std::min(row_count, row_lb + rows_per_worker));
+
+		m_workers.reserve(m_worker_states.size());
+		for (std::size_t i{}; i < m_worker_states.size(); ++i)
+			m_workers.emplace_back([this, i](){ run(i); });
+	}
+
+
+	path_matrix_filler::~path_matrix_filler()
+	{
+		{
+			std::lock_guard const lock(m_mutex);
+			m_should_stop = true;
+		}
+
+		m_start_cv.notify_all();
+		m_workers.clear();
+	}
+
+
+	void path_matrix_filler::start(path_record_batch const &batch)
+	{
+		libbio_assert(!m_batch);
+
+		{
+			std::lock_guard const lock(m_mutex);
+			for (auto &state : m_worker_states)
+			{
+				state.overlaps.clear();
+				state.columns.clear(batch.edge_lb);
+			}
+			m_batch = &batch;
+			m_running_count = m_workers.size();
+			++m_generation;
+		}
+
+		m_start_cv.notify_all();
+	}
+
+
+	void path_matrix_filler::wait()
+	{
+		std::unique_lock lock(m_mutex);
+		m_done_cv.wait(lock, [this](){ return 0 == m_running_count; });
+		m_batch = nullptr;
+
+		if (m_exception)
+			std::rethrow_exception(std::exchange(m_exception, nullptr));
+	}
+
+
+	template <typename t_fn>
+	void path_matrix_filler::report_overlaps(t_fn &&fn)
+	{
+		// Report in the order of the records and the rows.
+		std::vector <overlapping_alternative> overlaps;
+		for (auto const &state : m_worker_states)
+			overlaps.insert(overlaps.end(), state.overlaps.begin(), state.overlaps.end());
+
+		std::sort(overlaps.begin(), overlaps.end());
+		for (auto const &overlap : overlaps)
+			fn(overlap);
+	}
+
+
+	void path_matrix_filler::append_path_columns(v2m::variant_graph::path_matrix &paths, std::vector <ploidy_type> &column_rows) const
+	{
+		libbio_assert(!m_worker_states.empty());
+		auto const &first_columns(m_worker_states.front().columns);
+		libbio_assert_eq(paths.number_of_columns(), first_columns.edge_lb());
+
+		// The workers have consecutive ranges of rows.
+		for (auto edge_idx(first_columns.edge_lb()); edge_idx < first_columns.edge_limit(); ++edge_idx)
+		{
+			column_rows.clear();
+			for (auto const &state : m_worker_states)
+			{
+				auto const rows(state.columns.column(edge_idx));
+				column_rows.insert(column_rows.end(), rows.begin(), rows.end());
+			}
+
+			paths.push_back_column(column_rows);
+		}
+	}
+
+
+	void path_matrix_filler::run(std::size_t const worker_idx)
+	{
+		auto &state(m_worker_states[worker_idx]);
+		std::uint64_t generation{};
+		while (true)
+		{
+			path_record_batch const *batch{};
+
+			{
+				std::unique_lock lock(m_mutex);
+				m_start_cv.wait(lock, [this, generation](){ return m_should_stop || generation != m_generation; });
+				if (m_should_stop)
+					return;
+
+				generation = m_generation;
+				batch = m_batch;
+			}
+
+			try
+			{
+				// Only the genotypes of the rows of this worker are decoded.
+				std::span const chrom_copies(m_included_samples->data() + state.row_lb, state.row_rb - state.row_lb);
+				for (std::size_t record_idx{}; record_idx < batch->size; ++record_idx)
+				{
+					auto const &rec(batch->records[record_idx]);
+					decode_genotypes(rec.sample_columns, chrom_copies, rec.lineno, state.alts);
+					fill_paths(
+						rec,
+						state.row_lb,
+						state.row_rb,
+						[&state](ploidy_type const row_idx){ return state.alts[row_idx - state.row_lb]; },
+						*m_target_ref_positions_by_chrom_copy,
+						state.columns,
+						[&state, record_idx](ploidy_type const row_idx, alt_type const alt){
+							state.overlaps.emplace_back(record_idx, row_idx, alt);
+						}
+					);
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard const lock(m_mutex);
+				if (!m_exception)
+					m_exception = std::current_exception();
+			}
+
+			{
+				std::lock_guard const lock(m_mutex);
+				--m_running_count;
+				if (0 == m_running_count)
+					m_done_cv.notify_one();
+			}
+		}
+	}
+
+
+	struct edge_destination
+	{
+		position_type	ref_position{};		// Target reference position.
+		position_type	aligned_position{};	// Minimum target MSA position.
+		edge_type		edge_index{};
+
+		bool operator>(edge_destination const &other) const { return ref_position > other.ref_position; }
+	};
+
+
+	// Min-heap of edge destinations by reference position. The storage is reused,
+	// so nothing is allocated after the heap has reached its maximum size.
+	class edge_destination_queue
+	{
+	private:
+		std::vector <edge_destination>	m_heap;
+
+	public:
+		bool empty() const { return m_heap.empty(); }
+		edge_destination const &top() const { libbio_assert(!m_heap.empty()); return m_heap.front(); }
+		inline void push(edge_destination const &dst);
+		inline void pop();
+	};
+
+
+	void edge_destination_queue::push(edge_destination const &dst)
+	{
+		m_heap.push_back(dst);
+		std::push_heap(m_heap.begin(), m_heap.end(), std::greater <>{});
+	}
+
+
+	void edge_destination_queue::pop()
+	{
+		std::pop_heap(m_heap.begin(), m_heap.end(), std::greater <>{});
+		m_heap.pop_back();
+	}
+
+
+	// Builds the graph of one contig from the records that are passed to it.
+	class variant_graph_builder
+	{
+	private:
+		v2m::variant_graph									*m_graph{};
+		std::string_view									m_ref_seq;
+		std::string											m_chr_id;
+		vcf::reader											*m_reader{};
+		v2m::build_graph_delegate							*m_delegate{};
+		v2m::build_graph_chunk_delegate						*m_chunk_delegate{};
+		path_record											m_current_record;
+		std::vector <position_type>							m_target_ref_positions_by_chrom_copy;
+		edge_destination_queue								m_next_aligned_positions; // Aligned positions by reference position.
+		std::vector <sample_chromosome_index>				m_included_samples;
+		std::vector <alt_type>								m_alts;			// By path matrix row.
+		column_rows_builder									m_columns;		// Columns of the current record.
+		std::vector <ploidy_type>							m_column_rows;
+
+		// For filling the path matrix in worker threads. The parser thread fills one batch while the other is being processed.
+		std::optional <path_record_batch>					m_pending_batch;
+		std::optional <path_record_batch>					m_in_flight_batch;
+		std::optional <path_matrix_filler>					m_path_filler;	// Needs to be destroyed before the batches.
+
+		position_type										m_aln_pos{};
+		position_type										m_prev_ref_pos{};
+		std::uint64_t										m_expected_record_count{};
+		edge_type											m_min_chunk_edge_count{};
+		std::uint16_t										m_thread_count{};
+		bool												m_is_first{true};
+		bool												m_is_finished{};
+
+	public:
+		variant_graph_builder(
+			v2m::variant_graph &graph,
+			v2m::sequence_type const &ref_seq,
+			char const *chr_id,
+			vcf::reader &reader,
+			v2m::build_graph_delegate &delegate,
+			std::uint16_t const thread_count
+		);
+
+		variant_graph_builder(variant_graph_builder const &) = delete;
+		variant_graph_builder &operator=(variant_graph_builder const &) = delete;
+
+		std::string const &chr_id() const { return m_chr_id; }
+		bool has_records() const { return !m_is_first; }
+		bool is_finished() const { return m_is_finished; }
+
+		// Used for reserving memory for the graph when the first record is handled.
+		void set_expected_record_count(std::uint64_t const count) { m_expected_record_count = count; }
+
+		// Pass the graph to the delegate in chunks instead of building it as a whole.
+		void set_chunk_delegate(v2m::build_graph_chunk_delegate &delegate, edge_type const min_edge_count) { m_chunk_delegate = &delegate; m_min_chunk_edge_count = min_edge_count; }
+
+		// Returns false if parsing should be stopped. The sample columns may be swapped with another buffer.
+		bool handle_variant(vcf::transient_variant const &var, std::string &sample_columns, std::uint64_t const var_idx);
+
+		// Wait for the workers and stop them, e.g. when the records of another contig follow.
+		void suspend();
+
+		// Add the sink node, finalise the path matrices and release the excess memory or pass the last chunk to the delegate.
+		void finish();
+
+	private:
+		void determine_included_samples(std::string_view const sample_columns);
+		void add_target_nodes(position_type const ref_pos);
+		void report_overlap(std::uint64_t const lineno, position_type const ref_pos, std::vector <std::string_view> const &var_id, ploidy_type const row_idx, alt_type const alt);
+		void finish_in_flight_batch();
+		void submit_pending_batch();
+		void append_path_columns();
+		void complete_chunk();
+	};
+
+
+	variant_graph_builder::variant_graph_builder(
+		v2m::variant_graph &graph,
+		v2m::sequence_type const &ref_seq,
+		char const *chr_id,
+		vcf::reader &reader,
+		v2m::build_graph_delegate &delegate,
+		std::uint16_t const thread_count
+	):
+		m_graph(&graph),
+		m_ref_seq(ref_seq.data(), ref_seq.size()),
+		m_chr_id(chr_id),
+		m_reader(&reader),
+		m_delegate(&delegate),
+		m_thread_count(thread_count)
+	{
+		graph.sample_names = reader.sample_names_by_index();
+		graph.alt_edge_count_csum.push_back(0);
+		graph.add_node(0, 0);
+	}
+
+
+	void variant_graph_builder::add_target_nodes(position_type const ref_pos)
+	{
+		// The order of the destinations with the same reference position does not matter,
+		// since they share the node and its aligned position is the maximum.
+		while (!m_next_aligned_positions.empty())
+		{
+			auto const &dst(m_next_aligned_positions.top());
+			if (ref_pos < dst.ref_position)
+				break;
+
+			// Add the node.
+			auto const dist(dst.ref_position - m_prev_ref_pos); // Distance from the previous node.
+			m_aln_pos = std::max(m_aln_pos + dist, dst.aligned_position);
+			auto const node_idx(m_graph->add_or_update_node(dst.ref_position, m_aln_pos));
+			libbio_assert_lt(dst.edge_index, m_graph->alt_edge_targets.size());
+			m_graph->alt_edge_targets.set(dst.edge_index, node_idx);
+			m_prev_ref_pos = dst.ref_position;
+			m_next_aligned_positions.pop();
+		}
+	}
+
+
+	void variant_graph_builder::report_overlap(
+		std::uint64_t const lineno,
+		position_type const ref_pos,
+		std::vector <std::string_view> const &var_id,
+		ploidy_type const row_idx,
+		alt_type const alt
+	)
+	{
+		libbio_assert_lt(row_idx, m_included_samples.size());
+		auto const &sample_chr_idx(m_included_samples[row_idx]); // Rows are in the order of m_included_samples.
+		m_delegate->report_overlapping_alternative(
+			lineno,
+			ref_pos,
+			var_id,
+			m_reader->sample_names_by_index()[sample_chr_idx.sample_vcf_index],
+			sample_chr_idx.chromosome_copy_vcf_index,
+			alt
+		);
+	}
+
+
+	void variant_graph_builder::finish_in_flight_batch()
+	{
+		if (!(m_path_filler && m_path_filler->is_running()))
+			return;
+
+		m_path_filler->wait();
+		std::vector <std::string_view> var_id;
+		m_path_filler->report_overlaps([this, &var_id](overlapping_alternative const &overlap){
+			auto const &rec(m_in_flight_batch->records[overlap.record_idx]);
+			var_id.assign(rec.var_id.begin(), rec.var_id.end());
+			report_overlap(rec.lineno, rec.ref_pos, var_id, overlap.row_idx, overlap.alt);
+		});
+
+		libbio_assert(!m_in_flight_batch->empty());
+		m_path_filler->append_path_columns(m_graph->paths_by_edge_and_chrom_copy, m_column_rows);
+	}
+
+
+	void variant_graph_builder::append_path_columns()
+	{
+		auto &paths(m_graph->paths_by_edge_and_chrom_copy);
+		libbio_assert_eq(paths.number_of_columns(), m_columns.edge_lb());
+		for (auto edge_idx(m_columns.edge_lb()); edge_idx < m_columns.edge_limit(); ++edge_idx)
+			paths.push_back_column(m_columns.column(edge_idx));
+	}
+
+
+	void variant_graph_builder::submit_pending_batch()
+	{
+		finish_in_flight_batch();
+		if (m_pending_batch->empty())
+			return;
+
+		using std::swap;
+		swap(m_pending_batch, m_in_flight_batch);
+		m_pending_batch->clear();
+		m_path_filler->start(*m_in_flight_batch);
+	}
+
+
+	void variant_graph_builder::suspend()
+	{
+		if (!m_path_filler)
+			return;
+
+		submit_pending_batch();
+		finish_in_flight_batch();
+
+		// Release the threads and the buffers; they will be allocated again if more records of this contig follow.
+		m_path_filler.reset();
+		m_pending_batch.reset();
+		m_in_flight_batch.reset();
+	}
+
+
+	void variant_graph_builder::complete_chunk()
+	{
+		auto &graph(*m_graph);
+		libbio_assert(m_next_aligned_positions.empty());
+
+		// Fill the remaining columns of the path matrix without stopping the workers.
+		if (m_path_filler)
+		{
+			submit_pending_batch();
+			finish_in_flight_batch();
+		}
+		libbio_assert_eq(graph.paths_by_edge_and_chrom_copy.number_of_columns(), graph.edge_count());
+
+		m_chunk_delegate->handle_chunk(graph);
+
+		// Start the next chunk from the last node. The samples and the allocated memory are kept.
+		auto const ref_pos(graph.reference_positions.back());
+		auto const aln_pos(graph.aligned_positions.back());
+		graph.reference_positions.clear();
+		graph.aligned_positions.clear();
+		graph.alt_edge_targets.clear();
+		graph.alt_edge_count_csum.clear();
+		graph.alt_edge_labels.clear();
+		graph.paths_by_edge_and_chrom_copy.clear_columns();
+		graph.alt_edge_count_csum.push_back(0);
+		graph.add_node(ref_pos, aln_pos);
+	}
+
+
+	void variant_graph_builder::determine_included_samples(std::string_view const sample_columns)
+	{
+		auto &graph(*m_graph);
+		::determine_included_samples(sample_columns, *m_reader, m_chr_id, *m_delegate, m_included_samples, graph.sample_names, graph.ploidy_csum);
+		graph.paths_by_edge_and_chrom_copy = v2m::variant_graph::path_matrix(graph.ploidy_csum.back());
+		m_target_ref_positions_by_chrom_copy.resize(graph.ploidy_csum.back(), 0);
+
+		// Most records are biallelic and have a node of their own. The source and the sink nodes are added separately.
+		// Only one chunk is kept in memory at a time in the chunked mode, though.
+		if (m_expected_record_count && !m_chunk_delegate)
+			graph.reserve(2 + m_expected_record_count, m_expected_record_count, m_ref_seq.size());
+	}
+
+
+	bool variant_graph_builder::handle_variant(vcf::transient_variant const &var, std::string &sample_columns, std::uint64_t const var_idx)
+	{
+		auto &graph(*m_graph);
+
+		if (m_is_first)
+		{
+			m_is_first = false;
+			determine_included_samples(sample_columns);
+		}
+
+		if (1 < m_thread_count && graph.ploidy_csum.back() && !m_path_filler)
+		{
+			m_pending_batch.emplace(graph.ploidy_csum.back());
+			m_in_flight_batch.emplace(graph.ploidy_csum.back());
+			m_path_filler.emplace(m_thread_count, m_included_samples, m_target_ref_positions_by_chrom_copy);
+		}
+
+		auto const ref_pos(var.zero_based_pos());
+		if (! (m_prev_ref_pos <= ref_pos))
+		{
+			std::cerr << "ERROR: Variant " << var_idx << " has non-increasing position (" << m_prev_ref_pos << " v. " << ref_pos << ").\n";
+			std::exit(EXIT_FAILURE);
+		}
+
+		// Add nodes if needed.
+		add_target_nodes(ref_pos);
+
+		// Add node for the current record.
+		auto const dist(ref_pos - m_prev_ref_pos);
+		m_aln_pos += dist;
+		graph.add_or_update_node(ref_pos, m_aln_pos);
+
+		// The current node is a bridge if no ALT edge spans it. Since the edges of the current record
+		// have not been added yet, the chunk may be completed here.
+		if (m_chunk_delegate && m_next_aligned_positions.empty() && graph.edge_count() && m_min_chunk_edge_count <= graph.edge_count())
+			complete_chunk();
+
+		// Compare to the reference.
+		auto const &ref(var.ref());
+
+		{
+			auto const expected_ref(m_ref_seq.substr(ref_pos, ref.size()));
+			if (ref != expected_ref && !m_delegate->ref_column_mismatch(var_idx, var, expected_ref))
+				return false;
+		}
+
+		// Add the edges.
+		// We add even if none of the paths has the edge.
+		// FIXME: Take END into account here?
+		auto const edge_lb(graph.edge_count());
+		auto const &alts(var.alts());
+		auto &edges_by_alt(m_current_record.edges_by_alt);
+		auto &current_edge_targets(m_current_record.edge_targets);
+		edges_by_alt.clear();
+		edges_by_alt.resize(alts.size(), v2m::variant_graph::EDGE_MAX);
+		edge_type min_edge{};
+		current_edge_targets.clear();
+		{
+			bool is_first{true};
+			for (auto const &[alt_idx, alt] : rsv::enumerate(alts))
+			{
+				switch (alt.alt_sv_type)
+				{
+					case vcf::sv_type::NONE:
+					case vcf::sv_type::DEL:
+					{
+						auto const ref_target_pos(ref_pos + ref.size());
+						auto const edge_idx([&](){
+							if (vcf::sv_type::NONE == alt.alt_sv_type)
+							{
+								auto const edge_idx(graph.add_edge(alt.alt));
+								m_next_aligned_positions.push({ref_target_pos, m_aln_pos + alt.alt.size(), edge_idx});
+								return edge_idx;
+							}
+							else
+							{
+								auto const edge_idx(graph.add_edge());
+								m_next_aligned_positions.push({ref_target_pos, m_aln_pos, edge_idx});
+								return edge_idx;
+							}
+						}());
+
+						libbio_assert_lt(alt_idx, edges_by_alt.size());
+						edges_by_alt[alt_idx] = edge_idx;
+						current_edge_targets.emplace_back(ref_target_pos);
+
+						if (is_first)
+						{
+							min_edge = edge_idx;
+							is_first = false;
+						}
+						break;
+					}
+
+					default:
+						break;
+				}
+			}
+		}
+
+		// Paths.
+		m_current_record.ref_pos = ref_pos;
+		m_current_record.min_edge = min_edge;
+		m_current_record.edge_limit = graph.edge_count();
+		auto const lineno(var.lineno() + m_reader->last_header_lineno());
+		if (m_path_filler)
+		{
+			// Let the workers decode the genotypes. Only the buffer of the sample columns is swapped here.
+			if (m_pending_batch->empty())
+				m_pending_batch->edge_lb = edge_lb;
+
+			auto &rec(m_pending_batch->next_record());
+			static_cast <path_record &>(rec) = m_current_record;
+			rec.var_id.assign(var.id().begin(), var.id().end());
+			rec.lineno = lineno;
+			using std::swap;
+			swap(rec.sample_columns, sample_columns);
+
+			if (m_pending_batch->is_full())
+				submit_pending_batch();
+		}
+		else
+		{
+			decode_genotypes(sample_columns, m_included_samples, lineno, m_alts);
+			m_columns.clear(edge_lb);
+			fill_paths(
+				m_current_record,
+				0,
+				m_included_samples.size(),
+				[this](ploidy_type const row_idx){ return m_alts[row_idx]; },
+				m_target_ref_positions_by_chrom_copy,
+				m_columns,
+				[&var, this, lineno, ref_pos](ploidy_type const row_idx, alt_type const alt){
+					report_overlap(lineno, ref_pos, var.id(), row_idx, alt);
+				}
+			);
+			append_path_columns();
+		}
+
+		m_prev_ref_pos = ref_pos;
+		return true;
+	}
+
+
+	void variant_graph_builder::finish()
 	{
-		vcf::genotype_field_gt	*gt_field{};
+		libbio_assert(!m_is_finished);
+		m_is_finished = true;
+		auto &graph(*m_graph);
 
-		// Return a new empty instance of this class.
-		virtual variant_format *new_instance() const override { return new variant_format(); }
+		// Handle the remaining genotypes.
+		suspend();
 
-		virtual void reader_did_update_format(vcf::reader &reader) override
+		// Add a sink node.
 		{
-			this->assign_field_ptr("GT", gt_field);
+			auto const ref_pos(m_ref_seq.size());
+			add_target_nodes(ref_pos);
+			auto const dist(ref_pos - m_prev_ref_pos);
+			graph.add_or_update_node(ref_pos, m_aln_pos + dist);
 		}
-	};
 
-	inline variant_format const &get_variant_format(vcf::variant const &var)
-	{
-		libbio_assert(var.reader()->has_assigned_variant_format());
-		return static_cast <variant_format const &>(var.get_format());
-	}
+		libbio_assert_eq(graph.paths_by_edge_and_chrom_copy.number_of_columns(), graph.edge_count());
 
-	inline variant_format const &get_variant_format(vcf::transient_variant const &var)
-	{
-		libbio_assert(var.reader()->has_assigned_variant_format());
-		return static_cast <variant_format const &>(var.get_format());
+		if (m_chunk_delegate)
+		{
+			m_chunk_delegate->handle_chunk(graph);
+			return;
+		}
+
+		{
+			// Reported separately so that the memory logger shows the graph size before and after.
+			ml::state_guard const guard(v2m::state::shrink_variant_graph);
+			graph.shrink_to_fit();
+		}
 	}
 
 
-	struct sample_chromosome_index
+	// Adds the paths of the samples of a variant file to an existing graph. The records are matched
+	// to the nodes and the edges of the graph in order, so they need to be the same as those from
+	// which the graph was built, apart from the samples.
+	class sample_appender
 	{
-		std::uint32_t	sample_vcf_index{};
-		std::uint32_t	sample_output_index{};
-		std::uint32_t	chromosome_copy_vcf_index{};
-		std::uint32_t	chromosome_copy_output_index{};
+	private:
+		v2m::variant_graph									*m_graph{};
+		std::string											m_chr_id;
+		vcf::reader											*m_reader{};
+		v2m::build_graph_delegate							*m_delegate{};
+		path_record											m_current_record;
+		std::vector <position_type>							m_target_ref_positions_by_chrom_copy;
+		std::vector <sample_chromosome_index>				m_included_samples;
+		std::vector <alt_type>								m_alts;			// By new chromosome copy.
+		column_rows_builder									m_columns;		// Rows relative to the first new chromosome copy.
+		v2m::variant_graph::string_vector					m_sample_names;
+		v2m::variant_graph::ploidy_csum_vector				m_ploidy_csum;
+		v2m::variant_graph::node_type						m_node_idx{};
+		edge_type											m_edge_idx{};
+		bool												m_is_first{true};
+
+	public:
+		sample_appender(
+			v2m::variant_graph &graph,
+			char const *chr_id,
+			vcf::reader &reader,
+			v2m::build_graph_delegate &delegate
+		):
+			m_graph(&graph),
+			m_chr_id(chr_id),
+			m_reader(&reader),
+			m_delegate(&delegate)
+		{
+		}
 
-		auto to_tuple() const { return std::make_tuple(sample_vcf_index, sample_output_index, chromosome_copy_vcf_index, chromosome_copy_output_index); }
-		bool operator<(sample_chromosome_index const &other) const { return to_tuple() < other.to_tuple(); }
-	};
-}
+		std::string const &chr_id() const { return m_chr_id; }
+		bool has_records() const { return !m_is_first; }
+		void handle_variant(vcf::transient_variant const &var, std::string_view const sample_columns, std::uint64_t const var_idx);
 
+		// Add the new rows to the path matrix.
+		void finish();
 
-namespace vcf2multialign {
+	private:
+		[[noreturn]] void report_mismatch(std::uint64_t const var_idx) const;
+	};
 
-	auto variant_graph::add_node(position_type const ref_pos, position_type const aln_pos) -> node_type
+
+	void sample_appender::report_mismatch(std::uint64_t const var_idx) const
 	{
-		reference_positions.emplace_back(ref_pos);
-		aligned_positions.emplace_back(aln_pos);
-		alt_edge_count_csum.emplace_back(alt_edge_count_csum.back());
-		return reference_positions.size() - 1;
+		throw std::runtime_error("Variant " + std::to_string(var_idx) + " does not match the variant graph; the records need to be the same as those from which the graph was built");
 	}
 
 
-	auto variant_graph::add_or_update_node(position_type const ref_pos, position_type const aln_pos) -> node_type
+	void sample_appender::handle_variant(vcf::transient_variant const &var, std::string_view const sample_columns, std::uint64_t const var_idx)
 	{
-		auto const last_ref_pos(reference_positions.back());
-		libbio_assert_lte(last_ref_pos, ref_pos);
+		auto const &graph(*m_graph);
 
-		if (last_ref_pos < ref_pos)
-			return add_node(ref_pos, aln_pos);
+		if (m_is_first)
+		{
+			m_is_first = false;
+			determine_included_samples(sample_columns, *m_reader, m_chr_id, *m_delegate, m_included_samples, m_sample_names, m_ploidy_csum);
+			m_target_ref_positions_by_chrom_copy.resize(m_ploidy_csum.back(), 0);
 
-		aligned_positions.back() = std::max(aligned_positions.back(), aln_pos);
-		return reference_positions.size() - 1;
-	}
+			for (auto const &name : m_sample_names)
+			{
+				if (graph.sample_names.end() != std::find(graph.sample_names.begin(), graph.sample_names.end(), name))
+				{
+					std::cerr << "ERROR: Sample “" << name << "” is already in the variant graph.\n";
+					std::exit(EXIT_FAILURE);
+				}
+			}
+		}
+
+		// Find the node of the record.
+		auto const ref_pos(var.zero_based_pos());
+		while (m_node_idx < graph.node_count() && graph.reference_positions[m_node_idx] < ref_pos)
+			++m_node_idx;
+
+		if (! (m_node_idx < graph.node_count() && graph.reference_positions[m_node_idx] == ref_pos))
+			report_mismatch(var_idx);
+
+		// Match the edges.
+		auto const &ref(var.ref());
+		auto const &alts(var.alts());
+		auto &edges_by_alt(m_current_record.edges_by_alt);
+		auto &current_edge_targets(m_current_record.edge_targets);
+		edges_by_alt.clear();
+		edges_by_alt.resize(alts.size(), v2m::variant_graph::EDGE_MAX);
+		current_edge_targets.clear();
+		m_current_record.min_edge = m_edge_idx;
+		auto const target_ref_pos(ref_pos + ref.size());
+		for (auto const &[alt_idx, alt] : rsv::enumerate(alts))
+		{
+			switch (alt.alt_sv_type)
+			{
+				case vcf::sv_type::NONE:
+				case vcf::sv_type::DEL:
+				{
+					// The edge needs to belong to the current node, since the labels of the edges of
+					// the previous nodes may be identical.
+					auto const expected_label(vcf::sv_type::NONE == alt.alt_sv_type ? std::string_view(alt.alt) : std::string_view{});
+					if (! (
+						graph.alt_edge_count_csum[m_node_idx] <= m_edge_idx &&
+						m_edge_idx < graph.alt_edge_count_csum[1 + m_node_idx] &&
+						graph.alt_edge_labels[m_edge_idx] == expected_label &&
+						graph.reference_positions[graph.alt_edge_targets[m_edge_idx]] == target_ref_pos
+					))
+						report_mismatch(var_idx);
+
+					edges_by_alt[alt_idx] = m_edge_idx;
+					current_edge_targets.emplace_back(target_ref_pos);
+					++m_edge_idx;
+					break;
+				}
 
+				default:
+					break;
+			}
+		}
 
-	auto variant_graph::add_edge(std::string_view const label) -> edge_type
-	{
-		++alt_edge_count_csum.back();
-		alt_edge_targets.emplace_back();
-		alt_edge_labels.emplace_back(label);
-		return alt_edge_targets.size() - 1;
+		// Paths.
+		m_current_record.ref_pos = ref_pos;
+		m_current_record.edge_limit = m_edge_idx;
+		auto const lineno(var.lineno() + m_reader->last_header_lineno());
+		decode_genotypes(sample_columns, m_included_samples, lineno, m_alts);
+		fill_paths(
+			m_current_record,
+			0,
+			m_included_samples.size(),
+			[this](ploidy_type const row_idx){ return m_alts[row_idx]; },
+			m_target_ref_positions_by_chrom_copy,
+			m_columns,
+			[&var, this, lineno, ref_pos](ploidy_type const row_idx, alt_type const alt){
+				auto const &sample_chr_idx(m_included_samples[row_idx]);
+				m_delegate->report_overlapping_alternative(
+					lineno,
+					ref_pos,
+					var.id(),
+					m_reader->sample_names_by_index()[sample_chr_idx.sample_vcf_index],
+					sample_chr_idx.chromosome_copy_vcf_index,
+					alt
+				);
+			}
+		);
 	}
 
 
-	void build_variant_graph(
-		sequence_type const &ref_seq,
-		char const *variants_path,
-		char const *chr_id,
-		variant_graph &graph,
-		build_graph_statistics &stats,
-		build_graph_delegate &delegate
-	)
+	void sample_appender::finish()
 	{
-		typedef variant_graph::position_type	position_type;
-		typedef variant_graph::edge_type		edge_type;
-
-		struct edge_destination
+		auto &graph(*m_graph);
+
+		if (m_edge_idx != graph.edge_count())
+			throw std::runtime_error("The variant file has fewer records of chromosome “" + m_chr_id + "” than the variant graph");
+
+		if (m_sample_names.empty())
+			return;
+
+		// The existing columns are copied, since the rows of each column are stored together.
+		auto const &paths(graph.paths_by_edge_and_chrom_copy);
+		auto const prev_row_count(graph.total_chromosome_copies());
+		v2m::variant_graph::path_matrix new_paths(prev_row_count + m_ploidy_csum.back());
+		std::vector <ploidy_type> rows;
+		std::vector <ploidy_type> column_rows;
+		libbio_assert_eq(m_columns.edge_limit(), graph.edge_count());
+		for (edge_type edge_idx{}; edge_idx < graph.edge_count(); ++edge_idx)
 		{
-			edge_type		edge_index{};
-			position_type	position{};
-		};
-
-		constexpr std::size_t const path_matrix_row_col_divisor{64}; // Make sure we can transpose the matrix with the 8×8 operation.
-		constexpr std::size_t const path_column_allocation{512};
-
-		std::string_view const ref_seq_sv{ref_seq.data(), ref_seq.size()};
+			auto const prev_rows(paths.column(edge_idx).to_rows(rows));
+			column_rows.assign(prev_rows.begin(), prev_rows.end());
+			for (auto const row_idx : m_columns.column(edge_idx))
+				column_rows.push_back(prev_row_count + row_idx);
+			new_paths.push_back_column(column_rows);
+		}
 
-		// FIXME: Use the BCF library when it is ready.
-		// Open the variant file.
-		vcf::mmap_input vcf_input;
-		vcf_input.handle().open(variants_path);
+		m_columns.clear(0);
+		new_paths.shrink_to_fit();
+		graph.paths_by_edge_and_chrom_copy = std::move(new_paths);
 
-		vcf::reader reader(vcf_input);
+		graph.sample_names.insert(graph.sample_names.end(), m_sample_names.begin(), m_sample_names.end());
+		for (auto const csum : m_ploidy_csum | rsv::drop(1))
+			graph.ploidy_csum.push_back(prev_row_count + csum);
+	}
 
-		vcf::add_reserved_info_keys(reader.info_fields());
-		vcf::add_reserved_genotype_keys(reader.genotype_fields());
 
-		// Read the headers.
-		reader.set_variant_format(new variant_format());
-		reader.read_header();
-		reader.set_parsed_fields(vcf::field::ALL);
+	// If chunk_delegate is not null, the graph of the only contig is passed to it in chunks.
+	// If contig_delegate is not null, each graph is passed to it when the records of its contig end.
+	void build_variant_graphs(
+		char const *variants_path,
+		std::span <v2m::variant_graph_contig const> const contigs,
+		v2m::build_graph_statistics &stats,
+		v2m::build_graph_delegate &delegate,
+		v2m::build_graph_chunk_delegate *chunk_delegate,
+		v2m::build_graph_contig_delegate *contig_delegate,
+		edge_type const min_chunk_edge_count,
+		std::uint16_t const thread_count
+	)
+	{
+		libbio_assert(!chunk_delegate || 1 == contigs.size());
+		libbio_assert(!(chunk_delegate && contig_delegate));
 
-		graph.sample_names = reader.sample_names_by_index();
-		graph.alt_edge_count_csum.emplace_back(0);
-		graph.add_node(0, 0);
+		// FIXME: Use the BCF library when it is ready.
+		// Open the variant file. The index can only be used for seeking if there is exactly one contig.
+		variant_file_input vcf_input(variants_path, (1 == contigs.size() ? contigs.front().chromosome_id : nullptr), thread_count);
+		vcf::reader reader(vcf_input.input());
+		prepare_reader(reader);
+
+		// The builders are not movable since the workers refer to their members. They are in the order of the contigs.
+		std::deque <variant_graph_builder> builders;
+		std::map <std::string_view, std::size_t, std::less <>> builder_indices_by_chr_id;
+		for (auto const &contig : contigs)
+		{
+			libbio_assert(contig.reference);
+			libbio_assert(contig.chromosome_id);
+			libbio_assert(contig.graph);
 
-		std::uint64_t var_idx{};
-		position_type aln_pos{};
-		position_type prev_ref_pos{};
-		bool is_first{true};
-		std::vector <edge_type> edges_by_alt;
-		std::vector <position_type> target_ref_positions_by_chrom_copy;
-		std::vector <position_type> current_edge_targets;
-		std::multimap <position_type, edge_destination> next_aligned_positions; // Aligned positions by reference position.
-		std::vector <sample_chromosome_index> included_samples;
-
-		auto add_target_nodes([&graph, &aln_pos, &prev_ref_pos, &next_aligned_positions](position_type const ref_pos){
-			auto const end(next_aligned_positions.end());
-			auto it(next_aligned_positions.begin());
-			auto const begin(it);
-			for (; it != end; ++it)
+			auto &builder(builders.emplace_back(*contig.graph, *contig.reference, contig.chromosome_id, reader, delegate, thread_count));
+			if (!builder_indices_by_chr_id.emplace(builder.chr_id(), builders.size() - 1).second)
 			{
-				if (ref_pos < it->first)
-					break;
-
-				// Add the node.
-				auto const dist(it->first - prev_ref_pos); // Distance from the previous node.
-				aln_pos = std::max(aln_pos + dist, it->second.position);
-				auto const node_idx(graph.add_or_update_node(it->first, aln_pos));
-				libbio_assert_lt(it->second.edge_index, graph.alt_edge_targets.size());
-				graph.alt_edge_targets[it->second.edge_index] = node_idx;
-				prev_ref_pos = it->first;
+				std::cerr << "ERROR: Chromosome “" << builder.chr_id() << "” was listed more than once.\n";
+				std::exit(EXIT_FAILURE);
 			}
+		}
+
+		if (chunk_delegate)
+			builders.front().set_chunk_delegate(*chunk_delegate, min_chunk_edge_count);
+		else
+		{
+			std::map <std::string_view, std::uint64_t, std::less <>> record_counts;
+			for (auto const &builder : builders)
+				record_counts.emplace(builder.chr_id(), 0);
 
-			next_aligned_positions.erase(begin, it);
+			estimate_record_counts(variants_path, record_counts);
+			for (auto &builder : builders)
+				builder.set_expected_record_count(record_counts.find(builder.chr_id())->second);
+		}
+
+		auto finish_contig([&builders, contigs, contig_delegate](std::size_t const idx){
+			builders[idx].finish();
+			if (contig_delegate)
+				contig_delegate->handle_contig_graph(contigs[idx]);
 		});
 
+		std::uint64_t var_idx{};
+		variant_graph_builder *current_builder{};
+		std::size_t current_builder_idx{};
+		v2m::genotype_record_queue::record genotype_record;
 		reader.parse(
 			[
-				chr_id,
-				&graph,
 				&stats,
-				&delegate,
-				ref_seq_sv,
 				&reader,
 				&var_idx,
-				&aln_pos,
-				&prev_ref_pos,
-				&is_first,
-				&edges_by_alt,
-				&target_ref_positions_by_chrom_copy,
-				&current_edge_targets,
-				&next_aligned_positions,
-				&included_samples,
-				&add_target_nodes
+				&builders,
+				&builder_indices_by_chr_id,
+				&current_builder,
+				&current_builder_idx,
+				&vcf_input,
+				&genotype_record,
+				&finish_contig,
+				contig_delegate
 			](vcf::transient_variant const &var) -> bool {
 				++var_idx;
-				auto const * const gt_field(get_variant_format(var).gt_field);
+				vcf_input.genotype_records().pop(genotype_record); // Every record has been queued by the filter.
+				auto const chr_id(var.chrom_id());
+
+				// Records of the same contig usually follow each other. If the graphs are passed to the delegate,
+				// the graph of the previous contig is complete.
+				if (! (current_builder && current_builder->chr_id() == chr_id))
+				{
+					if (current_builder)
+					{
+						if (contig_delegate)
+							finish_contig(current_builder_idx);
+						else
+							current_builder->suspend();
+					}
+
+					auto const it(builder_indices_by_chr_id.find(chr_id));
+					if (builder_indices_by_chr_id.end() == it)
+						current_builder = nullptr;
+					else
+					{
+						current_builder_idx = it->second;
+						current_builder = &builders[current_builder_idx];
+						if (current_builder->is_finished())
+						{
+							std::cerr << "ERROR: The records of chromosome “" << chr_id << "” are not contiguous; the variant file needs to be sorted by chromosome.\n";
+							std::exit(EXIT_FAILURE);
+						}
+					}
+				}
 
-				if (var.chrom_id() != chr_id)
+				if (!current_builder)
 				{
+					// The records of the contig are contiguous in indexed files.
+					if (vcf_input.is_indexed() && builders.front().has_records())
+						return false;
+
 					++stats.chr_id_mismatches;
 					goto end;
 				}
 
-				if (!gt_field)
+				if (!genotype_record.has_genotypes)
 				{
 					std::cerr << "ERROR: Variant " << var_idx << " does not have a genotype.\n";
 					std::exit(EXIT_FAILURE);
 				}
 
-				if (is_first)
-				{
-					is_first = false;
-
-					// Check the ploidy and sample inclusion.
-    				graph.ploidy_csum.clear();
-					graph.ploidy_csum.resize(1 + graph.sample_names.size(), 0);
-					std::vector <std::uint32_t> removed_samples; // No chromosome copies included.
-					auto const &sample_names(reader.sample_names_by_index());
-					std::size_t sample_idx_output{};
-					for (auto const &[sample_idx_input, sample] : rsv::enumerate(var.samples()))
-					{
-						auto const &gt((*gt_field)(sample));
-						variant_graph::ploidy_type included_count{};
-						for (auto const chrom_copy_idx : rsv::iota(0U, gt.size()))
-						{
-							if (delegate.should_include(sample_names[sample_idx_input], chrom_copy_idx))
-							{
-								included_samples.emplace_back(sample_idx_input, sample_idx_output, chrom_copy_idx, included_count);
-								++included_count;
-							}
-						}
+				++stats.handled_variants;
+				if (!current_builder->handle_variant(var, genotype_record.sample_columns, var_idx))
+					return false;
 
-						if (included_count)
-						{
-							libbio_assert_lt(1 + sample_idx_output, graph.ploidy_csum.size());
-							graph.ploidy_csum[1 + sample_idx_output] = graph.ploidy_csum[sample_idx_output] + included_count;
-							++sample_idx_output;
-						}
-						else
-						{
-							removed_samples.push_back(sample_idx_input);
-						}
-					}
+			end:
+				if (0 == var_idx % 1'000'000)
+					lb::log_time(std::cerr) << "Handled " << var_idx << " variants…\n";
+				return true; // Continue parsing.
+			}
+		);
 
-					// If sample names were removed, replace the name vector.
-					if (!removed_samples.empty())
-					{
-						libbio_assert_lte(removed_samples.size(), graph.ploidy_csum.size());
-						graph.ploidy_csum.resize(graph.ploidy_csum.size() - removed_samples.size());
+		if (contig_delegate && current_builder)
+			finish_contig(current_builder_idx);
+
+		for (std::size_t idx{}; idx < builders.size(); ++idx)
+		{
+			if (!builders[idx].is_finished())
+				finish_contig(idx);
+		}
+	}
+}
 
-						removed_samples.push_back(UINT32_MAX);
-						auto it(removed_samples.begin());
-						variant_graph::label_vector new_sample_names;
 
-						libbio_assert_lte((removed_samples.size() - 1), graph.sample_names.size());
-						new_sample_names.reserve(graph.sample_names.size() - (removed_samples.size() - 1));
+namespace vcf2multialign {
 
-						for (auto &&[idx, sample_name] : rsv::enumerate(graph.sample_names))
-						{
-							if (idx < *it)
-								new_sample_names.emplace_back(std::move(sample_name));
-							else
-								++it;
-						}
+	auto variant_graph::add_node(position_type const ref_pos, position_type const aln_pos) -> node_type
+	{
+		reference_positions.push_back(ref_pos);
+		aligned_positions.push_back(aln_pos);
+		alt_edge_count_csum.push_back(alt_edge_count_csum.back());
+		return reference_positions.size() - 1;
+	}
 
-						using std::swap;
-						swap(graph.sample_names, new_sample_names);
-					}
 
-					{
-						// Make sure the row count is divisible by path_matrix_row_col_divisor.
-						std::size_t const path_matrix_rows(path_matrix_row_col_divisor * std::ceil(1.0 * graph.ploidy_csum.back() / path_matrix_row_col_divisor));
-						graph.paths_by_edge_and_chrom_copy = (
-							path_matrix_rows
-							? variant_graph::path_matrix(path_matrix_rows, path_column_allocation)
-							: variant_graph::path_matrix(1, 0)
-						);
-					}
+	auto variant_graph::add_or_update_node(position_type const ref_pos, position_type const aln_pos) -> node_type
+	{
+		auto const last_ref_pos(reference_positions.back());
+		libbio_assert_lte(last_ref_pos, ref_pos);
 
-					libbio_assert_eq(graph.ploidy_csum.size(), 1 + graph.sample_names.size());
-					libbio_assert_lte(graph.sample_names.size(), graph.ploidy_csum.back());
-					target_ref_positions_by_chrom_copy.resize(graph.ploidy_csum.back(), 0);
-				}
+		if (last_ref_pos < ref_pos)
+			return add_node(ref_pos, aln_pos);
 
-				{
-					++stats.handled_variants;
-					auto const ref_pos(var.zero_based_pos());
-					if (! (prev_ref_pos <= ref_pos))
-					{
-						std::cerr << "ERROR: Variant " << var_idx << " has non-increasing position (" << prev_ref_pos << " v. " << ref_pos << ").\n";
-						std::exit(EXIT_FAILURE);
-					}
+		auto const node_idx(reference_positions.size() - 1);
+		aligned_positions.set(node_idx, std::max(aligned_positions.back(), aln_pos));
+		return node_idx;
+	}
 
-					// Add nodes if needed.
-					add_target_nodes(ref_pos);
 
-					// Add node for the current record.
-					auto const dist(ref_pos - prev_ref_pos);
-					aln_pos += dist;
-					auto const node_idx(graph.add_or_update_node(ref_pos, aln_pos));
+	auto variant_graph::add_edge(std::string_view const label) -> edge_type
+	{
+		alt_edge_count_csum.set(alt_edge_count_csum.size() - 1, 1 + alt_edge_count_csum.back());
+		alt_edge_targets.push_back(0);
+		alt_edge_labels.push_back(label);
+		return alt_edge_targets.size() - 1;
+	}
 
-					// Compare to the reference.
-					auto const &ref(var.ref());
 
-					{
-						auto const expected_ref(ref_seq_sv.substr(ref_pos, ref.size()));
-						if (ref != expected_ref && !delegate.ref_column_mismatch(var_idx, var, expected_ref))
-							return false;
-					}
+	void variant_graph::reserve(node_type const node_count, edge_type const edge_count, position_type const max_position)
+	{
+		reference_positions.reserve(node_count, max_position);
+		aligned_positions.reserve(node_count, max_position);
+		alt_edge_targets.reserve(edge_count, node_count);
+		alt_edge_count_csum.reserve(1 + node_count, edge_count);
+		alt_edge_labels.reserve(edge_count, edge_count); // Most labels are single characters.
+		paths_by_edge_and_chrom_copy.reserve_columns(edge_count);
+	}
 
-					// Add the edges.
-					// We add even if none of the paths has the edge.
-					// FIXME: Take END into account here?
-					auto const &alts(var.alts());
-					edges_by_alt.clear();
-					edges_by_alt.resize(alts.size(), variant_graph::EDGE_MAX);
-					edge_type min_edge{}, max_edge{};
-					current_edge_targets.clear();
-					{
-						bool is_first{true};
-						for (auto const &[alt_idx, alt] : rsv::enumerate(alts))
-						{
-							switch (alt.alt_sv_type)
-							{
-								case vcf::sv_type::NONE:
-								case vcf::sv_type::DEL:
-								{
-									auto const ref_target_pos(ref_pos + ref.size());
-									auto const edge_idx([&](){
-										if (vcf::sv_type::NONE == alt.alt_sv_type)
-										{
-											auto const edge_idx(graph.add_edge(alt.alt));
-											next_aligned_positions.emplace(ref_target_pos, edge_destination{edge_idx, aln_pos + alt.alt.size()});
-											return edge_idx;
-										}
-										else
-										{
-											auto const edge_idx(graph.add_edge());
-											next_aligned_positions.emplace(ref_target_pos, edge_destination{edge_idx, aln_pos});
-											return edge_idx;
-										}
-									}());
-
-									libbio_assert_lt(alt_idx, edges_by_alt.size());
-									edges_by_alt[alt_idx] = edge_idx;
-									current_edge_targets.emplace_back(ref_target_pos);
-
-									if (is_first)
-									{
-										min_edge = edge_idx;
-										is_first = false;
-									}
-									max_edge = edge_idx;
-									break;
-								}
-
-								default:
-									break;
-							}
-						}
-					}
 
-					// Check that we have enough space for the paths.
-					{
-						auto const ncol(graph.paths_by_edge_and_chrom_copy.number_of_columns());
-						if (ncol && ncol <= max_edge)
-						{
-							auto const multiplier(4 + ncol / path_column_allocation);
-							graph.paths_by_edge_and_chrom_copy.resize(graph.paths_by_edge_and_chrom_copy.number_of_rows() * multiplier * path_column_allocation, 0);
-						}
-					}
+	void variant_graph::shrink_to_fit()
+	{
+		reference_positions.shrink_to_fit();
+		aligned_positions.shrink_to_fit();
+		alt_edge_targets.shrink_to_fit();
+		alt_edge_count_csum.shrink_to_fit();
+		alt_edge_labels.shrink_to_fit();
+		paths_by_edge_and_chrom_copy.shrink_to_fit();
+		sample_names.shrink_to_fit();
+		ploidy_csum.shrink_to_fit();
+	}
 
-					// Paths.
-					for (auto const &sample_chr_idx : included_samples)
-					{
-						auto const sample_idx_input(sample_chr_idx.sample_vcf_index);
-						auto const sample_idx_output(sample_chr_idx.sample_output_index);
-						auto const chr_idx_input(sample_chr_idx.chromosome_copy_vcf_index);
-						auto const chr_idx_output(sample_chr_idx.chromosome_copy_output_index);
-
-						auto const &sample(var.samples()[sample_idx_input]);
-						auto const &gt((*gt_field)(sample));
-						libbio_assert_lt(sample_idx_output, graph.ploidy_csum.size());
-						auto const base_idx(graph.ploidy_csum[sample_idx_output]); // Base index for this sample.
-						libbio_assert_lt(chr_idx_input, gt.size());
-						auto const &sample_gt(gt[chr_idx_input]);
-
-						if (0 == sample_gt.alt)
-							continue;
-
-						if (vcf::sample_genotype::NULL_ALLELE == sample_gt.alt)
-							continue;
-
-						// Check that the alternative allele was handled.
-						libbio_assert_lt(sample_gt.alt - 1, edges_by_alt.size());
-						auto const edge_idx(edges_by_alt[sample_gt.alt - 1]);
-						if (variant_graph::EDGE_MAX == edge_idx)
-							continue;
-
-						// Check for overlapping edges for the current sample.
-						auto const row_idx(base_idx + chr_idx_output);
-						libbio_assert_lt(row_idx, target_ref_positions_by_chrom_copy.size());
-						if (ref_pos < target_ref_positions_by_chrom_copy[row_idx])
-						{
-							delegate.report_overlapping_alternative(
-								var.lineno() + reader.last_header_lineno(),
-								ref_pos,
-								var.id(),
-								reader.sample_names_by_index()[sample_idx_input],
-								chr_idx_input,
-								sample_gt.alt
-							);
-						}
 
-						// Update the target position for this chromosome copy and the path information.
-						libbio_assert_lt(edge_idx - min_edge, current_edge_targets.size());
-						auto const target_pos(current_edge_targets[edge_idx - min_edge]);
-						target_ref_positions_by_chrom_copy[row_idx] = target_pos;
-						graph.paths_by_edge_and_chrom_copy(row_idx, edge_idx) |= 1;
-					}
+	void build_variant_graphs(
+		char const *variants_path,
+		std::span <variant_graph_contig const> const contigs,
+		build_graph_statistics &stats,
+		build_graph_delegate &delegate,
+		std::uint16_t const thread_count
+	)
+	{
+		::build_variant_graphs(variants_path, contigs, stats, delegate, nullptr, nullptr, 0, thread_count);
+	}
 
-					prev_ref_pos = ref_pos;
-				}
 
-			end:
-				if (0 == var_idx % 1'000'000)
-					lb::log_time(std::cerr) << "Handled " << var_idx << " variants…\n";
-				return true; // Continue parsing.
+	void build_variant_graphs(
+		char const *variants_path,
+		std::span <variant_graph_contig const> const contigs,
+		build_graph_statistics &stats,
+		build_graph_delegate &delegate,
+		build_graph_contig_delegate &contig_delegate,
+		std::uint16_t const thread_count
+	)
+	{
+		::build_variant_graphs(variants_path, contigs, stats, delegate, nullptr, &contig_delegate, 0, thread_count);
+	}
+
+
+	void build_variant_graph(
+		sequence_type const &ref_seq,
+		char const *variants_path,
+		char const *chr_id,
+		variant_graph &graph,
+		build_graph_statistics &stats,
+		build_graph_delegate &delegate,
+		std::uint16_t const thread_count
+	)
+	{
+		variant_graph_contig const contig{&ref_seq, chr_id, &graph};
+		build_variant_graphs(variants_path, std::span(&contig, 1), stats, delegate, thread_count);
+	}
+
+
+	void build_variant_graph_chunks(
+		sequence_type const &ref_seq,
+		char const *variants_path,
+		char const *chr_id,
+		build_graph_statistics &stats,
+		build_graph_delegate &delegate,
+		build_graph_chunk_delegate &chunk_delegate,
+		variant_graph::edge_type const min_edge_count,
+		std::uint16_t const thread_count
+	)
+	{
+		variant_graph graph;
+		variant_graph_contig const contig{&ref_seq, chr_id, &graph};
+		::build_variant_graphs(variants_path, std::span(&contig, 1), stats, delegate, &chunk_delegate, nullptr, min_edge_count, thread_count);
+	}
+
+
+	void append_samples(
+		char const *variants_path,
+		char const *chr_id,
+		variant_graph &graph,
+		build_graph_statistics &stats,
+		build_graph_delegate &delegate,
+		std::uint16_t const thread_count
+	)
+	{
+		libbio_assert(!graph.ploidy_csum.empty());
+
+		variant_file_input vcf_input(variants_path, chr_id, thread_count);
+		vcf::reader reader(vcf_input.input());
+		prepare_reader(reader);
+
+		sample_appender appender(graph, chr_id, reader, delegate);
+		std::uint64_t var_idx{};
+		v2m::genotype_record_queue::record genotype_record;
+		reader.parse([&stats, &vcf_input, &appender, &var_idx, &genotype_record](vcf::transient_variant const &var) -> bool {
+			++var_idx;
+			vcf_input.genotype_records().pop(genotype_record); // Every record has been queued by the filter.
+			if (0 == var_idx % 1'000'000)
+				lb::log_time(std::cerr) << "Handled " << var_idx << " variants…\n";
+
+			if (var.chrom_id() != appender.chr_id())
+			{
+				// The records of the contig are contiguous in indexed files.
+				if (vcf_input.is_indexed() && appender.has_records())
+					return false;
+
+				++stats.chr_id_mismatches;
+				return true;
 			}
-		);
 
-		// Add a sink node.
-		{
-			auto const ref_pos(ref_seq.size());
-			add_target_nodes(ref_pos);
-			auto const dist(ref_pos - prev_ref_pos);
-			graph.add_or_update_node(ref_pos, aln_pos + dist);
-		}
+			if (!genotype_record.has_genotypes)
+			{
+				std::cerr << "ERROR: Variant " << var_idx << " does not have a genotype.\n";
+				std::exit(EXIT_FAILURE);
+			}
 
-		// Remove extra entries.
-		// Does not actually shrink to fit.
-		if (graph.paths_by_edge_and_chrom_copy.size())
-		{
-			std::size_t const ncol(path_matrix_row_col_divisor * std::ceil(1.0 * graph.edge_count() / path_matrix_row_col_divisor));
-			graph.paths_by_edge_and_chrom_copy.resize(graph.paths_by_edge_and_chrom_copy.number_of_rows() * ncol, 0);
-		}
+			++stats.handled_variants;
+			appender.handle_variant(var, genotype_record.sample_columns, var_idx);
+			return true;
+		});
 
-		graph.paths_by_chrom_copy_and_edge = transpose_matrix(graph.paths_by_edge_and_chrom_copy);
+		appender.finish();
 	}
 }
 
 
 namespace libbio::size_calculation {
 
+	void value_size_calculator <vcf2multialign::packed_vector>::operator()(
+		size_calculator &sc,
+		entry_index_type const entry_idx,
+		vcf2multialign::packed_vector const &vec
+	) const
+	{
+		sc.add_entry_for(entry_idx, "words", vec.words());
+	}
+
+
+	void value_size_calculator <vcf2multialign::path_matrix>::operator()(
+		size_calculator &sc,
+		entry_index_type const entry_idx,
+		vcf2multialign::path_matrix const &mat
+	) const
+	{
+		sc.add_entry_for(entry_idx, "dense_words", mat.dense_words());
+		sc.add_entry_for(entry_idx, "sparse_rows", mat.sparse_rows());
+		sc.add_entry_for(entry_idx, "column_offsets", mat.column_offsets());
+		sc.add_entry_for(entry_idx, "one_counts", mat.one_counts());
+	}
+
+
+	void value_size_calculator <vcf2multialign::packed_label_vector>::operator()(
+		size_calculator &sc,
+		entry_index_type const entry_idx,
+		vcf2multialign::packed_label_vector const &vec
+	) const
+	{
+		sc.add_entry_for(entry_idx, "characters", vec.characters());
+		sc.add_entry_for(entry_idx, "offsets", vec.offsets());
+	}
+
+
 	void value_size_calculator <vcf2multialign::variant_graph>::operator()(
 		size_calculator &sc,
 		entry_index_type const entry_idx,
@@ -468,7 +1721,6 @@ namespace libbio::size_calculation {
 		sc.add_entry_for(entry_idx, "alt_edge_targets", graph.alt_edge_targets);
 		sc.add_entry_for(entry_idx, "alt_edge_count_csum", graph.alt_edge_count_csum);
 		sc.add_entry_for(entry_idx, "alt_edge_labels", graph.alt_edge_labels);
-		sc.add_entry_for(entry_idx, "paths_by_chrom_copy_and_edge", graph.paths_by_chrom_copy_and_edge);
 		sc.add_entry_for(entry_idx, "paths_by_edge_and_chrom_copy", graph.paths_by_edge_and_chrom_copy);
 		// FIXME: add sample_names
 		sc.add_entry_for(entry_idx, "ploidy_csum", graph.ploidy_csum);
@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <catch2/catch_all.hpp>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <libbio/fasta_reader.hh>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vcf2multialign/bgzf_index.hh>
+#include <vcf2multialign/bgzf_reader.hh>
+#include <vcf2multialign/variant_graph.hh>
+#include <vector>
+#include <zlib.h>
+
+namespace fs	= std::filesystem;
+namespace lb	= libbio;
+namespace v2m	= vcf2multialign;
+namespace vcf	= libbio::vcf;
+
+
+namespace {
+
+	template <typename t_type>
+	void append_le(std::string &dst, t_type const val)
+	{
+		char buffer[sizeof(t_type)];
+		std::memcpy(buffer, &val, sizeof(t_type));
+		dst.append(buffer, sizeof(t_type));
+	}
+
+
+	void append_bgzf_block(std::string &dst, std::string_view const data)
+	{
+		z_stream stream{};
+		REQUIRE(Z_OK == deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY));
+
+		std::string compressed(deflateBound(&stream, data.size()), '\0');
+		stream.next_in = reinterpret_cast <Bytef *>(const_cast <char *>(data.data()));
+		stream.avail_in = data.size();
+		stream.next_out = reinterpret_cast <Bytef *>(compressed.data());
+		stream.avail_out = compressed.size();
+		REQUIRE(Z_STREAM_END == deflate(&stream, Z_FINISH));
+		compressed.resize(stream.total_out);
+		deflateEnd(&stream);
+
+		// Header with the BC extra subfield.
+		dst.append("\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0", 16);
+		append_le <std::uint16_t>(dst, compressed.size() + 26 /* header and footer */ - 1);
+		dst += compressed;
+		append_le <std::uint32_t>(dst, crc32(0, reinterpret_cast <Bytef const *>(data.data()), data.size()));
+		append_le <std::uint32_t>(dst, data.size());
+	}
+
+
+	// Compress the given contents with small blocks so that they span several blocks.
+	// Returns the compressed offsets of the blocks, including the EOF marker.
+	std::vector <std::size_t> write_bgzf_contents(std::string_view const contents, fs::path const &dst_path, std::size_t const block_size)
+	{
+		std::string compressed;
+		std::vector <std::size_t> retval;
+		for (std::size_t pos{}; pos < contents.size(); pos += block_size)
+		{
+			retval.push_back(compressed.size());
+			append_bgzf_block(compressed, contents.substr(pos, block_size));
+		}
+		retval.push_back(compressed.size());
+		append_bgzf_block(compressed, ""); // EOF marker
+
+		std::ofstream os(dst_path, std::ios::binary);
+		os << compressed;
+		return retval;
+	}
+
+
+	void write_bgzf_file(fs::path const &src_path, fs::path const &dst_path, std::size_t const block_size)
+	{
+		std::ifstream is(src_path);
+		std::string const contents(std::istreambuf_iterator <char>(is), std::istreambuf_iterator <char>{});
+		write_bgzf_contents(contents, dst_path, block_size);
+	}
+
+
+	struct indexed_contig
+	{
+		std::string								name;
+		v2m::bgzf_reader::virtual_offset_type	begin{};
+		v2m::bgzf_reader::virtual_offset_type	end{};
+		std::uint64_t							record_count{};
+	};
+
+
+	// The tabix header fields and the sequence names, also used as the auxiliary data of CSI.
+	void append_tabix_header(std::string &dst, std::vector <indexed_contig> const &contigs)
+	{
+		append_le <std::int32_t>(dst, 2);	// format: VCF
+		append_le <std::int32_t>(dst, 1);	// col_seq
+		append_le <std::int32_t>(dst, 2);	// col_beg
+		append_le <std::int32_t>(dst, 0);	// col_end
+		append_le <std::int32_t>(dst, '#');	// meta
+		append_le <std::int32_t>(dst, 0);	// skip
+
+		std::string names;
+		for (auto const &contig : contigs)
+		{
+			names += contig.name;
+			names += '\0';
+		}
+		append_le <std::int32_t>(dst, names.size());
+		dst += names;
+	}
+
+
+	// One bin for the records and the pseudo-bin with the record counts.
+	void append_bins(std::string &dst, indexed_contig const &contig, std::uint32_t const pseudo_bin, bool const has_loffset)
+	{
+		append_le <std::int32_t>(dst, 2);
+
+		append_le <std::uint32_t>(dst, 4681);
+		if (has_loffset)
+			append_le <std::uint64_t>(dst, contig.begin);
+		append_le <std::int32_t>(dst, 1);
+		append_le <std::uint64_t>(dst, contig.begin);
+		append_le <std::uint64_t>(dst, contig.end);
+
+		append_le <std::uint32_t>(dst, pseudo_bin);
+		if (has_loffset)
+			append_le <std::uint64_t>(dst, 0);
+		append_le <std::int32_t>(dst, 2);
+		append_le <std::uint64_t>(dst, contig.begin);
+		append_le <std::uint64_t>(dst, contig.end);
+		append_le <std::uint64_t>(dst, contig.record_count);
+		append_le <std::uint64_t>(dst, 0);
+	}
+
+
+	void write_index(std::string_view const data, fs::path const &dst_path)
+	{
+		std::string compressed;
+		append_bgzf_block(compressed, data);
+		append_bgzf_block(compressed, "");
+		std::ofstream os(dst_path, std::ios::binary);
+		os << compressed;
+	}
+
+
+	void write_tbi(std::vector <indexed_contig> const &contigs, fs::path const &dst_path)
+	{
+		std::string data("TBI\1");
+		append_le <std::int32_t>(data, contigs.size());
+		append_tabix_header(data, contigs);
+		for (auto const &contig : contigs)
+		{
+			append_bins(data, contig, 37450, false);
+			append_le <std::int32_t>(data, 1);	// Linear index.
+			append_le <std::uint64_t>(data, contig.begin);
+		}
+		write_index(data, dst_path);
+	}
+
+
+	void write_csi(std::vector <indexed_contig> const &contigs, fs::path const &dst_path, std::size_t const aux_padding)
+	{
+		std::string aux;
+		append_tabix_header(aux, contigs);
+		aux.append(aux_padding, '\0');
+
+		std::string data("CSI\1");
+		append_le <std::int32_t>(data, 14);	// min_shift
+		append_le <std::int32_t>(data, 5);	// depth
+		append_le <std::int32_t>(data, aux.size());
+		data += aux;
+		append_le <std::int32_t>(data, contigs.size());
+		for (auto const &contig : contigs)
+			append_bins(data, contig, 37450, true);
+		write_index(data, dst_path);
+	}
+
+
+	template <typename t_source>
+	std::string read_all(t_source &source)
+	{
+		std::string retval;
+		std::string buffer(100, '\0');
+		while (true)
+		{
+			auto const res(source.read(buffer.data(), buffer.size()));
+			if (res < 0)
+				break;
+			retval.append(buffer.data(), res);
+		}
+		return retval;
+	}
+
+
+	std::string read_bgzf_file(fs::path const &path, std::uint16_t const thread_count)
+	{
+		v2m::bgzf_reader reader(path.c_str(), thread_count);
+		return read_all(reader);
+	}
+
+
+	struct build_variant_graph_delegate final : public v2m::build_graph_delegate
+	{
+		bool should_include(std::string_view const chr_id, std::string_view const sample_name, v2m::variant_graph::ploidy_type const chrom_copy_idx) const override { return true; }
+
+		void report_overlapping_alternative(
+			std::uint64_t const lineno,
+			v2m::variant_graph::position_type const ref_pos,
+			std::vector <std::string_view> const &var_id,
+			std::string_view const sample_name,
+			v2m::variant_graph::ploidy_type const chrom_copy_idx,
+			std::uint32_t const gt
+		) override
+		{
+		}
+
+		bool ref_column_mismatch(std::uint64_t const var_idx, vcf::transient_variant const &var, std::string_view const expected) override
+		{
+			FAIL("REF column contents do not match the reference sequence in variant " << var_idx << ", position " << var.pos() << ". Expected: “" << expected << "” Actual: “" << var.ref() << "”");
+			return false;
+		}
+	};
+}
+
+
+SCENARIO("BGZF-compressed variant files can be read", "[bgzf_reader]")
+{
+	GIVEN("A bgzipped VCF file")
+	{
+		fs::path const base_path("test-files/variant-graph");
+		auto const vcf_path(base_path / "test-1a.vcf");
+		auto const bgzf_path(fs::temp_directory_path() / "vcf2multialign-test-1a.vcf.gz");
+		write_bgzf_file(vcf_path, bgzf_path, 100);
+
+		WHEN("the file is decompressed")
+		{
+			std::ifstream is(vcf_path);
+			std::string const expected(std::istreambuf_iterator <char>(is), std::istreambuf_iterator <char>{});
+
+			THEN("the contents match the original regardless of the number of threads")
+			{
+				REQUIRE(v2m::is_bgzf_file(bgzf_path.c_str()));
+				REQUIRE(!v2m::is_bgzf_file(vcf_path.c_str()));
+
+				for (std::uint16_t const thread_count : {1, 2, 4})
+				{
+					INFO("Threads: " << thread_count);
+					CHECK(expected == read_bgzf_file(bgzf_path, thread_count));
+				}
+			}
+		}
+
+		WHEN("a variant graph is built from the file")
+		{
+			v2m::sequence_type ref_seq;
+			REQUIRE(lb::read_single_fasta_sequence(base_path / "test-1.fa", ref_seq, nullptr));
+
+			build_variant_graph_delegate delegate;
+			v2m::variant_graph expected;
+			v2m::variant_graph actual;
+
+			{
+				v2m::build_graph_statistics stats;
+				v2m::build_variant_graph(ref_seq, vcf_path, "1", expected, stats, delegate);
+			}
+
+			{
+				v2m::build_graph_statistics stats;
+				v2m::build_variant_graph(ref_seq, bgzf_path, "1", actual, stats, delegate, 2);
+			}
+
+			THEN("the graph matches the one built from the uncompressed file")
+			{
+				CHECK(expected.reference_positions == actual.reference_positions);
+				CHECK(expected.aligned_positions == actual.aligned_positions);
+				CHECK(expected.alt_edge_targets == actual.alt_edge_targets);
+				CHECK(expected.alt_edge_count_csum == actual.alt_edge_count_csum);
+				CHECK(expected.alt_edge_labels == actual.alt_edge_labels);
+				CHECK(expected.paths_by_edge_and_chrom_copy == actual.paths_by_edge_and_chrom_copy);
+				CHECK(expected.sample_names == actual.sample_names);
+				CHECK(expected.ploidy_csum == actual.ploidy_csum);
+			}
+		}
+
+		fs::remove(bgzf_path);
+	}
+}
+
+
+SCENARIO("Records of a contig can be located with a tabix or CSI index", "[bgzf_reader]")
+{
+	GIVEN("A bgzipped VCF file with two contigs")
+	{
+		std::string const header(
+			"##fileformat=VCFv4.2\n"
+			"##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n"
+			"#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tSAMPLE1\tSAMPLE2\n"
+		);
+		std::string contents(header);
+		std::vector <std::size_t> contig_starts;
+		for (auto const *chr_id : {"1", "2"})
+		{
+			contig_starts.push_back(contents.size());
+			for (std::size_t pos{5}; pos < 12; ++pos)
+				contents += std::string(chr_id) + "\t" + std::to_string(pos) + "\t.\tA\tG\t.\tPASS\t.\tGT\t0|1\t1|0\n";
+		}
+		contig_starts.push_back(contents.size());
+
+		// Use a block size that places the contig boundary inside a block.
+		std::size_t const block_size(50);
+		auto const bgzf_path(fs::temp_directory_path() / "vcf2multialign-test-contigs.vcf.gz");
+		auto const block_offsets(write_bgzf_contents(contents, bgzf_path, block_size));
+		REQUIRE(0 != contig_starts[1] % block_size);
+
+		auto const virtual_offset([&](std::size_t const pos) -> v2m::bgzf_reader::virtual_offset_type {
+			return (block_offsets[pos / block_size] << 16) | (pos % block_size);
+		});
+
+		std::vector <indexed_contig> const contigs{
+			{"1", virtual_offset(contig_starts[0]), virtual_offset(contig_starts[1]), 7},
+			{"2", virtual_offset(contig_starts[1]), virtual_offset(contig_starts[2]), 7}
+		};
+
+		// Records of contig 2, found with a linear scan.
+		std::string expected_records;
+		{
+			std::istringstream is(read_bgzf_file(bgzf_path, 1));
+			std::string line;
+			while (std::getline(is, line))
+			{
+				if (line.starts_with("2\t"))
+					expected_records += line + '\n';
+			}
+		}
+		REQUIRE(std::string_view(contents).substr(contig_starts[1]) == expected_records);
+
+		auto const tbi_path(fs::path(bgzf_path) += ".tbi");
+		auto const csi_path(fs::path(bgzf_path) += ".csi");
+		fs::remove(csi_path);
+		write_tbi(contigs, tbi_path);
+
+		WHEN("the offsets are read from the index")
+		{
+			THEN("they match the contig boundaries")
+			{
+				REQUIRE(tbi_path == v2m::find_bgzf_index(bgzf_path.c_str()));
+
+				for (std::size_t const aux_padding : {0, 8})
+				{
+					INFO("CSI auxiliary data padding: " << aux_padding);
+					write_csi(contigs, csi_path, aux_padding);
+
+					for (auto const &index_path : {tbi_path, csi_path})
+					{
+						INFO("Index: " << index_path);
+						for (auto const &contig : contigs)
+						{
+							CHECK(contig.begin == v2m::contig_offset_in_bgzf_index(index_path.c_str(), contig.name));
+							CHECK(contig.record_count == v2m::contig_record_count_in_bgzf_index(index_path.c_str(), contig.name));
+						}
+
+						CHECK(!v2m::contig_offset_in_bgzf_index(index_path.c_str(), "3"));
+					}
+				}
+			}
+		}
+
+		WHEN("the reader seeks to the second contig")
+		{
+			THEN("the records match those found with a linear scan")
+			{
+				for (std::uint16_t const thread_count : {1, 2})
+				{
+					INFO("Threads: " << thread_count);
+					v2m::bgzf_reader reader(bgzf_path.c_str(), thread_count);
+					char buffer{};
+					CHECK(0 == reader.read(&buffer, 0));
+
+					reader.seek(contigs[1].begin);
+					CHECK(expected_records == read_all(reader));
+					CHECK(0 == reader.read(&buffer, 0));
+					CHECK(-1 == reader.read(&buffer, 1));
+
+					// Seeking back works after reaching the end.
+					reader.seek(contigs[0].begin);
+					CHECK(std::string_view(contents).substr(contig_starts[0]) == read_all(reader));
+				}
+			}
+		}
+
+		WHEN("the records are read with bgzf_vcf_region_source")
+		{
+			THEN("the header is followed by the records of the contig")
+			{
+				auto const offset(v2m::contig_offset_in_bgzf_index(tbi_path.c_str(), "2"));
+				REQUIRE(offset);
+
+				v2m::bgzf_reader reader(bgzf_path.c_str(), 2);
+				v2m::bgzf_vcf_region_source source(reader, *offset, true);
+				CHECK(header + expected_records == read_all(source));
+			}
+
+			THEN("only the header is returned if the contig is not in the index")
+			{
+				v2m::bgzf_reader reader(bgzf_path.c_str(), 2);
+				v2m::bgzf_vcf_region_source source(reader, 0, false);
+				CHECK(header == read_all(source));
+			}
+		}
+
+		fs::remove(bgzf_path);
+		fs::remove(tbi_path);
+		fs::remove(csi_path);
+	}
+}
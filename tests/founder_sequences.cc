@@ -6,7 +6,9 @@
 #include <catch2/catch_all.hpp>
 #include <cstdint>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <libbio/fasta_reader.hh>
 #include <libbio/subprocess.hh>
 #include <ostream>
@@ -15,6 +17,7 @@
 #include <string_view>
 #include <vcf2multialign/find_cut_positions.hh>
 #include <vcf2multialign/output.hh>
+#include <vcf2multialign/pbwt.hh>
 #include <vcf2multialign/variant_graph.hh>
 #include <vector>
 
@@ -38,7 +41,7 @@ namespace {
 
 	struct build_variant_graph_delegate final : public v2m::build_graph_delegate
 	{
-		bool should_include(std::string_view const sample_name, v2m::variant_graph::ploidy_type const chrom_copy_idx) const override { return true; }
+		bool should_include(std::string_view const chr_id, std::string_view const sample_name, v2m::variant_graph::ploidy_type const chrom_copy_idx) const override { return true; }
 
 		void report_overlapping_alternative(
 			std::uint64_t const lineno,
@@ -66,7 +69,7 @@ namespace {
 		void will_handle_founder_sequence(sample_type const idx) override {}
 		void handled_sequences(sequence_count_type const sequence_count) override {}
 		void exit_subprocess(v2m::subprocess_type &proc) override {}
-		void handled_node(v2m::variant_graph::node_type const node) override {}
+		void handled_node(v2m::variant_graph::node_type const node, v2m::pbwt_statistics const &stats) override {}
 
 		void unable_to_execute_subprocess(libbio::subprocess_status const &status) override
 		{
@@ -99,9 +102,13 @@ namespace {
 			v2m::build_variant_graph(ref_seq, base_path / vcf_name, "1", graph, stats, delegate);
 		}
 
+		for (auto const pbwt_impl : {v2m::pbwt_implementation::dense, v2m::pbwt_implementation::sparse})
 		{
+			INFO("pBWT: " << (v2m::pbwt_implementation::sparse == pbwt_impl ? "sparse" : "dense"));
+
 			output_delegate delegate;
 			v2m::founder_sequence_greedy_output output(nullptr, nullptr, true, false, false, delegate);
+			output.set_pbwt_implementation(pbwt_impl);
 			REQUIRE(output.find_cut_positions(graph, 0));
 			REQUIRE(expected_cut_positions == output.cut_positions());
 			REQUIRE(output.find_matchings(graph, 2));
@@ -110,6 +117,16 @@ namespace {
 			std::stringstream os;
 			output.output_a2m(ref_seq, graph, os);
 			REQUIRE(expected_output == os.view());
+
+			// Output to a file goes through a memory mapping.
+			auto const path(fs::temp_directory_path() / "vcf2multialign-test-founder-output.a2m");
+			output.set_thread_count(2);
+			output.output_a2m(ref_seq, graph, path.c_str());
+
+			std::ifstream is(path);
+			std::string const actual_output(std::istreambuf_iterator <char>(is), std::istreambuf_iterator <char>{});
+			fs::remove(path);
+			REQUIRE(expected_output == actual_output);
 		}
 	}
 }
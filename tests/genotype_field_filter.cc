@@ -0,0 +1,473 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <catch2/catch_all.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <libbio/fasta_reader.hh>
+#include <libbio/vcf/vcf_input.hh>
+#include <libbio/vcf/vcf_reader.hh>
+#include <random>
+#include <range/v3/view/zip.hpp>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vcf2multialign/genotype_field_filter.hh>
+#include <vcf2multialign/variant_graph.hh>
+#include <vector>
+
+namespace fs	= std::filesystem;
+namespace lb	= libbio;
+namespace rsv	= ranges::views;
+namespace v2m	= vcf2multialign;
+namespace vcf	= libbio::vcf;
+
+
+namespace {
+
+	std::string filter_in_chunks(std::string_view const input, std::size_t const chunk_size)
+	{
+		v2m::genotype_field_filter filter;
+		for (std::size_t pos{}; pos < input.size(); pos += chunk_size)
+			filter.filter(input.substr(pos, chunk_size));
+		return filter.output();
+	}
+
+
+	std::vector <v2m::genotype_record_queue::record> queue_in_chunks(std::string_view const input, std::size_t const chunk_size)
+	{
+		v2m::genotype_record_queue queue;
+		v2m::genotype_field_filter filter(&queue);
+		for (std::size_t pos{}; pos < input.size(); pos += chunk_size)
+		{
+			filter.filter(input.substr(pos, chunk_size));
+			filter.clear_output();
+		}
+
+		std::vector <v2m::genotype_record_queue::record> retval;
+		while (!queue.empty())
+			queue.pop(retval.emplace_back());
+		return retval;
+	}
+
+
+	// Add INFO and FORMAT fields to a VCF file that only has genotypes.
+	std::string add_annotations(std::string const &input)
+	{
+		std::istringstream is(input);
+		std::ostringstream os;
+		std::string line;
+		bool is_first{true};
+		while (std::getline(is, line))
+		{
+			if (line.starts_with("#"))
+			{
+				os << line << '\n';
+				if (is_first)
+				{
+					os << "##INFO=<ID=DP,Number=1,Type=Integer,Description=\"Depth\">\n";
+					os << "##FORMAT=<ID=AD,Number=R,Type=Integer,Description=\"Allelic depths\">\n";
+					os << "##FORMAT=<ID=PL,Number=G,Type=Integer,Description=\"Phred-scaled genotype likelihoods\">\n";
+					is_first = false;
+				}
+				continue;
+			}
+
+			std::istringstream line_is(line);
+			std::string field;
+			std::size_t field_idx{};
+			while (std::getline(line_is, field, '\t'))
+			{
+				if (field_idx)
+					os << '\t';
+
+				switch (field_idx)
+				{
+					case 7:
+						os << "DP=10";
+						break;
+					case 8:
+						os << "AD:GT:PL";
+						break;
+					default:
+						if (field_idx < 8)
+							os << field;
+						else
+							os << "3,4:" << field << ":0,10,100";
+						break;
+				}
+
+				++field_idx;
+			}
+			os << '\n';
+		}
+
+		return os.str();
+	}
+
+
+	void write_file(fs::path const &path, std::string const &contents)
+	{
+		std::ofstream os(path);
+		os << contents;
+	}
+
+
+	struct build_variant_graph_delegate final : public v2m::build_graph_delegate
+	{
+		bool should_include(std::string_view const chr_id, std::string_view const sample_name, v2m::variant_graph::ploidy_type const chrom_copy_idx) const override { return true; }
+
+		void report_overlapping_alternative(
+			std::uint64_t const lineno,
+			v2m::variant_graph::position_type const ref_pos,
+			std::vector <std::string_view> const &var_id,
+			std::string_view const sample_name,
+			v2m::variant_graph::ploidy_type const chrom_copy_idx,
+			std::uint32_t const gt
+		) override
+		{
+		}
+
+		bool ref_column_mismatch(std::uint64_t const var_idx, vcf::transient_variant const &var, std::string_view const expected) override
+		{
+			FAIL("REF column contents do not match the reference sequence in variant " << var_idx << ", position " << var.pos() << ". Expected: “" << expected << "” Actual: “" << var.ref() << "”");
+			return false;
+		}
+	};
+
+
+	// Generate a reference and a VCF file with the given number of samples and records.
+	void generate_benchmark_input(std::size_t const sample_count, std::size_t const record_count, v2m::sequence_type &ref_seq, std::string &vcf)
+	{
+		std::mt19937_64 gen(1);
+		std::uniform_int_distribution <std::uint8_t> base_dist(0, 3);
+		std::uniform_int_distribution <std::uint8_t> gt_dist(0, 7);
+		char const bases[]{'A', 'C', 'G', 'T'};
+
+		ref_seq.resize(10 * (1 + record_count));
+		for (auto &cc : ref_seq)
+			cc = bases[base_dist(gen)];
+
+		std::ostringstream os;
+		os << "##fileformat=VCFv4.2\n";
+		os << "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n";
+		os << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT";
+		for (std::size_t i{}; i < sample_count; ++i)
+			os << "\tSAMPLE" << (1 + i);
+		os << '\n';
+
+		for (std::size_t i{}; i < record_count; ++i)
+		{
+			auto const pos(10 * (1 + i));
+			auto const ref_idx(base_dist(gen));
+			auto const ref(bases[ref_idx]);
+			auto const alt(bases[(1 + ref_idx) % 4]);
+			ref_seq[pos] = ref;
+			os << "1\t" << (1 + pos) << "\tv" << i << '\t' << ref << '\t' << alt << "\t.\tPASS\t.\tGT";
+			for (std::size_t j{}; j < sample_count; ++j)
+			{
+				auto const gt(gt_dist(gen));
+				os << '\t' << (1 == gt ? '1' : '0') << '|' << (2 == gt ? '1' : '0');
+			}
+			os << '\n';
+		}
+
+		vcf = os.str();
+	}
+
+
+	template <typename t_fn>
+	void report_time(char const *name, t_fn &&fn)
+	{
+		auto const start(std::chrono::steady_clock::now());
+		fn();
+		std::chrono::duration <double> const elapsed(std::chrono::steady_clock::now() - start);
+		std::cout << name << ": " << elapsed.count() << " s\n";
+	}
+
+
+	std::size_t parse_vcf(vcf::input_base &input)
+	{
+		vcf::reader reader(input);
+		vcf::add_reserved_info_keys(reader.info_fields());
+		vcf::add_reserved_genotype_keys(reader.genotype_fields());
+		reader.read_header();
+		reader.set_parsed_fields(vcf::field::ALL);
+
+		std::size_t retval{};
+		reader.parse([&retval](vcf::transient_variant const &var){
+			++retval;
+			return true;
+		});
+		return retval;
+	}
+
+
+	// Parse the columns up to ALT and take the sample columns from the queue, as the parser thread does when building a graph.
+	std::size_t parse_vcf_up_to_alt(vcf::input_base &input, v2m::genotype_record_queue &queue)
+	{
+		vcf::reader reader(input);
+		vcf::add_reserved_info_keys(reader.info_fields());
+		vcf::add_reserved_genotype_keys(reader.genotype_fields());
+		reader.read_header();
+		reader.set_parsed_fields(vcf::field::ALT);
+
+		std::size_t retval{};
+		v2m::genotype_record_queue::record record;
+		reader.parse([&retval, &queue, &record](vcf::transient_variant const &var){
+			queue.pop(record);
+			++retval;
+			return true;
+		});
+		return retval;
+	}
+}
+
+
+SCENARIO("genotype_field_filter reduces the records to genotypes", "[genotype_field_filter]")
+{
+	GIVEN("VCF records with various INFO and FORMAT fields")
+	{
+		std::string const input(
+			"##fileformat=VCFv4.2\n"
+			"##INFO=<ID=DP,Number=1,Type=Integer,Description=\"Depth\">\n"
+			"#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tSAMPLE1\tSAMPLE2\n"
+			"1\t5\ta\tA\tT\t100\tPASS\tDP=5;AF=0.1\tGT:AD:PL\t0|1:3,4:1,2,3\t1|1:.:.\n"
+			"1\t6\tb\tA\tT\t100\tPASS\t.\tAD:GT\t3,4:0|1\t5\n"
+			"1\t7\tc\tA\tT\t100\tPASS\tDP=2\tAD:PL\t1\t2\n"
+			"1\t8\td\tA\tT\t100\tPASS\tDP=2\n"
+		);
+
+		std::string const expected(
+			"##fileformat=VCFv4.2\n"
+			"##INFO=<ID=DP,Number=1,Type=Integer,Description=\"Depth\">\n"
+			"#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tSAMPLE1\tSAMPLE2\n"
+			"1\t5\ta\tA\tT\t100\tPASS\t.\tGT\t0|1\t1|1\n"
+			"1\t6\tb\tA\tT\t100\tPASS\t.\tGT\t0|1\t.\n"
+			"1\t7\tc\tA\tT\t100\tPASS\t.\tAD:PL\t1\t2\n"
+			"1\t8\td\tA\tT\t100\tPASS\t.\n"
+		);
+
+		WHEN("the records are filtered")
+		{
+			THEN("the result does not depend on how the input is split")
+			{
+				for (std::size_t const chunk_size : {1, 2, 3, 7, 64, 4096})
+				{
+					INFO("Chunk size: " << chunk_size);
+					CHECK(expected == filter_in_chunks(input, chunk_size));
+				}
+			}
+
+			THEN("CRLF line endings are converted to LF")
+			{
+				std::string crlf_input;
+				for (auto const cc : input)
+				{
+					if ('\n' == cc)
+						crlf_input.push_back('\r');
+					crlf_input.push_back(cc);
+				}
+
+				for (std::size_t const chunk_size : {1, 2, 3, 7, 64, 4096})
+				{
+					INFO("Chunk size: " << chunk_size);
+					CHECK(expected == filter_in_chunks(crlf_input, chunk_size));
+				}
+			}
+
+			THEN("the sample columns of the records are queued")
+			{
+				std::vector <std::pair <std::string, bool>> const expected_records{
+					{"0|1\t1|1", true},
+					{"0|1\t.", true},
+					{"", false},
+					{"", false}
+				};
+
+				for (std::size_t const chunk_size : {1, 2, 3, 7, 64, 4096})
+				{
+					INFO("Chunk size: " << chunk_size);
+					auto const records(queue_in_chunks(input, chunk_size));
+					REQUIRE(expected_records.size() == records.size());
+					for (auto const &[expected_record, record] : rsv::zip(expected_records, records))
+					{
+						CHECK(expected_record.first == record.sample_columns);
+						CHECK(expected_record.second == record.has_genotypes);
+					}
+				}
+			}
+
+			THEN("the last record is queued even if it does not end with a line feed")
+			{
+				v2m::genotype_record_queue queue;
+				boost::iostreams::filtering_istream stream;
+				stream.push(v2m::genotype_field_filter(&queue));
+				stream.push(boost::iostreams::array_source(input.data(), input.size() - 1));
+				std::string const output(std::istreambuf_iterator <char>(stream), std::istreambuf_iterator <char>{});
+
+				CHECK(expected == output);
+				std::size_t count{};
+				v2m::genotype_record_queue::record record;
+				while (!queue.empty())
+				{
+					queue.pop(record);
+					++count;
+				}
+				CHECK(4 == count);
+			}
+
+			THEN("other carriage returns are kept")
+			{
+				std::string const cr_input("#a\rb\r\n1\t5\ta\tA\tT\t100\tPASS\t.\tGT\t0|1\r");
+				for (std::size_t const chunk_size : {1, 2, 4096})
+				{
+					INFO("Chunk size: " << chunk_size);
+					CHECK("#a\rb\n1\t5\ta\tA\tT\t100\tPASS\t.\tGT\t0|1" == filter_in_chunks(cr_input, chunk_size));
+				}
+			}
+		}
+	}
+}
+
+
+SCENARIO("Variant graphs can be built from VCF files with additional fields", "[genotype_field_filter]")
+{
+	GIVEN("A VCF file with INFO and FORMAT fields")
+	{
+		fs::path const base_path("test-files/variant-graph");
+		auto const vcf_path(base_path / "test-1a.vcf");
+		auto const annotated_vcf_path(fs::temp_directory_path() / "vcf2multialign-test-1a-annotated.vcf");
+
+		{
+			std::ifstream is(vcf_path);
+			std::string const contents(std::istreambuf_iterator <char>(is), std::istreambuf_iterator <char>{});
+			write_file(annotated_vcf_path, add_annotations(contents));
+		}
+
+		REQUIRE(v2m::vcf_header_has_non_genotype_fields(annotated_vcf_path.c_str()));
+		REQUIRE(!v2m::vcf_header_has_non_genotype_fields(vcf_path.c_str()));
+
+		WHEN("a variant graph is built from the file")
+		{
+			v2m::sequence_type ref_seq;
+			REQUIRE(lb::read_single_fasta_sequence(base_path / "test-1.fa", ref_seq, nullptr));
+
+			build_variant_graph_delegate delegate;
+			v2m::variant_graph expected;
+			v2m::variant_graph actual;
+
+			{
+				v2m::build_graph_statistics stats;
+				v2m::build_variant_graph(ref_seq, vcf_path, "1", expected, stats, delegate);
+			}
+
+			{
+				v2m::build_graph_statistics stats;
+				v2m::build_variant_graph(ref_seq, annotated_vcf_path, "1", actual, stats, delegate);
+			}
+
+			THEN("the graph matches the one built from the genotype-only file")
+			{
+				CHECK(expected.reference_positions == actual.reference_positions);
+				CHECK(expected.aligned_positions == actual.aligned_positions);
+				CHECK(expected.alt_edge_targets == actual.alt_edge_targets);
+				CHECK(expected.alt_edge_count_csum == actual.alt_edge_count_csum);
+				CHECK(expected.alt_edge_labels == actual.alt_edge_labels);
+				CHECK(expected.paths_by_edge_and_chrom_copy == actual.paths_by_edge_and_chrom_copy);
+				CHECK(expected.sample_names == actual.sample_names);
+				CHECK(expected.ploidy_csum == actual.ploidy_csum);
+			}
+		}
+
+		fs::remove(annotated_vcf_path);
+	}
+}
+
+
+TEST_CASE(
+	"Parsing time of VCF files with rich FORMAT columns",
+	"[.][genotype_field_filter][benchmark]"
+)
+{
+	v2m::sequence_type ref_seq;
+	std::string vcf_contents;
+	generate_benchmark_input(1000, 20000, ref_seq, vcf_contents);
+
+	auto const vcf_path(fs::temp_directory_path() / "vcf2multialign-benchmark.vcf");
+	write_file(vcf_path, add_annotations(vcf_contents));
+	vcf_contents.clear();
+
+	report_time("libbio, all fields", [&](){
+		vcf::mmap_input input;
+		input.handle().open(vcf_path.c_str());
+		CHECK(20000 == parse_vcf(input));
+	});
+
+	report_time("libbio, genotype_field_filter", [&](){
+		vcf::stream_input <boost::iostreams::filtering_istream> input;
+		input.stream().push(v2m::genotype_field_filter());
+		input.stream().push(boost::iostreams::mapped_file_source(vcf_path.string()));
+		CHECK(20000 == parse_vcf(input));
+	});
+
+	report_time("build_variant_graph", [&](){
+		build_variant_graph_delegate delegate;
+		v2m::variant_graph graph;
+		v2m::build_graph_statistics stats;
+		v2m::build_variant_graph(ref_seq, vcf_path, "1", graph, stats, delegate);
+		CHECK(20000 == stats.handled_variants);
+	});
+
+	fs::remove(vcf_path);
+}
+
+
+TEST_CASE(
+	"Variant graph building time with many samples by thread count",
+	"[.][genotype_field_filter][benchmark]"
+)
+{
+	v2m::sequence_type ref_seq;
+	std::string vcf_contents;
+	generate_benchmark_input(5000, 20000, ref_seq, vcf_contents);
+
+	auto const vcf_path(fs::temp_directory_path() / "vcf2multialign-benchmark.vcf");
+	write_file(vcf_path, vcf_contents);
+	vcf_contents.clear();
+
+	// The parser thread only parses the columns up to ALT and queues the sample columns, and the genotypes
+	// are decoded in the workers. Hence building the graph with enough threads should take about as long as this.
+	report_time("Parser thread work", [&](){
+		v2m::genotype_record_queue queue;
+		vcf::stream_input <boost::iostreams::filtering_istream> input;
+		input.stream().push(v2m::genotype_field_filter(&queue));
+		input.stream().push(boost::iostreams::mapped_file_source(vcf_path.string()));
+		CHECK(20000 == parse_vcf_up_to_alt(input, queue));
+	});
+
+	for (std::uint16_t const thread_count : {1, 2, 4, 8})
+	{
+		auto const name("build_variant_graph, " + std::to_string(thread_count) + " threads");
+		report_time(name.c_str(), [&](){
+			build_variant_graph_delegate delegate;
+			v2m::variant_graph graph;
+			v2m::build_graph_statistics stats;
+			v2m::build_variant_graph(ref_seq, vcf_path, "1", graph, stats, delegate, thread_count);
+			CHECK(20000 == stats.handled_variants);
+		});
+	}
+
+	fs::remove(vcf_path);
+}
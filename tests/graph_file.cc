@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <catch2/catch_all.hpp>
+#include <cereal/archives/portable_binary.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <libbio/fasta_reader.hh>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vcf2multialign/graph_file.hh>
+#include <vcf2multialign/sequence_writer.hh>
+#include <vcf2multialign/variant_graph.hh>
+#include <vector>
+
+namespace fs	= std::filesystem;
+namespace lb	= libbio;
+namespace v2m	= vcf2multialign;
+namespace vcf	= libbio::vcf;
+
+
+namespace {
+
+	struct build_variant_graph_delegate final : public v2m::build_graph_delegate
+	{
+		bool should_include(std::string_view const chr_id, std::string_view const sample_name, v2m::variant_graph::ploidy_type const chrom_copy_idx) const override { return true; }
+
+		void report_overlapping_alternative(
+			std::uint64_t const lineno,
+			v2m::variant_graph::position_type const ref_pos,
+			std::vector <std::string_view> const &var_id,
+			std::string_view const sample_name,
+			v2m::variant_graph::ploidy_type const chrom_copy_idx,
+			std::uint32_t const gt
+		) override
+		{
+		}
+
+		bool ref_column_mismatch(std::uint64_t const var_idx, vcf::transient_variant const &var, std::string_view const expected) override
+		{
+			FAIL("REF column contents do not match the reference sequence in variant " << var_idx << ", position " << var.pos() << ". Expected: “" << expected << "” Actual: “" << var.ref() << "”");
+			return false;
+		}
+	};
+
+
+	void check_graphs_equal(v2m::variant_graph const &expected, v2m::variant_graph const &actual)
+	{
+		CHECK(expected.reference_positions == actual.reference_positions);
+		CHECK(expected.aligned_positions == actual.aligned_positions);
+		CHECK(expected.alt_edge_targets == actual.alt_edge_targets);
+		CHECK(expected.alt_edge_count_csum == actual.alt_edge_count_csum);
+		CHECK(expected.alt_edge_labels == actual.alt_edge_labels);
+		CHECK(expected.paths_by_edge_and_chrom_copy == actual.paths_by_edge_and_chrom_copy);
+		CHECK(expected.sample_names == actual.sample_names);
+		CHECK(expected.ploidy_csum == actual.ploidy_csum);
+	}
+
+
+	struct sequence_writing_delegate final : public v2m::sequence_writing_delegate
+	{
+		using v2m::sequence_writing_delegate::sequence_writing_delegate;
+		void handle_node(variant_graph const &graph, node_type const node) override {}
+	};
+
+
+	// Outputs the aligned sequence of the given chromosome copy (or the reference with PLOIDY_MAX).
+	std::string aligned_sequence(v2m::sequence_type const &ref_seq, v2m::variant_graph const &graph, v2m::variant_graph::ploidy_type const chrom_copy_idx)
+	{
+		std::stringstream stream;
+		sequence_writing_delegate delegate(chrom_copy_idx);
+		v2m::output_sequence(ref_seq, graph, stream, nullptr, false, delegate);
+		return stream.str();
+	}
+}
+
+
+SCENARIO("Variant graphs can be memory-mapped", "[graph_file]")
+{
+	GIVEN("A variant graph")
+	{
+		auto const test_idx(GENERATE(1, 2, 3, 4));
+		fs::path const base_path("test-files/variant-graph");
+		auto const fasta_path(base_path / ("test-" + std::to_string(test_idx) + ".fa"));
+		auto const vcf_path(base_path / (1 == test_idx ? std::string("test-1a.vcf") : "test-" + std::to_string(test_idx) + ".vcf"));
+		auto const graph_path(fs::temp_directory_path() / "vcf2multialign-test.graph");
+		INFO("VCF: " << vcf_path);
+
+		v2m::sequence_type ref_seq;
+		REQUIRE(lb::read_single_fasta_sequence(fasta_path, ref_seq, nullptr));
+
+		build_variant_graph_delegate delegate;
+		v2m::variant_graph expected;
+
+		{
+			v2m::build_graph_statistics stats;
+			v2m::build_variant_graph(ref_seq, vcf_path, "1", expected, stats, delegate);
+		}
+
+		WHEN("the graph is written in the native format and mapped")
+		{
+			v2m::write_graph_file(expected, graph_path.c_str());
+			REQUIRE(v2m::is_graph_file(graph_path.c_str()));
+
+			v2m::mapped_graph_file graph_file(graph_path.c_str());
+			v2m::variant_graph actual;
+			graph_file.get_graph(actual);
+
+			THEN("the mapped graph matches the original")
+			{
+				check_graphs_equal(expected, actual);
+				CHECK(actual.alt_edge_targets.words().is_borrowed());
+				CHECK(actual.paths_by_edge_and_chrom_copy.column_offsets().is_borrowed());
+			}
+
+			THEN("the mapped graph may be modified without affecting the file")
+			{
+				actual.add_node(actual.reference_positions.back() + 1, actual.aligned_positions.back() + 1);
+				CHECK(!actual.reference_positions.words().is_borrowed());
+				CHECK(expected.node_count() + 1 == actual.node_count());
+
+				v2m::mapped_graph_file graph_file_(graph_path.c_str());
+				v2m::variant_graph actual_;
+				graph_file_.get_graph(actual_);
+				check_graphs_equal(expected, actual_);
+			}
+		}
+
+		WHEN("the graph is written in the compressed format")
+		{
+			v2m::write_graph_file(expected, graph_path.c_str(), v2m::graph_file_format::compressed, 2);
+			REQUIRE(v2m::is_graph_file(graph_path.c_str()));
+
+			THEN("the decompressed graph matches the original")
+			{
+				v2m::mapped_graph_file graph_file(graph_path.c_str(), 2);
+				CHECK(graph_file.is_compressed());
+
+				v2m::variant_graph actual;
+				graph_file.get_graph(actual);
+				check_graphs_equal(expected, actual);
+			}
+		}
+
+		WHEN("the graph is written with Cereal")
+		{
+			{
+				std::ofstream os(graph_path, std::ios::binary);
+				cereal::PortableBinaryOutputArchive archive(os);
+				archive(expected);
+			}
+
+			THEN("the file is not detected as a native graph file")
+			{
+				CHECK(!v2m::is_graph_file(graph_path.c_str()));
+				CHECK_THROWS_AS(v2m::mapped_graph_file(graph_path.c_str()), std::runtime_error);
+			}
+
+			THEN("the graph may be read back")
+			{
+				v2m::variant_graph actual;
+				std::ifstream is(graph_path, std::ios::binary);
+				cereal::PortableBinaryInputArchive archive(is);
+				archive(actual);
+				check_graphs_equal(expected, actual);
+			}
+		}
+
+		WHEN("a truncated native file is read")
+		{
+			v2m::write_graph_file(expected, graph_path.c_str());
+			fs::resize_file(graph_path, fs::file_size(graph_path) / 2);
+
+			THEN("the file is rejected")
+			{
+				CHECK_THROWS_AS(v2m::mapped_graph_file(graph_path.c_str()), std::runtime_error);
+			}
+		}
+
+		WHEN("a native file with corrupted offsets is read")
+		{
+			auto const &labels(expected.alt_edge_labels);
+			auto const &paths(expected.paths_by_edge_and_chrom_copy);
+			REQUIRE(2 <= labels.size());
+			REQUIRE(0 < paths.number_of_columns());
+
+			THEN("decreasing label offsets are rejected")
+			{
+				// The last offset still matches the number of characters.
+				auto corrupted(expected);
+				auto offsets(labels.offsets());
+				offsets.mutable_data()[1] = labels.characters().size() + 1;
+				corrupted.alt_edge_labels = v2m::packed_label_vector(labels.characters(), std::move(offsets));
+
+				v2m::write_graph_file(corrupted, graph_path.c_str());
+				CHECK_THROWS_AS(v2m::mapped_graph_file(graph_path.c_str()), std::runtime_error);
+			}
+
+			THEN("path matrix column offsets past the end of the columns are rejected")
+			{
+				auto corrupted(expected);
+				auto column_offsets(paths.column_offsets());
+				column_offsets.mutable_data()[0] = paths.dense_words().size() + paths.sparse_rows().size() + 1;
+				corrupted.paths_by_edge_and_chrom_copy = v2m::path_matrix(
+					paths.number_of_rows(),
+					paths.dense_words(),
+					paths.sparse_rows(),
+					std::move(column_offsets),
+					paths.one_counts()
+				);
+
+				v2m::write_graph_file(corrupted, graph_path.c_str());
+				CHECK_THROWS_AS(v2m::mapped_graph_file(graph_path.c_str()), std::runtime_error);
+			}
+		}
+
+		fs::remove(graph_path);
+	}
+}
+
+
+TEST_CASE("Compressed variant graphs may consist of several blocks", "[graph_file]")
+{
+	auto const graph_path(fs::temp_directory_path() / "vcf2multialign-test-compressed.graph");
+
+	// Long labels make the contents span several blocks.
+	v2m::variant_graph expected;
+	expected.alt_edge_count_csum.push_back(0);
+	std::mt19937_64 gen(1);
+	std::uniform_int_distribution <std::uint8_t> base_dist(0, 3);
+	char const bases[]{'A', 'C', 'G', 'T'};
+	std::string label;
+	for (std::size_t node{}; node < 3 * v2m::GRAPH_FILE_COMPRESSION_BLOCK_SIZE / 1000; ++node)
+	{
+		expected.add_node(node, 1000 * node);
+		label.resize(1000);
+		for (auto &cc : label)
+			cc = bases[base_dist(gen)];
+		auto const edge_idx(expected.add_edge(label));
+		expected.alt_edge_targets.set(edge_idx, 1 + node);
+	}
+	expected.add_node(3 * v2m::GRAPH_FILE_COMPRESSION_BLOCK_SIZE / 1000, 3 * v2m::GRAPH_FILE_COMPRESSION_BLOCK_SIZE);
+	expected.sample_names.emplace_back("SAMPLE1");
+	expected.ploidy_csum = {0, 1};
+	expected.paths_by_edge_and_chrom_copy = v2m::path_matrix(1);
+	for (v2m::variant_graph::edge_type edge_idx{}; edge_idx < expected.edge_count(); ++edge_idx)
+	{
+		std::vector <v2m::path_matrix::row_type> const rows(edge_idx % 2, 0);
+		expected.paths_by_edge_and_chrom_copy.push_back_column(rows);
+	}
+
+	for (std::uint16_t const thread_count : {1, 4})
+	{
+		INFO("Threads: " << thread_count);
+		v2m::write_graph_file(expected, graph_path.c_str(), v2m::graph_file_format::compressed, thread_count);
+
+		v2m::mapped_graph_file graph_file(graph_path.c_str(), thread_count);
+		v2m::variant_graph actual;
+		graph_file.get_graph(actual);
+		check_graphs_equal(expected, actual);
+	}
+
+	fs::remove(graph_path);
+}
+
+
+SCENARIO("Variant graphs can be built in chunks", "[graph_file]")
+{
+	GIVEN("A variant file")
+	{
+		auto const test_idx(GENERATE(1, 2, 3, 4));
+		auto const min_edge_count(GENERATE(1, 3, 100));
+		fs::path const base_path("test-files/variant-graph");
+		auto const fasta_path(base_path / ("test-" + std::to_string(test_idx) + ".fa"));
+		auto const vcf_path(base_path / (1 == test_idx ? std::string("test-1a.vcf") : "test-" + std::to_string(test_idx) + ".vcf"));
+		auto const graph_path(fs::temp_directory_path() / "vcf2multialign-test-chunked.graph");
+		INFO("VCF: " << vcf_path);
+		INFO("Minimum edge count: " << min_edge_count);
+
+		v2m::sequence_type ref_seq;
+		REQUIRE(lb::read_single_fasta_sequence(fasta_path, ref_seq, nullptr));
+
+		build_variant_graph_delegate delegate;
+		v2m::variant_graph expected;
+
+		{
+			v2m::build_graph_statistics stats;
+			v2m::build_variant_graph(ref_seq, vcf_path, "1", expected, stats, delegate);
+		}
+
+		WHEN("the graph is built in chunks and written to a file")
+		{
+			std::size_t written_chunk_count{};
+
+			{
+				v2m::build_graph_statistics stats;
+				v2m::graph_chunk_writer writer(graph_path.c_str());
+				v2m::build_variant_graph_chunks(ref_seq, vcf_path, "1", stats, delegate, writer, min_edge_count);
+				written_chunk_count = writer.chunk_count();
+				writer.close();
+				CHECK(written_chunk_count == writer.chunk_count());
+			}
+
+			REQUIRE(v2m::is_chunked_graph_file(graph_path.c_str()));
+			REQUIRE(!v2m::is_graph_file(graph_path.c_str()));
+			v2m::mapped_chunked_graph_file const graph_file(graph_path.c_str());
+			REQUIRE(0 < graph_file.chunk_count());
+			CHECK(written_chunk_count == graph_file.chunk_count());
+
+			v2m::variant_graph chunk;
+			graph_file.get_samples(chunk);
+
+			THEN("the chunks have the same samples as the graph")
+			{
+				CHECK(expected.sample_names == chunk.sample_names);
+				CHECK(expected.ploidy_csum == chunk.ploidy_csum);
+			}
+
+			THEN("the chunks are separated at bridge nodes and together have the nodes and the edges of the graph")
+			{
+				v2m::variant_graph::node_type node_count{1};
+				v2m::variant_graph::edge_type edge_count{};
+				for (std::size_t chunk_idx{}; chunk_idx < graph_file.chunk_count(); ++chunk_idx)
+				{
+					INFO("Chunk: " << chunk_idx);
+					graph_file.get_chunk(chunk_idx, chunk);
+					REQUIRE(1 < chunk.node_count());
+					CHECK(expected.reference_positions[node_count - 1] == chunk.reference_positions[0]);
+					CHECK(expected.aligned_positions[node_count - 1] == chunk.aligned_positions[0]);
+					CHECK(chunk.edge_count() == chunk.paths_by_edge_and_chrom_copy.number_of_columns());
+					if (1 + chunk_idx < graph_file.chunk_count())
+						CHECK(std::size_t(min_edge_count) <= chunk.edge_count());
+
+					// No ALT edge targets the first node of the chunk.
+					for (auto const target : chunk.alt_edge_targets)
+						CHECK(0 < target);
+
+					node_count += chunk.node_count() - 1;
+					edge_count += chunk.edge_count();
+				}
+
+				CHECK(expected.node_count() == node_count);
+				CHECK(expected.edge_count() == edge_count);
+			}
+
+			THEN("the sequences may be output by concatenating their parts in the chunks")
+			{
+				auto const check_sequence([&](v2m::variant_graph::ploidy_type const chrom_copy_idx){
+					INFO("Chromosome copy: " << chrom_copy_idx);
+					std::string actual;
+					for (std::size_t chunk_idx{}; chunk_idx < graph_file.chunk_count(); ++chunk_idx)
+					{
+						graph_file.get_chunk(chunk_idx, chunk);
+						actual += aligned_sequence(ref_seq, chunk, chrom_copy_idx);
+					}
+
+					CHECK(aligned_sequence(ref_seq, expected, chrom_copy_idx) == actual);
+				});
+
+				check_sequence(v2m::variant_graph::PLOIDY_MAX);
+				for (v2m::variant_graph::ploidy_type chrom_copy_idx{}; chrom_copy_idx < expected.total_chromosome_copies(); ++chrom_copy_idx)
+					check_sequence(chrom_copy_idx);
+			}
+		}
+
+		WHEN("the chunked file is not closed")
+		{
+			{
+				v2m::build_graph_statistics stats;
+				v2m::graph_chunk_writer writer(graph_path.c_str());
+				v2m::build_variant_graph_chunks(ref_seq, vcf_path, "1", stats, delegate, writer, min_edge_count);
+			}
+
+			THEN("the file is rejected")
+			{
+				CHECK_THROWS_AS(v2m::mapped_chunked_graph_file(graph_path.c_str()), std::runtime_error);
+			}
+		}
+
+		fs::remove(graph_path);
+	}
+}
+
+
+SCENARIO("Outputs that need the whole graph are rejected for chunked graph files", "[graph_file]")
+{
+	GIVEN("The outputs that may be produced one chunk at a time")
+	{
+		THEN("they are accepted")
+		{
+			CHECK_NOTHROW(v2m::check_chunked_graph_outputs({}));
+		}
+	}
+
+	GIVEN("A request for founder sequences")
+	{
+		THEN("it is rejected with a message that names the founder sequences")
+		{
+			CHECK_THROWS_WITH(
+				v2m::check_chunked_graph_outputs({.founder_sequences = true}),
+				Catch::Matchers::StartsWith("Founder sequences cannot be output from a chunked variant graph")
+			);
+		}
+	}
+
+	GIVEN("A request for any of the other outputs that need the whole graph")
+	{
+		THEN("it is rejected")
+		{
+			CHECK_THROWS_AS(v2m::check_chunked_graph_outputs({.separate_sequences = true}), std::runtime_error);
+			CHECK_THROWS_AS(v2m::check_chunked_graph_outputs({.graphviz = true}), std::runtime_error);
+			CHECK_THROWS_AS(v2m::check_chunked_graph_outputs({.memory_breakdown = true}), std::runtime_error);
+		}
+	}
+}
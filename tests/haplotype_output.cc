@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <catch2/catch_all.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <libbio/fasta_reader.hh>
+#include <libbio/subprocess.hh>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vcf2multialign/output.hh>
+#include <vcf2multialign/variant_graph.hh>
+#include <vector>
+
+namespace fs	= std::filesystem;
+namespace lb	= libbio;
+namespace v2m	= vcf2multialign;
+namespace vcf	= libbio::vcf;
+
+
+namespace {
+
+	struct build_variant_graph_delegate final : public v2m::build_graph_delegate
+	{
+		bool should_include(std::string_view const chr_id, std::string_view const sample_name, v2m::variant_graph::ploidy_type const chrom_copy_idx) const override { return true; }
+
+		void report_overlapping_alternative(
+			std::uint64_t const lineno,
+			v2m::variant_graph::position_type const ref_pos,
+			std::vector <std::string_view> const &var_id,
+			std::string_view const sample_name,
+			v2m::variant_graph::ploidy_type const chrom_copy_idx,
+			std::uint32_t const gt
+		) override
+		{
+		}
+
+		bool ref_column_mismatch(std::uint64_t const var_idx, vcf::transient_variant const &var, std::string_view const expected) override
+		{
+			FAIL("REF column contents do not match the reference sequence in variant " << var_idx << ", position " << var.pos() << ". Expected: “" << expected << "” Actual: “" << var.ref() << "”");
+			return false;
+		}
+	};
+
+
+	struct output_delegate final : public v2m::output_delegate
+	{
+		std::vector <std::pair <sample_type, ploidy_type>>	handled_chromosome_copies;
+		sequence_count_type									sequence_count{};
+
+		void will_handle_sample(std::string const &sample, sample_type const sample_idx, ploidy_type const chr_copy_idx) override { handled_chromosome_copies.emplace_back(sample_idx, chr_copy_idx); }
+		void will_handle_founder_sequence(sample_type const idx) override {}
+		void handled_sequences(sequence_count_type const sequence_count_) override { sequence_count = sequence_count_; }
+		void exit_subprocess(v2m::subprocess_type &proc) override {}
+		void handled_node(v2m::variant_graph::node_type const node, v2m::pbwt_statistics const &stats) override {}
+
+		void unable_to_execute_subprocess(libbio::subprocess_status const &status) override
+		{
+			FAIL("Unable to execute subprocess");
+		}
+	};
+
+
+	void check_progress(v2m::variant_graph const &graph, output_delegate const &delegate)
+	{
+		// Every chromosome copy should have been reported once and in order.
+		std::vector <std::pair <output_delegate::sample_type, output_delegate::ploidy_type>> expected;
+		for (output_delegate::sample_type sample_idx{}; sample_idx < graph.sample_names.size(); ++sample_idx)
+		{
+			for (output_delegate::ploidy_type chr_copy_idx{}; chr_copy_idx < graph.sample_ploidy(sample_idx); ++chr_copy_idx)
+				expected.emplace_back(sample_idx, chr_copy_idx);
+		}
+
+		CHECK(expected == delegate.handled_chromosome_copies);
+		CHECK(1 + graph.total_chromosome_copies() == delegate.sequence_count);
+	}
+
+
+	std::string output_haplotypes(v2m::sequence_type const &ref_seq, v2m::variant_graph const &graph, std::uint16_t const thread_count)
+	{
+		output_delegate delegate;
+		v2m::haplotype_output output(nullptr, "1", true, false, delegate);
+		output.set_thread_count(thread_count);
+
+		std::stringstream os;
+		output.output_a2m(ref_seq, graph, os);
+		check_progress(graph, delegate);
+		return os.str();
+	}
+
+
+	std::string output_haplotypes_to_file(v2m::sequence_type const &ref_seq, v2m::variant_graph const &graph, std::uint16_t const thread_count)
+	{
+		auto const path(fs::temp_directory_path() / "vcf2multialign-test-haplotype-output.a2m");
+
+		{
+			output_delegate delegate;
+			v2m::haplotype_output output(nullptr, "1", true, false, delegate);
+			output.set_thread_count(thread_count);
+			output.output_a2m(ref_seq, graph, path.c_str());
+			check_progress(graph, delegate);
+		}
+
+		std::ifstream is(path);
+		std::string retval(std::istreambuf_iterator <char>(is), std::istreambuf_iterator <char>{});
+		fs::remove(path);
+		return retval;
+	}
+
+
+	void test_parallel_output(fs::path const &vcf_path, fs::path const &fasta_path)
+	{
+		INFO("VCF: " << vcf_path);
+		INFO("FASTA: " << fasta_path);
+
+		v2m::sequence_type ref_seq;
+		REQUIRE(lb::read_single_fasta_sequence(fasta_path, ref_seq, nullptr));
+
+		v2m::variant_graph graph;
+
+		{
+			build_variant_graph_delegate delegate;
+			v2m::build_graph_statistics stats;
+			v2m::build_variant_graph(ref_seq, vcf_path, "1", graph, stats, delegate);
+		}
+
+		auto const expected(output_haplotypes(ref_seq, graph, 1));
+		REQUIRE(!expected.empty());
+
+		for (std::uint16_t const thread_count : {2, 3, 8})
+		{
+			INFO("Threads: " << thread_count);
+			auto const actual(output_haplotypes(ref_seq, graph, thread_count));
+			CHECK(expected == actual);
+		}
+
+		for (std::uint16_t const thread_count : {1, 2, 8})
+		{
+			INFO("Threads: " << thread_count);
+			auto const actual(output_haplotypes_to_file(ref_seq, graph, thread_count));
+			CHECK(expected == actual);
+		}
+	}
+}
+
+
+SCENARIO("Haplotype A2M output is the same regardless of the number of threads and the output method", "[haplotype_output]")
+{
+	GIVEN("A VCF file with diploid samples")
+	{
+		fs::path const base_path("test-files/variant-graph");
+		test_parallel_output(base_path / "test-1a.vcf", base_path / "test-1.fa");
+	}
+
+	GIVEN("A VCF file with haploid samples")
+	{
+		fs::path const base_path("test-files/founder-sequences");
+		test_parallel_output(base_path / "test-1.vcf", base_path / "test-1.fa");
+	}
+}
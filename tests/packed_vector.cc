@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <catch2/catch_all.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <rapidcheck.h>
+#include <rapidcheck/catch.h>		// rc::prop
+#include <string>
+#include <vcf2multialign/packed_vector.hh>
+#include <vcf2multialign/sequence_writer.hh>
+#include <vcf2multialign/variant_graph.hh>
+#include <vector>
+
+namespace v2m	= vcf2multialign;
+
+
+namespace {
+
+	struct operation
+	{
+		std::uint64_t	value{};
+		std::size_t		index{};	// Modulo the current size.
+		bool			is_push_back{};
+	};
+
+
+	struct benchmark_writing_delegate final : public v2m::sequence_writing_delegate
+	{
+		using v2m::sequence_writing_delegate::sequence_writing_delegate;
+		void handle_node(variant_graph const &graph, node_type const node) override {}
+	};
+
+
+	// Generate a graph with one or two short ALT edges from most of the nodes.
+	void generate_benchmark_graph(std::size_t const node_count, v2m::variant_graph::ploidy_type const chrom_copies, v2m::sequence_type &ref_seq, v2m::variant_graph &graph)
+	{
+		std::mt19937_64 gen(1);
+		std::uniform_int_distribution <std::uint8_t> base_dist(0, 3);
+		std::uniform_int_distribution <std::uint8_t> edge_count_dist(0, 2);
+		std::bernoulli_distribution path_dist(0.25);
+		char const bases[]{'A', 'C', 'G', 'T'};
+
+		ref_seq.resize(4 * node_count);
+		for (auto &cc : ref_seq)
+			cc = bases[base_dist(gen)];
+
+		graph.alt_edge_count_csum.push_back(0);
+		for (std::size_t node{}; node < node_count; ++node)
+		{
+			graph.add_node(4 * node, 4 * node);
+			if (node + 2 < node_count)
+			{
+				auto const edge_count(edge_count_dist(gen));
+				for (std::uint8_t i{}; i < edge_count; ++i)
+				{
+					auto const edge_idx(graph.add_edge(std::string(1 + i, bases[base_dist(gen)])));
+					graph.alt_edge_targets.set(edge_idx, node + 1 + i);
+				}
+			}
+		}
+
+		graph.paths_by_edge_and_chrom_copy = v2m::variant_graph::path_matrix(chrom_copies);
+		std::vector <v2m::path_matrix::row_type> rows;
+		for (v2m::variant_graph::edge_type edge_idx{}; edge_idx < graph.edge_count(); ++edge_idx)
+		{
+			rows.clear();
+			for (v2m::variant_graph::ploidy_type copy_idx{}; copy_idx < chrom_copies; ++copy_idx)
+			{
+				if (path_dist(gen))
+					rows.push_back(copy_idx);
+			}
+			graph.paths_by_edge_and_chrom_copy.push_back_column(rows);
+		}
+	}
+}
+
+
+namespace rc {
+
+	template <>
+	struct Arbitrary <operation>
+	{
+		static Gen <operation> arbitrary()
+		{
+			return gen::build <operation>(
+				gen::set(&operation::value, gen::oneOf(
+					gen::inRange(std::uint64_t(0), std::uint64_t(256)),
+					gen::arbitrary <std::uint64_t>()
+				)),
+				gen::set(&operation::index),
+				gen::set(&operation::is_push_back)
+			);
+		}
+	};
+}
+
+
+TEST_CASE(
+	"packed_vector stores arbitrary values",
+	"[packed_vector]"
+)
+{
+	rc::prop(
+		"packed_vector matches std::vector",
+		[](std::vector <operation> const &operations){
+			std::vector <std::uint64_t> expected;
+			v2m::packed_vector actual;
+
+			for (auto const &op : operations)
+			{
+				if (op.is_push_back || expected.empty())
+				{
+					expected.push_back(op.value);
+					actual.push_back(op.value);
+				}
+				else
+				{
+					auto const idx(op.index % expected.size());
+					expected[idx] = op.value;
+					actual.set(idx, op.value);
+				}
+			}
+
+			RC_ASSERT(expected.size() == actual.size());
+			RC_ASSERT(std::equal(expected.begin(), expected.end(), actual.begin(), actual.end()));
+
+			v2m::packed_vector assigned;
+			assigned.assign(expected);
+			RC_ASSERT(assigned == actual);
+		}
+	);
+}
+
+
+TEST_CASE(
+	"packed_vector uses the width of the greatest value",
+	"[packed_vector]"
+)
+{
+	v2m::packed_vector vec{1, 2, 3};
+	CHECK(2 == vec.width());
+	CHECK(1 == vec.words().size());
+
+	vec.set(1, 1 << 20);
+	CHECK(21 == vec.width());
+	CHECK(v2m::packed_vector{1, 1 << 20, 3} == vec);
+}
+
+
+TEST_CASE(
+	"packed_vector may be reserved with the expected maximum value",
+	"[packed_vector]"
+)
+{
+	v2m::packed_vector vec;
+	vec.reserve(1000, 1 << 20);
+	CHECK(vec.empty());
+	CHECK(21 == vec.width());
+	CHECK(vec.words().owned_values().capacity() >= v2m::packed_vector::words_needed(1000, 21));
+
+	for (std::uint64_t i(0); i < 1000; ++i)
+		vec.push_back(i);
+	CHECK(21 == vec.width());
+	CHECK(1000 == vec.size());
+	CHECK(999 == vec.back());
+
+	vec.shrink_to_fit();
+	CHECK(vec.words().owned_values().capacity() == vec.words().size());
+}
+
+
+TEST_CASE(
+	"Sequence output time with packed graph vectors",
+	"[.][packed_vector][benchmark]"
+)
+{
+	std::size_t const node_count(20'000'000);
+	v2m::variant_graph::ploidy_type const chrom_copies(8);
+
+	v2m::sequence_type ref_seq;
+	v2m::variant_graph graph;
+	generate_benchmark_graph(node_count, chrom_copies, ref_seq, graph);
+
+	auto const packed_size(
+		graph.reference_positions.words().size() +
+		graph.aligned_positions.words().size() +
+		graph.alt_edge_targets.words().size() +
+		graph.alt_edge_count_csum.words().size()
+	);
+	auto const unpacked_size(2 * graph.node_count() + graph.edge_count() + graph.alt_edge_count_csum.size());
+	std::cout << "Nodes: " << graph.node_count() << " ALT edges: " << graph.edge_count() << '\n';
+	std::cout << "Position and edge vectors: " << (8 * packed_size / 1048576.0) << " MiB (" << (8 * unpacked_size / 1048576.0) << " MiB with 64-bit values)\n";
+
+	// Random access to the packed values in comparison to std::vector.
+	{
+		std::vector <std::uint64_t> const unpacked(graph.aligned_positions.begin(), graph.aligned_positions.end());
+		std::mt19937_64 gen(2);
+		std::vector <std::size_t> indices(node_count);
+		for (auto &idx : indices)
+			idx = gen() % node_count;
+
+		auto const time_access([&indices](char const *name, auto const &vec){
+			auto const start(std::chrono::steady_clock::now());
+			std::uint64_t sum{};
+			for (auto const idx : indices)
+				sum += vec[idx];
+			std::chrono::duration <double> const elapsed(std::chrono::steady_clock::now() - start);
+			std::cout << name << ": " << elapsed.count() << " s (checksum " << sum << ")\n";
+		});
+
+		time_access("Random access, std::vector", unpacked);
+		time_access("Random access, packed_vector", graph.aligned_positions);
+	}
+
+	std::vector <char> dst(graph.aligned_positions.back());
+	auto const start(std::chrono::steady_clock::now());
+	for (v2m::variant_graph::ploidy_type copy_idx{}; copy_idx < chrom_copies; ++copy_idx)
+	{
+		benchmark_writing_delegate delegate(copy_idx);
+		v2m::output_sequence(ref_seq, graph, dst.data(), delegate);
+	}
+	std::chrono::duration <double> const elapsed(std::chrono::steady_clock::now() - start);
+	std::cout << "output_sequence: " << (elapsed.count() / chrom_copies) << " s per chromosome copy\n";
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <catch2/catch_all.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <libbio/int_matrix.hh>
+#include <rapidcheck.h>
+#include <rapidcheck/catch.h>		// rc::prop
+#include <set>
+#include <vcf2multialign/path_matrix.hh>
+#include <vector>
+
+namespace lb	= libbio;
+namespace v2m	= vcf2multialign;
+
+
+namespace {
+
+	typedef v2m::path_matrix::row_type			row_type;
+	typedef v2m::path_matrix::column_index_type	column_index_type;
+
+
+	struct test_input
+	{
+		row_type								row_count{};
+		std::vector <std::vector <row_type>>	columns;	// Sorted rows.
+	};
+}
+
+
+namespace rc {
+
+	template <>
+	struct Arbitrary <test_input>
+	{
+		static Gen <test_input> arbitrary()
+		{
+			return gen::mapcat(gen::inRange(row_type(1), row_type(300)), [](row_type const row_count){
+				// Mix columns with a few ones and columns with many.
+				auto const row_gen(gen::inRange(row_type(0), row_count));
+				auto const column_gen(gen::map(
+					gen::oneOf(
+						gen::resize(3, gen::container <std::set <row_type>>(row_gen)),
+						gen::container <std::set <row_type>>(row_gen)
+					),
+					[](std::set <row_type> const &rows){ return std::vector <row_type>(rows.begin(), rows.end()); }
+				));
+
+				return gen::build <test_input>(
+					gen::set(&test_input::row_count, gen::just(row_count)),
+					gen::set(&test_input::columns, gen::container <std::vector <std::vector <row_type>>>(column_gen))
+				);
+			});
+		}
+	};
+}
+
+
+TEST_CASE(
+	"path_matrix stores arbitrary columns",
+	"[path_matrix]"
+)
+{
+	rc::prop(
+		"path_matrix matches the input",
+		[](test_input const &input){
+			v2m::path_matrix mat(input.row_count);
+			lb::bit_matrix dense(input.row_count, input.columns.size());
+			for (column_index_type col{}; col < input.columns.size(); ++col)
+			{
+				auto const &rows(input.columns[col]);
+				mat.push_back_column(rows);
+				for (auto const row : rows)
+					dense(row, col) |= 1;
+			}
+
+			RC_ASSERT(input.columns.size() == mat.number_of_columns());
+			RC_ASSERT(mat == v2m::path_matrix(dense, input.row_count, input.columns.size()));
+
+			v2m::path_matrix::word_vector buffer;
+			std::vector <row_type> row_buffer;
+			for (column_index_type col{}; col < mat.number_of_columns(); ++col)
+			{
+				auto const &rows(input.columns[col]);
+				auto const column(mat.column(col));
+				RC_ASSERT(rows.size() == column.one_count());
+				RC_ASSERT(column.is_dense() == (mat.sparse_column_limit() < rows.size()));
+
+				auto const column_rows(column.to_rows(row_buffer));
+				RC_ASSERT(std::equal(rows.begin(), rows.end(), column_rows.begin(), column_rows.end()));
+
+				auto const words(column.to_words(buffer));
+				for (row_type row{}; row < input.row_count; ++row)
+				{
+					bool const expected(std::binary_search(rows.begin(), rows.end(), row));
+					RC_ASSERT(expected == mat(row, col));
+					RC_ASSERT(expected == bool((words[row / 64] >> (row % 64)) & 0x1));
+				}
+			}
+		}
+	);
+}
@@ -0,0 +1,611 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <catch2/catch_all.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <random>
+#include <rapidcheck.h>
+#include <rapidcheck/catch.h>		// rc::prop
+#include <set>
+#include <span>
+#include <utility>
+#include <vcf2multialign/path_matrix.hh>
+#include <vcf2multialign/pbwt.hh>
+#include <vcf2multialign/sparse_pbwt.hh>
+#include <vector>
+
+namespace v2m	= vcf2multialign;
+
+
+namespace {
+
+	typedef v2m::path_matrix::row_type			row_type;
+	typedef v2m::path_matrix::column_index_type	column_index_type;
+	typedef v2m::pbwt_context <std::uint32_t, std::uint64_t, std::uint32_t>	pbwt_context_type;
+	typedef pbwt_context_type::divergence_value									divergence_value;
+	typedef v2m::sparse_pbwt_context <std::uint32_t, std::uint64_t, std::uint32_t>	sparse_pbwt_context_type;
+
+
+	// The divergence value counts maintained in a std::map, as in the original implementation.
+	struct map_pbwt_context
+	{
+		std::vector <std::uint32_t>					permutation;
+		std::vector <std::uint32_t>					prev_permutation;
+		std::vector <divergence_value>				divergence;
+		std::vector <divergence_value>				prev_divergence;
+		std::map <divergence_value, std::uint32_t>	divergence_value_counts;
+		v2m::path_matrix::word_vector				column_buffer;
+
+		explicit map_pbwt_context(std::uint32_t const count):
+			permutation(count),
+			divergence(count, pbwt_context_type::DIVERGENCE_MAX)
+		{
+			if (count)
+			{
+				divergence[0] = 0;
+				divergence_value_counts[0] = 1;
+				if (1 < count)
+					divergence_value_counts[pbwt_context_type::DIVERGENCE_MAX] = count - 1;
+			}
+			std::iota(permutation.begin(), permutation.end(), 0);
+		}
+
+		void swap_vectors()
+		{
+			using std::swap;
+			swap(permutation, prev_permutation);
+			swap(divergence, prev_divergence);
+			permutation.clear();
+			divergence.clear();
+		}
+
+		void update_divergence(v2m::path_matrix::column_type const &column, divergence_value const kk)
+		{
+			auto const words(column.to_words(column_buffer));
+			auto const bit_at([words](std::uint32_t const idx) -> bool {
+				return (words[idx / v2m::path_matrix::WORD_BITS] >> (idx % v2m::path_matrix::WORD_BITS)) & 0x1;
+			});
+
+			std::uint32_t zero_idx{};
+			std::uint32_t one_idx(prev_permutation.size() - column.one_count());
+			permutation.resize(prev_permutation.size());
+			divergence.resize(prev_divergence.size());
+			divergence_value pp{kk + 1};
+			divergence_value qq{kk + 1};
+			for (std::uint32_t ii{}; ii < prev_permutation.size(); ++ii)
+			{
+				auto const val_idx(prev_permutation[ii]);
+				auto const pd(prev_divergence[ii]);
+
+				if (pp < pd)
+					pp = pd;
+
+				if (qq < pd)
+					qq = pd;
+
+				{
+					auto const it(divergence_value_counts.find(pd));
+					--it->second;
+					if (0 == it->second)
+						divergence_value_counts.erase(it);
+				}
+
+				if (!bit_at(val_idx))
+				{
+					++divergence_value_counts[pp];
+					permutation[zero_idx] = val_idx;
+					divergence[zero_idx] = pp;
+					++zero_idx;
+					pp = 0;
+				}
+				else
+				{
+					++divergence_value_counts[qq];
+					permutation[one_idx] = val_idx;
+					divergence[one_idx] = qq;
+					++one_idx;
+					qq = 0;
+				}
+			}
+		}
+	};
+
+
+	struct test_input
+	{
+		row_type								row_count{};
+		std::vector <std::vector <row_type>>	columns;	// Sorted rows.
+	};
+
+
+	template <typename t_lhs, typename t_rhs>
+	bool divergence_values_equal(t_lhs const &lhs, t_rhs const &rhs)
+	{
+		return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](auto const lhs_, auto const rhs_){
+			return lhs_.value == rhs_.value;
+		});
+	}
+
+
+	template <typename t_counts>
+	bool divergence_value_counts_equal(pbwt_context_type const &ctx, t_counts const &expected)
+	{
+		return std::equal(
+			ctx.divergence_value_counts.begin(), ctx.divergence_value_counts.end(),
+			expected.begin(), expected.end(),
+			[](auto const &lhs, auto const &rhs){
+				return lhs.first.value == rhs.first.value && lhs.second == rhs.second;
+			}
+		);
+	}
+
+
+	// sparse_pbwt_context may retain zero counts.
+	bool divergence_value_counts_equal(sparse_pbwt_context_type const &ctx, pbwt_context_type const &expected)
+	{
+		std::vector <std::pair <std::uint64_t, std::uint32_t>> lhs, rhs;
+		for (auto const &[dd, count] : ctx.divergence_value_counts)
+		{
+			if (count)
+				lhs.emplace_back(dd.value, count);
+		}
+
+		for (auto const &[dd, count] : expected.divergence_value_counts)
+			rhs.emplace_back(dd.value, count);
+
+		return lhs == rhs;
+	}
+}
+
+
+namespace rc {
+
+	template <>
+	struct Arbitrary <test_input>
+	{
+		static Gen <test_input> arbitrary()
+		{
+			return gen::mapcat(gen::inRange(row_type(1), row_type(300)), [](row_type const row_count){
+				// Mix columns with a few ones and columns with many, as well as columns with only ones.
+				auto const row_gen(gen::inRange(row_type(0), row_count));
+				std::vector <row_type> all_rows(row_count);
+				std::iota(all_rows.begin(), all_rows.end(), 0);
+				auto const column_gen(gen::oneOf(
+					gen::map(
+						gen::oneOf(
+							gen::resize(3, gen::container <std::set <row_type>>(row_gen)),
+							gen::container <std::set <row_type>>(row_gen)
+						),
+						[](std::set <row_type> const &rows){ return std::vector <row_type>(rows.begin(), rows.end()); }
+					),
+					gen::just(all_rows)
+				));
+
+				return gen::build <test_input>(
+					gen::set(&test_input::row_count, gen::just(row_count)),
+					gen::set(&test_input::columns, gen::container <std::vector <std::vector <row_type>>>(column_gen))
+				);
+			});
+		}
+	};
+}
+
+
+TEST_CASE(
+	"pbwt_context maintains the divergence value counts",
+	"[pbwt]"
+)
+{
+	rc::prop(
+		"pbwt_context matches the std::map based implementation",
+		[](test_input const &input){
+			v2m::path_matrix mat(input.row_count);
+			for (auto const &rows : input.columns)
+				mat.push_back_column(rows);
+
+			pbwt_context_type ctx(input.row_count);
+			map_pbwt_context expected(input.row_count);
+			RC_ASSERT(divergence_value_counts_equal(ctx, expected.divergence_value_counts));
+
+			for (column_index_type col{}; col < mat.number_of_columns(); ++col)
+			{
+				auto const column(mat.column(col));
+				ctx.swap_vectors();
+				ctx.update_divergence(column, col);
+				expected.swap_vectors();
+				expected.update_divergence(column, col);
+
+				RC_ASSERT(ctx.permutation == expected.permutation);
+				RC_ASSERT(divergence_values_equal(ctx.divergence, expected.divergence));
+				RC_ASSERT(divergence_value_counts_equal(ctx, expected.divergence_value_counts));
+			}
+
+			RC_ASSERT(mat.number_of_columns() == ctx.statistics.handled_columns);
+			RC_ASSERT(ctx.statistics.skipped_columns + ctx.statistics.sparse_columns <= ctx.statistics.handled_columns);
+		}
+	);
+}
+
+
+TEST_CASE(
+	"pbwt_context may be used without the divergence value counts",
+	"[pbwt]"
+)
+{
+	rc::prop(
+		"pbwt_context gives the same permutation and divergence values",
+		[](test_input const &input){
+			v2m::path_matrix mat(input.row_count);
+			for (auto const &rows : input.columns)
+				mat.push_back_column(rows);
+
+			pbwt_context_type ctx(input.row_count);
+			v2m::pbwt_context <std::uint32_t, std::uint64_t, std::uint32_t, false> ctx_(input.row_count);
+			RC_ASSERT(ctx_.divergence_value_counts.empty());
+
+			for (column_index_type col{}; col < mat.number_of_columns(); ++col)
+			{
+				auto const column(mat.column(col));
+				ctx.swap_vectors();
+				ctx.update_divergence(column, col);
+				ctx_.swap_vectors();
+				ctx_.update_divergence(column, col);
+
+				RC_ASSERT(ctx.permutation == ctx_.permutation);
+				RC_ASSERT(divergence_values_equal(ctx.divergence, ctx_.divergence));
+				RC_ASSERT(ctx_.divergence_value_counts.empty());
+			}
+		}
+	);
+}
+
+
+TEST_CASE(
+	"sparse_pbwt_context matches pbwt_context",
+	"[pbwt]"
+)
+{
+	rc::prop(
+		"sparse_pbwt_context gives the same permutation, divergence values and divergence value counts",
+		[](test_input const &input){
+			v2m::path_matrix mat(input.row_count);
+			for (auto const &rows : input.columns)
+				mat.push_back_column(rows);
+
+			// Use small divisors to handle most of the columns with the treap.
+			auto const sparse_column_divisor(*rc::gen::inRange(std::uint32_t(1), std::uint32_t(16)));
+			pbwt_context_type ctx(input.row_count);
+			sparse_pbwt_context_type sparse_ctx(input.row_count, sparse_column_divisor);
+			v2m::sparse_pbwt_context <std::uint32_t, std::uint64_t, std::uint32_t, false> sparse_ctx_(input.row_count, sparse_column_divisor);
+			RC_ASSERT(divergence_value_counts_equal(sparse_ctx, ctx));
+
+			for (column_index_type col{}; col < mat.number_of_columns(); ++col)
+			{
+				auto const column(mat.column(col));
+				ctx.swap_vectors();
+				ctx.update_divergence(column, col);
+				sparse_ctx.swap_vectors();
+				sparse_ctx.update_divergence(column, col);
+				sparse_ctx_.swap_vectors();
+				sparse_ctx_.update_divergence(column, col);
+
+				RC_ASSERT(ctx.first_index() == sparse_ctx.first_index());
+				RC_ASSERT(divergence_value_counts_equal(sparse_ctx, ctx));
+				RC_ASSERT(sparse_ctx_.divergence_value_counts.empty());
+
+				sparse_ctx.fill_vectors();
+				RC_ASSERT(ctx.permutation == sparse_ctx.permutation);
+				RC_ASSERT(divergence_values_equal(ctx.divergence, sparse_ctx.divergence));
+
+				sparse_ctx_.fill_vectors();
+				RC_ASSERT(ctx.permutation == sparse_ctx_.permutation);
+				RC_ASSERT(divergence_values_equal(ctx.divergence, sparse_ctx_.divergence));
+			}
+
+			// The treap is also used for columns that pbwt_context does not consider sparse.
+			RC_ASSERT(ctx.statistics.handled_columns == sparse_ctx.statistics.handled_columns);
+			RC_ASSERT(ctx.statistics.skipped_columns == sparse_ctx.statistics.skipped_columns);
+		}
+	);
+}
+
+
+TEST_CASE(
+	"sparse_pbwt_context does not accumulate divergence value counts with uniform columns",
+	"[pbwt]"
+)
+{
+	row_type const row_count(256);
+	column_index_type const column_count(10'000);
+
+	// Runs of all-zero and all-one columns with an occasional singleton, which is handled with the treap.
+	v2m::path_matrix mat(row_count);
+	{
+		std::vector <row_type> all_rows(row_count);
+		std::iota(all_rows.begin(), all_rows.end(), 0);
+		for (column_index_type col{}; col < column_count; ++col)
+		{
+			if (0 == col % 1000)
+			{
+				std::vector <row_type> const rows{row_type(col / 1000 % row_count)};
+				mat.push_back_column(rows);
+			}
+			else if (col / 100 % 2)
+			{
+				mat.push_back_column(all_rows);
+			}
+			else
+			{
+				mat.push_back_column({});
+			}
+		}
+	}
+
+	pbwt_context_type ctx(row_count);
+	sparse_pbwt_context_type sparse_ctx(row_count);
+	auto const max_size(row_count + std::max(sparse_pbwt_context_type::MIN_COMPACTED_ZERO_COUNTS, std::size_t(row_count)));
+	for (column_index_type col{}; col < column_count; ++col)
+	{
+		auto const column(mat.column(col));
+		ctx.swap_vectors();
+		ctx.update_divergence(column, col);
+		sparse_ctx.swap_vectors();
+		sparse_ctx.update_divergence(column, col);
+
+		INFO("Column: " << col);
+		REQUIRE(sparse_ctx.divergence_value_counts.size() <= max_size);
+		REQUIRE(divergence_value_counts_equal(sparse_ctx, ctx));
+	}
+
+	sparse_ctx.fill_vectors();
+	CHECK(ctx.permutation == sparse_ctx.permutation);
+	CHECK(divergence_values_equal(ctx.divergence, sparse_ctx.divergence));
+}
+
+
+TEST_CASE(
+	"pbwt_context handles the columns of a node with one pass",
+	"[pbwt]"
+)
+{
+	rc::prop(
+		"Handling the columns together gives the same permutation, divergence values and divergence value counts",
+		[](){
+			auto const row_count(*rc::gen::inRange(row_type(1), row_type(300)));
+			auto const node_count(*rc::gen::inRange(0, 20));
+
+			// Assign an allele to each row at each node, zero being REF. The rows in overlaps have ones in all the columns of the node.
+			v2m::path_matrix mat(row_count);
+			std::vector <column_index_type> node_limits{0};
+			for (int node{}; node < node_count; ++node)
+			{
+				auto const alt_count(*rc::gen::inRange(row_type(1), row_type(6)));
+				auto const alleles(*rc::gen::container <std::vector <row_type>>(
+					row_count,
+					rc::gen::oneOf(rc::gen::just(row_type(0)), rc::gen::inRange(row_type(0), 1 + alt_count))
+				));
+				auto const overlaps(*rc::gen::resize(3, rc::gen::container <std::set <row_type>>(rc::gen::inRange(row_type(0), row_count))));
+
+				for (row_type alt{1}; alt <= alt_count; ++alt)
+				{
+					std::vector <row_type> rows;
+					for (row_type row{}; row < row_count; ++row)
+					{
+						if (alt == alleles[row] || overlaps.contains(row))
+							rows.push_back(row);
+					}
+					mat.push_back_column(rows);
+				}
+
+				node_limits.push_back(mat.number_of_columns());
+			}
+
+			pbwt_context_type expected(row_count);
+			pbwt_context_type ctx(row_count);
+			v2m::pbwt_context <std::uint32_t, std::uint64_t, std::uint32_t, false> ctx_(row_count);
+			sparse_pbwt_context_type sparse_ctx(row_count, *rc::gen::inRange(std::uint32_t(1), std::uint32_t(16)));
+
+			for (std::size_t node{1}; node < node_limits.size(); ++node)
+			{
+				auto const lb(node_limits[node - 1]);
+				auto const rb(node_limits[node]);
+				for (auto col(lb); col < rb; ++col)
+				{
+					expected.swap_vectors();
+					expected.update_divergence(mat.column(col), col);
+				}
+
+				ctx.swap_vectors();
+				ctx.update_divergence(mat, lb, rb);
+				ctx_.swap_vectors();
+				ctx_.update_divergence(mat, lb, rb);
+				sparse_ctx.swap_vectors();
+				sparse_ctx.update_divergence(mat, lb, rb);
+
+				RC_ASSERT(expected.permutation == ctx.permutation);
+				RC_ASSERT(divergence_values_equal(expected.divergence, ctx.divergence));
+				RC_ASSERT(divergence_value_counts_equal(ctx, expected.divergence_value_counts));
+
+				RC_ASSERT(expected.permutation == ctx_.permutation);
+				RC_ASSERT(divergence_values_equal(expected.divergence, ctx_.divergence));
+
+				RC_ASSERT(divergence_value_counts_equal(sparse_ctx, expected));
+				sparse_ctx.fill_vectors();
+				RC_ASSERT(expected.permutation == sparse_ctx.permutation);
+				RC_ASSERT(divergence_values_equal(expected.divergence, sparse_ctx.divergence));
+			}
+
+			RC_ASSERT(expected.statistics.handled_columns == ctx.statistics.handled_columns);
+			RC_ASSERT(expected.statistics.handled_columns == sparse_ctx.statistics.handled_columns);
+		}
+	);
+}
+
+
+TEST_CASE(
+	"gather_bits collects the bits in the given order",
+	"[pbwt]"
+)
+{
+	rc::prop(
+		"gather_bits matches the portable version",
+		[](std::vector <v2m::path_matrix::word_type> const &words_, std::vector <std::uint32_t> indices){
+			auto const words(words_.empty() ? std::vector <v2m::path_matrix::word_type>{0} : words_);
+			for (auto &idx : indices)
+				idx %= v2m::path_matrix::WORD_BITS * words.size();
+
+			auto const word_count((indices.size() + v2m::path_matrix::WORD_BITS - 1) / v2m::path_matrix::WORD_BITS);
+			std::vector <v2m::path_matrix::word_type> dst(word_count);
+			std::vector <v2m::path_matrix::word_type> expected(word_count);
+			v2m::gather_bits(words, indices, dst.data());
+			v2m::gather_bits_portable(std::span <v2m::path_matrix::word_type const>(words), std::span <std::uint32_t const>(indices), expected.data());
+			RC_ASSERT(dst == expected);
+
+			for (std::size_t ii{}; ii < indices.size(); ++ii)
+			{
+				auto const idx(indices[ii]);
+				bool const expected_bit((words[idx / 64] >> (idx % 64)) & 0x1);
+				RC_ASSERT(expected_bit == bool((dst[ii / 64] >> (ii % 64)) & 0x1));
+			}
+		}
+	);
+}
+
+
+TEST_CASE(
+	"Divergence value count update time",
+	"[.][pbwt][benchmark]"
+)
+{
+	row_type const row_count(100'000);
+	column_index_type const column_count(200);
+
+	// Columns with a random number of carriers, most of them rare.
+	v2m::path_matrix mat(row_count);
+	{
+		std::mt19937_64 gen(3);
+		std::vector <row_type> rows;
+		for (column_index_type col{}; col < column_count; ++col)
+		{
+			auto const carrier_pct((col % 4) ? 1 : 50);
+			rows.clear();
+			for (row_type row{}; row < row_count; ++row)
+			{
+				if (gen() % 100 < carrier_pct)
+					rows.push_back(row);
+			}
+			mat.push_back_column(rows);
+		}
+	}
+
+	auto const time_updates([&mat](char const *name, auto &ctx){
+		auto const start(std::chrono::steady_clock::now());
+		for (column_index_type col{}; col < mat.number_of_columns(); ++col)
+		{
+			ctx.swap_vectors();
+			ctx.update_divergence(mat.column(col), col);
+		}
+		std::chrono::duration <double> const elapsed(std::chrono::steady_clock::now() - start);
+		std::cout << name << ": " << (1000.0 * elapsed.count() / mat.number_of_columns()) << " ms per edge (" << ctx.divergence_value_counts.size() << " distinct divergence values)\n";
+	});
+
+	std::cout << "Rows: " << row_count << " columns: " << column_count << '\n';
+
+	{
+		map_pbwt_context ctx(row_count);
+		time_updates("std::map", ctx);
+	}
+
+	{
+		pbwt_context_type ctx(row_count);
+		time_updates("Sorted vector", ctx);
+	}
+
+	{
+		v2m::pbwt_context <std::uint32_t, std::uint64_t, std::uint32_t, false> ctx(row_count);
+		time_updates("Without counts", ctx);
+	}
+
+	{
+		sparse_pbwt_context_type ctx(row_count);
+		time_updates("Sparse", ctx);
+	}
+
+	{
+		v2m::sparse_pbwt_context <std::uint32_t, std::uint64_t, std::uint32_t, false> ctx(row_count);
+		time_updates("Sparse without counts", ctx);
+	}
+}
+
+
+TEST_CASE(
+	"Time of handling the columns of a node",
+	"[.][pbwt][benchmark]"
+)
+{
+	// Compare update_divergence(paths, lb, rb) with one update_divergence() call per column.
+	// Each row has one allele at each node, and half of the rows carry an ALT allele.
+	row_type const row_count(100'000);
+	std::size_t const node_count(200);
+
+	std::cout << "Rows: " << row_count << " nodes: " << node_count << '\n';
+	for (column_index_type const alt_count : {1, 2, 4, 8})
+	{
+		v2m::path_matrix mat(row_count);
+		{
+			std::mt19937_64 gen(3);
+			std::vector <row_type> alleles(row_count);
+			std::vector <row_type> rows;
+			for (std::size_t node{}; node < node_count; ++node)
+			{
+				for (auto &allele : alleles)
+					allele = (gen() % 2) ? 1 + gen() % alt_count : 0;
+
+				for (column_index_type alt{1}; alt <= alt_count; ++alt)
+				{
+					rows.clear();
+					for (row_type row{}; row < row_count; ++row)
+					{
+						if (alt == alleles[row])
+							rows.push_back(row);
+					}
+					mat.push_back_column(rows);
+				}
+			}
+		}
+
+		auto const time_updates([&mat, node_count, alt_count](auto &&update){
+			pbwt_context_type ctx(mat.number_of_rows());
+			auto const start(std::chrono::steady_clock::now());
+			for (std::size_t node{}; node < node_count; ++node)
+				update(ctx, node * alt_count, (1 + node) * alt_count);
+			std::chrono::duration <double> const elapsed(std::chrono::steady_clock::now() - start);
+			return std::make_pair(1000.0 * elapsed.count() / node_count, std::move(ctx));
+		});
+
+		auto const [column_ms, column_ctx](time_updates([&mat](auto &ctx, column_index_type const lb, column_index_type const rb){
+			for (auto col(lb); col < rb; ++col)
+			{
+				ctx.swap_vectors();
+				ctx.update_divergence(mat.column(col), col);
+			}
+		}));
+
+		auto const [node_ms, node_ctx](time_updates([&mat](auto &ctx, column_index_type const lb, column_index_type const rb){
+			ctx.swap_vectors();
+			ctx.update_divergence(mat, lb, rb);
+		}));
+
+		CHECK(column_ctx.permutation == node_ctx.permutation);
+		CHECK(divergence_values_equal(column_ctx.divergence, node_ctx.divergence));
+		std::cout << "ALT edges per node: " << alt_count << " one pass per column: " << column_ms << " ms per node, one pass per node: " << node_ms << " ms per node (" << (column_ms / node_ms) << "×)\n";
+	}
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2024 Tuukka Norri
+ * This code is licensed under MIT license (see LICENSE for details).
+ */
+
+#include <algorithm>
+#include <catch2/catch_all.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <rapidcheck.h>
+#include <rapidcheck/catch.h>		// rc::prop
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vcf2multialign/sequence_sink.hh>
+#include <vector>
+
+namespace v2m	= vcf2multialign;
+
+
+namespace {
+
+	struct fragment
+	{
+		std::size_t	size{};
+		bool		is_gap{};
+	};
+
+
+	std::string const &source_sequence()
+	{
+		static auto const retval([](){
+			std::string retval(4 * v2m::buffered_sequence_sink::GAP_BLOCK_SIZE, 'N');
+			char const characters[]{'A', 'C', 'G', 'T'};
+			for (std::size_t i(0); i < retval.size(); ++i)
+				retval[i] = characters[(i * 7 + i / 5) % 4];
+			return retval;
+		}());
+
+		return retval;
+	}
+
+
+	template <typename t_sink>
+	void append_fragments(t_sink &sink, std::vector <fragment> const &fragments)
+	{
+		auto const &src(source_sequence());
+		std::size_t pos{};
+		for (auto const &frag : fragments)
+		{
+			if (frag.is_gap)
+				sink.append_gap(frag.size);
+			else
+			{
+				pos = (pos + 13) % (src.size() - frag.size + 1);
+				sink.append(std::string_view(src.data() + pos, frag.size));
+			}
+		}
+	}
+
+
+	// The previous implementation.
+	struct naive_sink
+	{
+		std::ostream &stream;
+
+		void append(std::string_view const sv) { stream << sv; }
+		void append_gap(std::size_t const count) { std::fill_n(std::ostreambuf_iterator <char>(stream), count, '-'); }
+	};
+
+
+	// Fragments with alternating sequence and gaps; returns the total size in size.
+	std::vector <fragment> benchmark_fragments(std::size_t const max_length, std::size_t &size)
+	{
+		std::size_t const min_size(1 << 24);
+		std::mt19937_64 gen(1);
+		std::uniform_int_distribution <std::size_t> dist(1, max_length);
+		std::vector <fragment> retval;
+		bool is_gap{};
+		size = 0;
+		while (size < min_size)
+		{
+			auto const frag_size(dist(gen));
+			retval.emplace_back(frag_size, is_gap);
+			size += frag_size;
+			is_gap = !is_gap;
+		}
+		return retval;
+	}
+
+
+	template <typename t_fn>
+	double measure_throughput(char const *name, std::size_t const total_size, t_fn &&fn)
+	{
+		auto const start(std::chrono::steady_clock::now());
+		fn();
+		std::chrono::duration <double> const elapsed(std::chrono::steady_clock::now() - start);
+		auto const retval(total_size / elapsed.count() / 1e9);
+		std::cout << name << ": " << retval << " GB/s\n";
+		return retval;
+	}
+}
+
+
+namespace rc {
+
+	template <>
+	struct Arbitrary <fragment>
+	{
+		static Gen <fragment> arbitrary()
+		{
+			return gen::build <fragment>(
+				gen::set(&fragment::size, gen::oneOf(
+					gen::inRange(std::size_t(0), std::size_t(2 * v2m::buffered_sequence_sink::COPY_LIMIT)),
+					gen::inRange(std::size_t(0), std::size_t(3 * v2m::buffered_sequence_sink::GAP_BLOCK_SIZE))
+				)),
+				gen::set(&fragment::is_gap)
+			);
+		}
+	};
+}
+
+
+TEST_CASE(
+	"buffered_sequence_sink writes the fragments in order",
+	"[sequence_sink]"
+)
+{
+	rc::prop(
+		"buffered_sequence_sink works with arbitrary input",
+		[](std::vector <fragment> const &fragments){
+			std::stringstream expected_os;
+			naive_sink expected_sink{expected_os};
+			append_fragments(expected_sink, fragments);
+			auto const expected(expected_os.str());
+
+			// std::ostream
+			{
+				std::stringstream os;
+				v2m::buffered_sequence_sink sink(os);
+				append_fragments(sink, fragments);
+				sink.flush();
+				RC_ASSERT(expected == os.view());
+			}
+
+			// File descriptor
+			{
+				auto *fp(std::tmpfile());
+				RC_ASSERT(fp);
+				v2m::buffered_sequence_sink sink(::fileno(fp));
+				append_fragments(sink, fragments);
+				sink.flush();
+
+				std::rewind(fp);
+				std::string actual(expected.size() + 1, '\0');
+				actual.resize(std::fread(actual.data(), 1, actual.size(), fp));
+				std::fclose(fp);
+				RC_ASSERT(expected == actual);
+			}
+		}
+	);
+}
+
+
+// Run with ./tests "[sequence_sink][benchmark]". The fragments (about 16 MiB) are written repeatedly
+// to /dev/null, 1 GiB in total.
+TEST_CASE(
+	"buffered_sequence_sink throughput",
+	"[.][sequence_sink][benchmark]"
+)
+{
+	std::size_t const min_total_size(1 << 30);
+	for (std::size_t const max_length : {4, 32, 512})
+	{
+		std::size_t size{};
+		auto const fragments(benchmark_fragments(max_length, size));
+		auto const round_count((min_total_size + size - 1) / size);
+		auto const total_size(round_count * size);
+		std::cout << "Fragment lengths 1–" << max_length << '\n';
+
+		auto const write_all([&](auto &sink){
+			for (std::size_t ii{}; ii < round_count; ++ii)
+				append_fragments(sink, fragments);
+		});
+
+		double naive_throughput{};
+		{
+			std::ofstream os("/dev/null");
+			naive_sink sink{os};
+			naive_throughput = measure_throughput("  std::ostream, character-wise gaps", total_size, [&](){ write_all(sink); os.flush(); });
+		}
+
+		{
+			std::ofstream os("/dev/null");
+			v2m::buffered_sequence_sink sink(os);
+			auto const throughput(measure_throughput("  std::ostream, buffered_sequence_sink", total_size, [&](){ write_all(sink); sink.flush(); os.flush(); }));
+			std::cout << "    speedup: " << (throughput / naive_throughput) << "×\n";
+		}
+
+		{
+			auto const fd(::open("/dev/null", O_WRONLY));
+			REQUIRE(-1 != fd);
+			v2m::buffered_sequence_sink sink(fd);
+			auto const throughput(measure_throughput("  writev, buffered_sequence_sink", total_size, [&](){ write_all(sink); sink.flush(); }));
+			std::cout << "    speedup: " << (throughput / naive_throughput) << "×\n";
+			::close(fd);
+		}
+	}
+}
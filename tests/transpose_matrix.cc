@@ -5,18 +5,27 @@
 
 #include <algorithm>
 #include <catch2/catch_all.hpp>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
 #include <iterator>
 #include <libbio/int_matrix/int_matrix.hh>
 #include <ostream>
+#include <random>
 #include <rapidcheck.h>
 #include <rapidcheck/catch.h>		// rc::prop
 #include <sstream>
+#include <thread>
 #include <tuple>
 #include <utility>
+#include <vcf2multialign/path_matrix.hh>
 #include <vcf2multialign/transpose_matrix.hh>
 #include <vector>
 
+namespace fs	= std::filesystem;
 namespace lb	= libbio;
 namespace v2m	= vcf2multialign;
 
@@ -107,6 +116,31 @@ namespace {
 
 		return os.str();
 	}
+
+	std::vector <std::uint64_t> read_words(fs::path const &path)
+	{
+		std::ifstream is(path, std::ios::binary);
+		std::vector <std::uint64_t> retval(fs::file_size(path) / sizeof(std::uint64_t));
+		is.read(reinterpret_cast <char *>(retval.data()), retval.size() * sizeof(std::uint64_t));
+		REQUIRE(is);
+		return retval;
+	}
+
+
+	bool words_equal(lb::bit_matrix const &expected, std::vector <std::uint64_t> const &actual)
+	{
+		auto const &expected_values(expected.values());
+		if (expected_values.word_size() != actual.size())
+			return false;
+
+		for (std::size_t i(0); i < actual.size(); ++i)
+		{
+			if (expected_values.word_at(i) != actual[i])
+				return false;
+		}
+
+		return true;
+	}
 }
 
 
@@ -263,11 +297,14 @@ TEST_CASE(
 		[&max_size](test_case const &tc){
 			RC_TAG(tc.input.number_of_rows(), tc.input.number_of_columns());
 
-			auto const actual(v2m::transpose_matrix(tc.input));
-			auto const &actual_values(actual.values());
-			auto const &expected_values(tc.expected.values());
-			if (actual_values != expected_values)
-				RC_FAIL(comparison(tc.input, tc.expected, actual));
+			for (std::uint16_t const thread_count : {1, 3})
+			{
+				auto const actual(v2m::transpose_matrix(tc.input, thread_count));
+				auto const &actual_values(actual.values());
+				auto const &expected_values(tc.expected.values());
+				if (actual_values != expected_values)
+					RC_FAIL(comparison(tc.input, tc.expected, actual));
+			}
 
 			max_size = std::max(max_size, tc.size);
 
@@ -277,3 +314,110 @@ TEST_CASE(
 
 	RC_LOG() << "Max. size: " << max_size << " words\n";
 }
+
+
+TEST_CASE(
+	"transpose_matrix with arbitrary input and file output",
+	"[transpose_matrix]"
+)
+{
+	auto const path(fs::temp_directory_path() / "vcf2multialign-test-transpose");
+
+	rc::prop(
+		"transpose_matrix writes the transpose to a file with any buffer size",
+		[&path](test_case const &tc){
+			RC_TAG(tc.input.number_of_rows(), tc.input.number_of_columns());
+
+			// Zero produces stripes of 64 destination columns.
+			auto const buffer_size(*rc::gen::element(std::size_t(0), std::size_t(4096), std::size_t(65536)));
+			v2m::transpose_matrix(tc.input, path.c_str(), buffer_size, 2);
+			auto const actual(read_words(path));
+			if (!words_equal(tc.expected, actual))
+				RC_FAIL("File contents do not match the expected");
+
+			return true;
+		}
+	);
+
+	fs::remove(path);
+}
+
+
+SCENARIO("A path matrix may be transposed to a file", "[transpose_matrix]")
+{
+	GIVEN("a path matrix with sparse and dense columns")
+	{
+		auto const path(fs::temp_directory_path() / "vcf2multialign-test-transpose");
+		v2m::path_matrix::row_type const row_count(130);
+		std::size_t const column_count(200);
+
+		v2m::path_matrix paths(row_count);
+		lb::bit_matrix expected(256, 192); // Rounded up to multiples of 64.
+		std::mt19937_64 gen(1);
+		std::vector <v2m::path_matrix::row_type> rows;
+		for (std::size_t col(0); col < column_count; ++col)
+		{
+			rows.clear();
+			for (v2m::path_matrix::row_type row(0); row < row_count; ++row)
+			{
+				if (0 == gen() % (col % 3 ? 64 : 2))
+				{
+					rows.push_back(row);
+					expected(col, row) |= 1;
+				}
+			}
+
+			paths.push_back_column(rows);
+		}
+
+		REQUIRE(paths.dense_column_count());
+		REQUIRE(paths.dense_column_count() < column_count);
+
+		WHEN("the matrix is transposed")
+		{
+			v2m::transpose_matrix(paths, path.c_str(), 4096);
+
+			THEN("the file contains the transpose")
+			{
+				CHECK(words_equal(expected, read_words(path)));
+			}
+		}
+
+		fs::remove(path);
+	}
+}
+
+
+TEST_CASE(
+	"Transposing time of large bit matrices",
+	"[.][transpose_matrix][benchmark]"
+)
+{
+	// Roughly the size of the path matrix of a chromosome with a million edges and 16 384 chromosome copies.
+	std::size_t const nrow(16'384);
+	std::size_t const ncol(1'048'576);
+	lb::bit_matrix input(nrow, ncol);
+
+	{
+		std::mt19937_64 gen(1);
+		auto &values(input.values());
+		for (std::size_t i(0), count(values.word_size()); i < count; ++i)
+			values.word_at(i) = gen() & gen(); // Sparser than uniform.
+	}
+
+	std::cout << "Matrix: " << nrow << " × " << ncol << " (" << (nrow * ncol / 8 / 1048576.0) << " MiB)\n";
+
+	lb::bit_matrix single_threaded;
+	for (std::uint16_t const thread_count : {std::uint16_t(1), std::uint16_t(std::max(1U, std::thread::hardware_concurrency()))})
+	{
+		auto const start(std::chrono::steady_clock::now());
+		auto actual(v2m::transpose_matrix(input, thread_count));
+		std::chrono::duration <double> const elapsed(std::chrono::steady_clock::now() - start);
+		std::cout << "transpose_matrix with " << thread_count << " thread(s): " << elapsed.count() << " s\n";
+
+		if (1 == thread_count)
+			single_threaded = std::move(actual);
+		else
+			CHECK(single_threaded == actual);
+	}
+}
@@ -4,14 +4,23 @@
  */
 
 #include <catch2/catch_all.hpp>
+#include <cereal/archives/portable_binary.hpp>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <initializer_list>
+#include <iostream>
 #include <libbio/fasta_reader.hh>
 #include <libbio/vcf/variant/variant_decl.hh>
+#include <random>
 #include <range/v3/view/enumerate.hpp>
 #include <range/v3/view/zip.hpp>
 #include <set>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <tuple>
@@ -19,6 +28,7 @@
 #include <vcf2multialign/variant_graph.hh>
 #include <vector>
 
+namespace fs	= std::filesystem;
 namespace lb	= libbio;
 namespace rsv	= ranges::view;
 namespace v2m	= vcf2multialign;
@@ -199,7 +209,7 @@ namespace {
 		{
 		}
 
-		bool should_include(std::string_view const sample_name, v2m::variant_graph::ploidy_type const chrom_copy_idx) const override
+		bool should_include(std::string_view const chr_id, std::string_view const sample_name, v2m::variant_graph::ploidy_type const chrom_copy_idx) const override
 		{
 			return true;
 		}
@@ -224,6 +234,76 @@ namespace {
 	};
 
 
+	// Ignores overlapping alternatives.
+	struct benchmark_delegate final : public v2m::build_graph_delegate
+	{
+		bool should_include(std::string_view const chr_id, std::string_view const sample_name, v2m::variant_graph::ploidy_type const chrom_copy_idx) const override { return true; }
+
+		void report_overlapping_alternative(
+			std::uint64_t const lineno,
+			v2m::variant_graph::position_type const ref_pos,
+			std::vector <std::string_view> const &var_id,
+			std::string_view const sample_name,
+			v2m::variant_graph::ploidy_type const chrom_copy_idx,
+			std::uint32_t const gt
+		) override
+		{
+		}
+
+		bool ref_column_mismatch(std::uint64_t const var_idx, vcf::transient_variant const &var, std::string_view const expected) override { return false; }
+	};
+
+
+	// Records the order in which the graphs are passed on.
+	struct contig_graph_delegate final : public v2m::build_graph_contig_delegate
+	{
+		typedef std::function <void(v2m::variant_graph_contig const &)>	callback_type;
+
+		std::vector <std::string>	chromosome_ids;
+		callback_type				callback;
+
+		explicit contig_graph_delegate(callback_type &&callback_):
+			callback(std::move(callback_))
+		{
+		}
+
+		void handle_contig_graph(v2m::variant_graph_contig const &contig) override
+		{
+			chromosome_ids.emplace_back(contig.chromosome_id);
+			callback(contig);
+		}
+	};
+
+
+	// Includes the listed samples and ignores overlapping alternatives.
+	struct sample_filter_delegate final : public v2m::build_graph_delegate
+	{
+		std::set <std::string, std::less <>> included_samples;
+
+		explicit sample_filter_delegate(std::initializer_list <std::string> included_samples_):
+			included_samples(included_samples_)
+		{
+		}
+
+		bool should_include(std::string_view const chr_id, std::string_view const sample_name, v2m::variant_graph::ploidy_type const chrom_copy_idx) const override
+		{
+			return included_samples.contains(sample_name);
+		}
+
+		void report_overlapping_alternative(
+			std::uint64_t const lineno,
+			v2m::variant_graph::position_type const ref_pos,
+			std::vector <std::string_view> const &var_id,
+			std::string_view const sample_name,
+			v2m::variant_graph::ploidy_type const chrom_copy_idx,
+			std::uint32_t const gt
+		) override
+		{
+		}
+
+		bool ref_column_mismatch(std::uint64_t const var_idx, vcf::transient_variant const &var, std::string_view const expected) override { return true; }
+	};
+
 
 	void test_variant_graph(char const *vcf_name, char const *fasta_name, node_comparator &cmp, std::initializer_list <alternative_type> expected_overlapping_alts)
 	{
@@ -240,6 +320,36 @@ namespace {
 		v2m::build_variant_graph(ref_seq, vcf_path.c_str(), "1", graph, stats, delegate);
 
 		cmp.check_graph(ref_seq, graph);
+
+		// Serialise and load.
+		{
+			std::stringstream stream;
+
+			{
+				cereal::PortableBinaryOutputArchive archive(stream);
+				archive(graph);
+			}
+
+			v2m::variant_graph graph_;
+			cereal::PortableBinaryInputArchive archive(stream);
+			archive(graph_);
+
+			cmp.check_graph(ref_seq, graph_);
+			CHECK(graph.alt_edge_labels == graph_.alt_edge_labels);
+			CHECK(graph.paths_by_edge_and_chrom_copy == graph_.paths_by_edge_and_chrom_copy);
+			CHECK(graph.sample_names == graph_.sample_names);
+			CHECK(graph.ploidy_csum == graph_.ploidy_csum);
+		}
+
+		// Fill the paths in worker threads.
+		{
+			v2m::variant_graph graph_;
+			v2m::build_graph_statistics stats_;
+			v2m::build_variant_graph(ref_seq, vcf_path.c_str(), "1", graph_, stats_, delegate, 3);
+
+			cmp.check_graph(ref_seq, graph_);
+			CHECK(graph.paths_by_edge_and_chrom_copy == graph_.paths_by_edge_and_chrom_copy);
+		}
 	}
 }
 
@@ -337,3 +447,395 @@ SCENARIO("Variant graph can be created correctly from a set of miscellaneous var
 		test_variant_graph("test-4.vcf", "test-4.fa", cmp, {});
 	}
 }
+
+
+SCENARIO("Variant graphs of several contigs can be created in one pass")
+{
+	GIVEN("A VCF file with records of interleaved contigs")
+	{
+		fs::path const data_dir("test-files/variant-graph");
+		auto const vcf_path(fs::temp_directory_path() / "vcf2multialign-multiple-contigs.vcf");
+
+		{
+			// Records of test-2.vcf as chromosome 1 and those of test-3.vcf as chromosome 2, split in two parts.
+			std::ofstream os(vcf_path);
+			os << "##fileformat=VCFv4.1\n";
+			os << "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n";
+			os << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tSAMPLE1\tSAMPLE2\tSAMPLE3\tSAMPLE4\tSAMPLE5\n";
+			os << "1\t1\ta\tGCAACC\tTTTT\t100\tPASS\t.\tGT\t1|0\t0|0\t0|0\t0|1\t0|0\n";
+			os << "2\t1\ta\tTGCTGGGAGGCAACC\tT\t100\tPASS\t.\tGT\t1|0\t0|0\t0|0\t0|0\t0|0\n";
+			os << "2\t2\tC\tGCTGGGAGGCA\tC\t100\tPASS\t.\tGT\t0|0\t0|0\t0|0\t0|0\t0|0\n";
+			os << "2\t4\tb\tTG\tCCCC\t100\tPASS\t.\tGT\t0|1\t1|0\t0|1\t0|1\t0|0\n";
+			os << "3\t1\tx\tA\tT\t100\tPASS\t.\tGT\t1|1\t1|1\t1|1\t1|1\t1|1\n";
+			os << "1\t3\tb\tAA\tC\t100\tPASS\t.\tGT\t0|0\t1|0\t1|0\t0|0\t0|0\n";
+			os << "1\t5\tc\tC\tGG\t100\tPASS\t.\tGT\t0|0\t1|0\t0|1\t0|0\t1|0\n";
+			os << "2\t7\tc\tG\tT\t100\tPASS\t.\tGT\t0|1\t0|1\t0|1\t0|0\t0|0\n";
+			os << "2\t10\td\tGCAACC\tTTTT\t100\tPASS\t.\tGT\t0|0\t0|0\t1|1\t0|0\t0|0\n";
+			os << "2\t12\te\tA\tG\t100\tPASS\t.\tGT\t0|0\t0|0\t0|0\t0|0\t1|0\n";
+			os << "2\t12\tf\tAA\tC\t100\tPASS\t.\tGT\t0|0\t0|0\t0|0\t1|1\t0|1\n";
+		}
+
+		v2m::sequence_type ref_seq_1;
+		v2m::sequence_type ref_seq_2;
+		REQUIRE(lb::read_single_fasta_sequence(data_dir / "test-2.fa", ref_seq_1, nullptr));
+		REQUIRE(lb::read_single_fasta_sequence(data_dir / "test-3.fa", ref_seq_2, nullptr));
+
+		node_comparator cmp_1{{
+			{0,		0,	0,	"GC",	{{4, "TTTT"}}},
+			{1,		2,	2,	"AA",	{{2, "C"}}},
+			{2,		4,	4,	"C",	{{3, "GG"}}},
+			{3,		5,	6,	"C",	{}},
+			{4,		6,	7,	"",		{}}
+		}};
+
+		node_comparator cmp_2{{
+			{0,		0,	0,	"T",	{{10, "T"}}},
+			{1,		1,	1,	"GC",	{{8, "C"}}},
+			{2,		3,	3,	"TG",	{{3, "CCCC"}}},
+			{3,		5,	7,	"G",	{}},
+			{4,		6,	8,	"G",	{{5, "T"}}},
+			{5,		7,	9,	"AG",	{}},
+			{6,		9,	11,	"GC",	{{10, "TTTT"}}},
+			{7,		11,	13,	"A",	{{8, "G"}, {9, "C"}}},
+			{8,		12,	14,	"A",	{}},
+			{9,		13,	15,	"CC",	{}},
+			{10,	15,	17,	"",		{}}
+		}};
+
+		build_graph_delegate delegate(std::initializer_list <alternative_type>{});
+
+		WHEN("the graphs are built")
+		{
+			THEN("the graphs match those built one contig at a time regardless of the number of threads")
+			{
+				for (std::uint16_t const thread_count : {1, 3})
+				{
+					INFO("Threads: " << thread_count);
+
+					v2m::variant_graph graph_1;
+					v2m::variant_graph graph_2;
+					v2m::variant_graph_contig const contigs[]{
+						{&ref_seq_2, "2", &graph_2},
+						{&ref_seq_1, "1", &graph_1}
+					};
+
+					v2m::build_graph_statistics stats;
+					v2m::build_variant_graphs(vcf_path, contigs, stats, delegate, thread_count);
+
+					CHECK(10 == stats.handled_variants);
+					CHECK(1 == stats.chr_id_mismatches);
+
+					cmp_1.check_graph(ref_seq_1, graph_1);
+					cmp_2.check_graph(ref_seq_2, graph_2);
+
+					for (auto const &[chr_id, ref_seq, graph] : {
+						std::make_tuple("1", &ref_seq_1, &graph_1),
+						std::make_tuple("2", &ref_seq_2, &graph_2)
+					})
+					{
+						INFO("Chromosome " << chr_id);
+						v2m::variant_graph expected;
+						v2m::build_graph_statistics stats_;
+						v2m::build_variant_graph(*ref_seq, vcf_path, chr_id, expected, stats_, delegate);
+
+						CHECK(expected.paths_by_edge_and_chrom_copy == graph->paths_by_edge_and_chrom_copy);
+						CHECK(expected.sample_names == graph->sample_names);
+						CHECK(expected.ploidy_csum == graph->ploidy_csum);
+					}
+				}
+			}
+		}
+
+		fs::remove(vcf_path);
+	}
+}
+
+
+SCENARIO("Variant graphs of several contigs are passed on as soon as they are complete")
+{
+	GIVEN("A VCF file sorted by contig")
+	{
+		fs::path const data_dir("test-files/variant-graph");
+		auto const vcf_path(fs::temp_directory_path() / "vcf2multialign-sorted-contigs.vcf");
+
+		{
+			// Records of test-3.vcf as chromosome 2 followed by those of test-2.vcf as chromosome 1.
+			std::ofstream os(vcf_path);
+			os << "##fileformat=VCFv4.1\n";
+			os << "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n";
+			os << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tSAMPLE1\tSAMPLE2\tSAMPLE3\tSAMPLE4\tSAMPLE5\n";
+			os << "2\t1\ta\tTGCTGGGAGGCAACC\tT\t100\tPASS\t.\tGT\t1|0\t0|0\t0|0\t0|0\t0|0\n";
+			os << "2\t2\tC\tGCTGGGAGGCA\tC\t100\tPASS\t.\tGT\t0|0\t0|0\t0|0\t0|0\t0|0\n";
+			os << "2\t4\tb\tTG\tCCCC\t100\tPASS\t.\tGT\t0|1\t1|0\t0|1\t0|1\t0|0\n";
+			os << "2\t7\tc\tG\tT\t100\tPASS\t.\tGT\t0|1\t0|1\t0|1\t0|0\t0|0\n";
+			os << "2\t10\td\tGCAACC\tTTTT\t100\tPASS\t.\tGT\t0|0\t0|0\t1|1\t0|0\t0|0\n";
+			os << "2\t12\te\tA\tG\t100\tPASS\t.\tGT\t0|0\t0|0\t0|0\t0|0\t1|0\n";
+			os << "2\t12\tf\tAA\tC\t100\tPASS\t.\tGT\t0|0\t0|0\t0|0\t1|1\t0|1\n";
+			os << "3\t1\tx\tA\tT\t100\tPASS\t.\tGT\t1|1\t1|1\t1|1\t1|1\t1|1\n";
+			os << "1\t1\ta\tGCAACC\tTTTT\t100\tPASS\t.\tGT\t1|0\t0|0\t0|0\t0|1\t0|0\n";
+			os << "1\t3\tb\tAA\tC\t100\tPASS\t.\tGT\t0|0\t1|0\t1|0\t0|0\t0|0\n";
+			os << "1\t5\tc\tC\tGG\t100\tPASS\t.\tGT\t0|0\t1|0\t0|1\t0|0\t1|0\n";
+		}
+
+		v2m::sequence_type ref_seq_1;
+		v2m::sequence_type ref_seq_2;
+		REQUIRE(lb::read_single_fasta_sequence(data_dir / "test-2.fa", ref_seq_1, nullptr));
+		REQUIRE(lb::read_single_fasta_sequence(data_dir / "test-3.fa", ref_seq_2, nullptr));
+
+		node_comparator cmp_1{{
+			{0,		0,	0,	"GC",	{{4, "TTTT"}}},
+			{1,		2,	2,	"AA",	{{2, "C"}}},
+			{2,		4,	4,	"C",	{{3, "GG"}}},
+			{3,		5,	6,	"C",	{}},
+			{4,		6,	7,	"",		{}}
+		}};
+
+		node_comparator cmp_2{{
+			{0,		0,	0,	"T",	{{10, "T"}}},
+			{1,		1,	1,	"GC",	{{8, "C"}}},
+			{2,		3,	3,	"TG",	{{3, "CCCC"}}},
+			{3,		5,	7,	"G",	{}},
+			{4,		6,	8,	"G",	{{5, "T"}}},
+			{5,		7,	9,	"AG",	{}},
+			{6,		9,	11,	"GC",	{{10, "TTTT"}}},
+			{7,		11,	13,	"A",	{{8, "G"}, {9, "C"}}},
+			{8,		12,	14,	"A",	{}},
+			{9,		13,	15,	"CC",	{}},
+			{10,	15,	17,	"",		{}}
+		}};
+
+		build_graph_delegate delegate(std::initializer_list <alternative_type>{});
+
+		WHEN("the graphs are built")
+		{
+			THEN("each graph is complete when it is passed on, and the graphs of the contigs without records are passed last")
+			{
+				for (std::uint16_t const thread_count : {1, 3})
+				{
+					INFO("Threads: " << thread_count);
+
+					v2m::variant_graph graph_1;
+					v2m::variant_graph graph_2;
+					v2m::variant_graph graph_4;
+					v2m::variant_graph_contig const contigs[]{
+						{&ref_seq_1, "1", &graph_1},
+						{&ref_seq_1, "4", &graph_4},
+						{&ref_seq_2, "2", &graph_2}
+					};
+
+					contig_graph_delegate contig_delegate([&](v2m::variant_graph_contig const &contig){
+						std::string_view const chr_id(contig.chromosome_id);
+						if ("1" == chr_id)
+							cmp_1.check_graph(ref_seq_1, *contig.graph);
+						else if ("2" == chr_id)
+							cmp_2.check_graph(ref_seq_2, *contig.graph);
+						else
+						{
+							CHECK(2 == contig.graph->node_count());
+							CHECK(0 == contig.graph->edge_count());
+						}
+					});
+
+					v2m::build_graph_statistics stats;
+					v2m::build_variant_graphs(vcf_path.c_str(), contigs, stats, delegate, contig_delegate, thread_count);
+
+					CHECK(10 == stats.handled_variants);
+					CHECK(1 == stats.chr_id_mismatches);
+					CHECK(std::vector <std::string>{"2", "1", "4"} == contig_delegate.chromosome_ids);
+				}
+			}
+		}
+
+		fs::remove(vcf_path);
+	}
+}
+
+
+TEST_CASE(
+	"Variant graph building throughput",
+	"[.][variant_graph][benchmark]"
+)
+{
+	// Generate records with one to three ALT alleles and REF lengths that mostly overlap the following records.
+	std::size_t const record_count(2'000'000);
+	std::mt19937_64 gen(1);
+	std::uniform_int_distribution <std::uint8_t> base_dist(0, 3);
+	std::uniform_int_distribution <std::uint8_t> step_dist(1, 4);
+	std::uniform_int_distribution <std::uint8_t> alt_count_dist(1, 3);
+	std::uniform_int_distribution <std::uint8_t> ref_length_dist(1, 8);
+	std::uniform_int_distribution <std::uint8_t> gt_dist(0, 3);
+	char const bases[]{'A', 'C', 'G', 'T'};
+
+	v2m::sequence_type ref_seq(5 * record_count + 16);
+	for (auto &cc : ref_seq)
+		cc = bases[base_dist(gen)];
+
+	auto const vcf_path(fs::temp_directory_path() / "vcf2multialign-benchmark.vcf");
+
+	{
+		std::ofstream os(vcf_path);
+		os << "##fileformat=VCFv4.2\n";
+		os << "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n";
+		os << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tSAMPLE1\tSAMPLE2\n";
+
+		std::size_t pos{};
+		for (std::size_t i{}; i < record_count; ++i)
+		{
+			pos += step_dist(gen);
+			std::string_view const ref(ref_seq.data() + pos, ref_length_dist(gen));
+			os << "1\t" << (1 + pos) << "\tv" << i << '\t' << ref << '\t';
+
+			auto const alt_count(alt_count_dist(gen));
+			for (std::uint8_t j{}; j < alt_count; ++j)
+			{
+				if (j)
+					os << ',';
+				os << bases[(1 + j + base_dist(gen) % 2) % 4] << std::string_view(ref_seq.data() + pos + 1, gt_dist(gen));
+			}
+
+			os << "\t.\tPASS\t.\tGT";
+			for (std::size_t j{}; j < 2; ++j)
+				os << '\t' << (0 == gt_dist(gen) ? '1' : '0') << '|' << '0';
+			os << '\n';
+		}
+	}
+
+	for (std::uint16_t const thread_count : {1, 4})
+	{
+		benchmark_delegate delegate;
+		v2m::variant_graph graph;
+		v2m::build_graph_statistics stats;
+
+		auto const start(std::chrono::steady_clock::now());
+		v2m::build_variant_graph(ref_seq, vcf_path, "1", graph, stats, delegate, thread_count);
+		std::chrono::duration <double> const elapsed(std::chrono::steady_clock::now() - start);
+
+		CHECK(record_count == stats.handled_variants);
+		std::cout << "Threads: " << thread_count << " records: " << stats.handled_variants << " ALT edges: " << graph.edge_count() << " time: " << elapsed.count() << " s (" << (stats.handled_variants / elapsed.count()) << " records/s)\n";
+	}
+
+	fs::remove(vcf_path);
+}
+
+
+SCENARIO("Samples can be added to an existing variant graph", "[variant_graph]")
+{
+	GIVEN("A graph built from some of the samples")
+	{
+		std::string const data_dir("test-files/variant-graph/");
+		v2m::sequence_type ref_seq;
+		REQUIRE(lb::read_single_fasta_sequence((data_dir + "test-4.fa").c_str(), ref_seq));
+		auto const vcf_path(data_dir + "test-4.vcf");
+
+		v2m::variant_graph graph;
+		{
+			v2m::build_graph_statistics stats;
+			sample_filter_delegate delegate{"SAMPLE1", "SAMPLE2", "SAMPLE3"};
+			v2m::build_variant_graph(ref_seq, vcf_path.c_str(), "1", graph, stats, delegate);
+		}
+
+		WHEN("the rest of the samples are added")
+		{
+			{
+				v2m::build_graph_statistics stats;
+				sample_filter_delegate delegate{"SAMPLE4", "SAMPLE5", "SAMPLE6", "SAMPLE7"};
+				v2m::append_samples(vcf_path.c_str(), "1", graph, stats, delegate);
+			}
+
+			THEN("the graph matches the one built from all the samples")
+			{
+				v2m::variant_graph expected;
+				v2m::build_graph_statistics stats;
+				sample_filter_delegate delegate{"SAMPLE1", "SAMPLE2", "SAMPLE3", "SAMPLE4", "SAMPLE5", "SAMPLE6", "SAMPLE7"};
+				v2m::build_variant_graph(ref_seq, vcf_path.c_str(), "1", expected, stats, delegate);
+
+				CHECK(expected.reference_positions == graph.reference_positions);
+				CHECK(expected.aligned_positions == graph.aligned_positions);
+				CHECK(expected.alt_edge_targets == graph.alt_edge_targets);
+				CHECK(expected.alt_edge_labels == graph.alt_edge_labels);
+				CHECK(expected.paths_by_edge_and_chrom_copy == graph.paths_by_edge_and_chrom_copy);
+				CHECK(expected.sample_names == graph.sample_names);
+				CHECK(expected.ploidy_csum == graph.ploidy_csum);
+			}
+		}
+	}
+}
+
+
+SCENARIO("Added samples need to match the ALT edges of the variant graph", "[variant_graph]")
+{
+	GIVEN("A graph with consecutive nodes whose ALT edges have identical labels")
+	{
+		fs::path const data_dir("test-files/variant-graph");
+		auto const vcf_path(fs::temp_directory_path() / "vcf2multialign-append-samples.vcf");
+
+		v2m::sequence_type ref_seq;
+		REQUIRE(lb::read_single_fasta_sequence(data_dir / "test-2.fa", ref_seq, nullptr));
+
+		auto const write_vcf([&vcf_path](std::initializer_list <std::string_view> const records){
+			std::ofstream os(vcf_path);
+			os << "##fileformat=VCFv4.1\n";
+			os << "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n";
+			os << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tSAMPLE1\tSAMPLE2\tSAMPLE3\tSAMPLE4\n";
+			for (auto const record : records)
+				os << record << '\n';
+		});
+
+		std::string_view const record_a("1\t3\ta\tA\tT\t100\tPASS\t.\tGT\t1|0\t0|0\t0|1\t0|0");
+		std::string_view const record_b("1\t4\tb\tA\tT\t100\tPASS\t.\tGT\t0|0\t0|1\t0|0\t1|0");
+
+		write_vcf({record_a, record_b});
+		v2m::variant_graph graph;
+		{
+			v2m::build_graph_statistics stats;
+			sample_filter_delegate delegate{"SAMPLE1", "SAMPLE2"};
+			v2m::build_variant_graph(ref_seq, vcf_path, "1", graph, stats, delegate);
+		}
+
+		REQUIRE(2 == graph.edge_count());
+		REQUIRE(graph.alt_edge_labels[0] == graph.alt_edge_labels[1]);
+
+		v2m::build_graph_statistics stats;
+		sample_filter_delegate delegate{"SAMPLE3", "SAMPLE4"};
+
+		WHEN("the samples are added from the same records")
+		{
+			v2m::append_samples(vcf_path, "1", graph, stats, delegate);
+
+			THEN("the graph matches the one built from all the samples")
+			{
+				v2m::variant_graph expected;
+				v2m::build_graph_statistics stats_;
+				sample_filter_delegate delegate_{"SAMPLE1", "SAMPLE2", "SAMPLE3", "SAMPLE4"};
+				v2m::build_variant_graph(ref_seq, vcf_path, "1", expected, stats_, delegate_);
+
+				CHECK(expected.alt_edge_targets == graph.alt_edge_targets);
+				CHECK(expected.paths_by_edge_and_chrom_copy == graph.paths_by_edge_and_chrom_copy);
+				CHECK(expected.sample_names == graph.sample_names);
+			}
+		}
+
+		WHEN("the samples are added from a file in which the record of the first node has been replaced")
+		{
+			// The first record would otherwise match the ALT edge of the previous node.
+			write_vcf({record_b, "1\t4\tc\tA\tT\t100\tPASS\t.\tGT\t0|0\t0|1\t0|0\t1|0"});
+
+			THEN("the file is rejected")
+			{
+				CHECK_THROWS_AS(v2m::append_samples(vcf_path, "1", graph, stats, delegate), std::runtime_error);
+			}
+		}
+
+		WHEN("the samples are added from a file in which an ALT edge has a different target")
+		{
+			write_vcf({record_a, "1\t4\tb\tAC\tT\t100\tPASS\t.\tGT\t0|0\t0|1\t0|0\t1|0"});
+
+			THEN("the file is rejected")
+			{
+				CHECK_THROWS_AS(v2m::append_samples(vcf_path, "1", graph, stats, delegate), std::runtime_error);
+			}
+		}
+
+		fs::remove(vcf_path);
+	}
+}
@@ -8,9 +8,12 @@
 #include <cereal/archives/portable_binary.hpp>
 #include <cereal/types/vector.hpp>
 #include <cereal/types/string.hpp>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
 #include <exception>
+#include <filesystem>
+#include <functional>
 #include <iostream>
 #include <iterator>
 #include <libbio/assert.hh>
@@ -23,6 +26,8 @@
 #include <libbio/subprocess.hh>
 #include <libbio/utility.hh>
 #include <libbio/vcf/variant/variant_decl.hh>
+#include <map>
+#include <mutex>
 #include <range/v3/algorithm/copy.hpp>
 #include <range/v3/iterator/stream_iterators.hpp>
 #include <range/v3/view/enumerate.hpp>
@@ -30,15 +35,22 @@
 #include <range/v3/view/iota.hpp>
 #include <range/v3/view/zip.hpp>
 #include <signal.h>
+#include <span>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <sys/signal.h>
+#include <thread>
+#include <vcf2multialign/graph_file.hh>
 #include <vcf2multialign/output.hh>
+#include <vcf2multialign/pbwt.hh>
 #include <vcf2multialign/state.hh>
 #include <vcf2multialign/variant_graph.hh>
 #include <vector>
 #include "cmdline.h"
 
+namespace fs	= std::filesystem;
 namespace ios	= boost::iostreams;
 namespace lb	= libbio;
 namespace lbp	= libbio::parsing;
@@ -140,10 +152,21 @@ namespace {
 	typedef sample_identifier_tpl <std::string_view>	sample_identifier_sv;
 
 
+	typedef std::map <std::string, std::vector <sample_identifier>, std::less <>>	sample_list_map;
+	typedef std::map <std::string, v2m::sequence_type, std::less <>>				reference_sequence_map;
+
+
+	struct contig_description
+	{
+		std::string	reference_id;
+		std::string	chromosome_id;
+	};
+
+
 	struct build_variant_graph_delegate final : public v2m::build_graph_delegate
 	{
 		lb::file_ostream				overlapping_alternatives_os;
-		std::vector <sample_identifier>	sample_list;
+		sample_list_map					sample_lists;	// By chromosome identifier.
 		bool							should_exclude_listed_samples{true};
 		bool							ref_column_mismatch_is_fatal{false};
 
@@ -171,8 +194,13 @@ namespace {
 			}
 		}
 
-		bool should_include(std::string_view const sample_name, v2m::variant_graph::ploidy_type const chrom_copy_idx) const override
+		bool should_include(std::string_view const chr_id, std::string_view const sample_name, v2m::variant_graph::ploidy_type const chrom_copy_idx) const override
 		{
+			auto const it(sample_lists.find(chr_id));
+			if (sample_lists.end() == it)
+				return should_exclude_listed_samples;
+
+			auto const &sample_list(it->second);
 			return should_exclude_listed_samples ^ std::binary_search(sample_list.begin(), sample_list.end(), sample_identifier_sv{sample_name, chrom_copy_idx});
 		}
 
@@ -190,52 +218,105 @@ namespace {
 	};
 
 
-	void read_sample_list(char const *samples_tsv_path, char const *chr_id, std::vector <sample_identifier> &samples)
+	template <typename t_parser, typename t_fn>
+	void parse_tsv(char const *path, t_fn &&fn)
 	{
 		lb::file_istream stream;
-		lb::open_file_for_reading(samples_tsv_path, stream);
+		lb::open_file_for_reading(path, stream);
+
+		std::istreambuf_iterator it(stream.rdbuf());
+		std::istreambuf_iterator <typename decltype(it)::value_type> const sentinel;
+		t_parser parser;
+		typename t_parser::record_type rec;
+		try
+		{
+			while (true)
+			{
+				if (!parser.parse(it, sentinel, rec))
+					break;
 
+				fn(rec);
+			}
+		}
+		catch (lbp::parse_error const &err)
+		{
+			std::cerr << "ERROR: Parse error at position " << err.position() << ": ";
+			err.output_error(std::cerr);
+			std::cerr << '\n';
+			std::exit(EXIT_FAILURE);
+		}
+	}
+
+
+	void read_sample_list(char const *samples_tsv_path, sample_list_map &sample_lists)
+	{
 		typedef lbp::parser <
 			lbp::traits::delimited <lbp::delimiter <'\t'>, lbp::delimiter <'\n'>>,
 			lbp::fields::text <>,
 			lbp::fields::text <>,
 			lbp::fields::integer <std::uint32_t>
 		> parser_type;
-		typedef parser_type::record_type record_type;
 
+		parse_tsv <parser_type>(samples_tsv_path, [&sample_lists](auto const &rec){
+			sample_lists[std::string(std::get <0>(rec))].emplace_back(std::get <1>(rec), std::get <2>(rec));
+		});
+
+		for (auto &[chr_id, samples] : sample_lists)
+			std::sort(samples.begin(), samples.end());
+	}
+
+
+	void read_contig_list(char const *contigs_tsv_path, std::vector <contig_description> &contigs)
+	{
+		typedef lbp::parser <
+			lbp::traits::delimited <lbp::delimiter <'\t'>, lbp::delimiter <'\n'>>,
+			lbp::fields::text <>,
+			lbp::fields::text <>
+		> parser_type;
+
+		parse_tsv <parser_type>(contigs_tsv_path, [&contigs](auto const &rec){
+			contigs.emplace_back(std::string(std::get <0>(rec)), std::string(std::get <1>(rec)));
+		});
+	}
+
+
+	// Read the sequences whose identifiers are in the map in one pass over the FASTA file.
+	void read_reference_sequences(char const *fasta_path, reference_sequence_map &sequences)
+	{
+		lb::file_istream stream;
+		lb::open_file_for_reading(fasta_path, stream);
+
+		std::string line;
+		v2m::sequence_type *dst{};
+		while (std::getline(stream, line))
 		{
-			std::istreambuf_iterator it(stream.rdbuf());
-			std::istreambuf_iterator <decltype(it)::value_type> const sentinel;
-			parser_type parser;
-			record_type rec;
-			try
-			{
-				while (true)
-				{
-					if (!parser.parse(it, sentinel, rec))
-						break;
+			if (line.empty() || ';' == line.front())
+				continue;
 
-					if (chr_id == std::get <0>(rec))
-						samples.emplace_back(std::get <1>(rec), std::get <2>(rec));
-				}
+			if ('>' == line.front())
+			{
+				// The identifier ends at the first whitespace character.
+				std::string_view const header(line);
+				auto const identifier(header.substr(1, header.find_first_of(" \t\r", 1) - 1));
+				auto const it(sequences.find(identifier));
+				dst = ((sequences.end() == it || !it->second.empty()) ? nullptr : &it->second);
+				continue;
 			}
-			catch (lbp::parse_error const &err)
+
+			if (dst)
 			{
-				std::cerr << "ERROR: Parse error at position " << err.position() << ": ";
-				err.output_error(std::cerr);
-				std::cerr << '\n';
-				std::exit(EXIT_FAILURE);
+				if ('\r' == line.back())
+					line.pop_back();
+				dst->insert(dst->end(), line.begin(), line.end());
 			}
 		}
-
-		std::sort(samples.begin(), samples.end());
 	}
 
 
-	void read_filtered_samples(char const *path, char const *chr_id, build_variant_graph_delegate &delegate, bool const should_include, bool const be_verbose)
+	void read_filtered_samples(char const *path, build_variant_graph_delegate &delegate, bool const should_include, bool const be_verbose)
 	{
 		lb::log_time(std::cerr) << "Reading the " << (should_include ? "included" : "excluded") << " sample list…" << std::flush;
-		read_sample_list(path, chr_id, delegate.sample_list);
+		read_sample_list(path, delegate.sample_lists);
 		std::cerr << " Done.\n";
 
 		delegate.should_exclude_listed_samples = !should_include;
@@ -243,55 +324,91 @@ namespace {
 		if (be_verbose)
 		{
 			std::cerr << (should_include ? "Included" : "Excluded") << " the following samples:\n";
-			for (auto const &sample_id : delegate.sample_list)
-				std::cerr << sample_id.sample << " (" << sample_id.chromosome_copy_index << ")\n";
+			for (auto const &[chr_id, sample_list] : delegate.sample_lists)
+			{
+				for (auto const &sample_id : sample_list)
+					std::cerr << chr_id << '\t' << sample_id.sample << " (" << sample_id.chromosome_copy_index << ")\n";
+			}
 		}
 	}
 
 
-	void build_variant_graph(
-		char const *variants_path,
-		char const *chr_id,
-		char const *include_samples_tsv_path,
-		char const *exclude_samples_tsv_path,
-		char const *overlaps_tsv_path,
-		v2m::sequence_type const &ref_seq,
-		v2m::variant_graph &graph,
-		bool const be_verbose,
-		bool const ref_mismatch_is_fatal
-	)
+	void setup_build_delegate(gengetopt_args_info const &args_info, build_variant_graph_delegate &delegate)
 	{
-		build_variant_graph_delegate delegate;
-		delegate.ref_column_mismatch_is_fatal = ref_mismatch_is_fatal;
+		delegate.ref_column_mismatch_is_fatal = (ref_mismatch_handling_arg_error == args_info.ref_mismatch_handling_arg);
 
-		if (overlaps_tsv_path)
+		if (args_info.output_overlaps_arg)
 		{
-			lb::open_file_for_writing(overlaps_tsv_path, delegate.overlapping_alternatives_os, lb::writing_open_mode::CREATE);
+			lb::open_file_for_writing(args_info.output_overlaps_arg, delegate.overlapping_alternatives_os, lb::writing_open_mode::CREATE);
 			delegate.overlapping_alternatives_os << "LINENO\tPOS\tID\tSAMPLE\tCHROM_COPY\tGT\n";
 		}
 
-		if (include_samples_tsv_path)
-			read_filtered_samples(include_samples_tsv_path, chr_id, delegate, true, be_verbose);
-		else if (exclude_samples_tsv_path)
-			read_filtered_samples(exclude_samples_tsv_path, chr_id, delegate, false, be_verbose);
+		if (args_info.include_samples_arg)
+			read_filtered_samples(args_info.include_samples_arg, delegate, true, args_info.verbose_given);
+		else if (args_info.exclude_samples_arg)
+			read_filtered_samples(args_info.exclude_samples_arg, delegate, false, args_info.verbose_given);
+	}
+
 
-		lb::log_time(std::cerr) << "Building the variant graph…\n";
+	// If contig_delegate is not null, it is passed each graph as soon as the graph is complete.
+	void build_variant_graphs(
+		gengetopt_args_info const &args_info,
+		std::span <v2m::variant_graph_contig const> const contigs,
+		v2m::build_graph_contig_delegate *contig_delegate = nullptr
+	)
+	{
+		build_variant_graph_delegate delegate;
+		setup_build_delegate(args_info, delegate);
+
+		lb::log_time(std::cerr) << "Building the variant graph" << (1 == contigs.size() ? "" : "s") << "…\n";
 		v2m::build_graph_statistics stats;
-		v2m::build_variant_graph(ref_seq, variants_path, chr_id, graph, stats, delegate);
+		if (contig_delegate)
+			v2m::build_variant_graphs(args_info.input_variants_arg, contigs, stats, delegate, *contig_delegate, args_info.threads_arg);
+		else
+			v2m::build_variant_graphs(args_info.input_variants_arg, contigs, stats, delegate, args_info.threads_arg);
 		lb::log_time(std::cerr) << "Done. Handled variants: " << stats.handled_variants << " chromosome ID mismatches: " << stats.chr_id_mismatches << "\n";
 	}
 
 
+	void build_variant_graph_chunks(gengetopt_args_info const &args_info, v2m::sequence_type const &ref_seq)
+	{
+		build_variant_graph_delegate delegate;
+		setup_build_delegate(args_info, delegate);
+
+		lb::log_time(std::cerr) << "Building the variant graph in chunks and writing them to " << args_info.output_graph_arg << "…\n";
+		v2m::build_graph_statistics stats;
+		v2m::graph_chunk_writer writer(args_info.output_graph_arg);
+		v2m::build_variant_graph_chunks(ref_seq, args_info.input_variants_arg, args_info.chromosome_arg, stats, delegate, writer, args_info.graph_chunk_size_arg, args_info.threads_arg);
+		writer.close();
+		lb::log_time(std::cerr) << "Done. Chunks: " << writer.chunk_count() << " handled variants: " << stats.handled_variants << " chromosome ID mismatches: " << stats.chr_id_mismatches << "\n";
+	}
+
+
+	void append_samples(gengetopt_args_info const &args_info, v2m::variant_graph &graph)
+	{
+		build_variant_graph_delegate delegate;
+		setup_build_delegate(args_info, delegate);
+
+		lb::log_time(std::cerr) << "Adding the samples of " << args_info.input_variants_arg << " to the variant graph…\n";
+		v2m::build_graph_statistics stats;
+		auto const prev_sample_count(graph.sample_names.size());
+		v2m::append_samples(args_info.input_variants_arg, args_info.chromosome_arg, graph, stats, delegate, args_info.threads_arg);
+		lb::log_time(std::cerr) << "Done. Added samples: " << (graph.sample_names.size() - prev_sample_count) << " handled variants: " << stats.handled_variants << " chromosome ID mismatches: " << stats.chr_id_mismatches << "\n";
+	}
+
+
 	class output_delegate final : public v2m::output_delegate
 	{
 	private:
 		v2m::variant_graph const	*m_graph{};
 		bool						m_is_verbose{};
+		bool						m_should_report_progress{};
 
 	public:
-		output_delegate(v2m::variant_graph const &graph, bool const is_verbose):
+		output_delegate(v2m::variant_graph const &graph, bool const is_verbose, bool const should_report_progress = true):
 			m_graph(&graph),
-			m_is_verbose(is_verbose)
+			m_is_verbose(is_verbose && should_report_progress),
+			m_should_report_progress(should_report_progress)
 		{
 		}
 
@@ -312,7 +429,7 @@ namespace {
 
 		void handled_sequences(sequence_count_type const seq_count) override
 		{
-			if (0 == seq_count % 10)
+			if (m_should_report_progress && 0 == seq_count % 10)
 			{
 				auto const total_seq_count(m_graph->total_chromosome_copies());
 				lb::log_time(std::cerr) << "Handled " << seq_count << '/' << total_seq_count << " sequences…\n";
@@ -320,12 +437,12 @@ namespace {
 		}
 
 
-		void handled_node(v2m::variant_graph::node_type const node) override
+		void handled_node(v2m::variant_graph::node_type const node, v2m::pbwt_statistics const &stats) override
 		{
-			if (0 == (1 + node) % 1'000'000)
+			if (m_should_report_progress && 0 == (1 + node) % 1'000'000)
 			{
 				auto const total_node_count(m_graph->node_count());
-				lb::log_time(std::cerr) << "Handled " << (1 + node) << '/' << total_node_count << " nodes…\n";
+				lb::log_time(std::cerr) << "Handled " << (1 + node) << '/' << total_node_count << " nodes (ALT edges: " << stats.handled_columns << ", skipped: " << stats.skipped_columns << ", sparse: " << stats.sparse_columns << ")…\n";
 			}
 		}
 
@@ -367,189 +484,550 @@ namespace {
 	};
 
 
-	void run(gengetopt_args_info const &args_info)
+	// Insert the chromosome identifier before the extension, e.g. output.a2m becomes output.chr1.a2m.
+	std::string contig_path(char const *path, char const *chr_id)
 	{
-		::signal(SIGPIPE, SIG_IGN);
+		if (!chr_id)
+			return path;
+
+		fs::path retval(path);
+		auto filename(retval.stem().string());
+		filename += '.';
+		filename += chr_id;
+		filename += retval.extension().string();
+		retval.replace_filename(filename);
+		return retval.string();
+	}
 
-		// Read the reference sequence.
-		v2m::sequence_type ref_seq;
-		{
-			if (args_info.reference_sequence_arg)
-				lb::log_time(std::cerr) << "Reading reference sequence with identifier “" << args_info.reference_sequence_arg << "”…" << std::flush;
-			else
-				lb::log_time(std::cerr) << "Reading the first reference sequence from the input FASTA…" << std::flush;
-			auto const res(lb::read_single_fasta_sequence(args_info.input_reference_arg, ref_seq, args_info.reference_sequence_arg));
 
-			if (!res)
-			{
-				std::cerr << " ERROR: Unable to read the reference sequence.\n";
-				std::exit(EXIT_FAILURE);
-			}
+	// Rough estimate of the memory needed for processing the graph; the output data structures are proportional to it.
+	std::size_t estimated_graph_size(v2m::variant_graph const &graph)
+	{
+		std::size_t retval{};
+		retval += graph.reference_positions.words().size() * sizeof(v2m::packed_vector::word_type);
+		retval += graph.aligned_positions.words().size() * sizeof(v2m::packed_vector::word_type);
+		retval += graph.alt_edge_targets.words().size() * sizeof(v2m::packed_vector::word_type);
+		retval += graph.alt_edge_count_csum.words().size() * sizeof(v2m::packed_vector::word_type);
+		retval += graph.alt_edge_labels.characters().size();
+		retval += graph.alt_edge_labels.offsets().size() * sizeof(v2m::packed_label_vector::offset_type);
+		retval += graph.paths_by_edge_and_chrom_copy.dense_words().size() * sizeof(v2m::path_matrix::word_type);
+		retval += graph.paths_by_edge_and_chrom_copy.sparse_rows().size() * sizeof(v2m::path_matrix::row_type);
+		retval += graph.paths_by_edge_and_chrom_copy.column_offsets().size() * sizeof(v2m::path_matrix::offset_type);
+		retval += graph.paths_by_edge_and_chrom_copy.one_counts().size() * sizeof(v2m::path_matrix::row_type);
+		return retval;
+	}
 
-			std::cerr << " Done. Reference length is " << ref_seq.size() << ".\n";
-		}
 
-		v2m::variant_graph graph;
-		if (args_info.input_graph_given)
+	// The memory logger state and the progress messages are program-wide, so they are only used
+	// when one graph is processed at a time.
+	template <typename t_fn>
+	void run_in_state(bool const should_set_state, v2m::state const state, t_fn &&fn)
+	{
+		if (should_set_state)
 		{
-			lb::log_time(std::cerr) << "Loading the variant graph from " << args_info.input_graph_arg << "…" << std::flush;
-			lb::file_istream is;
-			lb::open_file_for_reading(args_info.input_graph_arg, is);
-			cereal::PortableBinaryInputArchive archive(is);
-			archive(graph);
-			std::cerr << " Done.\n";
+			ml::state_guard const guard(state);
+			fn();
 		}
 		else
 		{
-			ml::state_guard const guard(v2m::state::build_variant_graph);
-			build_variant_graph(
-				args_info.input_variants_arg,
-				args_info.chromosome_arg,
-				args_info.include_samples_arg,
-				args_info.exclude_samples_arg,
-				args_info.output_overlaps_arg,
-				ref_seq,
-				graph,
-				args_info.verbose_given,
-				ref_mismatch_handling_arg_error == args_info.ref_mismatch_handling_arg
-			);
+			fn();
 		}
+	}
+
+
+	// If chr_id is not null, the graph is one of several, and the output paths are made contig-specific.
+	// The graphs of several contigs are processed concurrently, so in that case progress is not reported.
+	void process_graph(gengetopt_args_info const &args_info, v2m::sequence_type const &ref_seq, v2m::variant_graph const &graph, char const *chr_id)
+	{
+		bool const is_only_graph(!chr_id);
+		std::string const message_prefix(chr_id ? std::string("Chromosome ") + chr_id + ": " : std::string{});
+		auto const * const dst_chromosome(chr_id ? chr_id : args_info.dst_chromosome_arg);
+		auto const log_status([is_only_graph](char const *message){
+			if (is_only_graph)
+				lb::log_time(std::cerr) << message;
+		});
 
 		if (args_info.output_graph_given)
 		{
-			lb::log_time(std::cerr) << "Outputting the variant graph…" << std::flush;
-			lb::file_ostream os;
-			lb::open_file_for_writing(args_info.output_graph_arg, os, lb::writing_open_mode::CREATE);
-			cereal::PortableBinaryOutputArchive archive(os);
-			archive(graph);
-			std::cerr << " Done.\n";
+			log_status("Outputting the variant graph…\n");
+			auto const path(contig_path(args_info.output_graph_arg, chr_id));
+			if (output_graph_format_arg_native == args_info.output_graph_format_arg)
+				v2m::write_graph_file(graph, path.c_str());
+			else if (output_graph_format_arg_compressed == args_info.output_graph_format_arg)
+				v2m::write_graph_file(graph, path.c_str(), v2m::graph_file_format::compressed, args_info.threads_arg);
+			else
+			{
+				lb::file_ostream os;
+				lb::open_file_for_writing(path, os, lb::writing_open_mode::CREATE);
+				cereal::PortableBinaryOutputArchive archive(os);
+				archive(graph);
+			}
 		}
 
 		if (args_info.output_graph_statistics_flag)
 		{
-			lb::log_time(std::cerr) << "Outputting variant graph statistics to stdout…\n";
-
-			std::cout << "Nodes:        " << graph.reference_positions.size() << '\n';
-			std::cout << "ALT edges:    " << graph.alt_edge_targets.size() << '\n';
-			std::cout << "Total ploidy: " << graph.ploidy_csum.back() << '\n';
+			log_status("Outputting variant graph statistics to stdout…\n");
+
+			std::stringstream stream;
+			if (chr_id)
+				stream << "Chromosome:   " << chr_id << '\n';
+			stream << "Nodes:        " << graph.reference_positions.size() << '\n';
+			stream << "ALT edges:    " << graph.alt_edge_targets.size() << '\n';
+			stream << "Dense paths:  " << graph.paths_by_edge_and_chrom_copy.dense_column_count() << '\n';
+			stream << "Total ploidy: " << graph.ploidy_csum.back() << '\n';
+			std::cout << stream.view() << std::flush;
 		}
 
 		if (args_info.output_memory_breakdown_given)
 		{
-			lb::log_time(std::cerr) << "Outputting the memory breakdown…" << std::flush;
+			log_status("Outputting the memory breakdown…\n");
 			lb::file_ostream os;
-			lb::open_file_for_writing(args_info.output_memory_breakdown_arg, os, lb::writing_open_mode::CREATE);
+			lb::open_file_for_writing(contig_path(args_info.output_memory_breakdown_arg, chr_id), os, lb::writing_open_mode::CREATE);
 			lb::size_calculator sc;
 			auto res(sc.add_root_entry());
 			sc.add_entry_for(res.index, "variant_graph", graph);
 			sc.output_entries(os);
-			std::cerr << " Done.\n";
 		}
 
 		if (args_info.output_graphviz_given)
 		{
-			lb::log_time(std::cerr) << "Outputting the variant graph in Graphviz format…" << std::flush;
-			lb::file_handle fh(lb::open_file_for_writing(args_info.output_graphviz_arg, lb::writing_open_mode::CREATE));
+			log_status("Outputting the variant graph in Graphviz format…\n");
+			lb::file_handle fh(lb::open_file_for_writing(contig_path(args_info.output_graphviz_arg, chr_id), lb::writing_open_mode::CREATE));
 			output_graphviz(ref_seq, graph, fh);
-			std::cerr << " Done.\n";
 		}
 
 		{
-			output_delegate delegate(graph, args_info.verbose_given);
-			auto do_output([&args_info, &ref_seq, &graph](v2m::output &output){
+			output_delegate delegate(graph, args_info.verbose_given, is_only_graph);
+			auto do_output([&args_info, &ref_seq, &graph, chr_id, &log_status](v2m::output &output){
 				if (args_info.output_sequences_a2m_given)
 				{
-					lb::log_time(std::cerr) << "Outputting sequences as A2M…\n";
-					output.output_a2m(ref_seq, graph, args_info.output_sequences_a2m_arg);
-					lb::log_time(std::cerr) << "Done.\n";
+					log_status("Outputting sequences as A2M…\n");
+					output.output_a2m(ref_seq, graph, contig_path(args_info.output_sequences_a2m_arg, chr_id).c_str());
+					log_status("Done.\n");
 				}
 
 				if (args_info.output_sequences_separate_given)
 				{
-					lb::log_time(std::cerr) << "Outputting sequences one by one…" << std::flush;
+					log_status("Outputting sequences one by one…\n");
 					output.output_separate(ref_seq, graph, separate_output_format_arg_A2M == args_info.separate_output_format_arg);
-					std::cerr << " Done.\n";
+					log_status("Done.\n");
 				}
 			});
 
 			if (args_info.haplotypes_given)
 			{
-				ml::state_guard const guard(v2m::state::output_haplotypes);
-				v2m::haplotype_output output(
-					args_info.pipe_arg,
-					args_info.dst_chromosome_arg,
-					!args_info.omit_reference_given,
-					args_info.unaligned_given,
-					delegate
-				);
-				do_output(output);
+				run_in_state(is_only_graph, v2m::state::output_haplotypes, [&](){
+					v2m::haplotype_output output(
+						args_info.pipe_arg,
+						dst_chromosome,
+						!args_info.omit_reference_given,
+						args_info.unaligned_given,
+						delegate
+					);
+					output.set_thread_count(args_info.threads_arg);
+					do_output(output);
+				});
 			}
 			else if (args_info.founder_sequences_given)
 			{
-				ml::state_guard const guard(v2m::state::output_founder_sequences_greedy);
-				v2m::founder_sequence_greedy_output output(
-					args_info.pipe_arg,
-					args_info.dst_chromosome_arg,
-					!args_info.omit_reference_given,
-					args_info.keep_ref_edges_given,
-					args_info.unaligned_given,
-					delegate
-				);
-
-				if (args_info.input_cut_positions_given)
-					output.load_cut_positions(args_info.input_cut_positions_arg);
-				else
-				{
-					ml::state_guard const guard(v2m::state::find_cut_positions);
-					lb::log_time(std::cerr) << "Optimising cut positions…\n";
-					if (!output.find_cut_positions(graph, args_info.minimum_distance_arg))
+				run_in_state(is_only_graph, v2m::state::output_founder_sequences_greedy, [&](){
+					v2m::founder_sequence_greedy_output output(
+						args_info.pipe_arg,
+						dst_chromosome,
+						!args_info.omit_reference_given,
+						args_info.keep_ref_edges_given,
+						args_info.unaligned_given,
+						delegate
+					);
+					output.set_thread_count(args_info.threads_arg);
+					output.set_pbwt_implementation(pbwt_arg_sparse == args_info.pbwt_arg ? v2m::pbwt_implementation::sparse : v2m::pbwt_implementation::dense);
+
+					if (args_info.input_cut_positions_given)
+						output.load_cut_positions(args_info.input_cut_positions_arg);
+					else
 					{
-						std::cerr << "ERROR: Unable to optimise cut positions.\n";
-						std::exit(EXIT_FAILURE);
+						run_in_state(is_only_graph, v2m::state::find_cut_positions, [&](){
+							log_status("Optimising cut positions…\n");
+							if (!output.find_cut_positions(graph, args_info.minimum_distance_arg))
+							{
+								std::cerr << "ERROR: " << message_prefix << "Unable to optimise cut positions.\n";
+								std::exit(EXIT_FAILURE);
+							}
+						});
+
+						if (args_info.verbose_flag)
+						{
+							std::stringstream stream;
+							stream << message_prefix << "Cut positions:";
+							for (auto const cp : output.cut_positions())
+								stream << ' ' << cp;
+							stream << '\n';
+							std::cout << stream.view() << std::flush;
+						}
 					}
 
-					if (args_info.verbose_flag)
 					{
-						std::cout << "Cut positions:";
-						for (auto const cp : output.cut_positions())
-							std::cout << ' ' << cp;
-						std::cout << '\n';
+						std::stringstream stream;
+						stream << message_prefix << "Maximum segmentation height: " << (1 + output.max_segmentation_height()) << '\n';
+						std::cout << stream.view() << std::flush;
 					}
-				}
 
-				std::cout << "Maximum segmentation height: " << (1 + output.max_segmentation_height()) << '\n';
+					if (args_info.output_cut_positions_given)
+						output.output_cut_positions(contig_path(args_info.output_cut_positions_arg, chr_id).c_str());
 
-				if (args_info.output_cut_positions_given)
-					output.output_cut_positions(args_info.output_cut_positions_arg);
-
-				{
-					ml::state_guard const guard(v2m::state::find_matchings);
-					lb::log_time(std::cerr) << "Finding matchings in the variant graph…\n";
-					if (!output.find_matchings(graph, args_info.founder_sequences_arg))
-					{
-						std::cerr << "ERROR: Unable to find matchings.\n";
-						std::exit(EXIT_FAILURE);
-					}
+					run_in_state(is_only_graph, v2m::state::find_matchings, [&](){
+						log_status("Finding matchings in the variant graph…\n");
+						if (!output.find_matchings(graph, args_info.founder_sequences_arg))
+						{
+							std::cerr << "ERROR: " << message_prefix << "Unable to find matchings.\n";
+							std::exit(EXIT_FAILURE);
+						}
+					});
 
 					if (args_info.verbose_flag)
 					{
-						std::cout << "Matchings:\n";
+						std::stringstream stream;
+						stream << message_prefix << "Matchings:\n";
 						auto const &assigned_samples(output.assigned_samples());
 						for (auto const col_idx : rsv::iota(std::size_t(0), assigned_samples.number_of_columns()))
 						{
 							auto const col(assigned_samples.column(col_idx));
-							std::cout << col_idx << ':';
+							stream << col_idx << ':';
 							for (auto const val : col)
-								std::cout << '\t' << val;
-							std::cout << '\n';
+								stream << '\t' << val;
+							stream << '\n';
 						}
+						std::cout << stream.view() << std::flush;
 					}
-				}
 
-				do_output(output);
+					do_output(output);
+				});
 			}
 		}
 	}
+
+
+	// Only some of the outputs may be produced one chunk at a time.
+	void check_chunked_graph_options(gengetopt_args_info const &args_info)
+	{
+		try
+		{
+			v2m::check_chunked_graph_outputs({
+				.founder_sequences = bool(args_info.founder_sequences_given),
+				.separate_sequences = bool(args_info.output_sequences_separate_given),
+				.graphviz = bool(args_info.output_graphviz_given),
+				.memory_breakdown = bool(args_info.output_memory_breakdown_given)
+			});
+		}
+		catch (std::runtime_error const &exc)
+		{
+			std::cerr << "ERROR: " << exc.what() << ". Chunked variant graphs may only be used with --output-graph-statistics and with --haplotypes and --output-sequences-a2m; use another --output-graph-format for the other outputs.\n";
+			std::exit(EXIT_FAILURE);
+		}
+	}
+
+
+	void process_chunked_graph(gengetopt_args_info const &args_info, v2m::sequence_type const &ref_seq, v2m::mapped_chunked_graph_file const &graph_file)
+	{
+		v2m::variant_graph graph;
+		graph_file.get_samples(graph);
+
+		if (args_info.output_graph_statistics_flag)
+		{
+			lb::log_time(std::cerr) << "Outputting variant graph statistics to stdout…\n";
+
+			// The last node of each chunk is the first node of the next one.
+			v2m::variant_graph::node_type node_count{1};
+			v2m::variant_graph::edge_type edge_count{};
+			v2m::path_matrix::column_index_type dense_column_count{};
+			for (std::size_t chunk_idx{}; chunk_idx < graph_file.chunk_count(); ++chunk_idx)
+			{
+				graph_file.get_chunk(chunk_idx, graph);
+				node_count += graph.node_count() - 1;
+				edge_count += graph.edge_count();
+				dense_column_count += graph.paths_by_edge_and_chrom_copy.dense_column_count();
+			}
+
+			std::stringstream stream;
+			stream << "Chunks:       " << graph_file.chunk_count() << '\n';
+			stream << "Nodes:        " << node_count << '\n';
+			stream << "ALT edges:    " << edge_count << '\n';
+			stream << "Dense paths:  " << dense_column_count << '\n';
+			stream << "Total ploidy: " << graph.ploidy_csum.back() << '\n';
+			std::cout << stream.view() << std::flush;
+		}
+
+		if (args_info.output_sequences_a2m_given)
+		{
+			ml::state_guard const guard(v2m::state::output_haplotypes);
+			output_delegate delegate(graph, args_info.verbose_given);
+			v2m::haplotype_output output(
+				args_info.pipe_arg,
+				args_info.dst_chromosome_arg,
+				!args_info.omit_reference_given,
+				args_info.unaligned_given,
+				delegate
+			);
+			output.set_thread_count(args_info.threads_arg);
+
+			lb::log_time(std::cerr) << "Outputting sequences as A2M one chunk at a time…\n";
+			output.output_a2m_chunked(ref_seq, graph_file, args_info.output_sequences_a2m_arg);
+			lb::log_time(std::cerr) << "Done.\n";
+		}
+	}
+
+
+	void run_one_contig(gengetopt_args_info const &args_info)
+	{
+		// Read the reference sequence.
+		v2m::sequence_type ref_seq;
+		{
+			if (args_info.reference_sequence_arg)
+				lb::log_time(std::cerr) << "Reading reference sequence with identifier “" << args_info.reference_sequence_arg << "”…" << std::flush;
+			else
+				lb::log_time(std::cerr) << "Reading the first reference sequence from the input FASTA…" << std::flush;
+			auto const res(lb::read_single_fasta_sequence(args_info.input_reference_arg, ref_seq, args_info.reference_sequence_arg));
+
+			if (!res)
+			{
+				std::cerr << " ERROR: Unable to read the reference sequence.\n";
+				std::exit(EXIT_FAILURE);
+			}
+
+			std::cerr << " Done. Reference length is " << ref_seq.size() << ".\n";
+		}
+
+		// Chunked graphs are not loaded as a whole.
+		if (args_info.input_graph_given && v2m::is_chunked_graph_file(args_info.input_graph_arg))
+		{
+			if (args_info.input_variants_given)
+			{
+				std::cerr << "ERROR: Samples cannot be added to a chunked variant graph.\n";
+				std::exit(EXIT_FAILURE);
+			}
+
+			check_chunked_graph_options(args_info);
+			v2m::mapped_chunked_graph_file const graph_file(args_info.input_graph_arg);
+			process_chunked_graph(args_info, ref_seq, graph_file);
+			return;
+		}
+
+		if (args_info.output_graph_given && output_graph_format_arg_chunked == args_info.output_graph_format_arg)
+		{
+			{
+				ml::state_guard const guard(v2m::state::build_variant_graph);
+				build_variant_graph_chunks(args_info, ref_seq);
+			}
+
+			v2m::mapped_chunked_graph_file const graph_file(args_info.output_graph_arg);
+			process_chunked_graph(args_info, ref_seq, graph_file);
+			return;
+		}
+
+		// The graph refers to the mapped file if the native format is used.
+		v2m::mapped_graph_file graph_file;
+		v2m::variant_graph graph;
+		if (args_info.input_graph_given)
+		{
+			lb::log_time(std::cerr) << "Loading the variant graph from " << args_info.input_graph_arg << "…" << std::flush;
+			if (v2m::is_graph_file(args_info.input_graph_arg))
+			{
+				graph_file.open(args_info.input_graph_arg, args_info.threads_arg);
+				graph_file.get_graph(graph);
+			}
+			else
+			{
+				lb::file_istream is;
+				lb::open_file_for_reading(args_info.input_graph_arg, is);
+				cereal::PortableBinaryInputArchive archive(is);
+				archive(graph);
+			}
+			std::cerr << " Done.\n";
+
+			if (args_info.input_variants_given)
+			{
+				ml::state_guard const guard(v2m::state::build_variant_graph);
+				append_samples(args_info, graph);
+			}
+		}
+		else
+		{
+			ml::state_guard const guard(v2m::state::build_variant_graph);
+			v2m::variant_graph_contig const contig{&ref_seq, args_info.chromosome_arg, &graph};
+			build_variant_graphs(args_info, std::span(&contig, 1));
+		}
+
+		process_graph(args_info, ref_seq, graph, nullptr);
+	}
+
+
+	// Processes each graph in a separate thread as soon as it is complete while keeping the sum of
+	// the estimated graph sizes within the budget. One graph is always processed even if it exceeds
+	// the budget. The parser waits in handle_contig_graph() while the budget is used up, so that the
+	// next graph is not built before memory has been released. Progress is only reported from the
+	// parser thread.
+	class contig_job_runner final : public v2m::build_graph_contig_delegate
+	{
+	private:
+		gengetopt_args_info const	*m_args_info{};
+		std::mutex					m_mutex;
+		std::condition_variable		m_cv;
+		std::vector <char const *>	m_finished_chr_ids;	// Not yet reported.
+		std::exception_ptr			m_exception;
+		std::size_t					m_max_jobs{};
+		std::size_t					m_memory_budget{};
+		std::size_t					m_running_jobs{};
+		std::size_t					m_reserved_memory{};
+		std::vector <std::jthread>	m_workers;			// Joined first since the workers refer to the other members.
+
+	public:
+		explicit contig_job_runner(gengetopt_args_info const &args_info):
+			m_args_info(&args_info),
+			m_max_jobs(args_info.contig_jobs_arg),
+			m_memory_budget(args_info.memory_budget_given ? std::size_t(args_info.memory_budget_arg) << 20 : SIZE_MAX)
+		{
+		}
+
+		void handle_contig_graph(v2m::variant_graph_contig const &contig) override;
+
+		// Wait for the remaining jobs.
+		void finish();
+
+	private:
+		void report_finished_jobs(); // Needs to be called with m_mutex held.
+		void run_job(v2m::variant_graph_contig const &contig, std::size_t const memory_needed);
+	};
+
+
+	void contig_job_runner::report_finished_jobs()
+	{
+		for (auto const chr_id : m_finished_chr_ids)
+			lb::log_time(std::cerr) << "Chromosome " << chr_id << ": Done.\n";
+		m_finished_chr_ids.clear();
+	}
+
+
+	void contig_job_runner::handle_contig_graph(v2m::variant_graph_contig const &contig)
+	{
+		auto const memory_needed(estimated_graph_size(*contig.graph));
+
+		{
+			std::unique_lock lock(m_mutex);
+			m_cv.wait(lock, [this, memory_needed](){
+				return m_exception || 0 == m_running_jobs || (m_running_jobs < m_max_jobs && memory_needed <= m_memory_budget - std::min(m_memory_budget, m_reserved_memory));
+			});
+
+			report_finished_jobs();
+			if (m_exception)
+				std::rethrow_exception(m_exception);
+
+			++m_running_jobs;
+			m_reserved_memory += memory_needed;
+		}
+
+		lb::log_time(std::cerr) << "Chromosome " << contig.chromosome_id << ": Processing the variant graph (estimated size " << (memory_needed >> 20) << " MiB)…\n";
+		m_workers.emplace_back([this, &contig, memory_needed](){ run_job(contig, memory_needed); });
+
+		// Continue building the next graph only if there is memory left.
+		{
+			std::unique_lock lock(m_mutex);
+			m_cv.wait(lock, [this](){ return m_exception || 0 == m_running_jobs || m_reserved_memory < m_memory_budget; });
+			report_finished_jobs();
+		}
+	}
+
+
+	void contig_job_runner::run_job(v2m::variant_graph_contig const &contig, std::size_t const memory_needed)
+	{
+		std::exception_ptr current_exc;
+		try
+		{
+			process_graph(*m_args_info, *contig.reference, *contig.graph, contig.chromosome_id);
+			*contig.graph = v2m::variant_graph{}; // Release the memory.
+		}
+		catch (...)
+		{
+			current_exc = std::current_exception();
+		}
+
+		{
+			std::lock_guard const lock(m_mutex);
+			--m_running_jobs;
+			m_reserved_memory -= memory_needed;
+			m_finished_chr_ids.push_back(contig.chromosome_id);
+			if (current_exc && !m_exception)
+				m_exception = current_exc;
+		}
+
+		m_cv.notify_all();
+	}
+
+
+	void contig_job_runner::finish()
+	{
+		{
+			std::unique_lock lock(m_mutex);
+			m_cv.wait(lock, [this](){ return 0 == m_running_jobs; });
+			report_finished_jobs();
+		}
+
+		m_workers.clear();
+		if (m_exception)
+			std::rethrow_exception(m_exception);
+	}
+
+
+	// Build the graphs of all the listed contigs in one pass over the variants and process each of them
+	// as soon as the records of its contig have been handled.
+	void run_contigs(gengetopt_args_info const &args_info)
+	{
+		std::vector <contig_description> contig_descriptions;
+		read_contig_list(args_info.contigs_arg, contig_descriptions);
+
+		reference_sequence_map ref_seqs;
+		for (auto const &desc : contig_descriptions)
+			ref_seqs.emplace(desc.reference_id, v2m::sequence_type{});
+
+		lb::log_time(std::cerr) << "Reading " << ref_seqs.size() << " reference sequences…" << std::flush;
+		read_reference_sequences(args_info.input_reference_arg, ref_seqs);
+		std::cerr << " Done.\n";
+
+		for (auto const &[ref_id, ref_seq] : ref_seqs)
+		{
+			if (ref_seq.empty())
+			{
+				std::cerr << "ERROR: Unable to read the reference sequence with identifier “" << ref_id << "”.\n";
+				std::exit(EXIT_FAILURE);
+			}
+		}
+
+		// The graphs are empty until their records are handled, and they are released after processing.
+		std::vector <v2m::variant_graph> graphs(contig_descriptions.size());
+		std::vector <v2m::variant_graph_contig> contigs;
+		contigs.reserve(contig_descriptions.size());
+		for (auto &&[desc, graph] : rsv::zip(contig_descriptions, graphs))
+			contigs.emplace_back(&ref_seqs.find(desc.reference_id)->second, desc.chromosome_id.c_str(), &graph);
+
+		contig_job_runner runner(args_info);
+
+		{
+			ml::state_guard const guard(v2m::state::build_variant_graph);
+			build_variant_graphs(args_info, contigs, &runner);
+		}
+
+		runner.finish();
+	}
+
+
+	void run(gengetopt_args_info const &args_info)
+	{
+		::signal(SIGPIPE, SIG_IGN);
+
+		if (args_info.contigs_given)
+			run_contigs(args_info);
+		else
+			run_one_contig(args_info);
+	}
 }
 
 
@@ -574,9 +1052,9 @@ int main(int argc, char **argv)
 		std::cerr << '\n';
 	}
 
-	if (args_info.input_variants_given && args_info.input_graph_given)
+	if (args_info.input_graph_given && args_info.contigs_given)
 	{
-		std::cerr << "ERROR: Only one of --input-variants and --input-graph can be specified.\n";
+		std::cerr << "ERROR: --contigs cannot be used with --input-graph.\n";
 		std::exit(EXIT_FAILURE);
 	}
 
@@ -586,12 +1064,56 @@ int main(int argc, char **argv)
 		std::exit(EXIT_FAILURE);
 	}
 
-	if (args_info.input_variants_given && !args_info.chromosome_given)
+	if (args_info.input_variants_given && ! (args_info.chromosome_given || args_info.contigs_given))
 	{
-		std::cerr << "ERROR: --chromosome must be specified with --input-variants.\n";
+		std::cerr << "ERROR: One of --chromosome and --contigs must be specified with --input-variants.\n";
 		std::exit(EXIT_FAILURE);
 	}
 
+	if (args_info.contigs_given)
+	{
+		if (args_info.chromosome_given || args_info.reference_sequence_given)
+		{
+			std::cerr << "ERROR: --contigs cannot be used with --chromosome or --reference-sequence.\n";
+			std::exit(EXIT_FAILURE);
+		}
+
+		if (args_info.input_cut_positions_given)
+		{
+			std::cerr << "ERROR: --contigs cannot be used with --input-cut-positions.\n";
+			std::exit(EXIT_FAILURE);
+		}
+
+		if (! (0 < args_info.contig_jobs_arg && args_info.contig_jobs_arg <= UINT16_MAX))
+		{
+			std::cerr << "ERROR: --contig-jobs must be positive and at most " << UINT16_MAX << ".\n";
+			std::exit(EXIT_FAILURE);
+		}
+
+		if (args_info.memory_budget_given && args_info.memory_budget_arg <= 0)
+		{
+			std::cerr << "ERROR: --memory-budget must be positive.\n";
+			std::exit(EXIT_FAILURE);
+		}
+	}
+
+	if (args_info.output_graph_given && output_graph_format_arg_chunked == args_info.output_graph_format_arg)
+	{
+		if (args_info.contigs_given || args_info.input_graph_given)
+		{
+			std::cerr << "ERROR: --output-graph-format=chunked cannot be used with --contigs or --input-graph.\n";
+			std::exit(EXIT_FAILURE);
+		}
+
+		if (args_info.graph_chunk_size_arg <= 0)
+		{
+			std::cerr << "ERROR: --graph-chunk-size must be positive.\n";
+			std::exit(EXIT_FAILURE);
+		}
+
+		check_chunked_graph_options(args_info);
+	}
+
 	if (args_info.founder_sequences_given && args_info.founder_sequences_arg <= 0)
 	{
 		std::cerr << "ERROR: --founder-sequences must be positive.\n";
@@ -610,6 +1132,12 @@ int main(int argc, char **argv)
 		std::exit(EXIT_FAILURE);
 	}
 
+	if (! (0 < args_info.threads_arg && args_info.threads_arg <= UINT16_MAX))
+	{
+		std::cerr << "ERROR: --threads must be positive and at most " << UINT16_MAX << ".\n";
+		std::exit(EXIT_FAILURE);
+	}
+
 	try
 	{
 		{